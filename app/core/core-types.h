@@ -199,6 +199,7 @@ typedef struct _GimpTagged          GimpTagged;      /* dummy typedef */
 
 typedef struct _GimpArea            GimpArea;
 typedef struct _GimpBoundSeg        GimpBoundSeg;
+typedef struct _GimpBoundaryCache   GimpBoundaryCache;
 typedef struct _GimpCoords          GimpCoords;
 typedef struct _GimpGradientSegment GimpGradientSegment;
 typedef struct _GimpPaletteEntry    GimpPaletteEntry;
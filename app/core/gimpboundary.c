@@ -26,12 +26,17 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-gegl-parallel.h"
+
 #include "gimpboundary.h"
 
 
 /* GimpBoundSeg array growth parameter */
 #define MAX_SEGS_INC  2048
 
+/* number of scanlines generated together, and cached, as one band */
+#define BAND_HEIGHT   64
+
 
 typedef struct _GimpBoundary GimpBoundary;
 
@@ -44,14 +49,36 @@ struct _GimpBoundary
 
   /*  The array of vertical segments  */
   gint         *vert_segs;
+};
 
-  /*  The empty segment arrays */
-  gint         *empty_segs_n;
-  gint         *empty_segs_c;
-  gint         *empty_segs_l;
-  gint          max_empty_segs;
+struct _GimpBoundaryCache
+{
+  /*  The parameters the bands were generated with  */
+  GeglRectangle     region;
+  const Babl       *format;
+  GimpBoundaryType  type;
+  gint              x1;
+  gint              y1;
+  gint              x2;
+  gint              y2;
+  gfloat            threshold;
+
+  /*  The scanlines covered, and their horizontal segments per band,
+   *  NULL for bands which need to be regenerated
+   */
+  gint              start;
+  gint              end;
+  gint              n_bands;
+  GArray          **bands;
 };
 
+typedef struct
+{
+  GimpBoundaryCache *cache;
+  GeglBuffer        *buffer;
+  gint              *bands;
+} BoundaryBandsData;
+
 
 /*  local function prototypes  */
 
@@ -84,14 +111,23 @@ static void           process_horiz_seg        (GimpBoundary        *boundary,
                                                 gint                 x2,
                                                 gint                 y2,
                                                 gboolean             open);
-static void           make_horiz_segs          (GimpBoundary        *boundary,
+static void           make_horiz_segs          (GArray              *segs,
                                                 gint                 start,
                                                 gint                 end,
                                                 gint                 scanline,
                                                 gint                 empty[],
                                                 gint                 num_empty,
                                                 gint                 top);
-static GimpBoundary * generate_boundary        (GeglBuffer          *buffer,
+static void           generate_band            (GimpBoundaryCache   *cache,
+                                                GeglBuffer          *buffer,
+                                                gint                 band,
+                                                gfloat              *band_data,
+                                                gint                *empty_segs[3]);
+static void           generate_bands           (gint                 offset,
+                                                gint                 size,
+                                                BoundaryBandsData   *data);
+static GimpBoundary * generate_boundary        (GimpBoundaryCache   *cache,
+                                                GeglBuffer          *buffer,
                                                 const GeglRectangle *region,
                                                 const Babl          *format,
                                                 GimpBoundaryType     type,
@@ -163,10 +199,141 @@ gimp_boundary_find (GeglBuffer          *buffer,
                     int                  y2,
                     gfloat               threshold,
                     int                 *num_segs)
+{
+  GimpBoundaryCache *cache;
+  GimpBoundSeg      *segs;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (num_segs != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (babl_format_get_bytes_per_pixel (format) ==
+                        sizeof (gfloat), NULL);
+
+  cache = gimp_boundary_cache_new ();
+
+  segs = gimp_boundary_cache_find (cache, buffer, region, format, type,
+                                   x1, y1, x2, y2, threshold, num_segs);
+
+  gimp_boundary_cache_free (cache);
+
+  return segs;
+}
+
+/**
+ * gimp_boundary_cache_new:
+ *
+ * Creates a cache for gimp_boundary_cache_find(), which keeps the
+ * segments found in each band of scanlines so that finding the
+ * boundary again only has to look at the bands which changed.
+ *
+ * Return value: a new #GimpBoundaryCache.
+ **/
+GimpBoundaryCache *
+gimp_boundary_cache_new (void)
+{
+  return g_slice_new0 (GimpBoundaryCache);
+}
+
+void
+gimp_boundary_cache_free (GimpBoundaryCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  gimp_boundary_cache_invalidate (cache, NULL);
+
+  g_free (cache->bands);
+
+  g_slice_free (GimpBoundaryCache, cache);
+}
+
+/**
+ * gimp_boundary_cache_invalidate:
+ * @cache: a #GimpBoundaryCache
+ * @rect:  the changed area of the buffer, or %NULL
+ *
+ * Drops the cached segments of all bands whose boundary can be
+ * affected by a change of the pixels in @rect, or of all bands
+ * if @rect is %NULL.
+ **/
+void
+gimp_boundary_cache_invalidate (GimpBoundaryCache   *cache,
+                                const GeglRectangle *rect)
+{
+  gint first, last;
+  gint i;
+
+  g_return_if_fail (cache != NULL);
+
+  if (cache->n_bands == 0)
+    return;
+
+  if (rect)
+    {
+      /*  a changed row affects the segments of the scanlines above and
+       *  below it as well
+       */
+      gint lo = MAX (rect->y - 1,            cache->start);
+      gint hi = MIN (rect->y + rect->height, cache->end - 1);
+
+      if (rect->width <= 0 || rect->height <= 0 || lo > hi)
+        return;
+
+      first = (lo - cache->start) / BAND_HEIGHT;
+      last  = (hi - cache->start) / BAND_HEIGHT;
+    }
+  else
+    {
+      first = 0;
+      last  = cache->n_bands - 1;
+    }
+
+  for (i = first; i <= last; i++)
+    {
+      if (cache->bands[i])
+        {
+          g_array_free (cache->bands[i], TRUE);
+          cache->bands[i] = NULL;
+        }
+    }
+}
+
+/**
+ * gimp_boundary_cache_find:
+ * @cache:     a #GimpBoundaryCache
+ * @buffer:    a #GeglBuffer
+ * @region:    the area of @buffer to consider, or %NULL
+ * @format:    a #Babl float format representing the component to analyze
+ * @type:      type of bounds
+ * @x1:        left side of bounds
+ * @y1:        top side of bounds
+ * @x2:        right side of bounds
+ * @y2:        botton side of bounds
+ * @threshold: pixel value of boundary line
+ * @num_segs:  number of returned #GimpBoundSeg's
+ *
+ * Like gimp_boundary_find(), but only regenerates the bands of @cache
+ * which were invalidated since the last call.  All bands are
+ * regenerated if any of the parameters differ from the last call.
+ *
+ * Return value: the boundary array.
+ **/
+GimpBoundSeg *
+gimp_boundary_cache_find (GimpBoundaryCache   *cache,
+                          GeglBuffer          *buffer,
+                          const GeglRectangle *region,
+                          const Babl          *format,
+                          GimpBoundaryType     type,
+                          gint                 x1,
+                          gint                 y1,
+                          gint                 x2,
+                          gint                 y2,
+                          gfloat               threshold,
+                          gint                *num_segs)
 {
   GimpBoundary  *boundary;
   GeglRectangle  rect = { 0, };
 
+  g_return_val_if_fail (cache != NULL, NULL);
   g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
   g_return_val_if_fail (num_segs != NULL, NULL);
   g_return_val_if_fail (format != NULL, NULL);
@@ -183,7 +350,7 @@ gimp_boundary_find (GeglBuffer          *buffer,
       rect.height = gegl_buffer_get_height (buffer);
     }
 
-  boundary = generate_boundary (buffer, &rect, format, type,
+  boundary = generate_boundary (cache, buffer, &rect, format, type,
                                 x1, y1, x2, y2, threshold);
 
   *num_segs = boundary->num_segs;
@@ -422,15 +589,6 @@ gimp_boundary_new (const GeglRectangle *region)
 
       for (i = 0; i <= (region->width + region->x); i++)
         boundary->vert_segs[i] = -1;
-
-      /*  find the maximum possible number of empty segments
-       *  given the current mask
-       */
-      boundary->max_empty_segs = region->width + 3;
-
-      boundary->empty_segs_n = g_new (gint, boundary->max_empty_segs);
-      boundary->empty_segs_c = g_new (gint, boundary->max_empty_segs);
-      boundary->empty_segs_l = g_new (gint, boundary->max_empty_segs);
     }
 
   return boundary;
@@ -448,9 +606,6 @@ gimp_boundary_free (GimpBoundary *boundary,
     segs = boundary->segs;
 
   g_free (boundary->vert_segs);
-  g_free (boundary->empty_segs_n);
-  g_free (boundary->empty_segs_c);
-  g_free (boundary->empty_segs_l);
 
   g_slice_free (GimpBoundary, boundary);
 
@@ -627,16 +782,21 @@ process_horiz_seg (GimpBoundary *boundary,
 }
 
 static void
-make_horiz_segs (GimpBoundary *boundary,
-                 gint          start,
-                 gint          end,
-                 gint          scanline,
-                 gint          empty[],
-                 gint          num_empty,
-                 gint          top)
+make_horiz_segs (GArray *segs,
+                 gint    start,
+                 gint    end,
+                 gint    scanline,
+                 gint    empty[],
+                 gint    num_empty,
+                 gint    top)
 {
-  gint empty_index;
-  gint e_s, e_e;    /* empty segment start and end values */
+  GimpBoundSeg seg = { 0, };
+  gint         empty_index;
+  gint         e_s, e_e;    /* empty segment start and end values */
+
+  seg.y1   = scanline;
+  seg.y2   = scanline;
+  seg.open = top;
 
   for (empty_index = 0; empty_index < num_empty; empty_index += 2)
     {
@@ -645,21 +805,161 @@ make_horiz_segs (GimpBoundary *boundary,
 
       if (e_s <= start && e_e >= end)
         {
-          process_horiz_seg (boundary,
-                             start, scanline, end, scanline, top);
+          seg.x1 = start;
+          seg.x2 = end;
+
+          g_array_append_val (segs, seg);
         }
       else if ((e_s > start && e_s < end) ||
                (e_e < end && e_e > start))
         {
-          process_horiz_seg (boundary,
-                             MAX (e_s, start), scanline,
-                             MIN (e_e, end), scanline, top);
+          seg.x1 = MAX (e_s, start);
+          seg.x2 = MIN (e_e, end);
+
+          g_array_append_val (segs, seg);
         }
     }
 }
 
+static inline const gfloat *
+band_line (const GeglRectangle *band_rect,
+           const gfloat        *band_data,
+           gint                 scanline)
+{
+  /*  scanlines outside the fetched rows are outside the processed
+   *  range, find_empty_segs() never looks at their data
+   */
+  if (scanline < band_rect->y ||
+      scanline >= band_rect->y + band_rect->height)
+    return NULL;
+
+  return band_data + (scanline - band_rect->y) * band_rect->width;
+}
+
+static void
+generate_band (GimpBoundaryCache *cache,
+               GeglBuffer        *buffer,
+               gint               band,
+               gfloat            *band_data,
+               gint              *empty_segs[3])
+{
+  GArray        *segs;
+  GeglRectangle  band_rect;
+  gint          *empty_segs_l = empty_segs[0];
+  gint          *empty_segs_c = empty_segs[1];
+  gint          *empty_segs_n = empty_segs[2];
+  gint          *tmp_segs;
+  gint           num_empty_n  = 0;
+  gint           num_empty_c  = 0;
+  gint           num_empty_l  = 0;
+  gint           start;
+  gint           end;
+  gint           scanline;
+  gint           i;
+
+  start = cache->start + band * BAND_HEIGHT;
+  end   = MIN (start + BAND_HEIGHT, cache->end);
+
+  /*  fetch the band's scanlines, and the ones above and below it
+   *  which still lie in the processed range, in one go
+   */
+  band_rect.x      = 0;
+  band_rect.y      = MAX (start - 1, cache->start);
+  band_rect.width  = gegl_buffer_get_width (buffer);
+  band_rect.height = MIN (end + 1, cache->end) - band_rect.y;
+
+  gegl_buffer_get (buffer, &band_rect, 1.0, cache->format,
+                   band_data, GEGL_AUTO_ROWSTRIDE,
+                   GEGL_ABYSS_NONE);
+
+  segs = g_array_new (FALSE, FALSE, sizeof (GimpBoundSeg));
+
+  /*  Find the empty segments for the previous and current scanlines  */
+  find_empty_segs (&cache->region,
+                   band_line (&band_rect, band_data, start - 1),
+                   start - 1, empty_segs_l,
+                   cache->region.width + 3, &num_empty_l,
+                   cache->type, cache->x1, cache->y1, cache->x2, cache->y2,
+                   cache->threshold);
+
+  find_empty_segs (&cache->region,
+                   band_line (&band_rect, band_data, start),
+                   start, empty_segs_c,
+                   cache->region.width + 3, &num_empty_c,
+                   cache->type, cache->x1, cache->y1, cache->x2, cache->y2,
+                   cache->threshold);
+
+  for (scanline = start; scanline < end; scanline++)
+    {
+      /*  find the empty segment list for the next scanline  */
+      find_empty_segs (&cache->region,
+                       band_line (&band_rect, band_data, scanline + 1),
+                       scanline + 1, empty_segs_n,
+                       cache->region.width + 3, &num_empty_n,
+                       cache->type, cache->x1, cache->y1, cache->x2, cache->y2,
+                       cache->threshold);
+
+      /*  process the segments on the current scanline  */
+      for (i = 1; i < num_empty_c - 1; i += 2)
+        {
+          make_horiz_segs (segs,
+                           empty_segs_c [i],
+                           empty_segs_c [i+1],
+                           scanline,
+                           empty_segs_l, num_empty_l, 1);
+          make_horiz_segs (segs,
+                           empty_segs_c [i],
+                           empty_segs_c [i+1],
+                           scanline + 1,
+                           empty_segs_n, num_empty_n, 0);
+        }
+
+      /*  get the next scanline of empty segments, swap others  */
+      tmp_segs     = empty_segs_l;
+      empty_segs_l = empty_segs_c;
+      num_empty_l  = num_empty_c;
+      empty_segs_c = empty_segs_n;
+      num_empty_c  = num_empty_n;
+      empty_segs_n = tmp_segs;
+    }
+
+  cache->bands[band] = segs;
+}
+
+static void
+generate_bands (gint               offset,
+                gint               size,
+                BoundaryBandsData *data)
+{
+  GimpBoundaryCache *cache = data->cache;
+  gfloat            *band_data;
+  gint              *empty_segs[3];
+  gint               max_empty_segs;
+  gint               i;
+
+  band_data = g_new (gfloat, (gsize) gegl_buffer_get_width (data->buffer) *
+                             (BAND_HEIGHT + 2));
+
+  /*  find the maximum possible number of empty segments
+   *  given the current mask
+   */
+  max_empty_segs = cache->region.width + 3;
+
+  for (i = 0; i < 3; i++)
+    empty_segs[i] = g_new (gint, max_empty_segs);
+
+  for (i = offset; i < offset + size; i++)
+    generate_band (cache, data->buffer, data->bands[i], band_data, empty_segs);
+
+  for (i = 0; i < 3; i++)
+    g_free (empty_segs[i]);
+
+  g_free (band_data);
+}
+
 static GimpBoundary *
-generate_boundary (GeglBuffer          *buffer,
+generate_boundary (GimpBoundaryCache   *cache,
+                   GeglBuffer          *buffer,
                    const GeglRectangle *region,
                    const Babl          *format,
                    GimpBoundaryType     type,
@@ -669,96 +969,99 @@ generate_boundary (GeglBuffer          *buffer,
                    gint                 y2,
                    gfloat               threshold)
 {
-  GimpBoundary  *boundary;
-  GeglRectangle  line_rect = { 0, };
-  gfloat        *line_data;
-  gint           scanline;
-  gint           i;
-  gint           start, end;
-  gint          *tmp_segs;
+  GimpBoundary *boundary;
+  gint          n_dirty = 0;
+  gint          i, j;
+
+  if (cache->format    != format    ||
+      cache->type      != type      ||
+      cache->x1        != x1        ||
+      cache->y1        != y1        ||
+      cache->x2        != x2        ||
+      cache->y2        != y2        ||
+      cache->threshold != threshold ||
+      ! gegl_rectangle_equal (&cache->region, region))
+    {
+      gimp_boundary_cache_invalidate (cache, NULL);
 
-  gint          num_empty_n = 0;
-  gint          num_empty_c = 0;
-  gint          num_empty_l = 0;
+      cache->region    = *region;
+      cache->format    = format;
+      cache->type      = type;
+      cache->x1        = x1;
+      cache->y1        = y1;
+      cache->x2        = x2;
+      cache->y2        = y2;
+      cache->threshold = threshold;
 
-  boundary = gimp_boundary_new (region);
+      cache->start = 0;
+      cache->end   = 0;
 
-  line_rect.width  = gegl_buffer_get_width (buffer);
-  line_rect.height = 1;
+      if (type == GIMP_BOUNDARY_WITHIN_BOUNDS)
+        {
+          cache->start = y1;
+          cache->end   = y2;
+        }
+      else if (type == GIMP_BOUNDARY_IGNORE_BOUNDS)
+        {
+          cache->start = region->y;
+          cache->end   = region->y + region->height;
+        }
 
-  line_data = g_alloca (sizeof (gfloat) * line_rect.width);
+      cache->n_bands = MAX (cache->end - cache->start + BAND_HEIGHT - 1, 0) /
+                       BAND_HEIGHT;
 
-  start = 0;
-  end   = 0;
+      g_free (cache->bands);
+      cache->bands = g_new0 (GArray *, cache->n_bands);
+    }
 
-  if (type == GIMP_BOUNDARY_WITHIN_BOUNDS)
+  /*  generate the horizontal segments of all invalid bands in
+   *  parallel, each band only depends on its own scanlines and the
+   *  ones directly above and below
+   */
+  for (i = 0; i < cache->n_bands; i++)
     {
-      start = y1;
-      end   = y2;
+      if (! cache->bands[i])
+        n_dirty++;
     }
-  else if (type == GIMP_BOUNDARY_IGNORE_BOUNDS)
+
+  if (n_dirty > 0)
     {
-      start = region->y;
-      end   = region->y + region->height;
-    }
+      BoundaryBandsData data;
 
-  /*  Find the empty segments for the previous and current scanlines  */
-  find_empty_segs (region, NULL,
-                   start - 1, boundary->empty_segs_l,
-                   boundary->max_empty_segs, &num_empty_l,
-                   type, x1, y1, x2, y2,
-                   threshold);
-
-  line_rect.y = start;
-  gegl_buffer_get (buffer, &line_rect, 1.0, format,
-                   line_data, GEGL_AUTO_ROWSTRIDE,
-                   GEGL_ABYSS_NONE);
+      data.cache  = cache;
+      data.buffer = buffer;
+      data.bands  = g_new (gint, n_dirty);
 
-  find_empty_segs (region, line_data,
-                   start, boundary->empty_segs_c,
-                   boundary->max_empty_segs, &num_empty_c,
-                   type, x1, y1, x2, y2,
-                   threshold);
+      for (i = 0, j = 0; i < cache->n_bands; i++)
+        {
+          if (! cache->bands[i])
+            data.bands[j++] = i;
+        }
 
-  for (scanline = start; scanline < end; scanline++)
-    {
-      /*  find the empty segment list for the next scanline  */
-      line_rect.y = scanline + 1;
-      if (scanline + 1 == end)
-        line_data = NULL;
-      else
-        gegl_buffer_get (buffer, &line_rect, 1.0, format,
-                         line_data, GEGL_AUTO_ROWSTRIDE,
-                         GEGL_ABYSS_NONE);
+      gimp_gegl_parallel_distribute_range (
+        n_dirty, 1,
+        (GimpGeglParallelRangeFunc) generate_bands,
+        &data);
 
-      find_empty_segs (region, line_data,
-                       scanline + 1, boundary->empty_segs_n,
-                       boundary->max_empty_segs, &num_empty_n,
-                       type, x1, y1, x2, y2,
-                       threshold);
+      g_free (data.bands);
+    }
 
-      /*  process the segments on the current scanline  */
-      for (i = 1; i < num_empty_c - 1; i += 2)
+  /*  stitch the bands together, closing the horizontal segments with
+   *  vertical ones in scanline order, across band borders
+   */
+  boundary = gimp_boundary_new (region);
+
+  for (i = 0; i < cache->n_bands; i++)
+    {
+      const GimpBoundSeg *segs = (const GimpBoundSeg *) cache->bands[i]->data;
+
+      for (j = 0; j < cache->bands[i]->len; j++)
         {
-          make_horiz_segs (boundary,
-                           boundary->empty_segs_c [i],
-                           boundary->empty_segs_c [i+1],
-                           scanline,
-                           boundary->empty_segs_l, num_empty_l, 1);
-          make_horiz_segs (boundary,
-                           boundary->empty_segs_c [i],
-                           boundary->empty_segs_c [i+1],
-                           scanline + 1,
-                           boundary->empty_segs_n, num_empty_n, 0);
+          process_horiz_seg (boundary,
+                             segs[j].x1, segs[j].y1,
+                             segs[j].x2, segs[j].y2,
+                             segs[j].open);
         }
-
-      /*  get the next scanline of empty segments, swap others  */
-      tmp_segs               = boundary->empty_segs_l;
-      boundary->empty_segs_l = boundary->empty_segs_c;
-      num_empty_l            = num_empty_c;
-      boundary->empty_segs_c = boundary->empty_segs_n;
-      num_empty_c            = num_empty_n;
-      boundary->empty_segs_n = tmp_segs;
     }
 
   return boundary;
@@ -37,7 +37,7 @@ gimp_brush_transform_boundary_exact (GimpBrush *brush,
                                      gdouble    angle,
                                      gdouble    hardness)
 {
-  const GimpTempBuf *mask;
+  GimpTempBuf *mask;
 
   mask = gimp_brush_transform_mask (brush,
                                     scale, aspect_ratio, angle, hardness);
@@ -48,7 +48,8 @@ gimp_brush_transform_boundary_exact (GimpBrush *brush,
       GimpBoundSeg  *bound_segs;
       gint           n_bound_segs;
 
-      buffer = gimp_temp_buf_create_buffer ((GimpTempBuf *) mask);
+      buffer = gimp_temp_buf_create_buffer (mask);
+      gimp_temp_buf_unref (mask);
 
       bound_segs = gimp_boundary_find (buffer, NULL,
                                        babl_format ("Y float"),
@@ -92,6 +92,12 @@ static gboolean      gimp_brush_real_want_null_motion (GimpBrush            *bru
 
 static gchar       * gimp_brush_get_checksum          (GimpTagged           *tagged);
 
+static gint64        gimp_brush_temp_buf_get_memsize  (gpointer              buf,
+                                                       gint64               *gui_size);
+static gint64        gimp_brush_bezier_desc_get_memsize
+                                                      (gpointer              desc,
+                                                       gint64               *gui_size);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpBrush, gimp_brush, GIMP_TYPE_DATA,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_TAGGED,
@@ -258,6 +264,18 @@ gimp_brush_get_memsize (GimpObject *object,
   memsize += gimp_temp_buf_get_memsize (brush->mask);
   memsize += gimp_temp_buf_get_memsize (brush->pixmap);
 
+  if (brush->mask_cache)
+    memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->mask_cache),
+                                        gui_size);
+
+  if (brush->pixmap_cache)
+    memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->pixmap_cache),
+                                        gui_size);
+
+  if (brush->boundary_cache)
+    memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->boundary_cache),
+                                        gui_size);
+
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
 }
@@ -417,13 +435,22 @@ static void
 gimp_brush_real_begin_use (GimpBrush *brush)
 {
   brush->mask_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'M', 'm');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          (GBoxedCopyFunc) gimp_temp_buf_ref,
+                          gimp_brush_temp_buf_get_memsize,
+                          'M', 'm');
 
   brush->pixmap_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'P', 'p');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          (GBoxedCopyFunc) gimp_temp_buf_ref,
+                          gimp_brush_temp_buf_get_memsize,
+                          'P', 'p');
 
   brush->boundary_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free, 'B', 'b');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free,
+                          (GBoxedCopyFunc) gimp_bezier_desc_copy,
+                          gimp_brush_bezier_desc_get_memsize,
+                          'B', 'b');
 }
 
 static void
@@ -482,6 +509,24 @@ gimp_brush_get_checksum (GimpTagged *tagged)
   return checksum_string;
 }
 
+static gint64
+gimp_brush_temp_buf_get_memsize (gpointer  buf,
+                                 gint64   *gui_size)
+{
+  return gimp_temp_buf_get_memsize (buf);
+}
+
+static gint64
+gimp_brush_bezier_desc_get_memsize (gpointer  desc,
+                                    gint64   *gui_size)
+{
+  GimpBezierDesc *bezier_desc = desc;
+
+  return (sizeof (GimpBezierDesc) +
+          bezier_desc->num_data * sizeof (cairo_path_data_t));
+}
+
+
 /*  public functions  */
 
 GimpData *
@@ -593,16 +638,20 @@ gimp_brush_transform_size (GimpBrush     *brush,
                                                 width, height);
 }
 
-const GimpTempBuf *
+/*  the transformed mask, pixmap and boundary come from caches that
+ *  other threads can evict them from, so the caller gets its own
+ *  reference or copy and has to release it
+ */
+GimpTempBuf *
 gimp_brush_transform_mask (GimpBrush *brush,
                            gdouble    scale,
                            gdouble    aspect_ratio,
                            gdouble    angle,
                            gdouble    hardness)
 {
-  const GimpTempBuf *mask;
-  gint               width;
-  gint               height;
+  GimpTempBuf *mask;
+  gint         width;
+  gint         height;
 
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
@@ -633,8 +682,10 @@ gimp_brush_transform_mask (GimpBrush *brush,
                                                                hardness);
         }
 
+      gimp_temp_buf_ref (mask);
+
       gimp_brush_cache_add (brush->mask_cache,
-                            (gpointer) mask,
+                            mask,
                             width, height,
                             scale, aspect_ratio, angle, hardness);
     }
@@ -642,16 +693,16 @@ gimp_brush_transform_mask (GimpBrush *brush,
   return mask;
 }
 
-const GimpTempBuf *
+GimpTempBuf *
 gimp_brush_transform_pixmap (GimpBrush *brush,
                              gdouble    scale,
                              gdouble    aspect_ratio,
                              gdouble    angle,
                              gdouble    hardness)
 {
-  const GimpTempBuf *pixmap;
-  gint               width;
-  gint               height;
+  GimpTempBuf *pixmap;
+  gint         width;
+  gint         height;
 
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
   g_return_val_if_fail (brush->pixmap != NULL, NULL);
@@ -683,8 +734,10 @@ gimp_brush_transform_pixmap (GimpBrush *brush,
                                                                    hardness);
         }
 
+      gimp_temp_buf_ref (pixmap);
+
       gimp_brush_cache_add (brush->pixmap_cache,
-                            (gpointer) pixmap,
+                            pixmap,
                             width, height,
                             scale, aspect_ratio, angle, hardness);
     }
@@ -692,7 +745,7 @@ gimp_brush_transform_pixmap (GimpBrush *brush,
   return pixmap;
 }
 
-const GimpBezierDesc *
+GimpBezierDesc *
 gimp_brush_transform_boundary (GimpBrush *brush,
                                gdouble    scale,
                                gdouble    aspect_ratio,
@@ -701,7 +754,7 @@ gimp_brush_transform_boundary (GimpBrush *brush,
                                gint      *width,
                                gint      *height)
 {
-  const GimpBezierDesc *boundary;
+  GimpBezierDesc *boundary;
 
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
@@ -734,7 +787,7 @@ gimp_brush_transform_boundary (GimpBrush *brush,
        */
       if (boundary)
         gimp_brush_cache_add (brush->boundary_cache,
-                              (gpointer) boundary,
+                              gimp_bezier_desc_copy (boundary),
                               *width, *height,
                               scale, aspect_ratio, angle, hardness);
     }
@@ -116,17 +116,17 @@ void                   gimp_brush_transform_size     (GimpBrush        *brush,
                                                       gdouble           angle,
                                                       gint             *width,
                                                       gint             *height);
-const GimpTempBuf    * gimp_brush_transform_mask     (GimpBrush        *brush,
+GimpTempBuf          * gimp_brush_transform_mask     (GimpBrush        *brush,
                                                       gdouble           scale,
                                                       gdouble           aspect_ratio,
                                                       gdouble           angle,
                                                       gdouble           hardness);
-const GimpTempBuf    * gimp_brush_transform_pixmap   (GimpBrush        *brush,
+GimpTempBuf          * gimp_brush_transform_pixmap   (GimpBrush        *brush,
                                                       gdouble           scale,
                                                       gdouble           aspect_ratio,
                                                       gdouble           angle,
                                                       gdouble           hardness);
-const GimpBezierDesc * gimp_brush_transform_boundary (GimpBrush        *brush,
+GimpBezierDesc       * gimp_brush_transform_boundary (GimpBrush        *brush,
                                                       gdouble           scale,
                                                       gdouble           aspect_ratio,
                                                       gdouble           angle,
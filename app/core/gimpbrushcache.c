@@ -22,18 +22,47 @@
 
 #include <gegl.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "core-types.h"
 
+#include "gimp-utils.h"
 #include "gimpbrushcache.h"
 
 #include "gimp-log.h"
 #include "gimp-intl.h"
 
 
+/*  the precision cache keys are rounded to, parameters closer than
+ *  this produce indistinguishable masks
+ */
+#define SCALE_QUANTUM        (1.0 / 1000.0)
+#define ASPECT_RATIO_QUANTUM (1.0 / 1000.0)
+#define ANGLE_QUANTUM        (1.0 / 3600.0)
+#define HARDNESS_QUANTUM     (1.0 / 1000.0)
+
+
 enum
 {
   PROP_0,
-  PROP_DATA_DESTROY
+  PROP_DATA_DESTROY,
+  PROP_DATA_COPY,
+  PROP_DATA_MEMSIZE
+};
+
+
+typedef struct _GimpBrushCacheUnit GimpBrushCacheUnit;
+
+struct _GimpBrushCacheUnit
+{
+  gpointer data;
+
+  gint     width;
+  gint     height;
+  gint     scale;
+  gint     aspect_ratio;
+  gint     angle;
+  gint     hardness;
 };
 
 
@@ -48,6 +77,20 @@ static void   gimp_brush_cache_get_property (GObject      *object,
                                              GValue       *value,
                                              GParamSpec   *pspec);
 
+static gint64 gimp_brush_cache_get_memsize  (GimpObject   *object,
+                                             gint64       *gui_size);
+
+static void   gimp_brush_cache_unit_init    (GimpBrushCacheUnit *unit,
+                                             gint                width,
+                                             gint                height,
+                                             gdouble             scale,
+                                             gdouble             aspect_ratio,
+                                             gdouble             angle,
+                                             gdouble             hardness);
+static void   gimp_brush_cache_unit_free    (GimpBrushCache     *cache,
+                                             GimpBrushCacheUnit *unit);
+static void   gimp_brush_cache_log_stats    (GimpBrushCache     *cache);
+
 
 G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 
@@ -57,23 +100,39 @@ G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 static void
 gimp_brush_cache_class_init (GimpBrushCacheClass *klass)
 {
-  GObjectClass  *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass    *object_class      = G_OBJECT_CLASS (klass);
+  GimpObjectClass *gimp_object_class = GIMP_OBJECT_CLASS (klass);
 
-  object_class->constructed  = gimp_brush_cache_constructed;
-  object_class->finalize     = gimp_brush_cache_finalize;
-  object_class->set_property = gimp_brush_cache_set_property;
-  object_class->get_property = gimp_brush_cache_get_property;
+  object_class->constructed      = gimp_brush_cache_constructed;
+  object_class->finalize         = gimp_brush_cache_finalize;
+  object_class->set_property     = gimp_brush_cache_set_property;
+  object_class->get_property     = gimp_brush_cache_get_property;
+
+  gimp_object_class->get_memsize = gimp_brush_cache_get_memsize;
 
   g_object_class_install_property (object_class, PROP_DATA_DESTROY,
                                    g_param_spec_pointer ("data-destroy",
                                                          NULL, NULL,
                                                          GIMP_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (object_class, PROP_DATA_COPY,
+                                   g_param_spec_pointer ("data-copy",
+                                                         NULL, NULL,
+                                                         GIMP_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (object_class, PROP_DATA_MEMSIZE,
+                                   g_param_spec_pointer ("data-memsize",
+                                                         NULL, NULL,
+                                                         GIMP_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
-gimp_brush_cache_init (GimpBrushCache *brush)
+gimp_brush_cache_init (GimpBrushCache *cache)
 {
+  g_mutex_init (&cache->lock);
 }
 
 static void
@@ -84,6 +143,7 @@ gimp_brush_cache_constructed (GObject *object)
   G_OBJECT_CLASS (parent_class)->constructed (object);
 
   g_assert (cache->data_destroy != NULL);
+  g_assert (cache->data_copy != NULL);
 }
 
 static void
@@ -91,11 +151,9 @@ gimp_brush_cache_finalize (GObject *object)
 {
   GimpBrushCache *cache = GIMP_BRUSH_CACHE (object);
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  gimp_brush_cache_clear (cache);
+
+  g_mutex_clear (&cache->lock);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -113,6 +171,12 @@ gimp_brush_cache_set_property (GObject      *object,
     case PROP_DATA_DESTROY:
       cache->data_destroy = g_value_get_pointer (value);
       break;
+    case PROP_DATA_COPY:
+      cache->data_copy = g_value_get_pointer (value);
+      break;
+    case PROP_DATA_MEMSIZE:
+      cache->data_memsize = g_value_get_pointer (value);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -133,6 +197,12 @@ gimp_brush_cache_get_property (GObject    *object,
     case PROP_DATA_DESTROY:
       g_value_set_pointer (value, cache->data_destroy);
       break;
+    case PROP_DATA_COPY:
+      g_value_set_pointer (value, cache->data_copy);
+      break;
+    case PROP_DATA_MEMSIZE:
+      g_value_set_pointer (value, cache->data_memsize);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -140,20 +210,58 @@ gimp_brush_cache_get_property (GObject    *object,
     }
 }
 
+static gint64
+gimp_brush_cache_get_memsize (GimpObject *object,
+                              gint64     *gui_size)
+{
+  GimpBrushCache *cache   = GIMP_BRUSH_CACHE (object);
+  gint64          memsize = 0;
+
+  g_mutex_lock (&cache->lock);
+
+  if (cache->data_memsize)
+    {
+      GList *list;
+
+      for (list = cache->cached_units; list; list = g_list_next (list))
+        {
+          GimpBrushCacheUnit *unit = list->data;
+
+          memsize += (sizeof (GList) + sizeof (GimpBrushCacheUnit) +
+                      cache->data_memsize (unit->data, gui_size));
+        }
+    }
+  else
+    {
+      memsize += gimp_g_list_get_memsize (cache->cached_units,
+                                          sizeof (GimpBrushCacheUnit));
+    }
+
+  g_mutex_unlock (&cache->lock);
+
+  return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
+                                                                  gui_size);
+}
+
 
 /*  public functions  */
 
 GimpBrushCache *
 gimp_brush_cache_new (GDestroyNotify  data_destroy,
+                      GBoxedCopyFunc  data_copy,
+                      GimpMemsizeFunc data_memsize,
                       gchar           debug_hit,
                       gchar           debug_miss)
 {
   GimpBrushCache *cache;
 
   g_return_val_if_fail (data_destroy != NULL, NULL);
+  g_return_val_if_fail (data_copy != NULL, NULL);
 
   cache =  g_object_new (GIMP_TYPE_BRUSH_CACHE,
                          "data-destroy", data_destroy,
+                         "data-copy",    data_copy,
+                         "data-memsize", data_memsize,
                          NULL);
 
   cache->debug_hit  = debug_hit;
@@ -167,14 +275,31 @@ gimp_brush_cache_clear (GimpBrushCache *cache)
 {
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
 
-  if (cache->last_data)
+  g_mutex_lock (&cache->lock);
+
+  if (cache->n_hits || cache->n_misses)
+    gimp_brush_cache_log_stats (cache);
+
+  while (cache->cached_units)
     {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
+      gimp_brush_cache_unit_free (cache, cache->cached_units->data);
+
+      cache->cached_units = g_list_delete_link (cache->cached_units,
+                                                cache->cached_units);
     }
+
+  cache->n_cached_units = 0;
+  cache->n_hits         = 0;
+  cache->n_misses       = 0;
+
+  g_mutex_unlock (&cache->lock);
 }
 
-gconstpointer
+/*  Returns a reference to the cached data, or a copy of it, made while
+ *  the cache is locked, so the data stays valid when another thread
+ *  evicts or clears it.  Release it with the cache's data_destroy.
+ */
+gpointer
 gimp_brush_cache_get (GimpBrushCache *cache,
                       gint            width,
                       gint            height,
@@ -183,28 +308,65 @@ gimp_brush_cache_get (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheUnit  key;
+  GList              *list;
+  gpointer            data = NULL;
+
   g_return_val_if_fail (GIMP_IS_BRUSH_CACHE (cache), NULL);
 
-  if (cache->last_data                         &&
-      cache->last_width        == width        &&
-      cache->last_height       == height       &&
-      cache->last_scale        == scale        &&
-      cache->last_aspect_ratio == aspect_ratio &&
-      cache->last_angle        == angle        &&
-      cache->last_hardness     == hardness)
+  gimp_brush_cache_unit_init (&key,
+                              width, height,
+                              scale, aspect_ratio, angle, hardness);
+
+  g_mutex_lock (&cache->lock);
+
+  for (list = cache->cached_units; list; list = g_list_next (list))
     {
-      if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
-        g_printerr ("%c", cache->debug_hit);
+      GimpBrushCacheUnit *unit = list->data;
+
+      if (unit->width        == key.width        &&
+          unit->height       == key.height       &&
+          unit->scale        == key.scale        &&
+          unit->aspect_ratio == key.aspect_ratio &&
+          unit->angle        == key.angle        &&
+          unit->hardness     == key.hardness)
+        {
+          /*  keep the list in most-recently-used order  */
+          if (list != cache->cached_units)
+            {
+              cache->cached_units = g_list_remove_link (cache->cached_units,
+                                                        list);
+              cache->cached_units = g_list_concat (list,
+                                                   cache->cached_units);
+            }
+
+          cache->n_hits++;
+
+          if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+            g_printerr ("%c", cache->debug_hit);
+
+          data = cache->data_copy (unit->data);
+
+          break;
+        }
+    }
 
-      return (gconstpointer) cache->last_data;
+  if (! data)
+    {
+      cache->n_misses++;
+
+      if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+        g_printerr ("%c", cache->debug_miss);
     }
 
-  if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
-    g_printerr ("%c", cache->debug_miss);
+  g_mutex_unlock (&cache->lock);
 
-  return NULL;
+  return data;
 }
 
+/*  The cache takes over @data, so callers that keep using it have to
+ *  take their own reference first.
+ */
 void
 gimp_brush_cache_add (GimpBrushCache *cache,
                       gpointer        data,
@@ -215,20 +377,77 @@ gimp_brush_cache_add (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheUnit *unit;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
   g_return_if_fail (data != NULL);
 
-  if (data == cache->last_data)
-    return;
+  g_mutex_lock (&cache->lock);
+
+  if (cache->cached_units &&
+      data == ((GimpBrushCacheUnit *) cache->cached_units->data)->data)
+    {
+      g_mutex_unlock (&cache->lock);
+      return;
+    }
+
+  if (cache->n_cached_units == GIMP_BRUSH_CACHE_MAX_UNITS)
+    {
+      GList *last = g_list_last (cache->cached_units);
+
+      gimp_brush_cache_unit_free (cache, last->data);
+
+      cache->cached_units = g_list_delete_link (cache->cached_units, last);
+      cache->n_cached_units--;
+    }
+
+  unit = g_slice_new (GimpBrushCacheUnit);
+
+  unit->data = data;
+  gimp_brush_cache_unit_init (unit,
+                              width, height,
+                              scale, aspect_ratio, angle, hardness);
+
+  cache->cached_units = g_list_prepend (cache->cached_units, unit);
+  cache->n_cached_units++;
+
+  g_mutex_unlock (&cache->lock);
+}
+
+
+/*  private functions  */
 
-  if (cache->last_data)
-    cache->data_destroy (cache->last_data);
+static void
+gimp_brush_cache_unit_init (GimpBrushCacheUnit *unit,
+                            gint                width,
+                            gint                height,
+                            gdouble             scale,
+                            gdouble             aspect_ratio,
+                            gdouble             angle,
+                            gdouble             hardness)
+{
+  unit->width        = width;
+  unit->height       = height;
+  unit->scale        = RINT (scale        / SCALE_QUANTUM);
+  unit->aspect_ratio = RINT (aspect_ratio / ASPECT_RATIO_QUANTUM);
+  unit->angle        = RINT (angle        / ANGLE_QUANTUM);
+  unit->hardness     = RINT (hardness     / HARDNESS_QUANTUM);
+}
+
+static void
+gimp_brush_cache_unit_free (GimpBrushCache     *cache,
+                            GimpBrushCacheUnit *unit)
+{
+  cache->data_destroy (unit->data);
+
+  g_slice_free (GimpBrushCacheUnit, unit);
+}
 
-  cache->last_data         = data;
-  cache->last_width        = width;
-  cache->last_height       = height;
-  cache->last_scale        = scale;
-  cache->last_aspect_ratio = aspect_ratio;
-  cache->last_angle        = angle;
-  cache->last_hardness     = hardness;
+static void
+gimp_brush_cache_log_stats (GimpBrushCache *cache)
+{
+  GIMP_LOG (BRUSH_CACHE, "'%c' cache: %d hits, %d misses (%.1f%% hit rate)",
+            cache->debug_hit,
+            cache->n_hits, cache->n_misses,
+            100.0 * cache->n_hits / (cache->n_hits + cache->n_misses));
 }
@@ -25,6 +25,9 @@
 #include "gimpobject.h"
 
 
+#define GIMP_BRUSH_CACHE_MAX_UNITS 16
+
+
 #define GIMP_TYPE_BRUSH_CACHE            (gimp_brush_cache_get_type ())
 #define GIMP_BRUSH_CACHE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_BRUSH_CACHE, GimpBrushCache))
 #define GIMP_BRUSH_CACHE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GIMP_TYPE_BRUSH_CACHE, GimpBrushCacheClass))
@@ -37,20 +40,25 @@ typedef struct _GimpBrushCacheClass GimpBrushCacheClass;
 
 struct _GimpBrushCache
 {
-  GimpObject      parent_instance;
+  GimpObject       parent_instance;
+
+  GDestroyNotify   data_destroy;
+  GBoxedCopyFunc   data_copy;
+  GimpMemsizeFunc  data_memsize;
+
+  /*  protects the units and counters, brushes are looked up from
+   *  both the GUI and the paint thread
+   */
+  GMutex           lock;
 
-  GDestroyNotify  data_destroy;
+  GList           *cached_units;
+  gint             n_cached_units;
 
-  gpointer        last_data;
-  gint            last_width;
-  gint            last_height;
-  gdouble         last_scale;
-  gdouble         last_aspect_ratio;
-  gdouble         last_angle;
-  gdouble         last_hardness;
+  gint             n_hits;
+  gint             n_misses;
 
-  gchar           debug_hit;
-  gchar           debug_miss;
+  gchar            debug_hit;
+  gchar            debug_miss;
 };
 
 struct _GimpBrushCacheClass
@@ -62,12 +70,14 @@ struct _GimpBrushCacheClass
 GType            gimp_brush_cache_get_type (void) G_GNUC_CONST;
 
 GimpBrushCache * gimp_brush_cache_new      (GDestroyNotify  data_destory,
+                                            GBoxedCopyFunc  data_copy,
+                                            GimpMemsizeFunc data_memsize,
                                             gchar           debug_hit,
                                             gchar           debug_miss);
 
 void             gimp_brush_cache_clear    (GimpBrushCache *cache);
 
-gconstpointer    gimp_brush_cache_get      (GimpBrushCache *cache,
+gpointer         gimp_brush_cache_get      (GimpBrushCache *cache,
                                             gint            width,
                                             gint            height,
                                             gdouble         scale,
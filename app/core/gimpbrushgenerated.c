@@ -27,6 +27,8 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-gegl-parallel.h"
+
 #include "gimpbrushgenerated.h"
 #include "gimpbrushgenerated-load.h"
 #include "gimpbrushgenerated-save.h"
@@ -37,6 +39,36 @@
 
 #define OVERSAMPLING 4
 
+#define EPSILON      1e-10
+
+/*  masks smaller than this are not worth splitting across threads  */
+#define MIN_PARALLEL_PIXELS (256 * 256)
+
+
+typedef enum
+{
+  SYMMETRY_NONE,     /*  compute everything                          */
+  SYMMETRY_POINT,    /*  compute y >= 0, mirror at the center        */
+  SYMMETRY_AXES,     /*  compute x, y >= 0, mirror at both axes      */
+  SYMMETRY_DIAGONAL  /*  compute x >= y >= 0, also mirror at x == y  */
+} Symmetry;
+
+typedef struct
+{
+  GimpBrushGeneratedShape  shape;
+  gfloat                   radius;
+  gint                     spikes;
+  gfloat                   aspect_ratio;
+  gdouble                  s, c;
+  gdouble                  cs, ss;
+  guchar                  *lookup;
+  Symmetry                 symmetry;
+  guchar                  *centerp;
+  gint                     mask_width;
+  gint                     x0, y0;
+  gint                     x1, y1;
+} CalcData;
+
 
 enum
 {
@@ -86,6 +118,18 @@ static GimpTempBuf * gimp_brush_generated_calc          (GimpBrushGenerated
                                                          gfloat                   angle,
                                                          GimpVector2             *xaxis,
                                                          GimpVector2             *yaxis);
+static void          gimp_brush_generated_calc_rows     (gint                     offset,
+                                                         gint                     size,
+                                                         CalcData                *data);
+static void          gimp_brush_generated_calc_distances(const CalcData          *data,
+                                                         gint                     x0,
+                                                         gint                     y,
+                                                         gint                     n,
+                                                         gdouble                 *distance);
+static inline gdouble
+                     gimp_brush_generated_calc_distance (GimpBrushGeneratedShape  shape,
+                                                         gdouble                  tx,
+                                                         gdouble                  ty);
 static void          gimp_brush_generated_get_half_size (GimpBrushGenerated      *gbrush,
                                                          GimpBrushGeneratedShape  shape,
                                                          gfloat                   radius,
@@ -461,17 +505,13 @@ gimp_brush_generated_calc (GimpBrushGenerated      *brush,
                            GimpVector2             *xaxis,
                            GimpVector2             *yaxis)
 {
-  guchar      *centerp;
-  guchar      *lookup;
-  guchar       a;
+  CalcData     data;
   gint         half_width  = 0;
   gint         half_height = 0;
-  gint         x, y;
-  gdouble      c, s, cs, ss;
+  gdouble      c, s;
   GimpVector2  x_axis;
   GimpVector2  y_axis;
   GimpTempBuf *mask;
-  gint         mask_width;
 
   gimp_brush_generated_get_half_size (brush,
                                       shape,
@@ -487,77 +527,252 @@ gimp_brush_generated_calc (GimpBrushGenerated      *brush,
                             half_height * 2 + 1,
                             babl_format ("Y u8"));
 
-  mask_width = gimp_temp_buf_get_width (mask);
+  /*  make masks at multiples of 90 degrees exactly symmetric, instead
+   *  of off by the rounding error of sin() and cos()
+   */
+  if (fabs (s) < EPSILON)
+    {
+      s = 0.0;
+      c = c > 0.0 ? 1.0 : -1.0;
+    }
+  else if (fabs (c) < EPSILON)
+    {
+      c = 0.0;
+      s = s > 0.0 ? 1.0 : -1.0;
+    }
+
+  data.shape        = shape;
+  data.radius       = radius;
+  data.spikes       = spikes;
+  data.aspect_ratio = aspect_ratio;
+  data.s            = s;
+  data.c            = c;
+  data.cs           = cos (- 2 * G_PI / spikes);
+  data.ss           = sin (- 2 * G_PI / spikes);
+  data.lookup       = gimp_brush_generated_calc_lut (radius, hardness);
+  data.mask_width   = gimp_temp_buf_get_width (mask);
+  data.centerp      = (guchar *) gimp_temp_buf_get_data (mask) +
+                      half_height * data.mask_width + half_width;
+  data.x1           = half_width;
+  data.y1           = half_height;
+
+  /*  all shapes are point symmetric for an even number of spikes;
+   *  when they are aligned to the axes, they are also symmetric to
+   *  both axes, and circles, squares and diamonds with an aspect
+   *  ratio of 1 are symmetric to the diagonal as well.  compute the
+   *  smallest part of the mask that determines the rest, and mirror
+   *  it.
+   */
+  if (spikes % 2)
+    data.symmetry = SYMMETRY_NONE;
+  else if (spikes > 2 || (s != 0.0 && c != 0.0))
+    data.symmetry = SYMMETRY_POINT;
+  else if (aspect_ratio != 1.0 || half_width != half_height)
+    data.symmetry = SYMMETRY_AXES;
+  else
+    data.symmetry = SYMMETRY_DIAGONAL;
 
-  centerp = gimp_temp_buf_get_data (mask) +
-            half_height * mask_width + half_width;
+  switch (data.symmetry)
+    {
+    case SYMMETRY_NONE:
+      data.x0 = -half_width;
+      data.y0 = -half_height;
+      break;
 
-  lookup = gimp_brush_generated_calc_lut (radius, hardness);
+    case SYMMETRY_POINT:
+      data.x0 = -half_width;
+      data.y0 = 0;
+      break;
 
-  cs = cos (- 2 * G_PI / spikes);
-  ss = sin (- 2 * G_PI / spikes);
+    case SYMMETRY_AXES:
+    case SYMMETRY_DIAGONAL:
+      data.x0 = 0;
+      data.y0 = 0;
+      break;
+    }
+
+  gimp_gegl_parallel_distribute_range (data.y1 - data.y0 + 1,
+                                       MAX (MIN_PARALLEL_PIXELS /
+                                            data.mask_width, 1),
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_brush_generated_calc_rows,
+                                       &data);
 
-  /* for an even number of spikes compute one half and mirror it */
-  for (y = ((spikes % 2) ? -half_height : 0); y <= half_height; y++)
+  g_free (data.lookup);
+
+  if (xaxis)
+    *xaxis = x_axis;
+
+  if (yaxis)
+    *yaxis = y_axis;
+
+  return mask;
+}
+
+static void
+gimp_brush_generated_calc_rows (gint      offset,
+                                gint      size,
+                                CalcData *data)
+{
+  const gint  w        = data->mask_width;
+  guchar     *centerp  = data->centerp;
+  gdouble    *distance = g_new (gdouble, data->x1 - data->x0 + 1);
+  gint        y;
+
+  for (y = data->y0 + offset; y < data->y0 + offset + size; y++)
     {
-      for (x = -half_width; x <= half_width; x++)
-        {
-          gdouble d  = 0;
-          gdouble tx = c * x - s * y;
-          gdouble ty = fabs (s * x + c * y);
+      gint x0 = data->x0;
+      gint n;
+      gint i;
 
-          if (spikes > 2)
-            {
-              gdouble angle = atan2 (ty, tx);
+      /*  only the part below the diagonal is computed  */
+      if (data->symmetry == SYMMETRY_DIAGONAL)
+        x0 = y;
 
-              while (angle > G_PI / spikes)
-                {
-                  gdouble sx = tx;
-                  gdouble sy = ty;
+      n = data->x1 - x0 + 1;
 
-                  tx = cs * sx - ss * sy;
-                  ty = ss * sx + cs * sy;
+      gimp_brush_generated_calc_distances (data, x0, y, n, distance);
 
-                  angle -= 2 * G_PI / spikes;
-                }
-            }
+      for (i = 0; i < n; i++)
+        {
+          gint   x = x0 + i;
+          guchar a;
 
-          ty *= aspect_ratio;
+          if (distance[i] < data->radius + 1)
+            a = data->lookup[(gint) RINT (distance[i] * OVERSAMPLING)];
+          else
+            a = 0;
+
+          centerp[y * w + x] = a;
 
-          switch (shape)
+          switch (data->symmetry)
             {
-            case GIMP_BRUSH_GENERATED_CIRCLE:
-              d = sqrt (SQR (tx) + SQR (ty));
+            case SYMMETRY_NONE:
               break;
-            case GIMP_BRUSH_GENERATED_SQUARE:
-              d = MAX (fabs (tx), fabs (ty));
+
+            case SYMMETRY_POINT:
+              centerp[-y * w - x] = a;
               break;
-            case GIMP_BRUSH_GENERATED_DIAMOND:
-              d = fabs (tx) + fabs (ty);
+
+            case SYMMETRY_DIAGONAL:
+              centerp[ x * w + y] = a;
+              centerp[ x * w - y] = a;
+              centerp[-x * w + y] = a;
+              centerp[-x * w - y] = a;
+              /* fallthrough */
+
+            case SYMMETRY_AXES:
+              centerp[ y * w - x] = a;
+              centerp[-y * w + x] = a;
+              centerp[-y * w - x] = a;
               break;
             }
+        }
+    }
 
-          if (d < radius + 1)
-            a = lookup[(gint) RINT (d * OVERSAMPLING)];
-          else
-            a = 0;
+  g_free (distance);
+}
+
+/*  computes the distances of @n pixels of row @y, starting at @x0, in
+ *  the brush's coordinate system.  unless there are spikes, this is a
+ *  branchless loop per shape, which the compiler can vectorize.
+ */
+static void
+gimp_brush_generated_calc_distances (const CalcData *data,
+                                     gint            x0,
+                                     gint            y,
+                                     gint            n,
+                                     gdouble        *distance)
+{
+  const gdouble c            = data->c;
+  const gdouble s            = data->s;
+  const gdouble aspect_ratio = data->aspect_ratio;
+  gint          i;
+
+  if (data->spikes > 2)
+    {
+      for (i = 0; i < n; i++)
+        {
+          gint    x     = x0 + i;
+          gdouble tx    = c * x - s * y;
+          gdouble ty    = fabs (s * x + c * y);
+          gdouble angle = atan2 (ty, tx);
+
+          while (angle > G_PI / data->spikes)
+            {
+              gdouble sx = tx;
+              gdouble sy = ty;
+
+              tx = data->cs * sx - data->ss * sy;
+              ty = data->ss * sx + data->cs * sy;
+
+              angle -= 2 * G_PI / data->spikes;
+            }
 
-          centerp[y * mask_width + x] = a;
+          ty *= aspect_ratio;
 
-          if (spikes % 2 == 0)
-            centerp[-1 * y * mask_width - x] = a;
+          distance[i] = gimp_brush_generated_calc_distance (data->shape,
+                                                            tx, ty);
         }
+
+      return;
     }
 
-  g_free (lookup);
+  switch (data->shape)
+    {
+    case GIMP_BRUSH_GENERATED_CIRCLE:
+      for (i = 0; i < n; i++)
+        {
+          gint    x  = x0 + i;
+          gdouble tx = c * x - s * y;
+          gdouble ty = fabs (s * x + c * y) * aspect_ratio;
 
-  if (xaxis)
-    *xaxis = x_axis;
+          distance[i] = sqrt (SQR (tx) + SQR (ty));
+        }
+      break;
 
-  if (yaxis)
-    *yaxis = y_axis;
+    case GIMP_BRUSH_GENERATED_SQUARE:
+      for (i = 0; i < n; i++)
+        {
+          gint    x  = x0 + i;
+          gdouble tx = c * x - s * y;
+          gdouble ty = fabs (s * x + c * y) * aspect_ratio;
 
-  return mask;
+          distance[i] = MAX (fabs (tx), fabs (ty));
+        }
+      break;
+
+    case GIMP_BRUSH_GENERATED_DIAMOND:
+      for (i = 0; i < n; i++)
+        {
+          gint    x  = x0 + i;
+          gdouble tx = c * x - s * y;
+          gdouble ty = fabs (s * x + c * y) * aspect_ratio;
+
+          distance[i] = fabs (tx) + fabs (ty);
+        }
+      break;
+    }
+}
+
+static inline gdouble
+gimp_brush_generated_calc_distance (GimpBrushGeneratedShape shape,
+                                    gdouble                 tx,
+                                    gdouble                 ty)
+{
+  switch (shape)
+    {
+    case GIMP_BRUSH_GENERATED_CIRCLE:
+      return sqrt (SQR (tx) + SQR (ty));
+
+    case GIMP_BRUSH_GENERATED_SQUARE:
+      return MAX (fabs (tx), fabs (ty));
+
+    case GIMP_BRUSH_GENERATED_DIAMOND:
+      return fabs (tx) + fabs (ty);
+    }
+
+  return 0.0;
 }
 
 /* This function is shared between gimp_brush_generated_transform_size and
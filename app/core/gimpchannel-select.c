@@ -84,6 +84,7 @@ gimp_channel_select_rectangle (GimpChannel    *channel,
 
       if (feather)
         gimp_gegl_apply_feather (add_on, NULL, NULL, add_on,
+                                 NULL,
                                  feather_radius_x,
                                  feather_radius_y);
 
@@ -137,6 +138,7 @@ gimp_channel_select_ellipse (GimpChannel    *channel,
 
       if (feather)
         gimp_gegl_apply_feather (add_on, NULL, NULL, add_on,
+                                 NULL,
                                  feather_radius_x,
                                  feather_radius_y);
 
@@ -194,6 +196,7 @@ gimp_channel_select_round_rect (GimpChannel         *channel,
 
       if (feather)
         gimp_gegl_apply_feather (add_on, NULL, NULL, add_on,
+                                 NULL,
                                  feather_radius_x,
                                  feather_radius_y);
 
@@ -250,6 +253,7 @@ gimp_channel_select_scan_convert (GimpChannel     *channel,
 
   if (feather)
     gimp_gegl_apply_feather (add_on, NULL, NULL, add_on,
+                             NULL,
                              feather_radius_x,
                              feather_radius_y);
 
@@ -364,6 +368,7 @@ gimp_channel_select_buffer (GimpChannel    *channel,
 
       if (feather)
         gimp_gegl_apply_feather (add_on2, NULL, NULL, add_on2,
+                                 NULL,
                                  feather_radius_x,
                                  feather_radius_y);
 
@@ -23,7 +23,9 @@
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#include "libgimpbase/gimpbase.h"
 #include "libgimpcolor/gimpcolor.h"
+#include "libgimpmath/gimpmath.h"
 
 #include "core-types.h"
 
@@ -33,6 +35,7 @@
 #include "gegl/gimp-gegl-apply-operation.h"
 #include "gegl/gimp-gegl-mask.h"
 #include "gegl/gimp-gegl-nodes.h"
+#include "gegl/gimp-gegl-parallel.h"
 
 #include "gimp.h"
 #include "gimp-utils.h"
@@ -55,6 +58,10 @@
 #include "gimp-intl.h"
 
 
+#define TILE_SIZE           64
+#define MIN_PARALLEL_PIXELS (256 * 256)
+
+
 enum
 {
   COLOR_CHANGED,
@@ -62,6 +69,29 @@ enum
 };
 
 
+typedef enum
+{
+  TILE_UNKNOWN,
+  TILE_EMPTY,
+  TILE_FULL,
+  TILE_PARTIAL
+} TileState;
+
+struct _GimpChannelTile
+{
+  TileState state;
+  gint      x1, y1;  /*  bounds of the tile's non-empty pixels  */
+  gint      x2, y2;
+};
+
+typedef struct
+{
+  GimpChannel *channel;
+  GeglBuffer  *buffer;
+  gint        *tiles;
+} ChannelTilesData;
+
+
 static void gimp_channel_pickable_iface_init (GimpPickableInterface *iface);
 
 static void       gimp_channel_finalize      (GObject           *object);
@@ -136,6 +166,11 @@ static void       gimp_channel_convert_type  (GimpDrawable      *drawable,
                                               gint               layer_dither_type,
                                               gint               mask_dither_type,
                                               gboolean           push_undo);
+static void gimp_channel_update                (GimpDrawable       *drawable,
+                                                gint                x,
+                                                gint                y,
+                                                gint                width,
+                                                gint                height);
 static void gimp_channel_invalidate_boundary   (GimpDrawable       *drawable);
 static void gimp_channel_get_active_components (const GimpDrawable *drawable,
                                                 gboolean           *active);
@@ -221,6 +256,22 @@ static void       gimp_channel_real_shrink   (GimpChannel         *channel,
                                               gboolean             edge_lock,
                                               gboolean             push_undo);
 
+static void       gimp_channel_tiles_ensure  (GimpChannel         *channel);
+static void       gimp_channel_tiles_invalidate
+                                             (GimpChannel         *channel,
+                                              const GeglRectangle *rect);
+static void       gimp_channel_tiles_set     (GimpChannel         *channel,
+                                              TileState            state);
+static void       gimp_channel_tiles_validate_range
+                                             (gint                 offset,
+                                              gint                 size,
+                                              ChannelTilesData    *data);
+static gboolean   gimp_channel_tiles_bounds  (GimpChannel         *channel,
+                                              gint                *x1,
+                                              gint                *y1,
+                                              gint                *x2,
+                                              gint                *y2);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpChannel, gimp_channel, GIMP_TYPE_DRAWABLE,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_PICKABLE,
@@ -289,6 +340,7 @@ gimp_channel_class_init (GimpChannelClass *klass)
   item_class->raise_failed         = _("Channel cannot be raised higher.");
   item_class->lower_failed         = _("Channel cannot be lowered more.");
 
+  drawable_class->update                = gimp_channel_update;
   drawable_class->convert_type          = gimp_channel_convert_type;
   drawable_class->invalidate_boundary   = gimp_channel_invalidate_boundary;
   drawable_class->get_active_components = gimp_channel_get_active_components;
@@ -329,16 +381,23 @@ gimp_channel_init (GimpChannel *channel)
 
   /*  Selection mask variables  */
   channel->boundary_known = FALSE;
+  channel->boundary_dirty = FALSE;
   channel->segs_in        = NULL;
   channel->segs_out       = NULL;
   channel->num_segs_in    = 0;
   channel->num_segs_out   = 0;
+  channel->segs_in_cache  = gimp_boundary_cache_new ();
+  channel->segs_out_cache = gimp_boundary_cache_new ();
   channel->empty          = FALSE;
   channel->bounds_known   = FALSE;
   channel->x1             = 0;
   channel->y1             = 0;
   channel->x2             = 0;
   channel->y2             = 0;
+  channel->tiles          = NULL;
+  channel->n_tiles_x      = 0;
+  channel->n_tiles_y      = 0;
+  channel->tiles_dirty    = FALSE;
 }
 
 static void
@@ -364,6 +423,24 @@ gimp_channel_finalize (GObject *object)
       channel->segs_out = NULL;
     }
 
+  if (channel->segs_in_cache)
+    {
+      gimp_boundary_cache_free (channel->segs_in_cache);
+      channel->segs_in_cache = NULL;
+    }
+
+  if (channel->segs_out_cache)
+    {
+      gimp_boundary_cache_free (channel->segs_out_cache);
+      channel->segs_out_cache = NULL;
+    }
+
+  if (channel->tiles)
+    {
+      g_free (channel->tiles);
+      channel->tiles = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -372,11 +449,16 @@ gimp_channel_get_memsize (GimpObject *object,
                           gint64     *gui_size)
 {
   GimpChannel *channel = GIMP_CHANNEL (object);
+  gint64       memsize = 0;
+
+  memsize += (channel->n_tiles_x * channel->n_tiles_y *
+              sizeof (GimpChannelTile));
 
   *gui_size += channel->num_segs_in  * sizeof (GimpBoundSeg);
   *gui_size += channel->num_segs_out * sizeof (GimpBoundSeg);
 
-  return GIMP_OBJECT_CLASS (parent_class)->get_memsize (object, gui_size);
+  return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
+                                                                  gui_size);
 }
 
 static gchar *
@@ -894,10 +976,43 @@ gimp_channel_convert_type (GimpDrawable      *drawable,
   g_object_unref (dest_buffer);
 }
 
+static void
+gimp_channel_update (GimpDrawable *drawable,
+                     gint          x,
+                     gint          y,
+                     gint          width,
+                     gint          height)
+{
+  GimpChannel   *channel = GIMP_CHANNEL (drawable);
+  GeglRectangle  rect    = { x, y, width, height };
+
+  /*  only the boundary bands touching the updated area have to be
+   *  found again
+   */
+  gimp_boundary_cache_invalidate (channel->segs_in_cache,  &rect);
+  gimp_boundary_cache_invalidate (channel->segs_out_cache, &rect);
+
+  channel->boundary_dirty = FALSE;
+
+  /*  same for the tile occupancy summaries  */
+  gimp_channel_tiles_invalidate (channel, &rect);
+
+  channel->tiles_dirty = FALSE;
+
+  GIMP_DRAWABLE_CLASS (parent_class)->update (drawable, x, y, width, height);
+}
+
 static void
 gimp_channel_invalidate_boundary (GimpDrawable *drawable)
 {
-  GIMP_CHANNEL (drawable)->boundary_known = FALSE;
+  GimpChannel *channel = GIMP_CHANNEL (drawable);
+
+  /*  until the change is followed by an update, we don't know which
+   *  area it affects
+   */
+  channel->boundary_known = FALSE;
+  channel->boundary_dirty = TRUE;
+  channel->tiles_dirty    = TRUE;
 }
 
 static void
@@ -981,6 +1096,11 @@ gimp_channel_set_buffer (GimpDrawable *drawable,
 
   channel->bounds_known = FALSE;
 
+  gimp_boundary_cache_invalidate (channel->segs_in_cache,  NULL);
+  gimp_boundary_cache_invalidate (channel->segs_out_cache, NULL);
+
+  gimp_channel_tiles_invalidate (channel, NULL);
+
   if (gimp_filter_peek_node (GIMP_FILTER (channel)))
     {
       const Babl *color_format;
@@ -1055,6 +1175,14 @@ gimp_channel_real_boundary (GimpChannel         *channel,
       g_free (channel->segs_in);
       g_free (channel->segs_out);
 
+      if (channel->boundary_dirty)
+        {
+          gimp_boundary_cache_invalidate (channel->segs_in_cache,  NULL);
+          gimp_boundary_cache_invalidate (channel->segs_out_cache, NULL);
+
+          channel->boundary_dirty = FALSE;
+        }
+
       if (gimp_channel_bounds (channel, &x3, &y3, &x4, &y4))
         {
           GeglBuffer *buffer;
@@ -1062,12 +1190,14 @@ gimp_channel_real_boundary (GimpChannel         *channel,
 
           buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
 
-          channel->segs_out = gimp_boundary_find (buffer, &rect,
-                                                  babl_format ("Y float"),
-                                                  GIMP_BOUNDARY_IGNORE_BOUNDS,
-                                                  x1, y1, x2, y2,
-                                                  GIMP_BOUNDARY_HALF_WAY,
-                                                  &channel->num_segs_out);
+          channel->segs_out =
+            gimp_boundary_cache_find (channel->segs_out_cache,
+                                      buffer, &rect,
+                                      babl_format ("Y float"),
+                                      GIMP_BOUNDARY_IGNORE_BOUNDS,
+                                      x1, y1, x2, y2,
+                                      GIMP_BOUNDARY_HALF_WAY,
+                                      &channel->num_segs_out);
           x1 = MAX (x1, x3);
           y1 = MAX (y1, y3);
           x2 = MIN (x2, x4);
@@ -1075,12 +1205,14 @@ gimp_channel_real_boundary (GimpChannel         *channel,
 
           if (x2 > x1 && y2 > y1)
             {
-              channel->segs_in = gimp_boundary_find (buffer, NULL,
-                                                     babl_format ("Y float"),
-                                                     GIMP_BOUNDARY_WITHIN_BOUNDS,
-                                                     x1, y1, x2, y2,
-                                                     GIMP_BOUNDARY_HALF_WAY,
-                                                     &channel->num_segs_in);
+              channel->segs_in =
+                gimp_boundary_cache_find (channel->segs_in_cache,
+                                          buffer, NULL,
+                                          babl_format ("Y float"),
+                                          GIMP_BOUNDARY_WITHIN_BOUNDS,
+                                          x1, y1, x2, y2,
+                                          GIMP_BOUNDARY_HALF_WAY,
+                                          &channel->num_segs_in);
             }
           else
             {
@@ -1114,8 +1246,6 @@ gimp_channel_real_bounds (GimpChannel *channel,
                           gint        *x2,
                           gint        *y2)
 {
-  GeglBuffer *buffer;
-
   /*  if the channel's bounds have already been reliably calculated...  */
   if (channel->bounds_known)
     {
@@ -1127,9 +1257,7 @@ gimp_channel_real_bounds (GimpChannel *channel,
       return ! channel->empty;
     }
 
-  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
-
-  channel->empty = ! gimp_gegl_mask_bounds (buffer, x1, y1, x2, y2);
+  channel->empty = ! gimp_channel_tiles_bounds (channel, x1, y1, x2, y2);
 
   channel->x1 = *x1;
   channel->y1 = *y1;
@@ -1144,15 +1272,38 @@ gimp_channel_real_bounds (GimpChannel *channel,
 static gboolean
 gimp_channel_real_is_empty (GimpChannel *channel)
 {
-  GeglBuffer *buffer;
+  gint x1, y1, x2, y2;
+  gint i;
 
   if (channel->bounds_known)
     return channel->empty;
 
-  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
+  /*  a single tile known to have pixels settles it, without looking
+   *  at the changed tiles
+   */
+  gimp_channel_tiles_ensure (channel);
 
-  if (! gimp_gegl_mask_is_empty (buffer))
-    return FALSE;
+  if (! channel->tiles_dirty)
+    {
+      for (i = 0; i < channel->n_tiles_x * channel->n_tiles_y; i++)
+        {
+          if (channel->tiles[i].state == TILE_FULL ||
+              channel->tiles[i].state == TILE_PARTIAL)
+            return FALSE;
+        }
+    }
+
+  if (gimp_channel_tiles_bounds (channel, &x1, &y1, &x2, &y2))
+    {
+      channel->empty        = FALSE;
+      channel->bounds_known = TRUE;
+      channel->x1           = x1;
+      channel->y1           = y1;
+      channel->x2           = x2;
+      channel->y2           = y2;
+
+      return FALSE;
+    }
 
   /*  The mask is empty, meaning we can set the bounds as known  */
   if (channel->segs_in)
@@ -1182,6 +1333,10 @@ gimp_channel_real_feather (GimpChannel *channel,
                            gboolean     push_undo)
 {
   GimpDrawable *drawable = GIMP_DRAWABLE (channel);
+  gint          x1, y1, x2, y2;
+  gboolean      empty;
+
+  empty = ! gimp_channel_bounds (channel, &x1, &y1, &x2, &y2);
 
   if (push_undo)
     gimp_channel_push_undo (channel,
@@ -1189,11 +1344,27 @@ gimp_channel_real_feather (GimpChannel *channel,
   else
     gimp_drawable_invalidate_boundary (drawable);
 
-  gimp_gegl_apply_feather (gimp_drawable_get_buffer (drawable),
-                           NULL, NULL,
-                           gimp_drawable_get_buffer (drawable),
-                           radius_x,
-                           radius_y);
+  /*  only the bounds plus the radius can change  */
+  if (! empty)
+    {
+      GeglRectangle rect;
+
+      gimp_rectangle_intersect (x1 - ceil (radius_x),
+                                y1 - ceil (radius_y),
+                                x2 - x1 + 2 * ceil (radius_x),
+                                y2 - y1 + 2 * ceil (radius_y),
+                                0, 0,
+                                gimp_item_get_width  (GIMP_ITEM (channel)),
+                                gimp_item_get_height (GIMP_ITEM (channel)),
+                                &rect.x, &rect.y, &rect.width, &rect.height);
+
+      gimp_gegl_apply_feather (gimp_drawable_get_buffer (drawable),
+                               NULL, NULL,
+                               gimp_drawable_get_buffer (drawable),
+                               &rect,
+                               radius_x,
+                               radius_y);
+    }
 
   channel->bounds_known = FALSE;
 
@@ -1267,6 +1438,8 @@ gimp_channel_real_clear (GimpChannel *channel,
   gimp_drawable_update (GIMP_DRAWABLE (channel), 0, 0,
                         gimp_item_get_width  (GIMP_ITEM (channel)),
                         gimp_item_get_height (GIMP_ITEM (channel)));
+
+  gimp_channel_tiles_set (channel, TILE_EMPTY);
 }
 
 static void
@@ -1298,6 +1471,8 @@ gimp_channel_real_all (GimpChannel *channel,
   gimp_drawable_update (GIMP_DRAWABLE (channel), 0, 0,
                         gimp_item_get_width  (GIMP_ITEM (channel)),
                         gimp_item_get_height (GIMP_ITEM (channel)));
+
+  gimp_channel_tiles_set (channel, TILE_FULL);
 }
 
 static void
@@ -1538,6 +1713,220 @@ gimp_channel_real_shrink (GimpChannel *channel,
                         gimp_item_get_height (GIMP_ITEM (channel)));
 }
 
+/*  per-tile occupancy summaries: bounds and emptiness queries only
+ *  look at the tiles touched by updates since they were last asked,
+ *  and combine the rest from the summaries
+ */
+
+static void
+gimp_channel_tiles_ensure (GimpChannel *channel)
+{
+  gint n_tiles_x;
+  gint n_tiles_y;
+
+  n_tiles_x = (gimp_item_get_width  (GIMP_ITEM (channel)) + TILE_SIZE - 1) /
+              TILE_SIZE;
+  n_tiles_y = (gimp_item_get_height (GIMP_ITEM (channel)) + TILE_SIZE - 1) /
+              TILE_SIZE;
+
+  if (! channel->tiles              ||
+      n_tiles_x != channel->n_tiles_x ||
+      n_tiles_y != channel->n_tiles_y)
+    {
+      g_free (channel->tiles);
+
+      channel->n_tiles_x = n_tiles_x;
+      channel->n_tiles_y = n_tiles_y;
+
+      /*  all TILE_UNKNOWN  */
+      channel->tiles = g_new0 (GimpChannelTile, n_tiles_x * n_tiles_y);
+    }
+}
+
+static void
+gimp_channel_tiles_invalidate (GimpChannel         *channel,
+                               const GeglRectangle *rect)
+{
+  GeglRectangle area;
+  gint          tx1, ty1, tx2, ty2;
+  gint          tx, ty;
+
+  if (! channel->tiles)
+    return;
+
+  area.x      = 0;
+  area.y      = 0;
+  area.width  = channel->n_tiles_x * TILE_SIZE;
+  area.height = channel->n_tiles_y * TILE_SIZE;
+
+  if (rect && ! gegl_rectangle_intersect (&area, &area, rect))
+    return;
+
+  tx1 = area.x / TILE_SIZE;
+  ty1 = area.y / TILE_SIZE;
+  tx2 = (area.x + area.width  - 1) / TILE_SIZE;
+  ty2 = (area.y + area.height - 1) / TILE_SIZE;
+
+  for (ty = ty1; ty <= ty2; ty++)
+    for (tx = tx1; tx <= tx2; tx++)
+      channel->tiles[ty * channel->n_tiles_x + tx].state = TILE_UNKNOWN;
+}
+
+static void
+gimp_channel_tiles_set (GimpChannel *channel,
+                        TileState    state)
+{
+  gint width  = gimp_item_get_width  (GIMP_ITEM (channel));
+  gint height = gimp_item_get_height (GIMP_ITEM (channel));
+  gint tx, ty;
+
+  gimp_channel_tiles_ensure (channel);
+
+  for (ty = 0; ty < channel->n_tiles_y; ty++)
+    {
+      for (tx = 0; tx < channel->n_tiles_x; tx++)
+        {
+          GimpChannelTile *tile = &channel->tiles[ty * channel->n_tiles_x + tx];
+
+          tile->state = state;
+          tile->x1    = tx * TILE_SIZE;
+          tile->y1    = ty * TILE_SIZE;
+          tile->x2    = MIN (tile->x1 + TILE_SIZE, width);
+          tile->y2    = MIN (tile->y1 + TILE_SIZE, height);
+        }
+    }
+
+  channel->tiles_dirty = FALSE;
+}
+
+static void
+gimp_channel_tiles_validate_range (gint              offset,
+                                   gint              size,
+                                   ChannelTilesData *data)
+{
+  GimpChannel *channel = data->channel;
+  gint         width   = gimp_item_get_width  (GIMP_ITEM (channel));
+  gint         height  = gimp_item_get_height (GIMP_ITEM (channel));
+  gint         i;
+
+  for (i = offset; i < offset + size; i++)
+    {
+      GimpChannelTile *tile = &channel->tiles[data->tiles[i]];
+      GeglRectangle    area;
+      gboolean         full;
+
+      area.x      = (data->tiles[i] % channel->n_tiles_x) * TILE_SIZE;
+      area.y      = (data->tiles[i] / channel->n_tiles_x) * TILE_SIZE;
+      area.width  = MIN (TILE_SIZE, width  - area.x);
+      area.height = MIN (TILE_SIZE, height - area.y);
+
+      if (! gimp_gegl_mask_area_bounds (data->buffer, &area, &full,
+                                        &tile->x1, &tile->y1,
+                                        &tile->x2, &tile->y2))
+        {
+          tile->state = TILE_EMPTY;
+        }
+      else if (full)
+        {
+          tile->state = TILE_FULL;
+        }
+      else
+        {
+          tile->state = TILE_PARTIAL;
+        }
+    }
+}
+
+static gboolean
+gimp_channel_tiles_bounds (GimpChannel *channel,
+                           gint        *x1,
+                           gint        *y1,
+                           gint        *x2,
+                           gint        *y2)
+{
+  gint n_tiles;
+  gint n_unknown = 0;
+  gint tx1, ty1, tx2, ty2;
+  gint i;
+
+  gimp_channel_tiles_ensure (channel);
+
+  n_tiles = channel->n_tiles_x * channel->n_tiles_y;
+
+  /*  a change we never got an update for can be anywhere  */
+  if (channel->tiles_dirty)
+    {
+      gimp_channel_tiles_invalidate (channel, NULL);
+
+      channel->tiles_dirty = FALSE;
+    }
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      if (channel->tiles[i].state == TILE_UNKNOWN)
+        n_unknown++;
+    }
+
+  if (n_unknown > 0)
+    {
+      ChannelTilesData data;
+      gint             j;
+
+      data.channel = channel;
+      data.buffer  = gimp_drawable_get_buffer (GIMP_DRAWABLE (channel));
+      data.tiles   = g_new (gint, n_unknown);
+
+      for (i = 0, j = 0; i < n_tiles; i++)
+        {
+          if (channel->tiles[i].state == TILE_UNKNOWN)
+            data.tiles[j++] = i;
+        }
+
+      gimp_gegl_parallel_distribute_range (
+        n_unknown,
+        MAX (MIN_PARALLEL_PIXELS / (TILE_SIZE * TILE_SIZE), 1),
+        (GimpGeglParallelRangeFunc) gimp_channel_tiles_validate_range,
+        &data);
+
+      g_free (data.tiles);
+    }
+
+  tx1 = G_MAXINT;
+  ty1 = G_MAXINT;
+  tx2 = G_MININT;
+  ty2 = G_MININT;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      const GimpChannelTile *tile = &channel->tiles[i];
+
+      if (tile->state != TILE_EMPTY)
+        {
+          tx1 = MIN (tx1, tile->x1);
+          ty1 = MIN (ty1, tile->y1);
+          tx2 = MAX (tx2, tile->x2);
+          ty2 = MAX (ty2, tile->y2);
+        }
+    }
+
+  if (tx1 >= tx2)
+    {
+      *x1 = 0;
+      *y1 = 0;
+      *x2 = gimp_item_get_width  (GIMP_ITEM (channel));
+      *y2 = gimp_item_get_height (GIMP_ITEM (channel));
+
+      return FALSE;
+    }
+
+  *x1 = tx1;
+  *y1 = ty1;
+  *x2 = tx2;
+  *y2 = ty2;
+
+  return TRUE;
+}
+
 
 /*  public functions  */
 
@@ -30,6 +30,7 @@
 
 
 typedef struct _GimpChannelClass GimpChannelClass;
+typedef struct _GimpChannelTile  GimpChannelTile;
 
 struct _GimpChannel
 {
@@ -44,15 +45,22 @@ struct _GimpChannel
   GeglNode     *mask_node;
 
   /*  Selection mask variables  */
-  gboolean      boundary_known;    /*  is the current boundary valid  */
-  GimpBoundSeg *segs_in;           /*  outline of selected region     */
-  GimpBoundSeg *segs_out;          /*  outline of selected region     */
-  gint          num_segs_in;       /*  number of lines in boundary    */
-  gint          num_segs_out;      /*  number of lines in boundary    */
-  gboolean      empty;             /*  is the region empty?           */
-  gboolean      bounds_known;      /*  recalculate the bounds?        */
-  gint          x1, y1;            /*  coordinates for bounding box   */
-  gint          x2, y2;            /*  lower right hand coordinate    */
+  gboolean           boundary_known;  /*  is the current boundary valid  */
+  gboolean           boundary_dirty;  /*  changed, but not updated yet   */
+  GimpBoundSeg      *segs_in;         /*  outline of selected region     */
+  GimpBoundSeg      *segs_out;        /*  outline of selected region     */
+  gint               num_segs_in;     /*  number of lines in boundary    */
+  gint               num_segs_out;    /*  number of lines in boundary    */
+  GimpBoundaryCache *segs_in_cache;   /*  per-band segments of segs_in   */
+  GimpBoundaryCache *segs_out_cache;  /*  per-band segments of segs_out  */
+  gboolean           empty;           /*  is the region empty?           */
+  gboolean           bounds_known;    /*  recalculate the bounds?        */
+  gint               x1, y1;          /*  coordinates for bounding box   */
+  gint               x2, y2;          /*  lower right hand coordinate    */
+  GimpChannelTile   *tiles;           /*  per-tile occupancy summaries   */
+  gint               n_tiles_x;
+  gint               n_tiles_y;
+  gboolean           tiles_dirty;     /*  changed, but not updated yet   */
 };
 
 struct _GimpChannelClass
@@ -32,24 +32,63 @@
 #include "gimpimage.h"
 
 
+static gboolean gimp_drawable_calculate_histogram_internal
+                                              (GimpDrawable  *drawable,
+                                               GimpHistogram *histogram,
+                                               gboolean       approximate);
+
+
+/*  public functions  */
+
 void
 gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
                                    GimpHistogram *histogram)
 {
-  GimpImage   *image;
-  GimpChannel *mask;
-  gint         x, y, width, height;
-
   g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
   g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
   g_return_if_fail (histogram != NULL);
 
+  gimp_drawable_calculate_histogram_internal (drawable, histogram, FALSE);
+}
+
+/*  like gimp_drawable_calculate_histogram(), but only samples large
+ *  drawables, see gimp_histogram_calculate_approximate().  Returns
+ *  TRUE if the drawable was small enough for an exact histogram.
+ */
+gboolean
+gimp_drawable_calculate_histogram_approximate (GimpDrawable  *drawable,
+                                               GimpHistogram *histogram)
+{
+  g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), FALSE);
+  g_return_val_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)), FALSE);
+  g_return_val_if_fail (histogram != NULL, FALSE);
+
+  return gimp_drawable_calculate_histogram_internal (drawable, histogram,
+                                                     TRUE);
+}
+
+
+/*  private functions  */
+
+static gboolean
+gimp_drawable_calculate_histogram_internal (GimpDrawable  *drawable,
+                                            GimpHistogram *histogram,
+                                            gboolean       approximate)
+{
+  GimpImage   *image;
+  GimpChannel *mask;
+  gint         x, y, width, height;
+  gboolean     exact = TRUE;
+
   if (! gimp_item_mask_intersect (GIMP_ITEM (drawable), &x, &y, &width, &height))
-    return;
+    return TRUE;
 
   image = gimp_item_get_image (GIMP_ITEM (drawable));
   mask  = gimp_image_get_mask (image);
 
+  /*  don't look at the pixels while a paint thread paints them  */
+  gimp_drawable_paint_lock (drawable);
+
   if (FALSE)
     {
       GeglNode      *node = gegl_node_new ();
@@ -99,25 +138,40 @@ gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
     }
   else
     {
+      GeglBuffer    *mask_buffer = NULL;
+      GeglRectangle  mask_rect   = { 0, };
+
       if (! gimp_channel_is_empty (mask))
         {
           gint off_x, off_y;
 
           gimp_item_get_offset (GIMP_ITEM (drawable), &off_x, &off_y);
 
-          gimp_histogram_calculate (histogram,
-                                    gimp_drawable_get_buffer (drawable),
-                                    GEGL_RECTANGLE (x, y, width, height),
-                                    gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
-                                    GEGL_RECTANGLE (x + off_x, y + off_y,
-                                                    width, height));
+          mask_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (mask));
+          gegl_rectangle_set (&mask_rect,
+                              x + off_x, y + off_y, width, height);
+        }
+
+      if (approximate)
+        {
+          exact =
+            gimp_histogram_calculate_approximate (histogram,
+                                                  gimp_drawable_get_buffer (drawable),
+                                                  GEGL_RECTANGLE (x, y, width, height),
+                                                  mask_buffer,
+                                                  mask_buffer ? &mask_rect : NULL);
         }
       else
         {
           gimp_histogram_calculate (histogram,
                                     gimp_drawable_get_buffer (drawable),
                                     GEGL_RECTANGLE (x, y, width, height),
-                                    NULL, NULL);
+                                    mask_buffer,
+                                    mask_buffer ? &mask_rect : NULL);
         }
     }
+
+  gimp_drawable_paint_unlock (drawable);
+
+  return exact;
 }
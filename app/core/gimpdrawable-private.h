@@ -33,6 +33,8 @@ struct _GimpDrawablePrivate
   GimpApplicator *fs_applicator;
 
   GeglNode       *mode_node;
+
+  GRecMutex       paint_lock; /* held while painting to the buffer */
 };
 
 #endif /* __GIMP_DRAWABLE_PRIVATE_H__ */
@@ -280,6 +280,8 @@ gimp_drawable_init (GimpDrawable *drawable)
                                                    GimpDrawablePrivate);
 
   drawable->private->filter_stack = gimp_filter_stack_new (GIMP_TYPE_FILTER);
+
+  g_rec_mutex_init (&drawable->private->paint_lock);
 }
 
 /* sorry for the evil casts */
@@ -330,6 +332,8 @@ gimp_drawable_finalize (GObject *object)
       drawable->private->filter_stack = NULL;
     }
 
+  g_rec_mutex_clear (&drawable->private->paint_lock);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -1395,6 +1399,35 @@ gimp_drawable_set_buffer_full (GimpDrawable *drawable,
                         gimp_item_get_height (item));
 }
 
+/**
+ * gimp_drawable_paint_lock:
+ * @drawable: a #GimpDrawable
+ *
+ * Locks @drawable's pixels against a paint stroke which is painted
+ * on a separate thread, see gimp_paint_tool_paint_start(). The paint
+ * thread holds the lock while it paints, and code reading the pixels
+ * of a drawable which might currently be painted to, from outside
+ * the paint thread, should hold it while it does.
+ *
+ * The lock is recursive, and must be released with
+ * gimp_drawable_paint_unlock().
+ **/
+void
+gimp_drawable_paint_lock (GimpDrawable *drawable)
+{
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+
+  g_rec_mutex_lock (&drawable->private->paint_lock);
+}
+
+void
+gimp_drawable_paint_unlock (GimpDrawable *drawable)
+{
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+
+  g_rec_mutex_unlock (&drawable->private->paint_lock);
+}
+
 GeglNode *
 gimp_drawable_get_source_node (GimpDrawable *drawable)
 {
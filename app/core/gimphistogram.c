@@ -28,10 +28,15 @@
 #include "core-types.h"
 
 #include "gegl/gimp-babl.h"
+#include "gegl/gimp-gegl-parallel.h"
 
 #include "gimphistogram.h"
 
 
+/*  below this, splitting the work isn't worth the per-thread bins  */
+#define GIMP_HISTOGRAM_MIN_PIXELS_PER_THREAD (64 * 64 * 16)
+
+
 enum
 {
   PROP_0,
@@ -48,6 +53,19 @@ struct _GimpHistogramPrivate
   gdouble *values;
 };
 
+typedef struct
+{
+  GimpHistogram       *histogram;
+  GeglBuffer          *buffer;
+  const GeglRectangle *buffer_rect;
+  GeglBuffer          *mask;
+  const GeglRectangle *mask_rect;
+  const Babl          *format;
+  gint                 n_components;
+  gint                 sample_step;
+  GMutex               mutex;
+} CalculateData;
+
 
 /*  local function prototypes  */
 
@@ -64,6 +82,25 @@ static void     gimp_histogram_get_property (GObject       *object,
 static gint64   gimp_histogram_get_memsize  (GimpObject    *object,
                                              gint64        *gui_size);
 
+static void     gimp_histogram_calculate_internal
+                                            (GimpHistogram       *histogram,
+                                             GeglBuffer          *buffer,
+                                             const GeglRectangle *buffer_rect,
+                                             GeglBuffer          *mask,
+                                             const GeglRectangle *mask_rect,
+                                             gint                 sample_step);
+static void     gimp_histogram_calculate_area
+                                            (const GeglRectangle *area,
+                                             CalculateData       *data);
+static void     gimp_histogram_accumulate   (gdouble       *values,
+                                             gint           n_bins,
+                                             gint           n_components,
+                                             const gfloat  *data,
+                                             const gfloat  *mask_data,
+                                             gint           length,
+                                             gint           step,
+                                             gdouble        scale);
+
 static void     gimp_histogram_alloc_values (GimpHistogram *histogram,
                                              gint           n_components,
                                              gint           n_bins);
@@ -230,251 +267,57 @@ gimp_histogram_calculate (GimpHistogram       *histogram,
                           GeglBuffer          *mask,
                           const GeglRectangle *mask_rect)
 {
-  GimpHistogramPrivate *priv;
-  GeglBufferIterator   *iter;
-  const Babl           *format;
-  gint                  n_components;
-  gint                  n_bins;
-
   g_return_if_fail (GIMP_IS_HISTOGRAM (histogram));
   g_return_if_fail (GEGL_IS_BUFFER (buffer));
   g_return_if_fail (buffer_rect != NULL);
 
-  priv = histogram->priv;
-
-  format = gegl_buffer_get_format (buffer);
-
-  if (babl_format_get_type (format, 0) == babl_type ("u8"))
-    n_bins = 256;
-  else
-    n_bins = 1024;
-
-  if (babl_format_is_palette (format))
-    {
-      if (babl_format_has_alpha (format))
-        format = babl_format ("R'G'B'A float");
-      else
-        format = babl_format ("R'G'B' float");
-    }
-  else
-    {
-      const Babl *model = babl_format_get_model (format);
-
-      if (model == babl_model ("Y"))
-        {
-          if (priv->gamma_correct)
-            format = babl_format ("Y' float");
-          else
-            format = babl_format ("Y float");
-        }
-      else if (model == babl_model ("Y'"))
-        {
-          format = babl_format ("Y' float");
-        }
-      else if (model == babl_model ("YA"))
-        {
-          if (priv->gamma_correct)
-            format = babl_format ("Y'A float");
-          else
-            format = babl_format ("YA float");
-        }
-      else if (model == babl_model ("Y'A"))
-        {
-          format = babl_format ("Y'A float");
-        }
-      else if (model == babl_model ("RGB"))
-        {
-          if (priv->gamma_correct)
-            format = babl_format ("R'G'B' float");
-          else
-            format = babl_format ("RGB float");
-        }
-      else if (model == babl_model ("R'G'B'"))
-        {
-          format = babl_format ("R'G'B' float");
-        }
-      else if (model == babl_model ("RGBA"))
-        {
-          if (priv->gamma_correct)
-            format = babl_format ("R'G'B'A float");
-          else
-            format = babl_format ("RGBA float");
-        }
-      else if (model == babl_model ("R'G'B'A"))
-        {
-          format = babl_format ("R'G'B'A float");
-        }
-      else
-        {
-          g_return_if_reached ();
-        }
-    }
-
-  n_components = babl_format_get_n_components (format);
-
-  g_object_freeze_notify (G_OBJECT (histogram));
-
-  gimp_histogram_alloc_values (histogram, n_components, n_bins);
-
-  iter = gegl_buffer_iterator_new (buffer, buffer_rect, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-  if (mask)
-    gegl_buffer_iterator_add (iter, mask, mask_rect, 0,
-                              babl_format ("Y float"),
-                              GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-#define VALUE(c,i) (priv->values[(c) * priv->n_bins + \
-                                 (gint) (CLAMP ((i), 0.0, 1.0) * \
-                                         (priv->n_bins - 0.0001))])
-
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const gfloat *data   = iter->data[0];
-      gint          length = iter->length;
-      gfloat        max;
-
-      if (mask)
-        {
-          const gfloat *mask_data = iter->data[1];
-
-          switch (n_components)
-            {
-            case 1:
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (0, data[0]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 2:
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[1];
-
-                  VALUE (0, data[0]) += weight * masked;
-                  VALUE (1, data[1]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 3: /* calculate separate value values */
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (1, data[0]) += masked;
-                  VALUE (2, data[1]) += masked;
-                  VALUE (3, data[2]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 4: /* calculate separate value values */
-              while (length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[3];
-
-                  VALUE (1, data[0]) += weight * masked;
-                  VALUE (2, data[1]) += weight * masked;
-                  VALUE (3, data[2]) += weight * masked;
-                  VALUE (4, data[3]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += weight * masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-            }
-        }
-      else /* no mask */
-        {
-          switch (n_components)
-            {
-            case 1:
-              while (length--)
-                {
-                  VALUE (0, data[0]) += 1.0;
-
-                  data += n_components;
-                }
-              break;
-
-            case 2:
-              while (length--)
-                {
-                  const gdouble weight = data[1];
-
-                  VALUE (0, data[0]) += weight;
-                  VALUE (1, data[1]) += 1.0;
-
-                  data += n_components;
-                }
-              break;
-
-            case 3: /* calculate separate value values */
-              while (length--)
-                {
-                  VALUE (1, data[0]) += 1.0;
-                  VALUE (2, data[1]) += 1.0;
-                  VALUE (3, data[2]) += 1.0;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += 1.0;
-
-                  data += n_components;
-                }
-              break;
-
-            case 4: /* calculate separate value values */
-              while (length--)
-                {
-                  const gdouble weight = data[3];
-
-                  VALUE (1, data[0]) += weight;
-                  VALUE (2, data[1]) += weight;
-                  VALUE (3, data[2]) += weight;
-                  VALUE (4, data[3]) += 1.0;
+  gimp_histogram_calculate_internal (histogram,
+                                     buffer, buffer_rect,
+                                     mask, mask_rect,
+                                     1);
+}
 
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+/**
+ * gimp_histogram_calculate_approximate:
+ * @histogram:   a %GimpHistogram
+ * @buffer:      the buffer to calculate the histogram of
+ * @buffer_rect: the area of @buffer to use
+ * @mask:        an optional mask buffer
+ * @mask_rect:   the area of @mask to use
+ *
+ * Like gimp_histogram_calculate(), but for large areas only looks at
+ * a regular grid of about %GIMP_HISTOGRAM_MAX_SAMPLES pixels, and
+ * scales the resulting counts accordingly. Use this for interactive
+ * previews, where speed matters more than exact counts.
+ *
+ * Return value: %TRUE if the area was small enough to look at every
+ *               pixel, so the histogram is exact.
+ **/
+gboolean
+gimp_histogram_calculate_approximate (GimpHistogram       *histogram,
+                                      GeglBuffer          *buffer,
+                                      const GeglRectangle *buffer_rect,
+                                      GeglBuffer          *mask,
+                                      const GeglRectangle *mask_rect)
+{
+  gdouble n_pixels;
+  gint    sample_step = 1;
 
-                  VALUE (0, max) += weight;
+  g_return_val_if_fail (GIMP_IS_HISTOGRAM (histogram), FALSE);
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (buffer_rect != NULL, FALSE);
 
-                  data += n_components;
-                }
-              break;
-            }
-        }
-    }
+  n_pixels = (gdouble) buffer_rect->width * (gdouble) buffer_rect->height;
 
-  g_object_notify (G_OBJECT (histogram), "values");
+  if (n_pixels > GIMP_HISTOGRAM_MAX_SAMPLES)
+    sample_step = ceil (sqrt (n_pixels / GIMP_HISTOGRAM_MAX_SAMPLES));
 
-  g_object_thaw_notify (G_OBJECT (histogram));
+  gimp_histogram_calculate_internal (histogram,
+                                     buffer, buffer_rect,
+                                     mask, mask_rect,
+                                     sample_step);
 
-#undef VALUE
+  return sample_step == 1;
 }
 
 void
@@ -915,6 +758,379 @@ gimp_histogram_get_std_dev (GimpHistogram        *histogram,
 
 /*  private functions  */
 
+static void
+gimp_histogram_calculate_internal (GimpHistogram       *histogram,
+                                   GeglBuffer          *buffer,
+                                   const GeglRectangle *buffer_rect,
+                                   GeglBuffer          *mask,
+                                   const GeglRectangle *mask_rect,
+                                   gint                 sample_step)
+{
+  GimpHistogramPrivate *priv;
+  CalculateData         data;
+  const Babl           *format;
+  gint                  n_components;
+  gint                  n_bins;
+
+  priv = histogram->priv;
+
+  format = gegl_buffer_get_format (buffer);
+
+  if (babl_format_get_type (format, 0) == babl_type ("u8"))
+    n_bins = 256;
+  else
+    n_bins = 1024;
+
+  if (babl_format_is_palette (format))
+    {
+      if (babl_format_has_alpha (format))
+        format = babl_format ("R'G'B'A float");
+      else
+        format = babl_format ("R'G'B' float");
+    }
+  else
+    {
+      const Babl *model = babl_format_get_model (format);
+
+      if (model == babl_model ("Y"))
+        {
+          if (priv->gamma_correct)
+            format = babl_format ("Y' float");
+          else
+            format = babl_format ("Y float");
+        }
+      else if (model == babl_model ("Y'"))
+        {
+          format = babl_format ("Y' float");
+        }
+      else if (model == babl_model ("YA"))
+        {
+          if (priv->gamma_correct)
+            format = babl_format ("Y'A float");
+          else
+            format = babl_format ("YA float");
+        }
+      else if (model == babl_model ("Y'A"))
+        {
+          format = babl_format ("Y'A float");
+        }
+      else if (model == babl_model ("RGB"))
+        {
+          if (priv->gamma_correct)
+            format = babl_format ("R'G'B' float");
+          else
+            format = babl_format ("RGB float");
+        }
+      else if (model == babl_model ("R'G'B'"))
+        {
+          format = babl_format ("R'G'B' float");
+        }
+      else if (model == babl_model ("RGBA"))
+        {
+          if (priv->gamma_correct)
+            format = babl_format ("R'G'B'A float");
+          else
+            format = babl_format ("RGBA float");
+        }
+      else if (model == babl_model ("R'G'B'A"))
+        {
+          format = babl_format ("R'G'B'A float");
+        }
+      else
+        {
+          g_return_if_reached ();
+        }
+    }
+
+  n_components = babl_format_get_n_components (format);
+
+  g_object_freeze_notify (G_OBJECT (histogram));
+
+  gimp_histogram_alloc_values (histogram, n_components, n_bins);
+
+  data.histogram    = histogram;
+  data.buffer       = buffer;
+  data.buffer_rect  = buffer_rect;
+  data.mask         = mask;
+  data.mask_rect    = mask_rect;
+  data.format       = format;
+  data.n_components = n_components;
+  data.sample_step  = sample_step;
+
+  g_mutex_init (&data.mutex);
+
+  gimp_gegl_parallel_distribute_area (buffer_rect,
+                                      GIMP_HISTOGRAM_MIN_PIXELS_PER_THREAD *
+                                      sample_step * sample_step,
+                                      (GimpGeglParallelAreaFunc)
+                                      gimp_histogram_calculate_area,
+                                      &data);
+
+  g_mutex_clear (&data.mutex);
+
+  g_object_notify (G_OBJECT (histogram), "values");
+
+  g_object_thaw_notify (G_OBJECT (histogram));
+}
+
+/*  runs on one of the worker threads: accumulates @area into private
+ *  bins, and adds them to the histogram's values when done
+ */
+static void
+gimp_histogram_calculate_area (const GeglRectangle *area,
+                               CalculateData       *data)
+{
+  GimpHistogramPrivate *priv     = data->histogram->priv;
+  gint                  n_values = priv->n_channels * priv->n_bins;
+  gdouble              *values;
+  gint                  mask_dx  = 0;
+  gint                  mask_dy  = 0;
+  gint                  i;
+
+  values = g_new0 (gdouble, n_values);
+
+  if (data->mask)
+    {
+      mask_dx = data->mask_rect->x - data->buffer_rect->x;
+      mask_dy = data->mask_rect->y - data->buffer_rect->y;
+    }
+
+  if (data->sample_step == 1)
+    {
+      GeglBufferIterator *iter;
+
+      iter = gegl_buffer_iterator_new (data->buffer, area, 0, data->format,
+                                       GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+      if (data->mask)
+        gegl_buffer_iterator_add (iter, data->mask,
+                                  GEGL_RECTANGLE (area->x + mask_dx,
+                                                  area->y + mask_dy,
+                                                  area->width,
+                                                  area->height),
+                                  0, babl_format ("Y float"),
+                                  GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+      while (gegl_buffer_iterator_next (iter))
+        {
+          gimp_histogram_accumulate (values, priv->n_bins,
+                                     data->n_components,
+                                     iter->data[0],
+                                     data->mask ? iter->data[1] : NULL,
+                                     iter->length, 1, 1.0);
+        }
+    }
+  else
+    {
+      const gint  step      = data->sample_step;
+      gfloat     *row       = g_new (gfloat,
+                                     area->width * data->n_components);
+      gfloat     *mask_row  = NULL;
+      gint        x0, y;
+
+      if (data->mask)
+        mask_row = g_new (gfloat, area->width);
+
+      /*  sample on a grid anchored at the origin of the whole area, so
+       *  the result doesn't depend on how the work was split up
+       */
+      x0 = (step - (area->x - data->buffer_rect->x) % step) % step;
+      y  = (step - (area->y - data->buffer_rect->y) % step) % step;
+
+      for (y += area->y; x0 < area->width && y < area->y + area->height;
+           y += step)
+        {
+          gegl_buffer_get (data->buffer,
+                           GEGL_RECTANGLE (area->x, y, area->width, 1), 1.0,
+                           data->format, row,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          if (data->mask)
+            gegl_buffer_get (data->mask,
+                             GEGL_RECTANGLE (area->x + mask_dx, y + mask_dy,
+                                             area->width, 1), 1.0,
+                             babl_format ("Y float"), mask_row,
+                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          gimp_histogram_accumulate (values, priv->n_bins,
+                                     data->n_components,
+                                     row + x0 * data->n_components,
+                                     mask_row ? mask_row + x0 : NULL,
+                                     (area->width - x0 + step - 1) / step,
+                                     step, step * step);
+        }
+
+      g_free (row);
+      g_free (mask_row);
+    }
+
+  g_mutex_lock (&data->mutex);
+
+  for (i = 0; i < n_values; i++)
+    priv->values[i] += values[i];
+
+  g_mutex_unlock (&data->mutex);
+
+  g_free (values);
+}
+
+/*  adds @length pixels, @step pixels apart, to @values; each pixel
+ *  counts @scale times
+ */
+static void
+gimp_histogram_accumulate (gdouble      *values,
+                           gint          n_bins,
+                           gint          n_components,
+                           const gfloat *data,
+                           const gfloat *mask_data,
+                           gint          length,
+                           gint          step,
+                           gdouble       scale)
+{
+  const gint stride = n_components * step;
+  gfloat     max;
+
+#define VALUE(c,i) (values[(c) * n_bins + \
+                           (gint) (CLAMP ((i), 0.0, 1.0) * \
+                                   (n_bins - 0.0001))])
+
+  if (mask_data)
+    {
+      switch (n_components)
+        {
+        case 1:
+          while (length--)
+            {
+              const gdouble masked = *mask_data * scale;
+
+              VALUE (0, data[0]) += masked;
+
+              data += stride;
+              mask_data += step;
+            }
+          break;
+
+        case 2:
+          while (length--)
+            {
+              const gdouble masked = *mask_data * scale;
+              const gdouble weight = data[1];
+
+              VALUE (0, data[0]) += weight * masked;
+              VALUE (1, data[1]) += masked;
+
+              data += stride;
+              mask_data += step;
+            }
+          break;
+
+        case 3: /* calculate separate value values */
+          while (length--)
+            {
+              const gdouble masked = *mask_data * scale;
+
+              VALUE (1, data[0]) += masked;
+              VALUE (2, data[1]) += masked;
+              VALUE (3, data[2]) += masked;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += masked;
+
+              data += stride;
+              mask_data += step;
+            }
+          break;
+
+        case 4: /* calculate separate value values */
+          while (length--)
+            {
+              const gdouble masked = *mask_data * scale;
+              const gdouble weight = data[3];
+
+              VALUE (1, data[0]) += weight * masked;
+              VALUE (2, data[1]) += weight * masked;
+              VALUE (3, data[2]) += weight * masked;
+              VALUE (4, data[3]) += masked;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += weight * masked;
+
+              data += stride;
+              mask_data += step;
+            }
+          break;
+        }
+    }
+  else /* no mask */
+    {
+      switch (n_components)
+        {
+        case 1:
+          while (length--)
+            {
+              VALUE (0, data[0]) += scale;
+
+              data += stride;
+            }
+          break;
+
+        case 2:
+          while (length--)
+            {
+              const gdouble weight = data[1] * scale;
+
+              VALUE (0, data[0]) += weight;
+              VALUE (1, data[1]) += scale;
+
+              data += stride;
+            }
+          break;
+
+        case 3: /* calculate separate value values */
+          while (length--)
+            {
+              VALUE (1, data[0]) += scale;
+              VALUE (2, data[1]) += scale;
+              VALUE (3, data[2]) += scale;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += scale;
+
+              data += stride;
+            }
+          break;
+
+        case 4: /* calculate separate value values */
+          while (length--)
+            {
+              const gdouble weight = data[3] * scale;
+
+              VALUE (1, data[0]) += weight;
+              VALUE (2, data[1]) += weight;
+              VALUE (3, data[2]) += weight;
+              VALUE (4, data[3]) += scale;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += weight;
+
+              data += stride;
+            }
+          break;
+        }
+    }
+
+#undef VALUE
+}
+
+
 static void
 gimp_histogram_alloc_values (GimpHistogram *histogram,
                              gint           n_components,
@@ -24,6 +24,10 @@
 #include "gimpobject.h"
 
 
+/*  the number of pixels gimp_histogram_calculate_approximate() looks at  */
+#define GIMP_HISTOGRAM_MAX_SAMPLES (1024 * 1024)
+
+
 #define GIMP_TYPE_HISTOGRAM            (gimp_histogram_get_type ())
 #define GIMP_HISTOGRAM(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_HISTOGRAM, GimpHistogram))
 #define GIMP_HISTOGRAM_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GIMP_TYPE_HISTOGRAM, GimpHistogramClass))
@@ -59,6 +63,12 @@ void            gimp_histogram_calculate     (GimpHistogram        *histogram,
                                               const GeglRectangle  *buffer_rect,
                                               GeglBuffer           *mask,
                                               const GeglRectangle  *mask_rect);
+gboolean        gimp_histogram_calculate_approximate
+                                             (GimpHistogram        *histogram,
+                                              GeglBuffer           *buffer,
+                                              const GeglRectangle  *buffer_rect,
+                                              GeglBuffer           *mask,
+                                              const GeglRectangle  *mask_rect);
 
 void            gimp_histogram_clear_values  (GimpHistogram        *histogram);
 
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <cairo.h>
 #include <gegl.h>
@@ -29,6 +30,7 @@
 #include "core-types.h"
 
 #include "gegl/gimp-babl.h"
+#include "gegl/gimp-gegl-parallel.h"
 
 #include "gimpdrawable.h"
 #include "gimpimage.h"
@@ -36,35 +38,86 @@
 #include "gimppickable.h"
 
 
+/*  the source is read, and compared to the seed color, in strips of
+ *  this many rows, when the fill first reaches them
+ */
+#define STRIP_HEIGHT        64
+#define MIN_PARALLEL_ROWS   8
+
+#define MIN_PARALLEL_PIXELS (64 * 64)
+
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+} ContiguousColor;
+
+typedef struct
+{
+  gint y;
+  gint start;  /*  first pixel of the segment  */
+  gint end;    /*  last pixel of the segment   */
+} ContiguousSegment;
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  gint                 width;
+  gint                 height;
+
+  gfloat             **diffs;     /*  per strip: each pixel's difference  */
+  guchar             **selected;  /*  per strip: the pixels already filled */
+} ContiguousRegion;
+
+typedef struct
+{
+  ContiguousRegion *region;
+  const gfloat     *src;
+  gfloat           *diff;
+} ContiguousStrip;
+
+
 /*  local function prototypes  */
 
 static const Babl * choose_format         (GeglBuffer          *buffer,
                                            GimpSelectCriterion  select_criterion,
                                            gint                *n_components,
                                            gboolean            *has_alpha);
-static gfloat   pixel_difference          (const gfloat        *col1,
-                                           const gfloat        *col2,
+static void     pixel_difference          (const gfloat        *col,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 n_pixels,
                                            gboolean             antialias,
                                            gfloat               threshold,
                                            gint                 n_components,
                                            gboolean             has_alpha,
                                            gboolean             select_transparent,
                                            GimpSelectCriterion  select_criterion);
-static gboolean find_contiguous_segment   (const gfloat        *col,
-                                           GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *src_format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gint                 width,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 initial_x,
-                                           gint                 initial_y,
-                                           gint                *start,
-                                           gint                *end);
+static void     find_by_color_area        (const GeglRectangle *area,
+                                           ContiguousColor     *color);
+static void     find_contiguous_diffs     (gint                 offset,
+                                           gint                 size,
+                                           ContiguousStrip     *strip);
+static gfloat * find_contiguous_strip     (ContiguousRegion    *region,
+                                           gint                 strip);
 static void find_contiguous_region_helper (GeglBuffer          *src_buffer,
                                            GeglBuffer          *mask_buffer,
                                            const Babl          *format,
@@ -162,14 +215,14 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
    *  fuzzy_select.  Modify the image's mask to reflect the
    *  additional selection
    */
-  GeglBufferIterator *iter;
-  GimpPickable       *pickable;
-  GeglBuffer         *src_buffer;
-  GeglBuffer         *mask_buffer;
-  const Babl         *format;
-  gint                n_components;
-  gboolean            has_alpha;
-  gfloat              start_col[MAX_CHANNELS];
+  GimpPickable    *pickable;
+  GeglBuffer      *src_buffer;
+  GeglBuffer      *mask_buffer;
+  ContiguousColor  data;
+  const Babl      *format;
+  gint             n_components;
+  gboolean         has_alpha;
+  gfloat           start_col[MAX_CHANNELS];
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), NULL);
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
@@ -207,35 +260,22 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  iter = gegl_buffer_iterator_new (src_buffer,
-                                   NULL, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, mask_buffer,
-                            NULL, 0, babl_format ("Y float"),
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const gfloat *src   = iter->data[0];
-      gfloat       *dest  = iter->data[1];
-      gint          count = iter->length;
-
-      while (count--)
-        {
-          /*  Find how closely the colors match  */
-          *dest = pixel_difference (start_col, src,
-                                    antialias,
-                                    threshold,
-                                    n_components,
-                                    has_alpha,
-                                    select_transparent,
-                                    select_criterion);
-
-          src  += n_components;
-          dest += 1;
-        }
-    }
+  data.src_buffer         = src_buffer;
+  data.mask_buffer        = mask_buffer;
+  data.format             = format;
+  data.n_components       = n_components;
+  data.has_alpha          = has_alpha;
+  data.select_transparent = select_transparent;
+  data.select_criterion   = select_criterion;
+  data.antialias          = antialias;
+  data.threshold          = threshold;
+  data.col                = start_col;
+
+  gimp_gegl_parallel_distribute_area (gegl_buffer_get_extent (src_buffer),
+                                      MIN_PARALLEL_PIXELS,
+                                      (GimpGeglParallelAreaFunc)
+                                      find_by_color_area,
+                                      &data);
 
   return mask_buffer;
 }
@@ -286,9 +326,15 @@ choose_format (GeglBuffer          *buffer,
   return format;
 }
 
-static gfloat
-pixel_difference (const gfloat        *col1,
-                  const gfloat        *col2,
+/*  computes the difference of n_pixels pixels from col, with separate
+ *  loops for each criterion and for the threshold, which the compiler
+ *  can vectorize
+ */
+static void
+pixel_difference (const gfloat        *col,
+                  const gfloat        *src,
+                  gfloat              *dest,
+                  gint                 n_pixels,
                   gboolean             antialias,
                   gfloat               threshold,
                   gint                 n_components,
@@ -296,167 +342,180 @@ pixel_difference (const gfloat        *col1,
                   gboolean             select_transparent,
                   GimpSelectCriterion  select_criterion)
 {
-  gfloat max = 0.0;
-
-  /*  if there is an alpha channel, never select transparent regions  */
-  if (! select_transparent && has_alpha && col2[n_components - 1] == 0.0)
-    return 0.0;
+  gint alpha = n_components - 1;
+  gint i;
 
   if (select_transparent && has_alpha)
     {
-      max = fabs (col1[n_components - 1] - col2[n_components - 1]);
+      for (i = 0; i < n_pixels; i++)
+        dest[i] = fabsf (col[alpha] - src[i * n_components + alpha]);
     }
   else
     {
-      gfloat diff;
-      gint   b;
-
-      if (has_alpha)
-        n_components--;
+      gint n_colors = has_alpha ? n_components - 1 : n_components;
+      gint b;
 
       switch (select_criterion)
         {
         case GIMP_SELECT_CRITERION_COMPOSITE:
-          for (b = 0; b < n_components; b++)
+          for (i = 0; i < n_pixels; i++)
+            dest[i] = fabsf (col[0] - src[i * n_components]);
+
+          for (b = 1; b < n_colors; b++)
             {
-              diff = fabs (col1[b] - col2[b]);
-              if (diff > max)
-                max = diff;
+              for (i = 0; i < n_pixels; i++)
+                {
+                  gfloat diff = fabsf (col[b] - src[i * n_components + b]);
+
+                  dest[i] = MAX (dest[i], diff);
+                }
             }
           break;
 
         case GIMP_SELECT_CRITERION_R:
-          max = fabs (col1[0] - col2[0]);
-          break;
-
         case GIMP_SELECT_CRITERION_G:
-          max = fabs (col1[1] - col2[1]);
-          break;
-
         case GIMP_SELECT_CRITERION_B:
-          max = fabs (col1[2] - col2[2]);
+          b = select_criterion - GIMP_SELECT_CRITERION_R;
+
+          for (i = 0; i < n_pixels; i++)
+            dest[i] = fabsf (col[b] - src[i * n_components + b]);
           break;
 
         case GIMP_SELECT_CRITERION_H:
-          {
-            /* wrap around candidates for the actual distance */
-            gfloat dist1 = fabs (col1[0] - col2[0]);
-            gfloat dist2 = fabs (col1[0] - 1.0 - col2[0]);
-            gfloat dist3 = fabs (col1[0] - col2[0] + 1.0);
-
-            max = MIN (dist1, dist2);
-            if (max > dist3)
-              max = dist3;
-          }
-          break;
+          for (i = 0; i < n_pixels; i++)
+            {
+              /* wrap around candidates for the actual distance */
+              gfloat dist1 = fabs (col[0] - src[i * n_components]);
+              gfloat dist2 = fabs (col[0] - 1.0 - src[i * n_components]);
+              gfloat dist3 = fabs (col[0] - src[i * n_components] + 1.0);
 
-        case GIMP_SELECT_CRITERION_S:
-          max = fabs (col1[1] - col2[1]);
+              dest[i] = MIN (MIN (dist1, dist2), dist3);
+            }
           break;
 
+        case GIMP_SELECT_CRITERION_S:
         case GIMP_SELECT_CRITERION_V:
-          max = fabs (col1[2] - col2[2]);
+          b = select_criterion - GIMP_SELECT_CRITERION_H;
+
+          for (i = 0; i < n_pixels; i++)
+            dest[i] = fabsf (col[b] - src[i * n_components + b]);
           break;
         }
     }
 
   if (antialias && threshold > 0.0)
     {
-      gfloat aa = 1.5 - (max / threshold);
+      for (i = 0; i < n_pixels; i++)
+        {
+          gfloat aa = 1.5 - (dest[i] / threshold);
 
-      if (aa <= 0.0)
-        return 0.0;
-      else if (aa < 0.5)
-        return aa * 2.0;
-      else
-        return 1.0;
+          dest[i] = CLAMP (aa * 2.0, 0.0, 1.0);
+        }
     }
   else
     {
-      if (max > threshold)
-        return 0.0;
-      else
-        return 1.0;
+      for (i = 0; i < n_pixels; i++)
+        dest[i] = dest[i] > threshold ? 0.0f : 1.0f;
+    }
+
+  /*  if there is an alpha channel, never select transparent regions  */
+  if (! select_transparent && has_alpha)
+    {
+      for (i = 0; i < n_pixels; i++)
+        {
+          if (src[i * n_components + alpha] == 0.0f)
+            dest[i] = 0.0f;
+        }
     }
 }
 
-static gboolean
-find_contiguous_segment (const gfloat        *col,
-                         GeglBuffer          *src_buffer,
-                         GeglBuffer          *mask_buffer,
-                         const Babl          *format,
-                         gint                 n_components,
-                         gboolean             has_alpha,
-                         gint                 width,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gfloat               threshold,
-                         gint                 initial_x,
-                         gint                 initial_y,
-                         gint                *start,
-                         gint                *end)
+static void
+find_by_color_area (const GeglRectangle *area,
+                    ContiguousColor     *color)
 {
-  gfloat s[MAX_CHANNELS];
-  gfloat mask_row[width];
-  gfloat diff;
-
-  gegl_buffer_sample (src_buffer, initial_x, initial_y, NULL, s, format,
-                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-
-  diff = pixel_difference (col, s, antialias, threshold,
-                           n_components, has_alpha, select_transparent,
-                           select_criterion);
-
-  /* check the starting pixel */
-  if (! diff)
-    return FALSE;
+  GeglBufferIterator *iter;
 
-  mask_row[initial_x] = diff;
+  iter = gegl_buffer_iterator_new (color->src_buffer,
+                                   area, 0, color->format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
-  *start = initial_x - 1;
+  gegl_buffer_iterator_add (iter, color->mask_buffer,
+                            area, 0, babl_format ("Y float"),
+                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-  while (*start >= 0 && diff)
+  while (gegl_buffer_iterator_next (iter))
     {
-      gegl_buffer_sample (src_buffer, *start, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+      pixel_difference (color->col, iter->data[0], iter->data[1],
+                        iter->length,
+                        color->antialias,
+                        color->threshold,
+                        color->n_components,
+                        color->has_alpha,
+                        color->select_transparent,
+                        color->select_criterion);
+    }
+}
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+static void
+find_contiguous_diffs (gint             offset,
+                       gint             size,
+                       ContiguousStrip *strip)
+{
+  ContiguousRegion *region = strip->region;
+
+  pixel_difference (region->col,
+                    strip->src  + offset * region->width * region->n_components,
+                    strip->diff + offset * region->width,
+                    size * region->width,
+                    region->antialias,
+                    region->threshold,
+                    region->n_components,
+                    region->has_alpha,
+                    region->select_transparent,
+                    region->select_criterion);
+}
 
-      mask_row[*start] = diff;
+static gfloat *
+find_contiguous_strip (ContiguousRegion *region,
+                       gint              strip)
+{
+  if (! region->diffs[strip])
+    {
+      ContiguousStrip data;
+      gfloat         *src;
+      gint            y      = strip * STRIP_HEIGHT;
+      gint            height = MIN (STRIP_HEIGHT, region->height - y);
 
-      if (diff)
-        (*start)--;
-    }
+      src = g_new (gfloat, region->width * height * region->n_components);
 
-  diff = 1;
-  *end = initial_x + 1;
+      gegl_buffer_get (region->src_buffer,
+                       GEGL_RECTANGLE (0, y, region->width, height), 1.0,
+                       region->format, src,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-  while (*end < width && diff)
-    {
-      gegl_buffer_sample (src_buffer, *end, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+      region->diffs[strip]    = g_new (gfloat, region->width * height);
+      region->selected[strip] = g_new0 (guchar, region->width * height);
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+      data.region = region;
+      data.src    = src;
+      data.diff   = region->diffs[strip];
 
-      mask_row[*end] = diff;
+      gimp_gegl_parallel_distribute_range (
+        height, MIN_PARALLEL_ROWS,
+        (GimpGeglParallelRangeFunc) find_contiguous_diffs,
+        &data);
 
-      if (diff)
-        (*end)++;
+      g_free (src);
     }
 
-  gegl_buffer_set (mask_buffer, GEGL_RECTANGLE (*start, initial_y,
-                                                *end - *start, 1),
-                   0, babl_format ("Y float"), &mask_row[*start],
-                   GEGL_AUTO_ROWSTRIDE);
-
-  return TRUE;
+  return region->diffs[strip];
 }
 
+/*  a scanline fill: each segment on the stack is a run of pixels whose
+ *  neighbors in the row it was found in are filled; all unfilled
+ *  pixels in it which match are grown to maximal runs, filled, and
+ *  their rows above and below are pushed in turn
+ */
 static void
 find_contiguous_region_helper (GeglBuffer          *src_buffer,
                                GeglBuffer          *mask_buffer,
@@ -471,63 +530,130 @@ find_contiguous_region_helper (GeglBuffer          *src_buffer,
                                gint                 y,
                                const gfloat        *col)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  GQueue *coord_stack;
+  ContiguousRegion  region;
+  ContiguousSegment segment;
+  GArray           *stack;
+  gint              n_strips;
+  gint              i;
 
-  coord_stack = g_queue_new ();
+  region.src_buffer         = src_buffer;
+  region.format             = format;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = col;
+  region.width              = gegl_buffer_get_width  (src_buffer);
+  region.height             = gegl_buffer_get_height (src_buffer);
 
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
-   */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
+  if (x < 0 || x >= region.width || y < 0 || y >= region.height)
+    return;
+
+  n_strips = (region.height + STRIP_HEIGHT - 1) / STRIP_HEIGHT;
 
-  do
+  region.diffs    = g_new0 (gfloat *, n_strips);
+  region.selected = g_new0 (guchar *, n_strips);
+
+  stack = g_array_new (FALSE, FALSE, sizeof (ContiguousSegment));
+
+  segment.y     = y;
+  segment.start = x;
+  segment.end   = x;
+
+  g_array_append_val (stack, segment);
+
+  while (stack->len > 0)
     {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+      ContiguousSegment  scan;
+      const gfloat      *diff;
+      guchar            *selected;
+      gint               offset;
+
+      scan = g_array_index (stack, ContiguousSegment, stack->len - 1);
+      g_array_set_size (stack, stack->len - 1);
+
+      y      = scan.y;
+      offset = (y % STRIP_HEIGHT) * region.width;
+
+      diff     = find_contiguous_strip (&region, y / STRIP_HEIGHT);
+      selected = region.selected[y / STRIP_HEIGHT];
 
-      for (x = start + 1; x < end; x++)
+      diff     += offset;
+      selected += offset;
+
+      for (x = scan.start; x <= scan.end; x++)
         {
-          gfloat val;
+          gint start;
+          gint end;
 
-          gegl_buffer_sample (mask_buffer, x, y, NULL, &val,
-                              babl_format ("Y float"),
-                              GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-          if (val != 0.0)
+          if (selected[x] || ! diff[x])
             continue;
 
-          if (! find_contiguous_segment (col, src_buffer, mask_buffer,
-                                         format,
-                                         n_components,
-                                         has_alpha,
-                                         gegl_buffer_get_width (src_buffer),
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x, y,
-                                         &new_start, &new_end))
-            continue;
+          start = x;
+          end   = x;
+
+          while (start > 0 && diff[start - 1] && ! selected[start - 1])
+            start--;
+
+          while (end < region.width - 1 && diff[end + 1] && ! selected[end + 1])
+            end++;
+
+          memset (selected + start, 1, end - start + 1);
+
+          segment.start = start;
+          segment.end   = end;
 
-          if (y + 1 < gegl_buffer_get_height (src_buffer))
+          if (y + 1 < region.height)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              segment.y = y + 1;
+              g_array_append_val (stack, segment);
             }
 
           if (y - 1 >= 0)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              segment.y = y - 1;
+              g_array_append_val (stack, segment);
             }
+
+          x = end;
         }
     }
-  while (! g_queue_is_empty (coord_stack));
 
-  g_queue_free (coord_stack);
+  g_array_free (stack, TRUE);
+
+  /*  write the filled pixels' differences to the strips of the mask
+   *  which the fill reached, the others are left empty
+   */
+  for (i = 0; i < n_strips; i++)
+    {
+      gfloat *diff     = region.diffs[i];
+      guchar *selected = region.selected[i];
+      gint    height;
+      gint    j;
+
+      if (! diff)
+        continue;
+
+      height = MIN (STRIP_HEIGHT, region.height - i * STRIP_HEIGHT);
+
+      for (j = 0; j < region.width * height; j++)
+        {
+          if (! selected[j])
+            diff[j] = 0.0;
+        }
+
+      gegl_buffer_set (mask_buffer,
+                       GEGL_RECTANGLE (0, i * STRIP_HEIGHT,
+                                       region.width, height),
+                       0, babl_format ("Y float"), diff,
+                       GEGL_AUTO_ROWSTRIDE);
+
+      g_free (diff);
+      g_free (selected);
+    }
+
+  g_free (region.diffs);
+  g_free (region.selected);
 }
@@ -398,6 +398,8 @@ gimp_image_duplicate_mask (GimpImage *image,
 
   GIMP_CHANNEL (new_mask)->bounds_known   = FALSE;
   GIMP_CHANNEL (new_mask)->boundary_known = FALSE;
+
+  gimp_drawable_invalidate_boundary (new_mask);
 }
 
 static void
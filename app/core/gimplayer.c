@@ -1547,6 +1547,7 @@ gimp_layer_create_mask (const GimpLayer *layer,
                                               0, 0));
 
             GIMP_CHANNEL (mask)->bounds_known = FALSE;
+            gimp_drawable_invalidate_boundary (GIMP_DRAWABLE (mask));
           }
       }
       break;
@@ -1598,6 +1599,7 @@ gimp_layer_create_mask (const GimpLayer *layer,
       }
 
       GIMP_CHANNEL (mask)->bounds_known = FALSE;
+      gimp_drawable_invalidate_boundary (GIMP_DRAWABLE (mask));
       break;
     }
 
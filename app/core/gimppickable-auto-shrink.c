@@ -24,12 +24,17 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-gegl-parallel.h"
+
 #include "gimp.h"
 #include "gimpimage.h"
 #include "gimppickable.h"
 #include "gimppickable-auto-shrink.h"
 
 
+#define MIN_PARALLEL_PIXELS (256 * 256)
+
+
 typedef enum
 {
   AUTO_SHRINK_NOTHING = 0,
@@ -41,6 +46,19 @@ typedef enum
 typedef gboolean (* ColorsEqualFunc) (guchar *col1,
                                       guchar *col2);
 
+typedef struct
+{
+  GeglBuffer      *buffer;
+  const Babl      *format;
+  ColorsEqualFunc  colors_equal_func;
+  guchar          *bgcolor;
+  gint             tile_width;
+  gint             tile_height;
+  gint             x1, y1;
+  gint             x2, y2;
+  GMutex           mutex;
+} AutoShrinkData;
+
 
 /*  local function prototypes  */
 
@@ -55,6 +73,10 @@ static gboolean         gimp_pickable_colors_equal  (guchar       *col1,
 static gboolean         gimp_pickable_colors_alpha  (guchar       *col1,
                                                      guchar       *col2);
 
+static void             gimp_pickable_auto_shrink_area
+                                                    (const GeglRectangle *area,
+                                                     AutoShrinkData      *data);
+
 
 /*  public functions  */
 
@@ -70,14 +92,10 @@ gimp_pickable_auto_shrink (GimpPickable *pickable,
                            gint         *shrunk_y2)
 {
   GeglBuffer      *buffer;
-  GeglRectangle    rect;
+  AutoShrinkData   data;
   ColorsEqualFunc  colors_equal_func;
   guchar           bgcolor[MAX_CHANNELS] = { 0, 0, 0, 0 };
-  guchar          *buf = NULL;
   gint             x1, y1, x2, y2;
-  gint             width, height;
-  const Babl      *format;
-  gint             x, y, abort;
   gboolean         retval = FALSE;
 
   g_return_val_if_fail (GIMP_IS_PICKABLE (pickable), FALSE);
@@ -103,8 +121,6 @@ gimp_pickable_auto_shrink (GimpPickable *pickable,
   x2 = MIN (start_x2, gegl_buffer_get_width  (buffer));
   y2 = MIN (start_y2, gegl_buffer_get_height (buffer));
 
-  format = babl_format ("R'G'B'A u8");
-
   switch (gimp_pickable_guess_bgcolor (pickable, bgcolor,
                                        x1, x2 - 1, y1, y2 - 1))
     {
@@ -119,87 +135,44 @@ gimp_pickable_auto_shrink (GimpPickable *pickable,
       break;
     }
 
-  width  = x2 - x1;
-  height = y2 - y1;
-
-  /* The following could be optimized further by processing
-   * the smaller side first instead of defaulting to width    --Sven
+  /* Find the bounding box of all pixels that differ from the
+   * background, instead of eating the area up line by line from
+   * each side.  The area is scanned tile by tile in parallel, and
+   * tiles which can't grow the bounds found so far are skipped.
    */
-
-  buf = g_malloc (MAX (width, height) * 4);
-
-  /* Check how many of the top lines are uniform/transparent. */
-  rect.x      = x1;
-  rect.y      = 0;
-  rect.width  = width;
-  rect.height = 1;
-
-  abort = FALSE;
-  for (y = y1; y < y2 && !abort; y++)
-    {
-      rect.y = y;
-      gegl_buffer_get (buffer, &rect, 1.0, format, buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      for (x = 0; x < width && !abort; x++)
-        abort = ! colors_equal_func (bgcolor, buf + x * 4);
-    }
-  if (y == y2 && !abort)
+  data.buffer            = buffer;
+  data.format            = babl_format ("R'G'B'A u8");
+  data.colors_equal_func = colors_equal_func;
+  data.bgcolor           = bgcolor;
+  data.x1                = G_MAXINT;
+  data.y1                = G_MAXINT;
+  data.x2                = G_MININT;
+  data.y2                = G_MININT;
+
+  g_object_get (buffer,
+                "tile-width",  &data.tile_width,
+                "tile-height", &data.tile_height,
+                NULL);
+
+  g_mutex_init (&data.mutex);
+
+  gimp_gegl_parallel_distribute_area (GEGL_RECTANGLE (x1, y1,
+                                                      x2 - x1, y2 - y1),
+                                      MIN_PARALLEL_PIXELS,
+                                      (GimpGeglParallelAreaFunc)
+                                      gimp_pickable_auto_shrink_area,
+                                      &data);
+
+  g_mutex_clear (&data.mutex);
+
+  /* Nothing but background, keep the whole area */
+  if (data.x1 >= data.x2)
     goto FINISH;
-  y1 = y - 1;
-
-  /* Check how many of the bottom lines are uniform/transparent. */
-  rect.x      = x1;
-  rect.y      = 0;
-  rect.width  = width;
-  rect.height = 1;
-
-  abort = FALSE;
-  for (y = y2; y > y1 && !abort; y--)
-    {
-      rect.y = y - 1;
-      gegl_buffer_get (buffer, &rect, 1.0, format, buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      for (x = 0; x < width && !abort; x++)
-        abort = ! colors_equal_func  (bgcolor, buf + x * 4);
-    }
-  y2 = y + 1;
 
-  /* compute a new height for the next operations */
-  height = y2 - y1;
-
-  /* Check how many of the left lines are uniform/transparent. */
-  rect.x      = 0;
-  rect.y      = y1;
-  rect.width  = 1;
-  rect.height = height;
-
-  abort = FALSE;
-  for (x = x1; x < x2 && !abort; x++)
-    {
-      rect.x = x;
-      gegl_buffer_get (buffer, &rect, 1.0, format, buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      for (y = 0; y < height && !abort; y++)
-        abort = ! colors_equal_func (bgcolor, buf + y * 4);
-    }
-  x1 = x - 1;
-
-  /* Check how many of the right lines are uniform/transparent. */
-  rect.x      = 0;
-  rect.y      = y1;
-  rect.width  = 1;
-  rect.height = height;
-
-  abort = FALSE;
-  for (x = x2; x > x1 && !abort; x--)
-    {
-      rect.x = x - 1;
-      gegl_buffer_get (buffer, &rect, 1.0, format, buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      for (y = 0; y < height && !abort; y++)
-        abort = ! colors_equal_func (bgcolor, buf + y * 4);
-    }
-  x2 = x + 1;
+  x1 = data.x1;
+  y1 = data.y1;
+  x2 = data.x2;
+  y2 = data.y2;
 
  FINISH:
 
@@ -214,7 +187,6 @@ gimp_pickable_auto_shrink (GimpPickable *pickable,
       retval = TRUE;
     }
 
-  g_free (buf);
   gimp_unset_busy (gimp_pickable_get_image (pickable)->gimp);
 
   return retval;
@@ -299,3 +271,111 @@ gimp_pickable_colors_alpha (guchar *dummy,
 {
   return (col[ALPHA] == 0);
 }
+
+static void
+gimp_pickable_auto_shrink_area (const GeglRectangle *area,
+                                AutoShrinkData      *data)
+{
+  ColorsEqualFunc  colors_equal_func = data->colors_equal_func;
+  guchar          *bgcolor           = data->bgcolor;
+  guchar          *buf;
+  gint             x1 = G_MAXINT;
+  gint             y1 = G_MAXINT;
+  gint             x2 = G_MININT;
+  gint             y2 = G_MININT;
+  gint             tx, ty;
+
+  buf = g_malloc (data->tile_width * data->tile_height * 4);
+
+  for (ty = area->y - area->y % data->tile_height;
+       ty < area->y + area->height;
+       ty += data->tile_height)
+    {
+      for (tx = area->x - area->x % data->tile_width;
+           tx < area->x + area->width;
+           tx += data->tile_width)
+        {
+          GeglRectangle rect;
+          gint          y;
+
+          gegl_rectangle_intersect (&rect,
+                                    GEGL_RECTANGLE (tx, ty,
+                                                    data->tile_width,
+                                                    data->tile_height),
+                                    area);
+
+          /* A tile inside the bounds can't grow them, skip it */
+          if (rect.x >= x1 && rect.x + rect.width  <= x2 &&
+              rect.y >= y1 && rect.y + rect.height <= y2)
+            continue;
+
+          gegl_buffer_get (data->buffer, &rect, 1.0, data->format, buf,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          for (y = 0; y < rect.height; y++)
+            {
+              guchar *row = buf + y * rect.width * 4;
+              gint    left_end;
+              gint    right_end;
+              gint    x;
+
+              if (rect.y + y >= y1 && rect.y + y < y2)
+                {
+                  /* The row is inside the bounds, only the pixels left
+                   * and right of them matter
+                   */
+                  left_end  = CLAMP (x1 - rect.x, 0, rect.width);
+                  right_end = CLAMP (x2 - rect.x, 0, rect.width);
+                }
+              else
+                {
+                  left_end  = rect.width;
+                  right_end = 0;
+                }
+
+              for (x = 0; x < left_end; x++)
+                {
+                  if (! colors_equal_func (bgcolor, row + x * 4))
+                    break;
+                }
+
+              if (x < left_end)
+                {
+                  x1 = MIN (x1, rect.x + x);
+                  x2 = MAX (x2, rect.x + x + 1);
+                  y1 = MIN (y1, rect.y + y);
+                  y2 = MAX (y2, rect.y + y + 1);
+
+                  right_end = MAX (right_end, x + 1);
+                }
+              else if (left_end == rect.width)
+                {
+                  continue;
+                }
+
+              for (x = rect.width - 1; x >= right_end; x--)
+                {
+                  if (! colors_equal_func (bgcolor, row + x * 4))
+                    break;
+                }
+
+              if (x >= right_end)
+                x2 = MAX (x2, rect.x + x + 1);
+            }
+        }
+    }
+
+  g_free (buf);
+
+  if (x1 < x2)
+    {
+      g_mutex_lock (&data->mutex);
+
+      data->x1 = MIN (data->x1, x1);
+      data->y1 = MIN (data->y1, y1);
+      data->x2 = MAX (data->x2, x2);
+      data->y2 = MAX (data->y2, y2);
+
+      g_mutex_unlock (&data->mutex);
+    }
+}
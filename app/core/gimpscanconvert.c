@@ -17,6 +17,7 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <gio/gio.h>
@@ -55,6 +56,65 @@ struct _GimpScanConvert
   GArray         *path_data;
 };
 
+typedef struct
+{
+  gint             data;       /*  index of the MOVE_TO in path_data      */
+  gint             n_data;     /*  number of path data elements           */
+  gdouble          start_x;    /*  the point the subpath starts at        */
+  gdouble          start_y;
+  gboolean         split;      /*  whether its pieces are single segments */
+  gboolean         closed;
+  gint             first;      /*  its first piece                        */
+  gint             n_pieces;
+} ScanConvertSubpath;
+
+typedef struct
+{
+  gint             subpath;
+  gint             data;       /*  index of the segment in path_data,
+                                *  -1 for the segment closing the subpath
+                                */
+  gdouble          start_x;    /*  the point the segment starts at        */
+  gdouble          start_y;
+  GeglRectangle    extents;    /*  the area it affects, in buffer coords  */
+} ScanConvertPiece;
+
+
+/*  local function prototypes  */
+
+static void   gimp_scan_convert_get_pieces    (GimpScanConvert    *sc,
+                                               gint                off_x,
+                                               gint                off_y,
+                                               GArray             *subpaths,
+                                               GArray             *pieces,
+                                               GeglRectangle      *extents);
+static void   gimp_scan_convert_add_piece     (GArray             *pieces,
+                                               gint                subpath,
+                                               gint                data,
+                                               gdouble             start_x,
+                                               gdouble             start_y,
+                                               const gdouble      *points,
+                                               gint                n_points,
+                                               gdouble             spread,
+                                               gint                off_x,
+                                               gint                off_y,
+                                               GeglRectangle      *extents);
+static void   gimp_scan_convert_append_run    (cairo_t            *cr,
+                                               GimpScanConvert    *sc,
+                                               GArray             *subpaths,
+                                               GArray             *pieces,
+                                               gint                first,
+                                               gint                last,
+                                               gboolean            move_to);
+static void   gimp_scan_convert_append_pieces (cairo_t            *cr,
+                                               GimpScanConvert    *sc,
+                                               GArray             *subpaths,
+                                               GArray             *pieces,
+                                               const gint         *selected,
+                                               gint                n_selected);
+static gint   gimp_scan_convert_compare_int   (const gint         *a,
+                                               const gint         *b);
+
 
 /*  public functions  */
 
@@ -452,12 +512,24 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
   const Babl         *format;
   GeglBufferIterator *iter;
   GeglRectangle      *roi;
+  GeglRectangle       rect;
+  GeglRectangle       extents;
+  GArray             *subpaths;
+  GArray             *pieces;
+  GArray            **bins;
+  gint               *stamps;
+  gint               *selected;
+  gint                tile_width;
+  gint                tile_height;
+  gint                n_bins_x;
+  gint                n_bins_y;
+  gint                n_tiles = 0;
   cairo_t            *cr;
   cairo_surface_t    *surface;
-  cairo_path_t        path;
   gint                bpp;
   gint                x, y;
   gint                width, height;
+  gint                i;
 
   g_return_if_fail (sc != NULL);
   g_return_if_fail (GEGL_IS_BUFFER (buffer));
@@ -473,23 +545,136 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
                                               &x, &y, &width, &height))
     return;
 
-  path.status   = CAIRO_STATUS_SUCCESS;
-  path.data     = (cairo_path_data_t *) sc->path_data->data;
-  path.num_data = sc->path_data->len;
+  /*  Split the path into pieces, whole subpaths or, for solid strokes,
+   *  single segments, and find the area each of them can affect
+   */
+  subpaths = g_array_new (FALSE, FALSE, sizeof (ScanConvertSubpath));
+  pieces   = g_array_new (FALSE, FALSE, sizeof (ScanConvertPiece));
+
+  gimp_scan_convert_get_pieces (sc, off_x, off_y, subpaths, pieces, &extents);
+
+  /*  Only tiles within the path's extents have to be rendered, when
+   *  replacing the buffer's content, the others are simply cleared
+   */
+  gegl_rectangle_intersect (&rect,
+                            GEGL_RECTANGLE (x, y, width, height), &extents);
+
+  if (replace && (rect.width != width || rect.height != height))
+    gegl_buffer_clear (buffer, GEGL_RECTANGLE (x, y, width, height));
+
+  if (rect.width < 1 || rect.height < 1)
+    {
+      g_array_free (subpaths, TRUE);
+      g_array_free (pieces, TRUE);
+
+      return;
+    }
+
+  /*  Bin the pieces by the tiles they touch  */
+  g_object_get (buffer,
+                "tile-width",  &tile_width,
+                "tile-height", &tile_height,
+                NULL);
+
+  n_bins_x = (rect.width  + tile_width  - 1) / tile_width;
+  n_bins_y = (rect.height + tile_height - 1) / tile_height;
+
+  bins = g_new0 (GArray *, n_bins_x * n_bins_y);
+
+  for (i = 0; i < pieces->len; i++)
+    {
+      const ScanConvertPiece *piece = &g_array_index (pieces,
+                                                      ScanConvertPiece, i);
+      GeglRectangle           area;
+      gint                    bin_x, bin_y;
+
+      if (! gegl_rectangle_intersect (&area, &piece->extents, &rect))
+        continue;
+
+      for (bin_y = (area.y - rect.y) / tile_height;
+           bin_y <= (area.y + area.height - 1 - rect.y) / tile_height;
+           bin_y++)
+        {
+          for (bin_x = (area.x - rect.x) / tile_width;
+               bin_x <= (area.x + area.width - 1 - rect.x) / tile_width;
+               bin_x++)
+            {
+              GArray **bin = &bins[bin_y * n_bins_x + bin_x];
+
+              if (! *bin)
+                *bin = g_array_new (FALSE, FALSE, sizeof (gint));
+
+              g_array_append_val (*bin, i);
+            }
+        }
+    }
+
+  stamps   = g_new (gint, pieces->len);
+  selected = g_new (gint, pieces->len);
+
+  for (i = 0; i < pieces->len; i++)
+    stamps[i] = -1;
 
   format = babl_format ("Y u8");
   bpp    = babl_format_get_bytes_per_pixel (format);
 
-  iter = gegl_buffer_iterator_new (buffer, NULL, 0, format,
+  iter = gegl_buffer_iterator_new (buffer, &rect, 0, format,
                                    GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
   roi = &iter->roi[0];
 
   while (gegl_buffer_iterator_next (iter))
     {
-      guchar     *data    = iter->data[0];
-      guchar     *tmp_buf = NULL;
-      const gint  stride  = cairo_format_stride_for_width (CAIRO_FORMAT_A8,
-                                                           roi->width);
+      guchar     *data       = iter->data[0];
+      guchar     *tmp_buf    = NULL;
+      gint        n_selected = 0;
+      gint        bin_x, bin_y;
+      const gint  stride     = cairo_format_stride_for_width (CAIRO_FORMAT_A8,
+                                                              roi->width);
+
+      /*  collect the pieces which can affect this tile, in path order  */
+      for (bin_y = (roi->y - rect.y) / tile_height;
+           bin_y <= (roi->y + roi->height - 1 - rect.y) / tile_height;
+           bin_y++)
+        {
+          for (bin_x = (roi->x - rect.x) / tile_width;
+               bin_x <= (roi->x + roi->width - 1 - rect.x) / tile_width;
+               bin_x++)
+            {
+              GArray *bin = bins[bin_y * n_bins_x + bin_x];
+
+              if (! bin)
+                continue;
+
+              for (i = 0; i < bin->len; i++)
+                {
+                  gint                    index = g_array_index (bin, gint, i);
+                  const ScanConvertPiece *piece;
+
+                  if (stamps[index] == n_tiles)
+                    continue;
+
+                  stamps[index] = n_tiles;
+
+                  piece = &g_array_index (pieces, ScanConvertPiece, index);
+
+                  if (gegl_rectangle_intersect (NULL, &piece->extents, roi))
+                    selected[n_selected++] = index;
+                }
+            }
+        }
+
+      n_tiles++;
+
+      if (n_selected == 0)
+        {
+          if (replace)
+            memset (data, 0, roi->width * roi->height * bpp);
+
+          continue;
+        }
+
+      qsort (selected, n_selected, sizeof (gint),
+             (GCompareFunc) gimp_scan_convert_compare_int);
 
       /*  cairo rowstrides are always multiples of 4, whereas
        *  maskPR.rowstride can be anything, so to be able to create an
@@ -535,7 +720,8 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
         }
 
       cairo_set_source_rgba (cr, 0, 0, 0, value);
-      cairo_append_path (cr, &path);
+      gimp_scan_convert_append_pieces (cr, sc, subpaths, pieces,
+                                       selected, n_selected);
 
       cairo_set_antialias (cr, antialias ?
                            CAIRO_ANTIALIAS_GRAY : CAIRO_ANTIALIAS_NONE);
@@ -587,4 +773,388 @@ gimp_scan_convert_render_full (GimpScanConvert *sc,
             }
         }
     }
+
+  for (i = 0; i < n_bins_x * n_bins_y; i++)
+    {
+      if (bins[i])
+        g_array_free (bins[i], TRUE);
+    }
+
+  g_free (bins);
+  g_free (stamps);
+  g_free (selected);
+
+  g_array_free (subpaths, TRUE);
+  g_array_free (pieces, TRUE);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_scan_convert_get_pieces (GimpScanConvert *sc,
+                              gint             off_x,
+                              gint             off_y,
+                              GArray          *subpaths,
+                              GArray          *pieces,
+                              GeglRectangle   *extents)
+{
+  const cairo_path_data_t *data   = (cairo_path_data_t *) sc->path_data->data;
+  gint                     n_data = sc->path_data->len;
+  gdouble                  spread;
+  gint                     start;
+
+  extents->x      = 0;
+  extents->y      = 0;
+  extents->width  = 0;
+  extents->height = 0;
+
+  /*  how far the rendering can reach beyond the path, one pixel
+   *  for antialiasing, plus half the pen and caps or miters when
+   *  stroking
+   */
+  spread = 1.0;
+
+  if (sc->do_stroke)
+    {
+      gdouble factor = G_SQRT2;
+
+      if (sc->join == GIMP_JOIN_MITER)
+        factor = MAX (factor, sc->miter);
+
+      spread += sc->width / 2.0 * MAX (1.0, sc->ratio_xy) * factor;
+    }
+
+  for (start = 0; start < n_data; )
+    {
+      ScanConvertSubpath subpath = { 0, };
+      gdouble            x, y;
+      gint               end;
+      gint               i;
+
+      /*  a subpath runs up to the next MOVE_TO  */
+      for (end = start + data[start].header.length;
+           end < n_data && data[end].header.type != CAIRO_PATH_MOVE_TO;
+           end += data[end].header.length);
+
+      subpath.data   = start;
+      subpath.n_data = end - start;
+      subpath.first  = pieces->len;
+
+      /*  a dash pattern runs along the whole subpath, and a fill
+       *  depends on all of its edges, so only solid strokes are split
+       *  into single segments
+       */
+      subpath.split = (sc->do_stroke && ! sc->dash_info &&
+                       data[start].header.type == CAIRO_PATH_MOVE_TO);
+
+      if (subpath.split)
+        {
+          /*  anything following a CLOSE_PATH without a MOVE_TO
+           *  starts a new subpath at the same point, keep those whole
+           */
+          for (i = start; i < end; i += data[i].header.length)
+            {
+              if (data[i].header.type == CAIRO_PATH_CLOSE_PATH &&
+                  i + data[i].header.length < end)
+                {
+                  subpath.split = FALSE;
+                  break;
+                }
+            }
+        }
+
+      if (data[start].header.length > 1)
+        {
+          subpath.start_x = data[start + 1].point.x;
+          subpath.start_y = data[start + 1].point.y;
+        }
+
+      x = subpath.start_x;
+      y = subpath.start_y;
+
+      if (subpath.split)
+        {
+          for (i = start + data[start].header.length;
+               i < end;
+               i += data[i].header.length)
+            {
+              gdouble points[6];
+
+              switch (data[i].header.type)
+                {
+                case CAIRO_PATH_LINE_TO:
+                  points[0] = data[i + 1].point.x;
+                  points[1] = data[i + 1].point.y;
+
+                  gimp_scan_convert_add_piece (pieces, subpaths->len, i,
+                                               x, y, points, 1, spread,
+                                               off_x, off_y, extents);
+
+                  x = points[0];
+                  y = points[1];
+                  break;
+
+                case CAIRO_PATH_CURVE_TO:
+                  points[0] = data[i + 1].point.x;
+                  points[1] = data[i + 1].point.y;
+                  points[2] = data[i + 2].point.x;
+                  points[3] = data[i + 2].point.y;
+                  points[4] = data[i + 3].point.x;
+                  points[5] = data[i + 3].point.y;
+
+                  gimp_scan_convert_add_piece (pieces, subpaths->len, i,
+                                               x, y, points, 3, spread,
+                                               off_x, off_y, extents);
+
+                  x = points[4];
+                  y = points[5];
+                  break;
+
+                case CAIRO_PATH_CLOSE_PATH:
+                  points[0] = subpath.start_x;
+                  points[1] = subpath.start_y;
+
+                  gimp_scan_convert_add_piece (pieces, subpaths->len, -1,
+                                               x, y, points, 1, spread,
+                                               off_x, off_y, extents);
+
+                  subpath.closed = TRUE;
+                  break;
+
+                default:
+                  break;
+                }
+            }
+        }
+      else
+        {
+          ScanConvertPiece piece  = { 0, };
+          gdouble          x1     = x;
+          gdouble          y1     = y;
+          gdouble          x2     = x;
+          gdouble          y2     = y;
+          gint             j;
+
+          /*  the fill and the stroke stay within the extents of all
+           *  points, including the control points of curves
+           */
+          for (i = start; i < end; i += data[i].header.length)
+            {
+              for (j = 1; j < data[i].header.length; j++)
+                {
+                  x1 = MIN (x1, data[i + j].point.x);
+                  y1 = MIN (y1, data[i + j].point.y);
+                  x2 = MAX (x2, data[i + j].point.x);
+                  y2 = MAX (y2, data[i + j].point.y);
+                }
+            }
+
+          piece.subpath = subpaths->len;
+          piece.data    = start;
+          piece.start_x = subpath.start_x;
+          piece.start_y = subpath.start_y;
+
+          piece.extents.x      = floor (x1 - spread) - off_x;
+          piece.extents.y      = floor (y1 - spread) - off_y;
+          piece.extents.width  = ceil (x2 + spread) - off_x - piece.extents.x;
+          piece.extents.height = ceil (y2 + spread) - off_y - piece.extents.y;
+
+          gegl_rectangle_bounding_box (extents, extents, &piece.extents);
+
+          g_array_append_val (pieces, piece);
+        }
+
+      subpath.n_pieces = pieces->len - subpath.first;
+
+      g_array_append_val (subpaths, subpath);
+
+      start = end;
+    }
+}
+
+static void
+gimp_scan_convert_add_piece (GArray        *pieces,
+                             gint           subpath,
+                             gint           data,
+                             gdouble        start_x,
+                             gdouble        start_y,
+                             const gdouble *points,
+                             gint           n_points,
+                             gdouble        spread,
+                             gint           off_x,
+                             gint           off_y,
+                             GeglRectangle *extents)
+{
+  ScanConvertPiece piece;
+  gdouble          x1 = start_x;
+  gdouble          y1 = start_y;
+  gdouble          x2 = start_x;
+  gdouble          y2 = start_y;
+  gint             i;
+
+  for (i = 0; i < n_points; i++)
+    {
+      x1 = MIN (x1, points[i * 2]);
+      y1 = MIN (y1, points[i * 2 + 1]);
+      x2 = MAX (x2, points[i * 2]);
+      y2 = MAX (y2, points[i * 2 + 1]);
+    }
+
+  piece.subpath = subpath;
+  piece.data    = data;
+  piece.start_x = start_x;
+  piece.start_y = start_y;
+
+  piece.extents.x      = floor (x1 - spread) - off_x;
+  piece.extents.y      = floor (y1 - spread) - off_y;
+  piece.extents.width  = ceil (x2 + spread) - off_x - piece.extents.x;
+  piece.extents.height = ceil (y2 + spread) - off_y - piece.extents.y;
+
+  gegl_rectangle_bounding_box (extents, extents, &piece.extents);
+
+  g_array_append_val (pieces, piece);
+}
+
+/*  appends the consecutive segments first to last of a split subpath  */
+static void
+gimp_scan_convert_append_run (cairo_t         *cr,
+                              GimpScanConvert *sc,
+                              GArray          *subpaths,
+                              GArray          *pieces,
+                              gint             first,
+                              gint             last,
+                              gboolean         move_to)
+{
+  const cairo_path_data_t *data = (cairo_path_data_t *) sc->path_data->data;
+  gint                     i;
+
+  for (i = first; i <= last; i++)
+    {
+      const ScanConvertPiece *piece = &g_array_index (pieces,
+                                                      ScanConvertPiece, i);
+
+      if (i == first && move_to)
+        cairo_move_to (cr, piece->start_x, piece->start_y);
+
+      if (piece->data < 0)
+        {
+          const ScanConvertSubpath *subpath;
+
+          subpath = &g_array_index (subpaths, ScanConvertSubpath,
+                                    piece->subpath);
+
+          cairo_line_to (cr, subpath->start_x, subpath->start_y);
+        }
+      else if (data[piece->data].header.type == CAIRO_PATH_LINE_TO)
+        {
+          cairo_line_to (cr,
+                         data[piece->data + 1].point.x,
+                         data[piece->data + 1].point.y);
+        }
+      else
+        {
+          cairo_curve_to (cr,
+                          data[piece->data + 1].point.x,
+                          data[piece->data + 1].point.y,
+                          data[piece->data + 2].point.x,
+                          data[piece->data + 2].point.y,
+                          data[piece->data + 3].point.x,
+                          data[piece->data + 3].point.y);
+        }
+    }
+}
+
+static void
+gimp_scan_convert_append_pieces (cairo_t         *cr,
+                                 GimpScanConvert *sc,
+                                 GArray          *subpaths,
+                                 GArray          *pieces,
+                                 const gint      *selected,
+                                 gint             n_selected)
+{
+  gint i = 0;
+
+  while (i < n_selected)
+    {
+      const ScanConvertPiece   *piece;
+      const ScanConvertSubpath *subpath;
+      gint                      n;
+
+      piece   = &g_array_index (pieces, ScanConvertPiece, selected[i]);
+      subpath = &g_array_index (subpaths, ScanConvertSubpath, piece->subpath);
+
+      /*  the selected pieces of this subpath  */
+      for (n = 1;
+           i + n < n_selected &&
+           selected[i + n] < subpath->first + subpath->n_pieces;
+           n++);
+
+      if (n == subpath->n_pieces)
+        {
+          /*  all of it, append it as it is  */
+          cairo_path_t path;
+
+          path.status   = CAIRO_STATUS_SUCCESS;
+          path.data     = (cairo_path_data_t *) sc->path_data->data +
+                          subpath->data;
+          path.num_data = subpath->n_data;
+
+          cairo_append_path (cr, &path);
+        }
+      else
+        {
+          const gint *sub       = selected + i;
+          gint        last      = subpath->first + subpath->n_pieces - 1;
+          gint        run_start = 0;
+          gint        run_end   = n;
+          gint        j;
+
+          /*  a run ending with the closing segment continues with
+           *  a run starting at the subpath's first segment, keeping
+           *  the join in between
+           */
+          if (subpath->closed       &&
+              sub[0]     == subpath->first &&
+              sub[n - 1] == last)
+            {
+              for (run_start = n - 1;
+                   sub[run_start - 1] == sub[run_start] - 1;
+                   run_start--);
+
+              gimp_scan_convert_append_run (cr, sc, subpaths, pieces,
+                                            sub[run_start], last, TRUE);
+
+              for (j = 1; j < n && sub[j] == sub[j - 1] + 1; j++);
+
+              gimp_scan_convert_append_run (cr, sc, subpaths, pieces,
+                                            sub[0], sub[j - 1], FALSE);
+
+              run_end   = run_start;
+              run_start = j;
+            }
+
+          /*  the remaining runs of consecutive segments  */
+          while (run_start < run_end)
+            {
+              for (j = run_start + 1;
+                   j < run_end && sub[j] == sub[j - 1] + 1;
+                   j++);
+
+              gimp_scan_convert_append_run (cr, sc, subpaths, pieces,
+                                            sub[run_start], sub[j - 1], TRUE);
+
+              run_start = j;
+            }
+        }
+
+      i += n;
+    }
+}
+
+static gint
+gimp_scan_convert_compare_int (const gint *a,
+                               const gint *b)
+{
+  return *a - *b;
 }
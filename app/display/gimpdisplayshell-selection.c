@@ -17,9 +17,14 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <gegl.h>
 #include <gtk/gtk.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "display-types.h"
 
 #include "config/gimpdisplayconfig.h"
@@ -39,22 +44,51 @@
 #include "gimpdisplayshell-transform.h"
 
 
-struct _Selection
-{
-  GimpDisplayShell *shell;            /*  shell that owns the selection     */
+typedef struct _SelectionView SelectionView;
+typedef struct _SelectionRun  SelectionRun;
 
-  GimpSegment      *segs_in;          /*  gdk segments of area boundary     */
-  gint              n_segs_in;        /*  number of segments in segs_in     */
+struct _SelectionView
+{
+  gdouble             scale_x;        /*  the view the segments were        */
+  gdouble             scale_y;        /*  zoomed and rendered for           */
+  gint                offset_x;
+  gint                offset_y;
+  gint                disp_width;
+  gint                disp_height;
+  gboolean            rotated;
+  cairo_matrix_t      rotate_transform;
+};
 
-  GimpSegment      *segs_out;         /*  gdk segments of area boundary     */
-  gint              n_segs_out;       /*  number of segments in segs_out    */
+struct _SelectionRun
+{
+  gint                line;           /*  row of a horizontal run, column   */
+  gint                start;          /*  of a vertical one                 */
+  gint                end;
+};
 
-  guint             index;            /*  index of current stipple pattern  */
-  gint              paused;           /*  count of pause requests           */
-  gboolean          shell_visible;    /*  visility of the display shell     */
-  gboolean          show_selection;   /*  is the selection visible?         */
-  guint             timeout;          /*  timer for successive draws        */
-  cairo_pattern_t  *segs_in_mask;     /*  cache for rendered segments       */
+struct _Selection
+{
+  GimpDisplayShell   *shell;          /*  shell that owns the selection     */
+
+  GimpSegment        *segs_in;        /*  gdk segments of area boundary     */
+  gint                n_segs_in;      /*  number of segments in segs_in     */
+
+  GimpSegment        *segs_out;       /*  gdk segments of area boundary     */
+  gint                n_segs_out;     /*  number of segments in segs_out    */
+
+  gboolean            segs_known;     /*  are the segments below valid?     */
+  const GimpBoundSeg *bound_segs_in;  /*  boundary the segments were        */
+  const GimpBoundSeg *bound_segs_out; /*  generated from                    */
+  gint                n_bound_segs_in;
+  gint                n_bound_segs_out;
+  SelectionView       view;
+
+  guint               index;          /*  index of current stipple pattern  */
+  gint                paused;         /*  count of pause requests           */
+  gboolean            shell_visible;  /*  visility of the display shell     */
+  gboolean            show_selection; /*  is the selection visible?         */
+  guint               timeout;        /*  timer for successive draws        */
+  cairo_pattern_t    *segs_in_mask;   /*  cache for rendered segments       */
 };
 
 
@@ -68,7 +102,21 @@ static void      selection_undraw         (Selection          *selection);
 
 static void      selection_render_mask    (Selection          *selection);
 
-static void      selection_zoom_segs      (Selection          *selection,
+static void      selection_get_view       (Selection          *selection,
+                                           SelectionView      *view);
+static gboolean  selection_view_equal     (const SelectionView *view1,
+                                           const SelectionView *view2);
+static void      selection_seg_rect       (const GimpSegment  *seg,
+                                           gint               *x1,
+                                           gint               *y1,
+                                           gint               *x2,
+                                           gint               *y2);
+static gint      selection_run_compare    (const SelectionRun *a,
+                                           const SelectionRun *b);
+static gint      selection_simplify_segs  (Selection          *selection,
+                                           GimpSegment        *segs,
+                                           gint                n_segs);
+static gint      selection_zoom_segs      (Selection          *selection,
                                            const GimpBoundSeg *src_segs,
                                            GimpSegment        *dest_segs,
                                            gint                n_segs);
@@ -147,6 +195,9 @@ gimp_display_shell_selection_undraw (GimpDisplayShell *shell)
   if (gimp_display_get_image (shell->display))
     {
       selection_undraw (shell->selection);
+
+      /*  the boundary changed, don't reuse the old segments  */
+      shell->selection->segs_known = FALSE;
     }
   else
     {
@@ -248,7 +299,7 @@ selection_stop (Selection *selection)
 static void
 selection_draw (Selection *selection)
 {
-  if (selection->segs_in)
+  if (selection->segs_in_mask)
     {
       cairo_t *cr;
 
@@ -287,11 +338,55 @@ selection_render_mask (Selection *selection)
   GdkWindow       *window;
   cairo_surface_t *surface;
   cairo_t         *cr;
+  gdouble          x1 = G_MAXDOUBLE;
+  gdouble          y1 = G_MAXDOUBLE;
+  gdouble          x2 = -G_MAXDOUBLE;
+  gdouble          y2 = -G_MAXDOUBLE;
+  gint             mask_x1, mask_y1;
+  gint             mask_x2, mask_y2;
+  gint             i;
 
   window = gtk_widget_get_window (selection->shell->canvas);
+
+  /*  the animation masks with the rendered segments on every step,
+   *  so keep the mask to the part of the window they actually cover
+   */
+  for (i = 0; i < selection->n_segs_in; i++)
+    {
+      gint sx1, sy1, sx2, sy2;
+      gint j;
+
+      selection_seg_rect (&selection->segs_in[i], &sx1, &sy1, &sx2, &sy2);
+
+      for (j = 0; j < 4; j++)
+        {
+          gdouble x = (j & 1) ? sx2 : sx1;
+          gdouble y = (j & 2) ? sy2 : sy1;
+
+          if (selection->shell->rotate_transform)
+            cairo_matrix_transform_point (selection->shell->rotate_transform,
+                                          &x, &y);
+
+          x1 = MIN (x1, x);
+          y1 = MIN (y1, y);
+          x2 = MAX (x2, x);
+          y2 = MAX (y2, y);
+        }
+    }
+
+  mask_x1 = MAX (floor (x1) - 1, 0);
+  mask_y1 = MAX (floor (y1) - 1, 0);
+  mask_x2 = MIN (ceil (x2) + 1, gdk_window_get_width  (window));
+  mask_y2 = MIN (ceil (y2) + 1, gdk_window_get_height (window));
+
+  if (mask_x2 <= mask_x1 || mask_y2 <= mask_y1)
+    return;
+
   surface = gdk_window_create_similar_surface (window, CAIRO_CONTENT_ALPHA,
-                                               gdk_window_get_width  (window),
-                                               gdk_window_get_height (window));
+                                               mask_x2 - mask_x1,
+                                               mask_y2 - mask_y1);
+  cairo_surface_set_device_offset (surface, -mask_x1, -mask_y1);
+
   cr = cairo_create (surface);
 
   cairo_set_line_cap (cr, CAIRO_LINE_CAP_SQUARE);
@@ -312,6 +407,209 @@ selection_render_mask (Selection *selection)
 }
 
 static void
+selection_get_view (Selection     *selection,
+                    SelectionView *view)
+{
+  GimpDisplayShell *shell = selection->shell;
+
+  memset (view, 0, sizeof (SelectionView));
+
+  view->scale_x     = shell->scale_x;
+  view->scale_y     = shell->scale_y;
+  view->offset_x    = shell->offset_x;
+  view->offset_y    = shell->offset_y;
+  view->disp_width  = shell->disp_width;
+  view->disp_height = shell->disp_height;
+
+  if (shell->rotate_transform)
+    {
+      view->rotated          = TRUE;
+      view->rotate_transform = *shell->rotate_transform;
+    }
+}
+
+static gboolean
+selection_view_equal (const SelectionView *view1,
+                      const SelectionView *view2)
+{
+  return (view1->scale_x     == view2->scale_x     &&
+          view1->scale_y     == view2->scale_y     &&
+          view1->offset_x    == view2->offset_x    &&
+          view1->offset_y    == view2->offset_y    &&
+          view1->disp_width  == view2->disp_width  &&
+          view1->disp_height == view2->disp_height &&
+          view1->rotated     == view2->rotated     &&
+          ! memcmp (&view1->rotate_transform, &view2->rotate_transform,
+                    sizeof (cairo_matrix_t)));
+}
+
+/*  the area, in unrotated display coordinates, which
+ *  gimp_cairo_add_segments() strokes for a segment
+ */
+static void
+selection_seg_rect (const GimpSegment *seg,
+                    gint              *x1,
+                    gint              *y1,
+                    gint              *x2,
+                    gint              *y2)
+{
+  if (seg->x1 == seg->x2)
+    {
+      *x1 = seg->x1;
+      *x2 = seg->x1 + 1;
+      *y1 = MIN (seg->y1, seg->y2 - 1);
+      *y2 = MAX (seg->y1 + 1, seg->y2);
+    }
+  else
+    {
+      *x1 = MIN (seg->x1, seg->x2 - 1);
+      *x2 = MAX (seg->x1 + 1, seg->x2);
+      *y1 = seg->y1;
+      *y2 = seg->y1 + 1;
+    }
+}
+
+static gint
+selection_run_compare (const SelectionRun *a,
+                       const SelectionRun *b)
+{
+  if (a->line != b->line)
+    return a->line < b->line ? -1 : 1;
+
+  if (a->start != b->start)
+    return a->start < b->start ? -1 : 1;
+
+  return 0;
+}
+
+/*  Drops the segments which lie outside of the window, and merges the
+ *  overlapping and adjacent ones on the same row or column.  When
+ *  zoomed out, most of a complex boundary collapses this way, and
+ *  since all segments are stroked as one path, the stroked area stays
+ *  exactly the same.
+ */
+static gint
+selection_simplify_segs (Selection   *selection,
+                         GimpSegment *segs,
+                         gint         n_segs)
+{
+  GimpDisplayShell *shell  = selection->shell;
+  GdkWindow        *window = gtk_widget_get_window (shell->canvas);
+  SelectionRun     *runs[2];
+  gint              n_runs[2] = { 0, 0 };
+  gdouble           view_x1   = 0.0;
+  gdouble           view_y1   = 0.0;
+  gdouble           view_x2   = gdk_window_get_width  (window);
+  gdouble           view_y2   = gdk_window_get_height (window);
+  gint              n_simplified = 0;
+  gint              i, j;
+
+  if (shell->rotate_transform)
+    {
+      gdouble x1 = G_MAXDOUBLE;
+      gdouble y1 = G_MAXDOUBLE;
+      gdouble x2 = -G_MAXDOUBLE;
+      gdouble y2 = -G_MAXDOUBLE;
+
+      for (j = 0; j < 4; j++)
+        {
+          gdouble x = (j & 1) ? view_x2 : view_x1;
+          gdouble y = (j & 2) ? view_y2 : view_y1;
+
+          cairo_matrix_transform_point (shell->rotate_untransform, &x, &y);
+
+          x1 = MIN (x1, x);
+          y1 = MIN (y1, y);
+          x2 = MAX (x2, x);
+          y2 = MAX (y2, y);
+        }
+
+      view_x1 = floor (x1);
+      view_y1 = floor (y1);
+      view_x2 = ceil (x2);
+      view_y2 = ceil (y2);
+    }
+
+  /*  horizontal runs go to runs[0], vertical ones to runs[1]  */
+  runs[0] = g_new (SelectionRun, n_segs);
+  runs[1] = g_new (SelectionRun, n_segs);
+
+  for (i = 0; i < n_segs; i++)
+    {
+      SelectionRun *run;
+      gint          x1, y1, x2, y2;
+
+      selection_seg_rect (&segs[i], &x1, &y1, &x2, &y2);
+
+      if (x2 <= view_x1 || x1 >= view_x2 ||
+          y2 <= view_y1 || y1 >= view_y2)
+        continue;
+
+      if (segs[i].x1 == segs[i].x2)
+        {
+          run = &runs[1][n_runs[1]++];
+
+          run->line  = x1;
+          run->start = y1;
+          run->end   = y2;
+        }
+      else
+        {
+          run = &runs[0][n_runs[0]++];
+
+          run->line  = y1;
+          run->start = x1;
+          run->end   = x2;
+        }
+    }
+
+  for (j = 0; j < 2; j++)
+    {
+      gint n_merged = 0;
+
+      qsort (runs[j], n_runs[j], sizeof (SelectionRun),
+             (GCompareFunc) selection_run_compare);
+
+      for (i = 0; i < n_runs[j]; i++)
+        {
+          SelectionRun *run  = &runs[j][i];
+          SelectionRun *last = n_merged ? &runs[j][n_merged - 1] : NULL;
+
+          if (last && last->line == run->line && last->end >= run->start)
+            last->end = MAX (last->end, run->end);
+          else
+            runs[j][n_merged++] = *run;
+        }
+
+      for (i = 0; i < n_merged; i++)
+        {
+          const SelectionRun *run = &runs[j][i];
+          GimpSegment        *seg = &segs[n_simplified++];
+
+          if (j == 0)
+            {
+              seg->x1 = run->start;
+              seg->y1 = run->line;
+              seg->x2 = run->end;
+              seg->y2 = run->line;
+            }
+          else
+            {
+              seg->x1 = run->line;
+              seg->y1 = run->start;
+              seg->x2 = run->line;
+              seg->y2 = run->end;
+            }
+        }
+    }
+
+  g_free (runs[0]);
+  g_free (runs[1]);
+
+  return n_simplified;
+}
+
+static gint
 selection_zoom_segs (Selection          *selection,
                      const GimpBoundSeg *src_segs,
                      GimpSegment        *dest_segs,
@@ -353,6 +651,8 @@ selection_zoom_segs (Selection          *selection,
             }
         }
     }
+
+  return selection_simplify_segs (selection, dest_segs, n_segs);
 }
 
 static void
@@ -361,39 +661,73 @@ selection_generate_segs (Selection *selection)
   GimpImage          *image = gimp_display_get_image (selection->shell->display);
   const GimpBoundSeg *segs_in;
   const GimpBoundSeg *segs_out;
+  gint                n_segs_in;
+  gint                n_segs_out;
+  SelectionView       view;
 
   /*  Ask the image for the boundary of its selected region...
    *  Then transform that information into a new buffer of GimpSegments
    */
   gimp_channel_boundary (gimp_image_get_mask (image),
                          &segs_in, &segs_out,
-                         &selection->n_segs_in, &selection->n_segs_out,
+                         &n_segs_in, &n_segs_out,
                          0, 0, 0, 0);
 
-  if (selection->n_segs_in)
-    {
-      selection->segs_in = g_new (GimpSegment, selection->n_segs_in);
-      selection_zoom_segs (selection, segs_in,
-                           selection->segs_in, selection->n_segs_in);
+  selection_get_view (selection, &view);
 
-      selection_render_mask (selection);
-    }
-  else
+  /*  Keep the zoomed segments and the rendered mask as long as neither
+   *  the boundary nor the view changed, the canvas is exposed far more
+   *  often than that
+   */
+  if (selection->segs_known                        &&
+      selection->bound_segs_in    == segs_in       &&
+      selection->bound_segs_out   == segs_out      &&
+      selection->n_bound_segs_in  == n_segs_in     &&
+      selection->n_bound_segs_out == n_segs_out    &&
+      selection_view_equal (&selection->view, &view))
+    return;
+
+  selection_free_segs (selection);
+
+  if (n_segs_in)
     {
-      selection->segs_in = NULL;
+      selection->segs_in   = g_new (GimpSegment, n_segs_in);
+      selection->n_segs_in = selection_zoom_segs (selection, segs_in,
+                                                  selection->segs_in,
+                                                  n_segs_in);
+
+      if (selection->n_segs_in)
+        {
+          selection_render_mask (selection);
+        }
+      else
+        {
+          g_free (selection->segs_in);
+          selection->segs_in = NULL;
+        }
     }
 
   /*  Possible secondary boundary representation  */
-  if (selection->n_segs_out)
-    {
-      selection->segs_out = g_new (GimpSegment, selection->n_segs_out);
-      selection_zoom_segs (selection, segs_out,
-                           selection->segs_out, selection->n_segs_out);
-    }
-  else
+  if (n_segs_out)
     {
-      selection->segs_out = NULL;
+      selection->segs_out   = g_new (GimpSegment, n_segs_out);
+      selection->n_segs_out = selection_zoom_segs (selection, segs_out,
+                                                   selection->segs_out,
+                                                   n_segs_out);
+
+      if (! selection->n_segs_out)
+        {
+          g_free (selection->segs_out);
+          selection->segs_out = NULL;
+        }
     }
+
+  selection->segs_known       = TRUE;
+  selection->bound_segs_in    = segs_in;
+  selection->bound_segs_out   = segs_out;
+  selection->n_bound_segs_in  = n_segs_in;
+  selection->n_bound_segs_out = n_segs_out;
+  selection->view             = view;
 }
 
 static void
@@ -418,16 +752,20 @@ selection_free_segs (Selection *selection)
       cairo_pattern_destroy (selection->segs_in_mask);
       selection->segs_in_mask = NULL;
     }
+
+  selection->segs_known = FALSE;
 }
 
 static gboolean
 selection_start_timeout (Selection *selection)
 {
-  selection_free_segs (selection);
   selection->timeout = 0;
 
   if (! gimp_display_get_image (selection->shell->display))
-    return FALSE;
+    {
+      selection_free_segs (selection);
+      return FALSE;
+    }
 
   selection_generate_segs (selection);
 
@@ -456,7 +794,7 @@ selection_start_timeout (Selection *selection)
           cairo_destroy (cr);
         }
 
-      if (selection->segs_in && selection->shell_visible)
+      if (selection->segs_in_mask && selection->shell_visible)
         selection->timeout = g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE,
                                                  config->marching_ants_speed,
                                                  (GSourceFunc) selection_timeout,
@@ -24,12 +24,16 @@
 
 #include <gegl.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "gimp-gegl-types.h"
 
 #include "core/gimp-utils.h"
 #include "core/gimpprogress.h"
 
 #include "gimp-gegl-apply-operation.h"
+#include "gimp-gegl-loops.h"
+#include "gimp-gegl-mask.h"
 #include "gimp-gegl-nodes.h"
 #include "gegl/gimp-gegl-utils.h"
 
@@ -185,13 +189,18 @@ gimp_gegl_apply_flatten (GeglBuffer    *src_buffer,
 }
 
 void
-gimp_gegl_apply_feather (GeglBuffer   *src_buffer,
-                         GimpProgress *progress,
-                         const gchar  *undo_desc,
-                         GeglBuffer   *dest_buffer,
-                         gdouble       radius_x,
-                         gdouble       radius_y)
+gimp_gegl_apply_feather (GeglBuffer          *src_buffer,
+                         GimpProgress        *progress,
+                         const gchar         *undo_desc,
+                         GeglBuffer          *dest_buffer,
+                         const GeglRectangle *dest_rect,
+                         gdouble              radius_x,
+                         gdouble              radius_y)
 {
+  GeglNode *node;
+  gdouble   std_dev_x;
+  gdouble   std_dev_y;
+
   g_return_if_fail (GEGL_IS_BUFFER (src_buffer));
   g_return_if_fail (progress == NULL || GIMP_IS_PROGRESS (progress));
   g_return_if_fail (GEGL_IS_BUFFER (dest_buffer));
@@ -199,11 +208,59 @@ gimp_gegl_apply_feather (GeglBuffer   *src_buffer,
   /* 3.5 is completely magic and picked to visually match the old
    * gaussian_blur_region() on a crappy laptop display
    */
-  gimp_gegl_apply_gaussian_blur (src_buffer,
-                                 progress, undo_desc,
-                                 dest_buffer,
-                                 radius_x / 3.5,
-                                 radius_y / 3.5);
+  std_dev_x = radius_x / 3.5;
+  std_dev_y = radius_y / 3.5;
+
+  /*  masks get the recursive gaussian, which doesn't get slower with
+   *  the radius, but can't report progress. Nothing changes farther
+   *  than the radius from the mask's non-empty area.
+   */
+  if (! progress &&
+      babl_format_get_n_components (gegl_buffer_get_format (src_buffer)) == 1 &&
+      (std_dev_x == 0.0 || std_dev_x >= 0.5) &&
+      (std_dev_y == 0.0 || std_dev_y >= 0.5))
+    {
+      GeglRectangle rect;
+
+      if (dest_rect)
+        {
+          rect = *dest_rect;
+        }
+      else
+        {
+          gint x1, y1, x2, y2;
+
+          if (src_buffer != dest_buffer)
+            gegl_buffer_copy (src_buffer, NULL, dest_buffer, NULL);
+
+          if (! gimp_gegl_mask_bounds (src_buffer, &x1, &y1, &x2, &y2))
+            return;
+
+          rect.x      = x1 - ceil (radius_x);
+          rect.y      = y1 - ceil (radius_y);
+          rect.width  = x2 - x1 + 2 * ceil (radius_x);
+          rect.height = y2 - y1 + 2 * ceil (radius_y);
+
+          gegl_rectangle_intersect (&rect, &rect,
+                                    gegl_buffer_get_extent (src_buffer));
+        }
+
+      gimp_gegl_gaussian_blur_mask (src_buffer, &rect,
+                                    dest_buffer, &rect,
+                                    std_dev_x, std_dev_y);
+
+      return;
+    }
+
+  node = gegl_node_new_child (NULL,
+                              "operation", "gegl:gaussian-blur",
+                              "std-dev-x", std_dev_x,
+                              "std-dev-y", std_dev_y,
+                              NULL);
+
+  gimp_gegl_apply_operation (src_buffer, progress, undo_desc,
+                             node, dest_buffer, dest_rect);
+  g_object_unref (node);
 }
 
 void
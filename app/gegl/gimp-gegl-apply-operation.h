@@ -53,6 +53,7 @@ void   gimp_gegl_apply_feather         (GeglBuffer            *src_buffer,
                                         GimpProgress          *progress,
                                         const gchar           *undo_desc,
                                         GeglBuffer            *dest_buffer,
+                                        const GeglRectangle   *dest_rect,
                                         gdouble                radius_x,
                                         gdouble                radius_y);
 
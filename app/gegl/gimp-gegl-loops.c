@@ -20,6 +20,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gegl.h>
 
 #include "libgimpmath/gimpmath.h"
@@ -28,7 +30,95 @@
 
 #include "gimp-babl.h"
 #include "gimp-gegl-loops.h"
+#include "gimp-gegl-parallel.h"
+
+
+/* split the loops into parts of at least this many pixels */
+#define MIN_PARALLEL_PIXELS (64 * 64)
+
+/* the number of columns the vertical gaussian pass runs side by side */
+#define GAUSSIAN_BLOCK_SIZE 64
+
+
+typedef struct
+{
+  const gfloat        *src;
+  gint                 src_rowstride;
+  gfloat              *dest;
+  gint                 width;
+  gint                 components;
+  const gfloat        *kernel;
+  const gfloat        *kernel_x;
+  const gfloat        *kernel_y;
+  gint                 kernel_size;
+  gdouble              divisor;
+  gfloat               offset;
+  gboolean             absolute;
+  gboolean             alpha_weighting;
+} ConvolveData;
+
+typedef struct
+{
+  gfloat              *data;
+  gint                 width;
+  gint                 height;
+  gdouble              coefs[4];
+} GaussianData;
 
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  const GeglRectangle *src_rect;
+  GeglBuffer          *dest_buffer;
+  const GeglRectangle *dest_rect;
+  gfloat               exposure;
+  GimpTransferMode     mode;
+} DodgeBurnData;
+
+typedef struct
+{
+  GeglBuffer          *top_buffer;
+  const GeglRectangle *top_rect;
+  GeglBuffer          *bottom_buffer;
+  const GeglRectangle *bottom_rect;
+  GeglBuffer          *dest_buffer;
+  const GeglRectangle *dest_rect;
+  gfloat               blend;
+} SmudgeBlendData;
+
+
+static gboolean gimp_gegl_convolve_separate   (const gfloat        *kernel,
+                                               gint                 kernel_size,
+                                               gfloat              *kernel_x,
+                                               gfloat              *kernel_y);
+static void     gimp_gegl_convolve_rows       (gint                 offset,
+                                               gint                 size,
+                                               ConvolveData        *data);
+static void     gimp_gegl_convolve_finish_row (const gdouble       *total,
+                                               gfloat              *dest,
+                                               ConvolveData        *data);
+
+static void     gimp_gegl_gaussian_coefs      (gdouble              std_dev,
+                                               gdouble             *coefs);
+static void     gimp_gegl_gaussian_lines      (gfloat              *data,
+                                               gint                 length,
+                                               gint                 stride,
+                                               gint                 n_lines,
+                                               const gdouble       *coefs);
+static void     gimp_gegl_gaussian_rows       (gint                 offset,
+                                               gint                 size,
+                                               GaussianData        *data);
+static void     gimp_gegl_gaussian_columns    (gint                 offset,
+                                               gint                 size,
+                                               GaussianData        *data);
+
+static void     gimp_gegl_dodgeburn_area      (const GeglRectangle *area,
+                                               DodgeBurnData       *data);
+static void     gimp_gegl_smudge_blend_area   (const GeglRectangle *area,
+                                               SmudgeBlendData     *data);
+
+
+/*  public functions  */
 
 void
 gimp_gegl_convolve (GeglBuffer          *src_buffer,
@@ -41,167 +131,217 @@ gimp_gegl_convolve (GeglBuffer          *src_buffer,
                     GimpConvolutionType  mode,
                     gboolean             alpha_weighting)
 {
-  GeglBufferIterator *iter;
-  GeglRectangle      *src_roi;
-  GeglRectangle      *dest_roi;
-  const Babl         *src_format;
-  const Babl         *dest_format;
-  gint                src_components;
-  gint                dest_components;
+  ConvolveData  data;
+  const Babl   *src_format;
+  gint          components;
+  gint          margin = kernel_size / 2;
+  gint          width;
+  gint          height;
+  gint          padded_width;
+  gint          padded_height;
+  gfloat       *src;
+  gfloat       *dest;
+  gfloat       *kernel_x;
+  gfloat       *kernel_y;
+  gint          x, y;
+
+  /*  FIXME: without alpha weighting, the result has never been written
+   *  to @dest, and the brush transforms' hardness blur relies on that
+   */
+  if (! alpha_weighting)
+    return;
+
+  if (! src_rect)
+    src_rect = gegl_buffer_get_extent (src_buffer);
+
+  if (! dest_rect)
+    dest_rect = gegl_buffer_get_extent (dest_buffer);
+
+  width  = src_rect->width;
+  height = src_rect->height;
+
+  if (width <= 0 || height <= 0)
+    return;
 
   src_format = gegl_buffer_get_format (src_buffer);
 
+  /*  alpha weighting weights by the last component, so read sources
+   *  without alpha as opaque pixels with alpha
+   */
   if (babl_format_is_palette (src_format))
     src_format = gimp_babl_format (GIMP_RGB,
                                    GIMP_PRECISION_FLOAT_LINEAR,
+                                   alpha_weighting ||
                                    babl_format_has_alpha (src_format));
   else
     src_format = gimp_babl_format (gimp_babl_format_get_base_type (src_format),
                                    GIMP_PRECISION_FLOAT_LINEAR,
+                                   alpha_weighting ||
                                    babl_format_has_alpha (src_format));
 
-  dest_format = gegl_buffer_get_format (dest_buffer);
+  components = babl_format_get_n_components (src_format);
 
-  if (babl_format_is_palette (dest_format))
-    dest_format = gimp_babl_format (GIMP_RGB,
-                                    GIMP_PRECISION_FLOAT_LINEAR,
-                                    babl_format_has_alpha (dest_format));
-  else
-    dest_format = gimp_babl_format (gimp_babl_format_get_base_type (dest_format),
-                                    GIMP_PRECISION_FLOAT_LINEAR,
-                                    babl_format_has_alpha (dest_format));
+  /*  read the source with a margin of its replicated edge pixels, so
+   *  the kernel never has to be clipped
+   */
+  padded_width  = width  + 2 * margin;
+  padded_height = height + 2 * margin;
 
-  src_components  = babl_format_get_n_components (src_format);
-  dest_components = babl_format_get_n_components (dest_format);
+  src  = g_new (gfloat, padded_width * padded_height * components);
+  dest = g_new (gfloat, width * height * components);
 
-  iter = gegl_buffer_iterator_new (src_buffer, src_rect, 0, src_format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-  src_roi = &iter->roi[0];
-
-  gegl_buffer_iterator_add (iter, dest_buffer, dest_rect, 0, dest_format,
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-  dest_roi = &iter->roi[1];
+  gegl_buffer_get (src_buffer, src_rect, 1.0, src_format,
+                   src + (margin * padded_width + margin) * components,
+                   padded_width * components * sizeof (gfloat),
+                   GEGL_ABYSS_NONE);
 
-  while (gegl_buffer_iterator_next (iter))
+  for (y = margin; y < margin + height; y++)
     {
-      /*  Convolve the src image using the convolution kernel, writing
-       *  to dest Convolve is not tile-enabled--use accordingly
-       */
-      const gfloat *src         = iter->data[0];
-      gfloat       *dest        = iter->data[1];
-      const gint    components  = src_components;
-      const gint    a_component = components - 1;
-      const gint    rowstride   = src_components * src_roi->width;
-      const gint    margin      = kernel_size / 2;
-      const gint    x1          = src_roi->x;
-      const gint    y1          = src_roi->y;
-      const gint    x2          = src_roi->x + src_roi->width  - 1;
-      const gint    y2          = src_roi->y + src_roi->height - 1;
-      gint          x, y;
-      gfloat        offset;
-
-      /*  If the mode is NEGATIVE_CONVOL, the offset should be 128  */
-      if (mode == GIMP_NEGATIVE_CONVOL)
-        {
-          offset = 0.5;
-          mode = GIMP_NORMAL_CONVOL;
-        }
-      else
+      gfloat *row = src + y * padded_width * components;
+
+      for (x = 0; x < margin; x++)
         {
-          offset = 0.0;
+          memcpy (row + x * components,
+                  row + margin * components,
+                  components * sizeof (gfloat));
+          memcpy (row + (margin + width + x) * components,
+                  row + (margin + width - 1) * components,
+                  components * sizeof (gfloat));
         }
+    }
+
+  for (y = 0; y < margin; y++)
+    {
+      memcpy (src + y * padded_width * components,
+              src + margin * padded_width * components,
+              padded_width * components * sizeof (gfloat));
+      memcpy (src + (margin + height + y) * padded_width * components,
+              src + (margin + height - 1) * padded_width * components,
+              padded_width * components * sizeof (gfloat));
+    }
+
+  /*  with alpha weighting, the color is the alpha-weighted average,
+   *  which is the convolution of the premultiplied color divided by
+   *  the convolution of alpha
+   */
+  if (alpha_weighting)
+    {
+      gfloat *s = src;
+      gint    n = padded_width * padded_height;
 
-      for (y = 0; y < dest_roi->height; y++)
+      while (n--)
         {
-          gfloat *d = dest;
+          gint b;
 
-          if (alpha_weighting)
-            {
-              for (x = 0; x < dest_roi->width; x++)
-                {
-                  const gfloat *m                = kernel;
-                  gdouble       total[4]         = { 0.0, 0.0, 0.0, 0.0 };
-                  gdouble       weighted_divisor = 0.0;
-                  gint          i, j, b;
+          for (b = 0; b < components - 1; b++)
+            s[b] *= s[components - 1];
 
-                  for (j = y - margin; j <= y + margin; j++)
-                    {
-                      for (i = x - margin; i <= x + margin; i++, m++)
-                        {
-                          gint          xx = CLAMP (i, x1, x2);
-                          gint          yy = CLAMP (j, y1, y2);
-                          const gfloat *s  = src + yy * rowstride + xx * components;
-                          const gfloat  a  = s[a_component];
+          s += components;
+        }
+    }
 
-                          if (a)
-                            {
-                              gdouble mult_alpha = *m * a;
+  data.src             = src;
+  data.src_rowstride   = padded_width * components;
+  data.dest            = dest;
+  data.width           = width;
+  data.components      = components;
+  data.kernel          = kernel;
+  data.kernel_x        = NULL;
+  data.kernel_y        = NULL;
+  data.kernel_size     = kernel_size;
+  data.divisor         = divisor;
+  data.offset          = (mode == GIMP_NEGATIVE_CONVOL) ? 0.5 : 0.0;
+  data.absolute        = (mode == GIMP_ABSOLUTE_CONVOL);
+  data.alpha_weighting = alpha_weighting;
+
+  kernel_x = g_new (gfloat, kernel_size);
+  kernel_y = g_new (gfloat, kernel_size);
+
+  if (gimp_gegl_convolve_separate (kernel, kernel_size, kernel_x, kernel_y))
+    {
+      data.kernel_x = kernel_x;
+      data.kernel_y = kernel_y;
+    }
 
-                              weighted_divisor += mult_alpha;
+  gimp_gegl_parallel_distribute_range (height,
+                                       MAX (MIN_PARALLEL_PIXELS / width, 1),
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_gegl_convolve_rows,
+                                       &data);
 
-                              for (b = 0; b < a_component; b++)
-                                total[b] += mult_alpha * s[b];
+  gegl_buffer_set (dest_buffer,
+                   GEGL_RECTANGLE (dest_rect->x, dest_rect->y, width, height),
+                   0, src_format, dest, GEGL_AUTO_ROWSTRIDE);
 
-                              total[a_component] += mult_alpha;
-                            }
-                        }
-                    }
+  g_free (kernel_x);
+  g_free (kernel_y);
+  g_free (src);
+  g_free (dest);
+}
 
-                  if (weighted_divisor == 0.0)
-                    weighted_divisor = divisor;
+void
+gimp_gegl_gaussian_blur_mask (GeglBuffer          *src_buffer,
+                              const GeglRectangle *src_rect,
+                              GeglBuffer          *dest_buffer,
+                              const GeglRectangle *dest_rect,
+                              gdouble              std_dev_x,
+                              gdouble              std_dev_y)
+{
+  GaussianData  data;
+  const Babl   *format = babl_format ("Y float");
+  gint          width;
+  gint          height;
 
-                  for (b = 0; b < a_component; b++)
-                    total[b] /= weighted_divisor;
+  if (! src_rect)
+    src_rect = gegl_buffer_get_extent (src_buffer);
 
-                  total[a_component] /= divisor;
+  if (! dest_rect)
+    dest_rect = gegl_buffer_get_extent (dest_buffer);
 
-                  for (b = 0; b < components; b++)
-                    {
-                      total[b] += offset;
+  width  = src_rect->width;
+  height = src_rect->height;
 
-                      if (mode != GIMP_NORMAL_CONVOL && total[b] < 0.0)
-                        total[b] = - total[b];
+  if (width <= 0 || height <= 0)
+    return;
 
-                      *d++ = CLAMP (total[b], 0.0, 1.0);
-                    }
-                }
-            }
-          else
-            {
-              for (x = 0; x < dest_roi->width; x++)
-                {
-                  const gfloat *m        = kernel;
-                  gdouble       total[4] = { 0.0, 0.0, 0.0, 0.0 };
-                  gint          i, j, b;
+  data.data   = g_new (gfloat, width * height);
+  data.width  = width;
+  data.height = height;
 
-                  for (j = y - margin; j <= y + margin; j++)
-                    {
-                      for (i = x - margin; i <= x + margin; i++, m++)
-                        {
-                          gint          xx = CLAMP (i, x1, x2);
-                          gint          yy = CLAMP (j, y1, y2);
-                          const gfloat *s  = src + yy * rowstride + xx * components;
-
-                          for (b = 0; b < components; b++)
-                            total[b] += *m * s[b];
-                        }
-                    }
+  gegl_buffer_get (src_buffer, src_rect, 1.0, format,
+                   data.data, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-                  for (b = 0; b < components; b++)
-                    {
-                      total[b] = total[b] / divisor + offset;
+  if (std_dev_x > 0.0)
+    {
+      gimp_gegl_gaussian_coefs (std_dev_x, data.coefs);
 
-                      if (mode != GIMP_NORMAL_CONVOL && total[b] < 0.0)
-                        total[b] = - total[b];
+      gimp_gegl_parallel_distribute_range (height,
+                                           MAX (MIN_PARALLEL_PIXELS / width, 1),
+                                           (GimpGeglParallelRangeFunc)
+                                           gimp_gegl_gaussian_rows,
+                                           &data);
+    }
 
-                      total[b] = CLAMP (total[b], 0.0, 1.0);
-                    }
-                }
-            }
+  if (std_dev_y > 0.0)
+    {
+      gint n_blocks = (width + GAUSSIAN_BLOCK_SIZE - 1) / GAUSSIAN_BLOCK_SIZE;
 
-          dest += dest_roi->width * dest_components;
-        }
+      gimp_gegl_gaussian_coefs (std_dev_y, data.coefs);
+
+      gimp_gegl_parallel_distribute_range (n_blocks,
+                                           MAX (MIN_PARALLEL_PIXELS /
+                                                (GAUSSIAN_BLOCK_SIZE * height),
+                                                1),
+                                           (GimpGeglParallelRangeFunc)
+                                           gimp_gegl_gaussian_columns,
+                                           &data);
     }
+
+  gegl_buffer_set (dest_buffer,
+                   GEGL_RECTANGLE (dest_rect->x, dest_rect->y, width, height),
+                   0, format, data.data, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data.data);
 }
 
 void
@@ -213,116 +353,31 @@ gimp_gegl_dodgeburn (GeglBuffer          *src_buffer,
                      GimpDodgeBurnType    type,
                      GimpTransferMode     mode)
 {
-  GeglBufferIterator *iter;
-
-  if (type == GIMP_BURN)
-    exposure = -exposure;
-
-  iter = gegl_buffer_iterator_new (src_buffer, src_rect, 0,
-                                   babl_format ("R'G'B'A float"),
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, dest_buffer, dest_rect, 0,
-                            babl_format ("R'G'B'A float"),
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  switch (mode)
-    {
-      gfloat factor;
-
-    case GIMP_HIGHLIGHTS:
-      factor = 1.0 + exposure * (0.333333);
-
-      while (gegl_buffer_iterator_next (iter))
-        {
-          gfloat *src   = iter->data[0];
-          gfloat *dest  = iter->data[1];
-          gint    count = iter->length;
-
-          while (count--)
-            {
-              *dest++ = *src++ * factor;
-              *dest++ = *src++ * factor;
-              *dest++ = *src++ * factor;
-
-              *dest++ = *src++;
-            }
-        }
-      break;
-
-    case GIMP_MIDTONES:
-      if (exposure < 0)
-        factor = 1.0 - exposure * (0.333333);
-      else
-        factor = 1.0 / (1.0 + exposure);
-
-      while (gegl_buffer_iterator_next (iter))
-        {
-          gfloat *src   = iter->data[0];
-          gfloat *dest  = iter->data[1];
-          gint    count = iter->length;
+  DodgeBurnData data;
 
-          while (count--)
-            {
-              *dest++ = pow (*src++, factor);
-              *dest++ = pow (*src++, factor);
-              *dest++ = pow (*src++, factor);
-
-              *dest++ = *src++;
-            }
-        }
-      break;
+  if (! src_rect)
+    src_rect = gegl_buffer_get_extent (src_buffer);
 
-    case GIMP_SHADOWS:
-      if (exposure >= 0)
-        factor = 0.333333 * exposure;
-      else
-        factor = -0.333333 * exposure;
-
-      while (gegl_buffer_iterator_next (iter))
-        {
-          gfloat *src   = iter->data[0];
-          gfloat *dest  = iter->data[1];
-          gint    count = iter->length;
+  if (! dest_rect)
+    dest_rect = gegl_buffer_get_extent (dest_buffer);
 
-          while (count--)
-            {
-              if (exposure >= 0)
-                {
-                  gfloat s;
-
-                  s = *src++; *dest++ = factor + s - factor * s;
-                  s = *src++; *dest++ = factor + s - factor * s;
-                  s = *src++; *dest++ = factor + s - factor * s;
-                }
-              else
-                {
-                  gfloat s;
-
-                  s = *src++;
-                  if (s < factor)
-                    *dest++ = 0;
-                  else /* factor <= value <=1 */
-                    *dest++ = (s - factor) / (1.0 - factor);
-
-                  s = *src++;
-                  if (s < factor)
-                    *dest++ = 0;
-                  else /* factor <= value <=1 */
-                    *dest++ = (s - factor) / (1.0 - factor);
-
-                  s = *src++;
-                  if (s < factor)
-                    *dest++ = 0;
-                  else /* factor <= value <=1 */
-                    *dest++ = (s - factor) / (1.0 - factor);
-                }
+  if (type == GIMP_BURN)
+    exposure = -exposure;
 
-              *dest++ = *src++;
-           }
-        }
-      break;
-    }
+  data.src_buffer  = src_buffer;
+  data.src_rect    = src_rect;
+  data.dest_buffer = dest_buffer;
+  data.dest_rect   = dest_rect;
+  data.exposure    = exposure;
+  data.mode        = mode;
+
+  gimp_gegl_parallel_distribute_area (GEGL_RECTANGLE (0, 0,
+                                                      src_rect->width,
+                                                      src_rect->height),
+                                      MIN_PARALLEL_PIXELS,
+                                      (GimpGeglParallelAreaFunc)
+                                      gimp_gegl_dodgeburn_area,
+                                      &data);
 }
 
 /*
@@ -341,55 +396,32 @@ gimp_gegl_smudge_blend (GeglBuffer          *top_buffer,
                         const GeglRectangle *dest_rect,
                         gdouble              blend)
 {
-  GeglBufferIterator *iter;
-
-  iter = gegl_buffer_iterator_new (top_buffer, top_rect, 0,
-                                   babl_format ("RGBA float"),
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, bottom_buffer, bottom_rect, 0,
-                            babl_format ("RGBA float"),
-                            GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, dest_buffer, dest_rect, 0,
-                            babl_format ("RGBA float"),
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const gfloat *top    = iter->data[0];
-      const gfloat *bottom = iter->data[1];
-      gfloat       *dest   = iter->data[2];
-      gint          count  = iter->length;
-      const gfloat  blend1 = 1.0 - blend;
-      const gfloat  blend2 = blend;
-
-      while (count--)
-        {
-          const gfloat a1 = blend1 * bottom[3];
-          const gfloat a2 = blend2 * top[3];
-          const gfloat a  = a1 + a2;
-          gint         b;
-
-          if (a == 0)
-            {
-              for (b = 0; b < 4; b++)
-                dest[b] = 0;
-            }
-          else
-            {
-              for (b = 0; b < 3; b++)
-                dest[b] =
-                  bottom[b] + (bottom[b] * a1 + top[b] * a2 - a * bottom[b]);
-
-              dest[3] = a;
-            }
-
-          top    += 4;
-          bottom += 4;
-          dest   += 4;
-        }
-    }
+  SmudgeBlendData data;
+
+  if (! top_rect)
+    top_rect = gegl_buffer_get_extent (top_buffer);
+
+  if (! bottom_rect)
+    bottom_rect = gegl_buffer_get_extent (bottom_buffer);
+
+  if (! dest_rect)
+    dest_rect = gegl_buffer_get_extent (dest_buffer);
+
+  data.top_buffer    = top_buffer;
+  data.top_rect      = top_rect;
+  data.bottom_buffer = bottom_buffer;
+  data.bottom_rect   = bottom_rect;
+  data.dest_buffer   = dest_buffer;
+  data.dest_rect     = dest_rect;
+  data.blend         = blend;
+
+  gimp_gegl_parallel_distribute_area (GEGL_RECTANGLE (0, 0,
+                                                      top_rect->width,
+                                                      top_rect->height),
+                                      MIN_PARALLEL_PIXELS,
+                                      (GimpGeglParallelAreaFunc)
+                                      gimp_gegl_smudge_blend_area,
+                                      &data);
 }
 
 void
@@ -611,3 +643,502 @@ gimp_gegl_replace (GeglBuffer          *top_buffer,
         }
     }
 }
+
+
+/*  private functions  */
+
+/*  if @kernel is the product of a column and a row vector, like box and
+ *  gaussian kernels are, return them in @kernel_y and @kernel_x, so it
+ *  can be applied as a vertical pass over a horizontal one
+ */
+static gboolean
+gimp_gegl_convolve_separate (const gfloat *kernel,
+                             gint          kernel_size,
+                             gfloat       *kernel_x,
+                             gfloat       *kernel_y)
+{
+  gfloat max     = 0.0;
+  gint   pivot_x = 0;
+  gint   pivot_y = 0;
+  gint   x, y;
+
+  for (y = 0; y < kernel_size; y++)
+    for (x = 0; x < kernel_size; x++)
+      if (fabs (kernel[y * kernel_size + x]) > max)
+        {
+          max     = fabs (kernel[y * kernel_size + x]);
+          pivot_x = x;
+          pivot_y = y;
+        }
+
+  if (max == 0.0)
+    return FALSE;
+
+  for (x = 0; x < kernel_size; x++)
+    kernel_x[x] = kernel[pivot_y * kernel_size + x];
+
+  for (y = 0; y < kernel_size; y++)
+    kernel_y[y] = (kernel[y * kernel_size + pivot_x] /
+                   kernel[pivot_y * kernel_size + pivot_x]);
+
+  for (y = 0; y < kernel_size; y++)
+    for (x = 0; x < kernel_size; x++)
+      if (fabs (kernel_y[y] * kernel_x[x] -
+                kernel[y * kernel_size + x]) > max * 1e-6)
+        return FALSE;
+
+  return TRUE;
+}
+
+/*  the inner loops add a weighted source row to a row of totals, over
+ *  all the components at once, which the compiler can vectorize; the
+ *  totals are doubles, since sharpening kernels with alpha weighting
+ *  can cancel out the weighted divisor
+ */
+static void
+gimp_gegl_convolve_rows (gint          offset,
+                         gint          size,
+                         ConvolveData *data)
+{
+  const gint  components  = data->components;
+  const gint  kernel_size = data->kernel_size;
+  const gint  row_size    = data->width * components;
+  gdouble    *total;
+  gdouble    *temp        = NULL;
+  gint        y, i, j, k;
+
+  total = g_new (gdouble, row_size);
+
+  if (data->kernel_x)
+    {
+      /*  the horizontal pass over all the rows the vertical one needs  */
+      temp = g_new0 (gdouble, (size + kernel_size - 1) * row_size);
+
+      for (y = 0; y < size + kernel_size - 1; y++)
+        {
+          const gfloat *src = data->src + (offset + y) * data->src_rowstride;
+          gdouble      *t   = temp + y * row_size;
+
+          for (j = 0; j < kernel_size; j++)
+            {
+              const gfloat  w = data->kernel_x[j];
+              const gfloat *s = src + j * components;
+
+              if (w == 0.0)
+                continue;
+
+              for (i = 0; i < row_size; i++)
+                t[i] += w * s[i];
+            }
+        }
+    }
+
+  for (y = offset; y < offset + size; y++)
+    {
+      memset (total, 0, row_size * sizeof (gdouble));
+
+      if (temp)
+        {
+          for (j = 0; j < kernel_size; j++)
+            {
+              const gfloat  w = data->kernel_y[j];
+              const gdouble *t = temp + (y - offset + j) * row_size;
+
+              if (w == 0.0)
+                continue;
+
+              for (i = 0; i < row_size; i++)
+                total[i] += w * t[i];
+            }
+        }
+      else
+        {
+          for (j = 0; j < kernel_size; j++)
+            {
+              const gfloat *src = data->src + (y + j) * data->src_rowstride;
+
+              for (k = 0; k < kernel_size; k++)
+                {
+                  const gfloat  w = data->kernel[j * kernel_size + k];
+                  const gfloat *s = src + k * components;
+
+                  if (w == 0.0)
+                    continue;
+
+                  for (i = 0; i < row_size; i++)
+                    total[i] += w * s[i];
+                }
+            }
+        }
+
+      gimp_gegl_convolve_finish_row (total, data->dest + y * row_size, data);
+    }
+
+  g_free (temp);
+  g_free (total);
+}
+
+static void
+gimp_gegl_convolve_finish_row (const gdouble *total,
+                               gfloat        *dest,
+                               ConvolveData  *data)
+{
+  const gint    components  = data->components;
+  const gint    a_component = components - 1;
+  const gdouble divisor     = data->divisor;
+  gint          x, b;
+
+  for (x = 0; x < data->width; x++)
+    {
+      gdouble weighted_divisor = divisor;
+
+      if (data->alpha_weighting && total[a_component] != 0.0)
+        weighted_divisor = total[a_component];
+
+      for (b = 0; b < components; b++)
+        {
+          gdouble value;
+
+          if (data->alpha_weighting && b != a_component)
+            value = total[b] / weighted_divisor;
+          else
+            value = total[b] / divisor;
+
+          value += data->offset;
+
+          if (data->absolute)
+            value = fabs (value);
+
+          dest[b] = CLAMP (value, 0.0, 1.0);
+        }
+
+      total += components;
+      dest  += components;
+    }
+}
+
+/*  the coefficients of the recursive gaussian from I. T. Young and
+ *  L. J. van Vliet, "Recursive implementation of the Gaussian filter",
+ *  normalized so that coefs[0] is the input weight and coefs[1..3] the
+ *  weights of the three previous outputs
+ */
+static void
+gimp_gegl_gaussian_coefs (gdouble  std_dev,
+                          gdouble *coefs)
+{
+  gdouble q;
+  gdouble b0, b1, b2, b3;
+
+  if (std_dev >= 2.5)
+    q = 0.98711 * std_dev - 0.96330;
+  else
+    q = 3.97156 - 4.14554 * sqrt (1.0 - 0.26891 * MAX (std_dev, 0.5));
+
+  b0 = 1.57825 + 2.44413 * q + 1.4281 * SQR (q) + 0.422205 * q * SQR (q);
+  b1 = 2.44413 * q + 2.85619 * SQR (q) + 1.26661 * q * SQR (q);
+  b2 = -(1.4281 * SQR (q) + 1.26661 * q * SQR (q));
+  b3 = 0.422205 * q * SQR (q);
+
+  coefs[1] = b1 / b0;
+  coefs[2] = b2 / b0;
+  coefs[3] = b3 / b0;
+  coefs[0] = 1.0 - (coefs[1] + coefs[2] + coefs[3]);
+}
+
+/*  filters @n_lines adjacent lines of @length pixels, @stride apart,
+ *  in place: a causal pass followed by an anti-causal one, each
+ *  starting in the steady state of its first pixel, which extends the
+ *  edges
+ */
+static void
+gimp_gegl_gaussian_lines (gfloat        *data,
+                          gint           length,
+                          gint           stride,
+                          gint           n_lines,
+                          const gdouble *coefs)
+{
+  gdouble w1[GAUSSIAN_BLOCK_SIZE];
+  gdouble w2[GAUSSIAN_BLOCK_SIZE];
+  gdouble w3[GAUSSIAN_BLOCK_SIZE];
+  gfloat *p;
+  gint    i, k;
+
+  for (k = 0; k < n_lines; k++)
+    w1[k] = w2[k] = w3[k] = data[k];
+
+  for (i = 0, p = data; i < length; i++, p += stride)
+    {
+      for (k = 0; k < n_lines; k++)
+        {
+          gdouble w = (coefs[0] * p[k] +
+                       coefs[1] * w1[k] +
+                       coefs[2] * w2[k] +
+                       coefs[3] * w3[k]);
+
+          w3[k] = w2[k];
+          w2[k] = w1[k];
+          w1[k] = w;
+
+          p[k] = w;
+        }
+    }
+
+  p = data + (length - 1) * stride;
+
+  for (k = 0; k < n_lines; k++)
+    w1[k] = w2[k] = w3[k] = p[k];
+
+  for (i = 0; i < length; i++, p -= stride)
+    {
+      for (k = 0; k < n_lines; k++)
+        {
+          gdouble w = (coefs[0] * p[k] +
+                       coefs[1] * w1[k] +
+                       coefs[2] * w2[k] +
+                       coefs[3] * w3[k]);
+
+          w3[k] = w2[k];
+          w2[k] = w1[k];
+          w1[k] = w;
+
+          p[k] = w;
+        }
+    }
+}
+
+static void
+gimp_gegl_gaussian_rows (gint          offset,
+                         gint          size,
+                         GaussianData *data)
+{
+  gint y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gimp_gegl_gaussian_lines (data->data + y * data->width,
+                                data->width, 1, 1, data->coefs);
+    }
+}
+
+/*  the columns are filtered in blocks, so each step of the recursion
+ *  walks along a row of the block instead of jumping between rows
+ */
+static void
+gimp_gegl_gaussian_columns (gint          offset,
+                            gint          size,
+                            GaussianData *data)
+{
+  gint block;
+
+  for (block = offset; block < offset + size; block++)
+    {
+      gint x = block * GAUSSIAN_BLOCK_SIZE;
+
+      gimp_gegl_gaussian_lines (data->data + x,
+                                data->height, data->width,
+                                MIN (GAUSSIAN_BLOCK_SIZE, data->width - x),
+                                data->coefs);
+    }
+}
+
+static void
+gimp_gegl_dodgeburn_area (const GeglRectangle *area,
+                          DodgeBurnData       *data)
+{
+  GeglBufferIterator *iter;
+  gfloat              exposure = data->exposure;
+  gfloat              factor;
+
+  iter = gegl_buffer_iterator_new (data->src_buffer,
+                                   GEGL_RECTANGLE (data->src_rect->x + area->x,
+                                                   data->src_rect->y + area->y,
+                                                   area->width,
+                                                   area->height),
+                                   0, babl_format ("R'G'B'A float"),
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, data->dest_buffer,
+                            GEGL_RECTANGLE (data->dest_rect->x + area->x,
+                                            data->dest_rect->y + area->y,
+                                            area->width,
+                                            area->height),
+                            0, babl_format ("R'G'B'A float"),
+                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  switch (data->mode)
+    {
+    case GIMP_HIGHLIGHTS:
+      factor = 1.0 + exposure * (0.333333);
+
+      while (gegl_buffer_iterator_next (iter))
+        {
+          const gfloat *src   = iter->data[0];
+          gfloat       *dest  = iter->data[1];
+          gint          count = iter->length;
+
+          while (count--)
+            {
+              dest[0] = src[0] * factor;
+              dest[1] = src[1] * factor;
+              dest[2] = src[2] * factor;
+              dest[3] = src[3];
+
+              src  += 4;
+              dest += 4;
+            }
+        }
+      break;
+
+    case GIMP_MIDTONES:
+      if (exposure < 0)
+        factor = 1.0 - exposure * (0.333333);
+      else
+        factor = 1.0 / (1.0 + exposure);
+
+      while (gegl_buffer_iterator_next (iter))
+        {
+          const gfloat *src   = iter->data[0];
+          gfloat       *dest  = iter->data[1];
+          gint          count = iter->length;
+
+          while (count--)
+            {
+              dest[0] = pow (src[0], factor);
+              dest[1] = pow (src[1], factor);
+              dest[2] = pow (src[2], factor);
+              dest[3] = src[3];
+
+              src  += 4;
+              dest += 4;
+            }
+        }
+      break;
+
+    case GIMP_SHADOWS:
+      if (exposure >= 0)
+        {
+          factor = 0.333333 * exposure;
+
+          while (gegl_buffer_iterator_next (iter))
+            {
+              const gfloat *src   = iter->data[0];
+              gfloat       *dest  = iter->data[1];
+              gint          count = iter->length;
+
+              while (count--)
+                {
+                  dest[0] = factor + src[0] - factor * src[0];
+                  dest[1] = factor + src[1] - factor * src[1];
+                  dest[2] = factor + src[2] - factor * src[2];
+                  dest[3] = src[3];
+
+                  src  += 4;
+                  dest += 4;
+                }
+            }
+        }
+      else
+        {
+          gfloat scale;
+
+          factor = -0.333333 * exposure;
+          scale  = 1.0 / (1.0 - factor);
+
+          /*  values below factor become 0, factor <= value <= 1 is
+           *  stretched to 0..1
+           */
+          while (gegl_buffer_iterator_next (iter))
+            {
+              const gfloat *src   = iter->data[0];
+              gfloat       *dest  = iter->data[1];
+              gint          count = iter->length;
+
+              while (count--)
+                {
+                  dest[0] = MAX (src[0] - factor, 0.0f) * scale;
+                  dest[1] = MAX (src[1] - factor, 0.0f) * scale;
+                  dest[2] = MAX (src[2] - factor, 0.0f) * scale;
+                  dest[3] = src[3];
+
+                  src  += 4;
+                  dest += 4;
+                }
+            }
+        }
+      break;
+
+    default:
+      gegl_buffer_iterator_stop (iter);
+      break;
+    }
+}
+
+static void
+gimp_gegl_smudge_blend_area (const GeglRectangle *area,
+                             SmudgeBlendData     *data)
+{
+  GeglBufferIterator *iter;
+  const gfloat        blend1 = 1.0 - data->blend;
+  const gfloat        blend2 = data->blend;
+
+  iter = gegl_buffer_iterator_new (data->top_buffer,
+                                   GEGL_RECTANGLE (data->top_rect->x + area->x,
+                                                   data->top_rect->y + area->y,
+                                                   area->width,
+                                                   area->height),
+                                   0, babl_format ("RGBA float"),
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, data->bottom_buffer,
+                            GEGL_RECTANGLE (data->bottom_rect->x + area->x,
+                                            data->bottom_rect->y + area->y,
+                                            area->width,
+                                            area->height),
+                            0, babl_format ("RGBA float"),
+                            GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, data->dest_buffer,
+                            GEGL_RECTANGLE (data->dest_rect->x + area->x,
+                                            data->dest_rect->y + area->y,
+                                            area->width,
+                                            area->height),
+                            0, babl_format ("RGBA float"),
+                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *top    = iter->data[0];
+      const gfloat *bottom = iter->data[1];
+      gfloat       *dest   = iter->data[2];
+      gint          count  = iter->length;
+
+      while (count--)
+        {
+          const gfloat a1 = blend1 * bottom[3];
+          const gfloat a2 = blend2 * top[3];
+          const gfloat a  = a1 + a2;
+
+          /*  bottom + (bottom * a1 + top * a2 - a * bottom), which
+           *  simplifies to a plain interpolation by a2
+           */
+          if (a == 0)
+            {
+              dest[0] = 0;
+              dest[1] = 0;
+              dest[2] = 0;
+              dest[3] = 0;
+            }
+          else
+            {
+              dest[0] = bottom[0] + a2 * (top[0] - bottom[0]);
+              dest[1] = bottom[1] + a2 * (top[1] - bottom[1]);
+              dest[2] = bottom[2] + a2 * (top[2] - bottom[2]);
+              dest[3] = a;
+            }
+
+          top    += 4;
+          bottom += 4;
+          dest   += 4;
+        }
+    }
+}
@@ -22,8 +22,8 @@
 #define __GIMP_GEGL_LOOPS_H__
 
 
-/*  this is a pretty stupid port of concolve_region() that only works
- *  on a linear source buffer
+/*  a port of convolve_region(), for square kernels of any odd size,
+ *  which are applied in two passes when they are separable
  */
 void   gimp_gegl_convolve           (GeglBuffer          *src_buffer,
                                      const GeglRectangle *src_rect,
@@ -35,6 +35,17 @@ void   gimp_gegl_convolve           (GeglBuffer          *src_buffer,
                                      GimpConvolutionType  mode,
                                      gboolean             alpha_weighting);
 
+/*  a recursive (Young/van Vliet) gaussian blur for single-channel
+ *  masks, which costs the same per pixel for any standard deviation.
+ *  The edge pixels of @src_rect are extended.
+ */
+void   gimp_gegl_gaussian_blur_mask (GeglBuffer          *src_buffer,
+                                     const GeglRectangle *src_rect,
+                                     GeglBuffer          *dest_buffer,
+                                     const GeglRectangle *dest_rect,
+                                     gdouble              std_dev_x,
+                                     gdouble              std_dev_y);
+
 void   gimp_gegl_dodgeburn          (GeglBuffer          *src_buffer,
                                      const GeglRectangle *src_rect,
                                      GeglBuffer          *dest_buffer,
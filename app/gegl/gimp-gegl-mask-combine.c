@@ -28,6 +28,42 @@
 #include "gimp-gegl-types.h"
 
 #include "gimp-gegl-mask-combine.h"
+#include "gimp-gegl-parallel.h"
+
+
+/* split the combining into parts of at least this many pixels */
+#define MIN_PARALLEL_PIXELS (64 * 64)
+
+
+typedef struct
+{
+  GeglBuffer     *mask;
+  GimpChannelOps  op;
+  gint            x;
+  gint            y;
+  gint            w;
+  gint            h;
+  gdouble         a;
+  gdouble         b;
+  gdouble         a_sqr;
+  gdouble         b_sqr;
+  gboolean        antialias;
+} EllipseRectData;
+
+typedef struct
+{
+  GeglBuffer     *mask;
+  GeglBuffer     *add_on;
+  GimpChannelOps  op;
+  gint            off_x;
+  gint            off_y;
+} CombineBufferData;
+
+
+static void   gimp_gegl_mask_combine_ellipse_rect_area (const GeglRectangle *area,
+                                                        EllipseRectData     *data);
+static void   gimp_gegl_mask_combine_buffer_area       (const GeglRectangle *area,
+                                                        CombineBufferData   *data);
 
 
 gboolean
@@ -107,32 +143,26 @@ gimp_gegl_mask_combine_span (gfloat         *data,
     case GIMP_CHANNEL_OP_REPLACE:
       if (value == 1.0)
         {
-          while (x1 < x2)
-            data[x1++] = 1.0;
+          for (; x1 < x2; x1++)
+            data[x1] = 1.0f;
         }
       else
         {
-          while (x1 < x2)
-            {
-              const gfloat val = data[x1] + value;
-              data[x1++] = val > 1.0 ? 1.0 : val;
-            }
+          for (; x1 < x2; x1++)
+            data[x1] = MIN (data[x1] + value, 1.0f);
         }
       break;
 
     case GIMP_CHANNEL_OP_SUBTRACT:
       if (value == 1.0)
         {
-          while (x1 < x2)
-            data[x1++] = 0.0;
+          for (; x1 < x2; x1++)
+            data[x1] = 0.0f;
         }
       else
         {
-          while (x1 < x2)
-            {
-              const gfloat val = data[x1] - value;
-              data[x1++] = val > 0.0 ? val : 0.0;
-            }
+          for (; x1 < x2; x1++)
+            data[x1] = MAX (data[x1] - value, 0.0f);
         }
       break;
 
@@ -142,6 +172,156 @@ gimp_gegl_mask_combine_span (gfloat         *data,
     }
 }
 
+/* algorithm changed 7-18-04, because the previous one did not work
+ * well for eccentric ellipses.  The new algorithm measures the
+ * distance to the ellipse in the X and Y directions, and uses
+ * trigonometry to approximate the distance to the ellipse as the
+ * distance to the hypotenuse of a right triangle whose legs are the X
+ * and Y distances.  (WES)
+ */
+static inline gfloat
+gimp_gegl_mask_ellipse_coverage (const EllipseRectData *data,
+                                 gfloat                 xj,
+                                 gfloat                 yi)
+{
+  gfloat xdist;
+  gfloat ydist;
+  gfloat r;
+  gfloat dist;
+
+  if (yi < data->b)
+    xdist = xj - data->a * sqrt (1 - SQR (yi) / data->b_sqr);
+  else
+    xdist = 1000.0;  /* anything large will work */
+
+  if (xj < data->a)
+    ydist = yi - data->b * sqrt (1 - SQR (xj) / data->a_sqr);
+  else
+    ydist = 1000.0;  /* anything large will work */
+
+  r = hypot (xdist, ydist);
+
+  if (r < 0.001)
+    dist = 0.0;
+  else
+    dist = xdist * ydist / r; /* trig formula for distance to hypotenuse */
+
+  if (xdist < 0.0)
+    dist *= -1;
+
+  if (dist < -0.5)
+    return 1.0;
+  else if (dist < 0.5)
+    return (1.0 - (dist + 0.5));
+  else
+    return 0.0;
+}
+
+/*  0 outside, 1 on the edge, 2 inside the corner's ellipse  */
+static inline gint
+gimp_gegl_mask_ellipse_level (const EllipseRectData *data,
+                              gint                   px,
+                              gdouble                center_x,
+                              gfloat                 yi)
+{
+  const gfloat val = gimp_gegl_mask_ellipse_coverage (data,
+                                                      ABS (px + 0.5 - center_x),
+                                                      yi);
+
+  return val == 0.0 ? 0 : val == 1.0 ? 2 : 1;
+}
+
+/*  the coverage only grows towards the corner's center, so the pixel
+ *  where a run of pixels on one side of it reaches (@towards_center)
+ *  or leaves a level can be found by bisection
+ */
+static gint
+gimp_gegl_mask_ellipse_search (const EllipseRectData *data,
+                               gint                   x1,
+                               gint                   x2,
+                               gdouble                center_x,
+                               gfloat                 yi,
+                               gint                   level,
+                               gboolean               towards_center)
+{
+  while (x1 < x2)
+    {
+      gint px = x1 + (x2 - x1) / 2;
+      gint l  = gimp_gegl_mask_ellipse_level (data, px, center_x, yi);
+
+      if (towards_center ? l >= level : l <= level)
+        x2 = px;
+      else
+        x1 = px + 1;
+    }
+
+  return x1;
+}
+
+static void
+gimp_gegl_mask_combine_ellipse_edge (gfloat                *row,
+                                     gint                   row_x,
+                                     const EllipseRectData *data,
+                                     gint                   x1,
+                                     gint                   x2,
+                                     gdouble                center_x,
+                                     gfloat                 yi)
+{
+  gint inside_x1;
+  gint inside_x2;
+  gint edge_x1;
+  gint edge_x2;
+  gint px;
+
+  if (x2 <= x1)
+    return;
+
+  if (x2 <= ceil (center_x - 0.5))
+    {
+      /*  left of the center: outside, edge, inside  */
+      edge_x1   = gimp_gegl_mask_ellipse_search (data, x1, x2, center_x, yi,
+                                                 1, TRUE);
+      edge_x2   = gimp_gegl_mask_ellipse_search (data, edge_x1, x2,
+                                                 center_x, yi, 2, TRUE);
+      inside_x1 = edge_x2;
+      inside_x2 = x2;
+    }
+  else if (x1 >= ceil (center_x - 0.5))
+    {
+      /*  right of the center: inside, edge, outside  */
+      inside_x1 = x1;
+      inside_x2 = gimp_gegl_mask_ellipse_search (data, x1, x2, center_x, yi,
+                                                 1, FALSE);
+      edge_x1   = inside_x2;
+      edge_x2   = gimp_gegl_mask_ellipse_search (data, edge_x1, x2,
+                                                 center_x, yi, 0, FALSE);
+    }
+  else
+    {
+      gint center = ceil (center_x - 0.5);
+
+      gimp_gegl_mask_combine_ellipse_edge (row, row_x, data,
+                                           x1, center, center_x, yi);
+      gimp_gegl_mask_combine_ellipse_edge (row, row_x, data,
+                                           center, x2, center_x, yi);
+      return;
+    }
+
+  /*  only the edge pixels need their coverage, the inside is a span  */
+  for (px = edge_x1; px < edge_x2; px++)
+    {
+      gfloat val = gimp_gegl_mask_ellipse_coverage (data,
+                                                    ABS (px + 0.5 - center_x),
+                                                    yi);
+
+      gimp_gegl_mask_combine_span (row, data->op,
+                                   px - row_x, px - row_x + 1, val);
+    }
+
+  gimp_gegl_mask_combine_span (row, data->op,
+                               inside_x1 - row_x, inside_x2 - row_x, 1.0);
+}
+
 /**
  * gimp_gegl_mask_combine_ellipse_rect:
  * @mask:      the channel with which to combine the elliptic rect
@@ -173,56 +353,154 @@ gimp_gegl_mask_combine_ellipse_rect (GeglBuffer     *mask,
                                      gdouble         b,
                                      gboolean        antialias)
 {
-  GeglBufferIterator *iter;
-  GeglRectangle      *roi;
-  gdouble             a_sqr;
-  gdouble             b_sqr;
-  gdouble             ellipse_center_x;
-  gint                x0, y0;
-  gint                width, height;
+  EllipseRectData data;
+  gint            x0, y0;
+  gint            width, height;
 
   g_return_val_if_fail (GEGL_IS_BUFFER (mask), FALSE);
   g_return_val_if_fail (a >= 0.0 && b >= 0.0, FALSE);
   g_return_val_if_fail (op != GIMP_CHANNEL_OP_INTERSECT, FALSE);
 
+  if (! gimp_rectangle_intersect (x, y, w, h,
+                                  0, 0,
+                                  gegl_buffer_get_width  (mask),
+                                  gegl_buffer_get_height (mask),
+                                  &x0, &y0, &width, &height))
+    return FALSE;
+
+  data.mask      = mask;
+  data.op        = op;
+  data.x         = x;
+  data.y         = y;
+  data.w         = w;
+  data.h         = h;
+  data.antialias = antialias;
+
   /* Make sure the elliptic corners fit into the rect */
-  a = MIN (a, w / 2.0);
-  b = MIN (b, h / 2.0);
+  data.a = MIN (a, w / 2.0);
+  data.b = MIN (b, h / 2.0);
 
-  a_sqr = SQR (a);
-  b_sqr = SQR (b);
+  data.a_sqr = SQR (data.a);
+  data.b_sqr = SQR (data.b);
 
-  if (! gimp_rectangle_intersect (x, y, w, h,
+  gimp_gegl_parallel_distribute_area (GEGL_RECTANGLE (x0, y0, width, height),
+                                      MIN_PARALLEL_PIXELS,
+                                      (GimpGeglParallelAreaFunc)
+                                      gimp_gegl_mask_combine_ellipse_rect_area,
+                                      &data);
+
+  return TRUE;
+}
+
+gboolean
+gimp_gegl_mask_combine_buffer (GeglBuffer     *mask,
+                               GeglBuffer     *add_on,
+                               GimpChannelOps  op,
+                               gint            off_x,
+                               gint            off_y)
+{
+  CombineBufferData data;
+  gint              x, y, w, h;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (mask), FALSE);
+  g_return_val_if_fail (GEGL_IS_BUFFER (add_on), FALSE);
+
+  if (! gimp_rectangle_intersect (off_x, off_y,
+                                  gegl_buffer_get_width  (add_on),
+                                  gegl_buffer_get_height (add_on),
                                   0, 0,
                                   gegl_buffer_get_width  (mask),
                                   gegl_buffer_get_height (mask),
-                                  &x0, &y0, &width, &height))
+                                  &x, &y, &w, &h))
     return FALSE;
 
-  ellipse_center_x = x + a;
+  switch (op)
+    {
+    case GIMP_CHANNEL_OP_ADD:
+    case GIMP_CHANNEL_OP_SUBTRACT:
+    case GIMP_CHANNEL_OP_REPLACE:
+    case GIMP_CHANNEL_OP_INTERSECT:
+      break;
+
+    default:
+      g_warning ("%s: unknown operation type", G_STRFUNC);
+      return TRUE;
+    }
+
+  data.mask   = mask;
+  data.add_on = add_on;
+  data.op     = op;
+  data.off_x  = off_x;
+  data.off_y  = off_y;
+
+  gimp_gegl_parallel_distribute_area (GEGL_RECTANGLE (x, y, w, h),
+                                      MIN_PARALLEL_PIXELS,
+                                      (GimpGeglParallelAreaFunc)
+                                      gimp_gegl_mask_combine_buffer_area,
+                                      &data);
+
+  return TRUE;
+}
+
+
+/*  private functions  */
+
+static void
+gimp_gegl_mask_combine_ellipse_rect_area (const GeglRectangle *area,
+                                          EllipseRectData     *data)
+{
+  GeglBufferIterator *iter;
+  GeglRectangle      *roi;
+  const gint          x = data->x;
+  const gint          y = data->y;
+  const gint          w = data->w;
+  const gint          h = data->h;
+  const gdouble       a = data->a;
+  const gdouble       b = data->b;
+  gint                straight_x1;
+  gint                straight_x2;
+  gint                left_x2;
+  gint                right_x1;
+
+  /*  the pixels of the straight segment between rounded corners, and
+   *  those measured against the left and right corners' centers
+   */
+  straight_x1 = ceil (x + a);
+  straight_x2 = ceil (x + w - a);
+
+  if (straight_x1 < straight_x2)
+    {
+      left_x2  = straight_x1;
+      right_x1 = straight_x2;
+    }
+  else
+    {
+      left_x2  = x + w / 2;
+      right_x1 = x + w / 2;
+    }
 
-  iter = gegl_buffer_iterator_new (mask,
-                                   GEGL_RECTANGLE (x0, y0, width, height), 0,
+  iter = gegl_buffer_iterator_new (data->mask, area, 0,
                                    babl_format ("Y float"),
                                    GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
   roi = &iter->roi[0];
 
   while (gegl_buffer_iterator_next (iter))
     {
-      gfloat *data = iter->data[0];
+      gfloat *row = iter->data[0];
       gint    py;
 
       for (py = roi->y;
            py < roi->y + roi->height;
-           py++, data += roi->width)
+           py++, row += roi->width)
         {
           const gint px = roi->x;
+          const gint ex = roi->x + roi->width;
           gdouble    ellipse_center_y;
 
           if (py >= y + b && py < y + h - b)
             {
               /*  we are on a row without rounded corners  */
-              gimp_gegl_mask_combine_span (data, op, 0, roi->width, 1.0);
+              gimp_gegl_mask_combine_span (row, data->op, 0, roi->width, 1.0);
               continue;
             }
 
@@ -240,235 +518,89 @@ gimp_gegl_mask_combine_ellipse_rect (GeglBuffer     *mask,
            * for an ellipse with an arbitrary center
            * (ellipse_center_x, ellipse_center_y).
            */
-          if (! antialias)
+          if (! data->antialias)
             {
               gdouble half_ellipse_width_at_y;
               gint    x_start;
               gint    x_end;
 
               half_ellipse_width_at_y =
-                sqrt (a_sqr -
-                      a_sqr * SQR (py + 0.5f - ellipse_center_y) / b_sqr);
+                sqrt (data->a_sqr -
+                      data->a_sqr * SQR (py + 0.5f - ellipse_center_y) /
+                      data->b_sqr);
 
-              x_start = ROUND (ellipse_center_x - half_ellipse_width_at_y);
-              x_end   = ROUND (ellipse_center_x + w - 2 * a +
-                               half_ellipse_width_at_y);
+              x_start = ROUND (x + a - half_ellipse_width_at_y);
+              x_end   = ROUND (x + w - a + half_ellipse_width_at_y);
 
-              gimp_gegl_mask_combine_span (data, op,
+              gimp_gegl_mask_combine_span (row, data->op,
                                            MAX (x_start - px, 0),
                                            MIN (x_end   - px, roi->width), 1.0);
             }
           else  /* use antialiasing */
             {
-              /* algorithm changed 7-18-04, because the previous one
-               * did not work well for eccentric ellipses.  The new
-               * algorithm measures the distance to the ellipse in the
-               * X and Y directions, and uses trigonometry to
-               * approximate the distance to the ellipse as the
-               * distance to the hypotenuse of a right triangle whose
-               * legs are the X and Y distances.  (WES)
-               */
-              const gfloat yi       = ABS (py + 0.5 - ellipse_center_y);
-              gfloat       last_val = -1;
-              gint         x_start  = px;
-              gint         cur_x;
-
-              for (cur_x = px; cur_x < (px + roi->width); cur_x++)
-                {
-                  gfloat  xj;
-                  gfloat  xdist;
-                  gfloat  ydist;
-                  gfloat  r;
-                  gfloat  dist;
-                  gfloat  val;
-
-                  if (cur_x < x + w / 2)
-                    {
-                      ellipse_center_x = x + a;
-                    }
-                  else
-                    {
-                      ellipse_center_x = x + w - a;
-                    }
-
-                  xj = ABS (cur_x + 0.5 - ellipse_center_x);
-
-                  if (yi < b)
-                    xdist = xj - a * sqrt (1 - SQR (yi) / b_sqr);
-                  else
-                    xdist = 1000.0;  /* anything large will work */
-
-                  if (xj < a)
-                    ydist = yi - b * sqrt (1 - SQR (xj) / a_sqr);
-                  else
-                    ydist = 1000.0;  /* anything large will work */
-
-                  r = hypot (xdist, ydist);
-
-                  if (r < 0.001)
-                    dist = 0.0;
-                  else
-                    dist = xdist * ydist / r; /* trig formula for distance to
-                                               * hypotenuse
-                                               */
-
-                  if (xdist < 0.0)
-                    dist *= -1;
-
-                  if (dist < -0.5)
-                    val = 1.0;
-                  else if (dist < 0.5)
-                    val = (1.0 - (dist + 0.5));
-                  else
-                    val = 0.0;
-
-                  if (last_val != val)
-                    {
-                      if (last_val != -1)
-                        gimp_gegl_mask_combine_span (data, op,
-                                                     MAX (x_start - px, 0),
-                                                     MIN (cur_x   - px, roi->width),
-                                                     last_val);
-
-                      x_start = cur_x;
-                      last_val = val;
-                    }
-
-                  /*  skip ahead if we are on the straight segment
-                   *  between rounded corners
-                   */
-                  if (cur_x >= x + a && cur_x < x + w - a)
-                    {
-                      gimp_gegl_mask_combine_span (data, op,
-                                                   MAX (x_start - px, 0),
-                                                   MIN (cur_x   - px, roi->width),
-                                                   last_val);
-
-                      x_start = cur_x;
-                      cur_x = x + w - a;
-                      last_val = val = 1.0;
-                    }
-
-                  /* Time to change center? */
-                  if (cur_x >= x + w / 2)
-                    {
-                      ellipse_center_x = x + w - a;
-                    }
-                }
-
-              gimp_gegl_mask_combine_span (data, op,
-                                           MAX (x_start - px, 0),
-                                           MIN (cur_x   - px, roi->width),
-                                           last_val);
+              const gfloat yi = ABS (py + 0.5 - ellipse_center_y);
+
+              gimp_gegl_mask_combine_ellipse_edge (row, px, data,
+                                                   MAX (x, px),
+                                                   MIN (left_x2, ex),
+                                                   x + a, yi);
+
+              gimp_gegl_mask_combine_span (row, data->op,
+                                           MAX (straight_x1, px) - px,
+                                           MIN (straight_x2, ex) - px,
+                                           1.0);
+
+              gimp_gegl_mask_combine_ellipse_edge (row, px, data,
+                                                   MAX (right_x1, px),
+                                                   MIN (x + w, ex),
+                                                   x + w - a, yi);
             }
         }
     }
-
-  return TRUE;
 }
 
-gboolean
-gimp_gegl_mask_combine_buffer (GeglBuffer     *mask,
-                               GeglBuffer     *add_on,
-                               GimpChannelOps  op,
-                               gint            off_x,
-                               gint            off_y)
+static void
+gimp_gegl_mask_combine_buffer_area (const GeglRectangle *area,
+                                    CombineBufferData   *data)
 {
   GeglBufferIterator *iter;
-  GeglRectangle       rect;
-  gint                x, y, w, h;
-
-  g_return_val_if_fail (GEGL_IS_BUFFER (mask), FALSE);
-  g_return_val_if_fail (GEGL_IS_BUFFER (add_on), FALSE);
 
-  if (! gimp_rectangle_intersect (off_x, off_y,
-                                  gegl_buffer_get_width  (add_on),
-                                  gegl_buffer_get_height (add_on),
-                                  0, 0,
-                                  gegl_buffer_get_width  (mask),
-                                  gegl_buffer_get_height (mask),
-                                  &x, &y, &w, &h))
-    return FALSE;
-
-  rect.x      = x;
-  rect.y      = y;
-  rect.width  = w;
-  rect.height = h;
-
-  iter = gegl_buffer_iterator_new (mask, &rect, 0,
+  iter = gegl_buffer_iterator_new (data->mask, area, 0,
                                    babl_format ("Y float"),
                                    GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
 
-  rect.x -= off_x;
-  rect.y -= off_y;
-
-  gegl_buffer_iterator_add (iter, add_on, &rect, 0,
+  gegl_buffer_iterator_add (iter, data->add_on,
+                            GEGL_RECTANGLE (area->x - data->off_x,
+                                            area->y - data->off_y,
+                                            area->width, area->height), 0,
                             babl_format ("Y float"),
                             GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
-  switch (op)
+  while (gegl_buffer_iterator_next (iter))
     {
-    case GIMP_CHANNEL_OP_ADD:
-    case GIMP_CHANNEL_OP_REPLACE:
-      while (gegl_buffer_iterator_next (iter))
-        {
-          gfloat       *mask_data   = iter->data[0];
-          const gfloat *add_on_data = iter->data[1];
-          gint          count       = iter->length;
-
-          while (count--)
-            {
-              const gfloat val = *mask_data + *add_on_data;
-
-              *mask_data = CLAMP (val, 0.0, 1.0);
-
-              add_on_data++;
-              mask_data++;
-            }
-        }
-      break;
-
-    case GIMP_CHANNEL_OP_SUBTRACT:
-      while (gegl_buffer_iterator_next (iter))
-        {
-          gfloat       *mask_data   = iter->data[0];
-          const gfloat *add_on_data = iter->data[1];
-          gint          count       = iter->length;
-
-          while (count--)
-            {
-              if (*add_on_data > *mask_data)
-                *mask_data = 0.0;
-              else
-                *mask_data -= *add_on_data;
+      gfloat       *mask_data   = iter->data[0];
+      const gfloat *add_on_data = iter->data[1];
+      gint          count       = iter->length;
+      gint          i;
 
-              add_on_data++;
-              mask_data++;
-            }
-        }
-      break;
-
-    case GIMP_CHANNEL_OP_INTERSECT:
-      while (gegl_buffer_iterator_next (iter))
+      /*  keep the loops free of branches, so they can be vectorized  */
+      switch (data->op)
         {
-          gfloat       *mask_data   = iter->data[0];
-          const gfloat *add_on_data = iter->data[1];
-          gint          count       = iter->length;
-
-          while (count--)
-            {
-              *mask_data = MIN (*mask_data, *add_on_data);
-
-              add_on_data++;
-              mask_data++;
-            }
+        case GIMP_CHANNEL_OP_ADD:
+        case GIMP_CHANNEL_OP_REPLACE:
+          for (i = 0; i < count; i++)
+            mask_data[i] = CLAMP (mask_data[i] + add_on_data[i], 0.0f, 1.0f);
+          break;
+
+        case GIMP_CHANNEL_OP_SUBTRACT:
+          for (i = 0; i < count; i++)
+            mask_data[i] = MAX (mask_data[i] - add_on_data[i], 0.0f);
+          break;
+
+        case GIMP_CHANNEL_OP_INTERSECT:
+          for (i = 0; i < count; i++)
+            mask_data[i] = MIN (mask_data[i], add_on_data[i]);
+          break;
         }
-      break;
-
-    default:
-      g_warning ("%s: unknown operation type", G_STRFUNC);
-      break;
     }
-
-  return TRUE;
 }
@@ -153,3 +153,103 @@ gimp_gegl_mask_is_empty (GeglBuffer *buffer)
 
   return TRUE;
 }
+
+/*  computes the bounds of the non-empty pixels within @area, and
+ *  whether all of them are fully selected. Returns FALSE if the area
+ *  is empty.
+ */
+gboolean
+gimp_gegl_mask_area_bounds (GeglBuffer          *buffer,
+                            const GeglRectangle *area,
+                            gboolean            *full,
+                            gint                *x1,
+                            gint                *y1,
+                            gint                *x2,
+                            gint                *y2)
+{
+  GeglBufferIterator *iter;
+  GeglRectangle      *roi;
+  gboolean            is_full = TRUE;
+  gint                tx1, tx2, ty1, ty2;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (area != NULL, FALSE);
+  g_return_val_if_fail (x1 != NULL, FALSE);
+  g_return_val_if_fail (y1 != NULL, FALSE);
+  g_return_val_if_fail (x2 != NULL, FALSE);
+  g_return_val_if_fail (y2 != NULL, FALSE);
+
+  tx1 = G_MAXINT;
+  ty1 = G_MAXINT;
+  tx2 = G_MININT;
+  ty2 = G_MININT;
+
+  iter = gegl_buffer_iterator_new (buffer, area, 0, babl_format ("Y float"),
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  roi = &iter->roi[0];
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data = iter->data[0];
+      gint          y;
+
+      for (y = 0; y < roi->height; y++, data += roi->width)
+        {
+          gint first;
+          gint last;
+
+          if (is_full)
+            {
+              for (first = 0; first < roi->width; first++)
+                {
+                  if (data[first] < 1.0)
+                    {
+                      is_full = FALSE;
+                      break;
+                    }
+                }
+            }
+
+          if (is_full)
+            {
+              first = 0;
+              last  = roi->width - 1;
+            }
+          else
+            {
+              for (first = 0; first < roi->width && ! data[first]; first++);
+
+              if (first == roi->width)
+                continue;
+
+              for (last = roi->width - 1; ! data[last]; last--);
+            }
+
+          tx1 = MIN (tx1, roi->x + first);
+          tx2 = MAX (tx2, roi->x + last + 1);
+
+          ty1 = MIN (ty1, roi->y + y);
+          ty2 = MAX (ty2, roi->y + y + 1);
+        }
+    }
+
+  if (full)
+    *full = is_full && tx1 < tx2;
+
+  if (tx1 >= tx2)
+    {
+      *x1 = area->x;
+      *y1 = area->y;
+      *x2 = area->x + area->width;
+      *y2 = area->y + area->height;
+
+      return FALSE;
+    }
+
+  *x1 = tx1;
+  *y1 = ty1;
+  *x2 = tx2;
+  *y2 = ty2;
+
+  return TRUE;
+}
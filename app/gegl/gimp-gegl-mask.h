@@ -26,5 +26,13 @@ gboolean   gimp_gegl_mask_bounds   (GeglBuffer *buffer,
                                     gint        *y2);
 gboolean   gimp_gegl_mask_is_empty (GeglBuffer *buffer);
 
+gboolean   gimp_gegl_mask_area_bounds (GeglBuffer          *buffer,
+                                       const GeglRectangle *area,
+                                       gboolean            *full,
+                                       gint                *x1,
+                                       gint                *y1,
+                                       gint                *x2,
+                                       gint                *y2);
+
 
 #endif /* __GIMP_GEGL_MASK_H__ */
@@ -0,0 +1,283 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-gegl-parallel.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "gimp-gegl-types.h"
+
+#include "gimp-gegl-parallel.h"
+
+
+#define GIMP_GEGL_PARALLEL_MAX_THREADS 64
+
+
+typedef struct
+{
+  GimpGeglParallelFunc  func;
+  gpointer              user_data;
+  gint                  i;
+  gint                  n;
+} ParallelTask;
+
+typedef struct
+{
+  GimpGeglParallelRangeFunc  func;
+  gpointer                   user_data;
+  gint                       size;
+} ParallelRangeData;
+
+typedef struct
+{
+  GimpGeglParallelAreaFunc  func;
+  gpointer                  user_data;
+  const GeglRectangle      *area;
+  gboolean                  split_rows;
+} ParallelAreaData;
+
+
+static gpointer gimp_gegl_parallel_thread_func (ParallelTask *task);
+static void     gimp_gegl_parallel_range_func  (gint          i,
+                                                gint          n,
+                                                gpointer      user_data);
+static void     gimp_gegl_parallel_area_func   (gint          i,
+                                                gint          n,
+                                                gpointer      user_data);
+
+
+/*  set on threads which are already running a distributed task, so
+ *  that nested calls run serially instead of oversubscribing the CPU
+ */
+static GPrivate parallel_nested = G_PRIVATE_INIT (NULL);
+
+
+/*  public functions  */
+
+gint
+gimp_gegl_parallel_get_n_threads (void)
+{
+  gint n_threads = 1;
+
+  g_object_get (gegl_config (),
+                "threads", &n_threads,
+                NULL);
+
+  return CLAMP (n_threads, 1, GIMP_GEGL_PARALLEL_MAX_THREADS);
+}
+
+/**
+ * gimp_gegl_parallel_distribute:
+ * @max_n:     the maximal number of parts to split the work into
+ * @func:      the function to call for each part
+ * @user_data: user data for @func
+ *
+ * Calls @func with indices 0 to n - 1, where n is at most @max_n and
+ * the number of threads GEGL is configured to use, each call on its
+ * own thread. Returns when all calls have finished.
+ **/
+void
+gimp_gegl_parallel_distribute (gint                 max_n,
+                               GimpGeglParallelFunc func,
+                               gpointer             user_data)
+{
+  ParallelTask  tasks[GIMP_GEGL_PARALLEL_MAX_THREADS];
+  GThread      *threads[GIMP_GEGL_PARALLEL_MAX_THREADS];
+  gint          n;
+  gint          i;
+
+  g_return_if_fail (func != NULL);
+
+  n = MIN (max_n, gimp_gegl_parallel_get_n_threads ());
+
+  if (n <= 1 || g_private_get (&parallel_nested))
+    {
+      func (0, 1, user_data);
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      tasks[i].func      = func;
+      tasks[i].user_data = user_data;
+      tasks[i].i         = i;
+      tasks[i].n         = n;
+    }
+
+  for (i = 1; i < n; i++)
+    {
+      threads[i] = g_thread_new ("gimp-gegl-parallel",
+                                 (GThreadFunc) gimp_gegl_parallel_thread_func,
+                                 &tasks[i]);
+    }
+
+  gimp_gegl_parallel_thread_func (&tasks[0]);
+
+  for (i = 1; i < n; i++)
+    g_thread_join (threads[i]);
+}
+
+/**
+ * gimp_gegl_parallel_distribute_range:
+ * @size:         the size of the range
+ * @min_sub_size: the minimal size of a sub-range, or 0
+ * @func:         the function to call for each sub-range
+ * @user_data:    user data for @func
+ *
+ * Splits the range [0, @size) into consecutive sub-ranges of at least
+ * @min_sub_size elements, and calls @func for each of them in
+ * parallel.
+ **/
+void
+gimp_gegl_parallel_distribute_range (gint                      size,
+                                     gint                      min_sub_size,
+                                     GimpGeglParallelRangeFunc func,
+                                     gpointer                  user_data)
+{
+  ParallelRangeData data;
+  gint              max_n;
+
+  g_return_if_fail (size >= 0);
+  g_return_if_fail (func != NULL);
+
+  if (size == 0)
+    return;
+
+  if (min_sub_size > 0)
+    max_n = MAX (size / min_sub_size, 1);
+  else
+    max_n = size;
+
+  if (max_n == 1)
+    {
+      func (0, size, user_data);
+      return;
+    }
+
+  data.func      = func;
+  data.user_data = user_data;
+  data.size      = size;
+
+  gimp_gegl_parallel_distribute (max_n, gimp_gegl_parallel_range_func, &data);
+}
+
+/**
+ * gimp_gegl_parallel_distribute_area:
+ * @area:         the area to process
+ * @min_sub_area: the minimal number of pixels of a sub-area, or 0
+ * @func:         the function to call for each sub-area
+ * @user_data:    user data for @func
+ *
+ * Splits @area into horizontal (or, for wide and short areas,
+ * vertical) bands of at least @min_sub_area pixels, and calls @func
+ * for each of them in parallel.
+ **/
+void
+gimp_gegl_parallel_distribute_area (const GeglRectangle      *area,
+                                    gint                      min_sub_area,
+                                    GimpGeglParallelAreaFunc  func,
+                                    gpointer                  user_data)
+{
+  ParallelAreaData data;
+  gint64           n_pixels;
+  gint             max_n;
+
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  n_pixels = (gint64) area->width * area->height;
+
+  data.func       = func;
+  data.user_data  = user_data;
+  data.area       = area;
+  data.split_rows = area->height >= area->width ||
+                    area->height >= gimp_gegl_parallel_get_n_threads ();
+
+  if (min_sub_area > 0)
+    max_n = MIN (n_pixels / min_sub_area, G_MAXINT);
+  else
+    max_n = G_MAXINT;
+
+  max_n = MIN (max_n, data.split_rows ? area->height : area->width);
+
+  if (max_n <= 1)
+    {
+      func (area, user_data);
+      return;
+    }
+
+  gimp_gegl_parallel_distribute (max_n, gimp_gegl_parallel_area_func, &data);
+}
+
+
+/*  private functions  */
+
+static gpointer
+gimp_gegl_parallel_thread_func (ParallelTask *task)
+{
+  g_private_set (&parallel_nested, GINT_TO_POINTER (TRUE));
+
+  task->func (task->i, task->n, task->user_data);
+
+  g_private_set (&parallel_nested, NULL);
+
+  return NULL;
+}
+
+static void
+gimp_gegl_parallel_range_func (gint     i,
+                               gint     n,
+                               gpointer user_data)
+{
+  ParallelRangeData *data   = user_data;
+  gint               offset = (gint64) data->size * i       / n;
+  gint               end    = (gint64) data->size * (i + 1) / n;
+
+  data->func (offset, end - offset, data->user_data);
+}
+
+static void
+gimp_gegl_parallel_area_func (gint     i,
+                              gint     n,
+                              gpointer user_data)
+{
+  ParallelAreaData    *data = user_data;
+  const GeglRectangle *area = data->area;
+  GeglRectangle        sub_area;
+
+  if (data->split_rows)
+    {
+      gint y1 = area->y + (gint64) area->height * i       / n;
+      gint y2 = area->y + (gint64) area->height * (i + 1) / n;
+
+      gegl_rectangle_set (&sub_area, area->x, y1, area->width, y2 - y1);
+    }
+  else
+    {
+      gint x1 = area->x + (gint64) area->width * i       / n;
+      gint x2 = area->x + (gint64) area->width * (i + 1) / n;
+
+      gegl_rectangle_set (&sub_area, x1, area->y, x2 - x1, area->height);
+    }
+
+  data->func (&sub_area, data->user_data);
+}
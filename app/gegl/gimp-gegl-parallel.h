@@ -0,0 +1,49 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-gegl-parallel.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_GEGL_PARALLEL_H__
+#define __GIMP_GEGL_PARALLEL_H__
+
+
+typedef void (* GimpGeglParallelFunc)      (gint                 i,
+                                            gint                 n,
+                                            gpointer             user_data);
+typedef void (* GimpGeglParallelRangeFunc) (gint                 offset,
+                                            gint                 size,
+                                            gpointer             user_data);
+typedef void (* GimpGeglParallelAreaFunc)  (const GeglRectangle *area,
+                                            gpointer             user_data);
+
+
+gint   gimp_gegl_parallel_get_n_threads   (void);
+
+void   gimp_gegl_parallel_distribute       (gint                       max_n,
+                                            GimpGeglParallelFunc       func,
+                                            gpointer                   user_data);
+void   gimp_gegl_parallel_distribute_range (gint                       size,
+                                            gint                       min_sub_size,
+                                            GimpGeglParallelRangeFunc  func,
+                                            gpointer                   user_data);
+void   gimp_gegl_parallel_distribute_area  (const GeglRectangle       *area,
+                                            gint                       min_sub_area,
+                                            GimpGeglParallelAreaFunc   func,
+                                            gpointer                   user_data);
+
+
+#endif /* __GIMP_GEGL_PARALLEL_H__ */
@@ -0,0 +1,477 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpmaskmorphology.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "operations-types.h"
+
+#include "gegl/gimp-gegl-parallel.h"
+
+#include "gimpmaskmorphology.h"
+
+
+/*  Dilation of a mask by the ellipse used by the grow and shrink
+ *  operations.
+ *
+ *  The mask's pixels are split into fully selected, partially selected
+ *  and unselected ones. For both of the first two kinds, a column pass
+ *  finds each pixel's vertical distance to the closest pixel of that
+ *  kind, and a row pass turns every such distance d into the span
+ *  [x - reach[d], x + reach[d]] of pixels whose ellipse contains it,
+ *  and marks the spans using a difference array. Pixels covered by a
+ *  fully selected pixel are fully selected, pixels covered by nothing
+ *  are unselected, and only the remaining pixels, close to partially
+ *  selected ones, need to look at the values of the partially selected
+ *  pixels in their ellipse, which are kept in per-row lists.
+ *
+ *  The cost for fully selected and unselected areas doesn't depend on
+ *  the radius, but each pixel close to partially selected ones still
+ *  searches the lists of all the rows its ellipse covers, which is
+ *  O(radius_y * log n) per pixel.
+ *
+ *  Masks with many partially selected pixels, like feathered ones,
+ *  would spend most of their time in that last step, so they are
+ *  rejected and left to the callers' row based code.
+ */
+
+
+#define MAX_PARTIAL_FRACTION 16
+
+
+typedef struct
+{
+  const gfloat *src;
+  gfloat       *dest;
+  gint          width;
+  gint          height;
+  gint          radius_y;
+  gboolean      invert;
+  const gint   *reach;
+
+  guint16      *full_dist;
+  guint16      *partial_dist;
+
+  gint         *partial_rows;
+  gint         *partial_x;
+  gfloat        partial_max;
+} MorphologyData;
+
+
+static inline gfloat
+morphology_value (const MorphologyData *data,
+                  gfloat                value)
+{
+  return data->invert ? 1.0 - value : value;
+}
+
+static void
+morphology_count_partial (gint     offset,
+                          gint     size,
+                          gpointer user_data)
+{
+  MorphologyData *data = user_data;
+  gint            y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      const gfloat *src   = data->src + (gsize) y * data->width;
+      gint          count = 0;
+      gint          x;
+
+      for (x = 0; x < data->width; x++)
+        {
+          gfloat v = morphology_value (data, src[x]);
+
+          if (v > 0.0 && v < 1.0)
+            count++;
+        }
+
+      data->partial_rows[y + 1] = count;
+    }
+}
+
+static void
+morphology_collect_partial (gint     offset,
+                            gint     size,
+                            gpointer user_data)
+{
+  MorphologyData *data = user_data;
+  gint            y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      const gfloat *src = data->src + (gsize) y * data->width;
+      gint         *px  = data->partial_x + data->partial_rows[y];
+      gint          x;
+
+      for (x = 0; x < data->width; x++)
+        {
+          gfloat v = morphology_value (data, src[x]);
+
+          if (v > 0.0 && v < 1.0)
+            *px++ = x;
+        }
+    }
+}
+
+static void
+morphology_columns (gint     offset,
+                    gint     size,
+                    gpointer user_data)
+{
+  MorphologyData *data   = user_data;
+  gint            width  = data->width;
+  gint            height = data->height;
+  guint16         none   = data->radius_y + 1;
+  gint            x0     = offset;
+  gint            x1     = offset + size;
+  gint            x, y;
+
+  /*  top to bottom  */
+  for (y = 0; y < height; y++)
+    {
+      const gfloat *src     = data->src          + (gsize) y * width;
+      guint16      *full    = data->full_dist    + (gsize) y * width;
+      guint16      *partial = data->partial_dist + (gsize) y * width;
+
+      for (x = x0; x < x1; x++)
+        {
+          gfloat v = morphology_value (data, src[x]);
+
+          if (v >= 1.0)
+            {
+              full[x]    = 0;
+              partial[x] = y > 0 ? MIN (partial[x - width] + 1, none) : none;
+            }
+          else if (v > 0.0)
+            {
+              full[x]    = y > 0 ? MIN (full[x - width] + 1, none) : none;
+              partial[x] = 0;
+            }
+          else
+            {
+              full[x]    = y > 0 ? MIN (full[x - width] + 1, none) : none;
+              partial[x] = y > 0 ? MIN (partial[x - width] + 1, none) : none;
+            }
+        }
+    }
+
+  /*  bottom to top  */
+  for (y = height - 2; y >= 0; y--)
+    {
+      guint16 *full    = data->full_dist    + (gsize) y * width;
+      guint16 *partial = data->partial_dist + (gsize) y * width;
+
+      for (x = x0; x < x1; x++)
+        {
+          full[x]    = MIN (full[x],    full[x + width]    + 1);
+          partial[x] = MIN (partial[x], partial[x + width] + 1);
+        }
+    }
+}
+
+static void
+morphology_mark_spans (const guint16 *dist,
+                       const gint    *reach,
+                       gint           radius_y,
+                       gint           width,
+                       gint          *cover)
+{
+  gint x;
+
+  memset (cover, 0, (width + 1) * sizeof (gint));
+
+  for (x = 0; x < width; x++)
+    {
+      if (dist[x] <= radius_y)
+        {
+          gint r = reach[dist[x]];
+
+          cover[MAX (x - r, 0)]++;
+          cover[MIN (x + r + 1, width)]--;
+        }
+    }
+}
+
+static gfloat
+morphology_partial_max (const MorphologyData *data,
+                        gint                  x,
+                        gint                  y)
+{
+  gfloat max = 0.0;
+  gint   dy;
+
+  for (dy = -data->radius_y; dy <= data->radius_y; dy++)
+    {
+      gint        row = y + dy;
+      gint        r   = data->reach[ABS (dy)];
+      const gint *px;
+      gint        lo, hi;
+
+      if (row < 0 || row >= data->height)
+        continue;
+
+      lo = data->partial_rows[row];
+      hi = data->partial_rows[row + 1];
+
+      /*  find the first partially selected pixel >= x - r  */
+      while (lo < hi)
+        {
+          gint mid = (lo + hi) / 2;
+
+          if (data->partial_x[mid] < x - r)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      for (px = data->partial_x + lo;
+           px < data->partial_x + data->partial_rows[row + 1] && *px <= x + r;
+           px++)
+        {
+          gfloat v = morphology_value (data,
+                                       data->src[(gsize) row * data->width + *px]);
+
+          if (v > max)
+            {
+              max = v;
+
+              if (max >= data->partial_max)
+                return max;
+            }
+        }
+    }
+
+  return max;
+}
+
+static void
+morphology_rows (gint     offset,
+                 gint     size,
+                 gpointer user_data)
+{
+  MorphologyData *data          = user_data;
+  gint            width         = data->width;
+  gint           *full_cover    = g_new (gint, width + 1);
+  gint           *partial_cover = g_new (gint, width + 1);
+  gint            y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      gfloat *dest    = data->dest + (gsize) y * width;
+      gint    full    = 0;
+      gint    partial = 0;
+      gint    x;
+
+      morphology_mark_spans (data->full_dist + (gsize) y * width,
+                             data->reach, data->radius_y, width,
+                             full_cover);
+      morphology_mark_spans (data->partial_dist + (gsize) y * width,
+                             data->reach, data->radius_y, width,
+                             partial_cover);
+
+      for (x = 0; x < width; x++)
+        {
+          gfloat v;
+
+          full    += full_cover[x];
+          partial += partial_cover[x];
+
+          if (full > 0)
+            v = 1.0;
+          else if (partial > 0)
+            v = morphology_partial_max (data, x, y);
+          else
+            v = 0.0;
+
+          dest[x] = morphology_value (data, v);
+        }
+    }
+
+  g_free (full_cover);
+  g_free (partial_cover);
+}
+
+
+/*  public functions  */
+
+/**
+ * gimp_mask_morphology_ellipse:
+ * @radius_x: the horizontal radius
+ * @radius_y: the vertical radius
+ * @circ:     return location for the ellipse, 2 * @radius_x + 1 values
+ *
+ * Computes the structuring element of the grow and shrink operations:
+ * for each horizontal offset from -@radius_x to @radius_x, the
+ * largest vertical offset inside the ellipse.
+ **/
+void
+gimp_mask_morphology_ellipse (gint    radius_x,
+                              gint    radius_y,
+                              gint16 *circ)
+{
+  gint    i;
+  gint    diameter = radius_x * 2 + 1;
+  gdouble tmp;
+
+  for (i = 0; i < diameter; i++)
+    {
+      if (i > radius_x)
+        tmp = (i - radius_x) - 0.5;
+      else if (i < radius_x)
+        tmp = (radius_x - i) - 0.5;
+      else
+        tmp = 0.0;
+
+      circ[i] = RINT (radius_y /
+                      (gdouble) radius_x * sqrt (SQR (radius_x) - SQR (tmp)));
+    }
+}
+
+/**
+ * gimp_mask_morphology_dilate:
+ * @src:      the source mask, @width * @height floats
+ * @dest:     the destination mask, @width * @height floats
+ * @width:    the width of the masks
+ * @height:   the height of the masks
+ * @radius_x: the horizontal radius
+ * @radius_y: the vertical radius
+ * @invert:   whether to erode instead of dilate
+ *
+ * Computes the maximum of @src (or, if @invert is %TRUE, the minimum)
+ * over the ellipse given by gimp_mask_morphology_ellipse() around
+ * each pixel, ignoring the area outside the mask.
+ *
+ * Return value: %FALSE if @src has too many partially selected pixels
+ *               to be processed efficiently, in which case @dest is
+ *               left untouched.
+ **/
+gboolean
+gimp_mask_morphology_dilate (const gfloat *src,
+                             gfloat       *dest,
+                             gint          width,
+                             gint          height,
+                             gint          radius_x,
+                             gint          radius_y,
+                             gboolean      invert)
+{
+  MorphologyData  data;
+  gint16         *circ;
+  gint           *reach;
+  gint64          n_partial;
+  gint            i, d;
+
+  g_return_val_if_fail (src != NULL, FALSE);
+  g_return_val_if_fail (dest != NULL, FALSE);
+  g_return_val_if_fail (radius_x > 0 && radius_y > 0, FALSE);
+  g_return_val_if_fail (radius_y < G_MAXUINT16, FALSE);
+
+  if (width < 1 || height < 1)
+    return TRUE;
+
+  data.src          = src;
+  data.dest         = dest;
+  data.width        = width;
+  data.height       = height;
+  data.radius_y     = radius_y;
+  data.invert       = invert;
+  data.partial_rows = g_new (gint, height + 1);
+
+  data.partial_rows[0] = 0;
+
+  gimp_gegl_parallel_distribute_range (height, 64,
+                                       morphology_count_partial, &data);
+
+  for (i = 0; i < height; i++)
+    data.partial_rows[i + 1] += data.partial_rows[i];
+
+  n_partial = data.partial_rows[height];
+
+  if (n_partial > (gint64) width * height / MAX_PARTIAL_FRACTION)
+    {
+      g_free (data.partial_rows);
+
+      return FALSE;
+    }
+
+  data.partial_x = g_new (gint, MAX (n_partial, 1));
+
+  gimp_gegl_parallel_distribute_range (height, 64,
+                                       morphology_collect_partial, &data);
+
+  /*  the largest partial value, used to stop scanning early  */
+  data.partial_max = 0.0;
+
+  for (i = 0; i < height; i++)
+    {
+      gint j;
+
+      for (j = data.partial_rows[i]; j < data.partial_rows[i + 1]; j++)
+        {
+          gfloat v = morphology_value (&data,
+                                       src[(gsize) i * width +
+                                           data.partial_x[j]]);
+
+          data.partial_max = MAX (data.partial_max, v);
+        }
+    }
+
+  /*  reach[d] is the horizontal radius of the ellipse at vertical
+   *  offset d, the ellipse's rows never get longer further out, so
+   *  reach[] never increases with d
+   */
+  circ  = g_new (gint16, 2 * radius_x + 1);
+  reach = g_new (gint, radius_y + 1);
+
+  gimp_mask_morphology_ellipse (radius_x, radius_y, circ);
+
+  for (d = 0, i = radius_x; d <= radius_y; d++)
+    {
+      while (i > 0 && circ[radius_x + i] < d)
+        i--;
+
+      reach[d] = i;
+    }
+
+  data.reach = reach;
+
+  data.full_dist    = g_new (guint16, (gsize) width * height);
+  data.partial_dist = g_new (guint16, (gsize) width * height);
+
+  gimp_gegl_parallel_distribute_range (width, 64,
+                                       morphology_columns, &data);
+
+  gimp_gegl_parallel_distribute_range (height, 16,
+                                       morphology_rows, &data);
+
+  g_free (data.full_dist);
+  g_free (data.partial_dist);
+  g_free (data.partial_x);
+  g_free (data.partial_rows);
+  g_free (reach);
+  g_free (circ);
+
+  return TRUE;
+}
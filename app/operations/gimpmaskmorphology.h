@@ -0,0 +1,37 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpmaskmorphology.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_MASK_MORPHOLOGY_H__
+#define __GIMP_MASK_MORPHOLOGY_H__
+
+
+void       gimp_mask_morphology_ellipse (gint          radius_x,
+                                         gint          radius_y,
+                                         gint16       *circ);
+
+gboolean   gimp_mask_morphology_dilate  (const gfloat *src,
+                                         gfloat       *dest,
+                                         gint          width,
+                                         gint          height,
+                                         gint          radius_x,
+                                         gint          radius_y,
+                                         gboolean      invert);
+
+
+#endif /* __GIMP_MASK_MORPHOLOGY_H__ */
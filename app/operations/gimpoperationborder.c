@@ -29,6 +29,8 @@
 
 #include "operations-types.h"
 
+#include "gegl/gimp-gegl-parallel.h"
+
 #include "gimpoperationborder.h"
 
 
@@ -42,6 +44,22 @@ enum
 };
 
 
+typedef struct
+{
+  const gfloat *src;
+  gfloat       *dest;
+  gint          width;
+  gint          height;
+  gint          radius_x;
+  gint          radius_y;
+  gboolean      feather;
+  gboolean      edge_lock;
+  gfloat       *outside;
+  gfloat       *transition;
+  guint16      *dist;
+} BorderData;
+
+
 static void     gimp_operation_border_get_property (GObject      *object,
                                                     guint         property_id,
                                                     GValue       *value,
@@ -65,6 +83,16 @@ static gboolean gimp_operation_border_process (GeglOperation       *operation,
                                                const GeglRectangle *roi,
                                                gint                 level);
 
+static void     gimp_operation_border_transitions (gint     offset,
+                                                   gint     size,
+                                                   gpointer user_data);
+static void     gimp_operation_border_columns     (gint     offset,
+                                                   gint     size,
+                                                   gpointer user_data);
+static void     gimp_operation_border_rows        (gint     offset,
+                                                   gint     size,
+                                                   gpointer user_data);
+
 
 G_DEFINE_TYPE (GimpOperationBorder, gimp_operation_border,
                GEGL_TYPE_OPERATION_FILTER)
@@ -218,21 +246,6 @@ gimp_operation_border_get_cached_region (GeglOperation       *self,
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
-static inline void
-rotate_pointers (gfloat  **p,
-                 guint32   n)
-{
-  guint32  i;
-  gfloat  *tmp;
-
-  tmp = p[0];
-
-  for (i = 0; i < n - 1; i++)
-    p[i] = p[i + 1];
-
-  p[i] = tmp;
-}
-
 /* Computes whether pixels in `buf[1]', if they are selected, have neighbouring
    pixels that are unselected. Put result in `transition'. */
 static void
@@ -326,421 +339,267 @@ compute_transition (gfloat    *transition,
     }
 }
 
-static gboolean
-gimp_operation_border_process (GeglOperation       *operation,
-                               GeglBuffer          *input,
-                               GeglBuffer          *output,
-                               const GeglRectangle *roi,
-                               gint                 level)
+static void
+gimp_operation_border_transitions (gint     offset,
+                                   gint     size,
+                                   gpointer user_data)
 {
-  /* This function has no bugs, but if you imagine some you can blame
-   * them on jaycox@gimp.org
-   */
-  GimpOperationBorder *self          = GIMP_OPERATION_BORDER (operation);
-  const Babl          *input_format  = babl_format ("Y float");
-  const Babl          *output_format = babl_format ("Y float");
-
-  gint32 i, j, x, y;
-
-  /* A cache used in the algorithm as it works its way down. `buf[1]' is the
-     current row. Thus, at algorithm initialization, `buf[0]' represents the
-     row 'above' the first row of the region. */
-  gfloat  *buf[3];
-
-  /* The resulting selection is calculated row by row, and this buffer holds the
-     output for each individual row, on each iteration. */
-  gfloat  *out;
+  BorderData *data  = user_data;
+  gint        width = data->width;
+  gint        y;
 
-  /* Keeps track of transitional pixels (pixels that are selected and have
-     unselected neighbouring pixels). */
-  gfloat **transition;
-
-  /* TODO: Figure out role clearly in algorithm. */
-  gint16  *max;
-
-  /* TODO: Figure out role clearly in algorithm. */
-  gfloat **density;
-
-  gint16   last_index;
-
-  /* optimize this case specifically */
-  if (self->radius_x == 1 && self->radius_y == 1)
+  for (y = offset; y < offset + size; y++)
     {
-      gfloat *transition;
-      gfloat *source[3];
-
-      for (i = 0; i < 3; i++)
-        source[i] = g_new (gfloat, roi->width);
-
-      transition = g_new (gfloat, roi->width);
+      gfloat *buf[3];
 
-      /* With `self->edge_lock', initialize row above image as
-       * selected, otherwise, initialize as unselected.
+      /*  the rows above and below the input are selected with edge
+       *  lock, and unselected without
        */
-      if (self->edge_lock)
-        {
-          for (i = 0; i < roi->width; i++)
-            source[0][i] = 1.0;
-        }
-      else
-        {
-          memset (source[0], 0, roi->width * sizeof (gfloat));
-        }
-
-      gegl_buffer_get (input,
-                       GEGL_RECTANGLE (roi->x, roi->y + 0,
-                                       roi->width, 1),
-                       1.0, input_format, source[1],
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      if (roi->height > 1)
-        gegl_buffer_get (input,
-                         GEGL_RECTANGLE (roi->x, roi->y + 1,
-                                         roi->width, 1),
-                         1.0, input_format, source[2],
-                         GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      else
-        memcpy (source[2], source[1], roi->width * sizeof (gfloat));
+      buf[0] = y > 0 ?
+               (gfloat *) data->src + (gsize) (y - 1) * width : data->outside;
+      buf[1] = (gfloat *) data->src + (gsize) y * width;
+      buf[2] = y < data->height - 1 ?
+               (gfloat *) data->src + (gsize) (y + 1) * width : data->outside;
+
+      compute_transition (data->transition + (gsize) y * width,
+                          buf, width, data->edge_lock);
+    }
+}
 
-      compute_transition (transition, source, roi->width, self->edge_lock);
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y,
-                                       roi->width, 1),
-                       1.0, output_format, transition,
-                       GEGL_AUTO_ROWSTRIDE);
+static void
+gimp_operation_border_columns (gint     offset,
+                               gint     size,
+                               gpointer user_data)
+{
+  BorderData *data   = user_data;
+  gint        width  = data->width;
+  gint        height = data->height;
+  guint16     none   = data->radius_y + 1;
+  gint        x0     = offset;
+  gint        x1     = offset + size;
+  gint        x, y;
+
+  /*  vertical distance to the closest transition in the column  */
+  for (y = 0; y < height; y++)
+    {
+      const gfloat *transition = data->transition + (gsize) y * width;
+      guint16      *dist       = data->dist       + (gsize) y * width;
 
-      for (y = 1; y < roi->height; y++)
+      for (x = x0; x < x1; x++)
         {
-          rotate_pointers (source, 3);
-
-          if (y + 1 < roi->height)
-            {
-              gegl_buffer_get (input,
-                               GEGL_RECTANGLE (roi->x, roi->y + y + 1,
-                                               roi->width, 1),
-                               1.0, input_format, source[2],
-                               GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-            }
+          if (transition[x])
+            dist[x] = 0;
           else
-            {
-              /* Depending on `self->edge_lock', set the row below the
-               * image as either selected or non-selected.
-               */
-              if (self->edge_lock)
-                {
-                  for (i = 0; i < roi->width; i++)
-                    source[2][i] = 1.0;
-                }
-              else
-                {
-                  memset (source[2], 0, roi->width * sizeof (gfloat));
-                }
-            }
-
-          compute_transition (transition, source, roi->width, self->edge_lock);
-          gegl_buffer_set (output,
-                           GEGL_RECTANGLE (roi->x, roi->y + y,
-                                           roi->width, 1),
-                           1.0, output_format, transition,
-                           GEGL_AUTO_ROWSTRIDE);
+            dist[x] = y > 0 ? MIN (dist[x - width] + 1, none) : none;
         }
-
-      for (i = 0; i < 3; i++)
-        g_free (source[i]);
-
-      g_free (transition);
-
-      /* Finnished handling the radius = 1 special case, return here. */
-      return TRUE;
     }
 
-  max = g_new (gint16, roi->width + 2 * self->radius_x);
-
-  for (i = 0; i < (roi->width + 2 * self->radius_x); i++)
-    max[i] = self->radius_y + 2;
-
-  max += self->radius_x;
-
-  for (i = 0; i < 3; i++)
-    buf[i] = g_new (gfloat, roi->width);
-
-  transition = g_new (gfloat *, self->radius_y + 1);
-
-  for (i = 0; i < self->radius_y + 1; i++)
+  for (y = height - 2; y >= 0; y--)
     {
-      transition[i] = g_new (gfloat, roi->width + 2 * self->radius_x);
-      memset (transition[i], 0,
-              (roi->width + 2 * self->radius_x) * sizeof (gfloat));
-      transition[i] += self->radius_x;
+      guint16 *dist = data->dist + (gsize) y * width;
+
+      for (x = x0; x < x1; x++)
+        dist[x] = MIN (dist[x], dist[x + width] + 1);
     }
+}
 
-  out = g_new (gfloat, roi->width);
+static inline gdouble
+border_offset (gint    d,
+               gdouble radius)
+{
+  gdouble t = ABS (d) - 0.5;
 
-  density = g_new (gfloat *, 2 * self->radius_x + 1);
-  density += self->radius_x;
+  return t > 0.0 ? SQR (t / radius) : 0.0;
+}
 
-  /* allocate density[][] */
-  for (x = 0; x < (self->radius_x + 1); x++)
-    {
-      density[ x]  = g_new (gfloat, 2 * self->radius_y + 1);
-      density[ x] += self->radius_y;
-      density[-x]  = density[x];
-    }
+/*  the first x in [0, width] where the ellipse around q is at least as
+ *  close as the ellipse around p, with p < q
+ */
+static inline gint
+border_crossing (const gdouble *height,
+                 gint           p,
+                 gint           q,
+                 gint           width,
+                 gdouble        radius)
+{
+  gint lo = 0;
+  gint hi = width;
 
-  /* compute density[][] */
-  for (x = 0; x < (self->radius_x + 1); x++)
+  while (lo < hi)
     {
-      gdouble tmpx, tmpy, dist;
-      gfloat  a;
+      gint x = (lo + hi) / 2;
 
-      if (x > 0)
-        tmpx = x - 0.5;
-      else if (x < 0)
-        tmpx = x + 0.5;
+      if (border_offset (x - q, radius) + height[q] <=
+          border_offset (x - p, radius) + height[p])
+        hi = x;
       else
-        tmpx = 0.0;
-
-      for (y = 0; y < (self->radius_y + 1); y++)
-        {
-          if (y > 0)
-            tmpy = y - 0.5;
-          else if (y < 0)
-            tmpy = y + 0.5;
-          else
-            tmpy = 0.0;
-
-          dist = ((tmpy * tmpy) / (self->radius_y * self->radius_y) +
-                  (tmpx * tmpx) / (self->radius_x * self->radius_x));
-
-          if (dist < 1.0)
-            {
-              if (self->feather)
-                a = 1.0 - sqrt (dist);
-              else
-                a = 1.0;
-            }
-          else
-            {
-              a = 0.0;
-            }
-
-          density[ x][ y] = a;
-          density[ x][-y] = a;
-          density[-x][ y] = a;
-          density[-x][-y] = a;
-        }
+        lo = x + 1;
     }
 
-  /* Since the algorithm considerers `buf[0]' to be 'over' the row
-   * currently calculated, we must start with `buf[0]' as non-selected
-   * if there is no `self->edge_lock. If there is an
-   * 'self->edge_lock', initialize the first row to 'selected'. Refer
-   * to bug #350009.
-   */
-  if (self->edge_lock)
-    {
-      for (i = 0; i < roi->width; i++)
-        buf[0][i] = 1.0;
-    }
-  else
-    {
-      memset (buf[0], 0, roi->width * sizeof (gfloat));
-    }
-
-  gegl_buffer_get (input,
-                   GEGL_RECTANGLE (roi->x, roi->y + 0,
-                                   roi->width, 1),
-                   1.0, input_format, buf[1],
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-  if (roi->height > 1)
-    gegl_buffer_get (input,
-                     GEGL_RECTANGLE (roi->x, roi->y + 1,
-                                     roi->width, 1),
-                     1.0, input_format, buf[2],
-                     GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-  else
-    memcpy (buf[2], buf[1], roi->width * sizeof (gfloat));
-
-  compute_transition (transition[1], buf, roi->width, self->edge_lock);
+  return lo;
+}
 
-   /* set up top of image */
-  for (y = 1; y < self->radius_y && y + 1 < roi->height; y++)
+static void
+gimp_operation_border_rows (gint     offset,
+                            gint     size,
+                            gpointer user_data)
+{
+  BorderData *data   = user_data;
+  gint        width  = data->width;
+  gdouble     rx     = data->radius_x;
+  gdouble    *height = g_new (gdouble, width);
+  gint       *v      = g_new (gint, width + 1);
+  gint       *z      = g_new (gint, width + 1);
+  gint        y;
+
+  for (y = offset; y < offset + size; y++)
     {
-      rotate_pointers (buf, 3);
-      gegl_buffer_get (input,
-                       GEGL_RECTANGLE (roi->x, roi->y + y + 1,
-                                       roi->width, 1),
-                       1.0, input_format, buf[2],
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-      compute_transition (transition[y + 1], buf, roi->width, self->edge_lock);
-    }
+      const guint16 *dist = data->dist + (gsize) y * width;
+      gfloat        *out  = data->dest + (gsize) y * width;
+      gint           k    = -1;
+      gint           x;
+
+      /*  the normalized vertical part of the distance to the closest
+       *  transition in each column, and the lower envelope of the
+       *  horizontal parts around them; the horizontal distance is
+       *  convex, so two of them cross at most once
+       */
+      for (x = 0; x < width; x++)
+        {
+          gint s;
 
-  /* set up max[] for top of image */
-  for (x = 0; x < roi->width; x++)
-    {
-      max[x] = -(self->radius_y + 7);
-
-      for (j = 1; j < self->radius_y + 1; j++)
-        if (transition[j][x])
-          {
-            max[x] = j;
-            break;
-          }
-    }
+          if (dist[x] > data->radius_y)
+            continue;
 
-  /* main calculation loop */
-  for (y = 0; y < roi->height; y++)
-    {
-      rotate_pointers (buf, 3);
-      rotate_pointers (transition, self->radius_y + 1);
+          height[x] = border_offset (dist[x], data->radius_y);
 
-      if (y < roi->height - (self->radius_y + 1))
-        {
-          gegl_buffer_get (input,
-                           GEGL_RECTANGLE (roi->x,
-                                           roi->y + y + self->radius_y + 1,
-                                           roi->width, 1),
-                           1.0, input_format, buf[2],
-                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-          compute_transition (transition[self->radius_y], buf, roi->width, self->edge_lock);
-        }
-      else
-        {
-          if (self->edge_lock)
+          if (k < 0)
             {
-              memcpy (transition[self->radius_y], transition[self->radius_y - 1], roi->width * sizeof (gfloat));
+              k    = 0;
+              v[0] = x;
+              z[0] = -1;
+              continue;
             }
-          else
+
+          s = border_crossing (height, v[k], x, width, rx);
+
+          while (k > 0 && s <= z[k])
             {
-              /* No edge lock, set everything 'below canvas' as seen
-               * from the algorithm as unselected.
-               */
-              memset (buf[2], 0, roi->width * sizeof (gfloat));
-              compute_transition (transition[self->radius_y], buf, roi->width, self->edge_lock);
+              k--;
+              s = border_crossing (height, v[k], x, width, rx);
             }
+
+          if (s >= width)
+            continue;
+
+          k++;
+          v[k] = x;
+          z[k] = s;
         }
 
-      /* update max array */
-      for (x = 0; x < roi->width; x++)
+      if (k < 0)
         {
-          if (max[x] < 1)
-            {
-              if (max[x] <= -self->radius_y)
-                {
-                  if (transition[self->radius_y][x])
-                    max[x] = self->radius_y;
-                  else
-                    max[x]--;
-                }
-              else
-                {
-                  if (transition[-max[x]][x])
-                    max[x] = -max[x];
-                  else if (transition[-max[x] + 1][x])
-                    max[x] = -max[x] + 1;
-                  else
-                    max[x]--;
-                }
-            }
-          else
-            {
-              max[x]--;
-            }
-
-          if (max[x] < -self->radius_y - 1)
-            max[x] = -self->radius_y - 1;
+          memset (out, 0, width * sizeof (gfloat));
+          continue;
         }
 
-      last_index = 1;
+      z[k + 1] = G_MAXINT;
 
-       /* render scan line */
-      for (x = 0 ; x < roi->width; x++)
+      for (x = 0, k = 0; x < width; x++)
         {
-          gfloat last_max;
-
-          last_index--;
+          gdouble d;
 
-          if (last_index >= 0)
-            {
-              last_max = 0.0;
+          while (z[k + 1] <= x)
+            k++;
 
-              for (i = self->radius_x; i >= 0; i--)
-                if (max[x + i] <= self->radius_y && max[x + i] >= -self->radius_y &&
-                    density[i][max[x+i]] > last_max)
-                  {
-                    last_max = density[i][max[x + i]];
-                    last_index = i;
-                  }
+          d = border_offset (x - v[k], rx) + height[v[k]];
 
-              out[x] = last_max;
-            }
+          if (d < 1.0)
+            out[x] = data->feather ? 1.0 - sqrt (d) : 1.0;
           else
-            {
-              last_max = 0.0;
-
-              for (i = self->radius_x; i >= -self->radius_x; i--)
-                if (max[x + i] <= self->radius_y && max[x + i] >= -self->radius_y &&
-                    density[i][max[x + i]] > last_max)
-                  {
-                    last_max = density[i][max[x + i]];
-                    last_index = i;
-                  }
+            out[x] = 0.0;
+        }
+    }
 
-              out[x] = last_max;
-            }
+  g_free (height);
+  g_free (v);
+  g_free (z);
+}
 
-          if (last_max <= 0.0)
-            {
-              for (i = x + 1; i < roi->width; i++)
-                {
-                  if (max[i] >= -self->radius_y)
-                    break;
-                }
+static gboolean
+gimp_operation_border_process (GeglOperation       *operation,
+                               GeglBuffer          *input,
+                               GeglBuffer          *output,
+                               const GeglRectangle *roi,
+                               gint                 level)
+{
+  /* This function has no bugs, but if you imagine some you can blame
+   * them on jaycox@gimp.org
+   */
+  GimpOperationBorder *self   = GIMP_OPERATION_BORDER (operation);
+  const Babl          *format = babl_format ("Y float");
+  BorderData           data;
+  gfloat              *src;
+  gint                 i;
 
-              if (i - x > self->radius_x)
-                {
-                  for (; x < i - self->radius_x; x++)
-                    out[x] = 0;
+  src = g_new (gfloat, (gsize) roi->width * roi->height);
 
-                  x--;
-                }
+  gegl_buffer_get (input, roi, 1.0, format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
 
-              last_index = self->radius_x;
-            }
-        }
+  data.src        = src;
+  data.width      = roi->width;
+  data.height     = roi->height;
+  data.radius_x   = self->radius_x;
+  data.radius_y   = self->radius_y;
+  data.feather    = self->feather;
+  data.edge_lock  = self->edge_lock;
+  data.outside    = g_new (gfloat, roi->width);
+  data.transition = g_new (gfloat, (gsize) roi->width * roi->height);
+
+  for (i = 0; i < roi->width; i++)
+    data.outside[i] = self->edge_lock ? 1.0 : 0.0;
+
+  /*  Keeps track of transitional pixels (pixels that are selected and
+   *  have unselected neighbouring pixels).
+   */
+  gimp_gegl_parallel_distribute_range (roi->height, 64,
+                                       gimp_operation_border_transitions,
+                                       &data);
 
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + y,
-                                       roi->width, 1),
-                       1.0, output_format, out,
+  /* optimize this case specifically */
+  if (self->radius_x == 1 && self->radius_y == 1)
+    {
+      gegl_buffer_set (output, roi, 0, format, data.transition,
                        GEGL_AUTO_ROWSTRIDE);
     }
+  else
+    {
+      /*  The border is the set of pixels whose distance to the closest
+       *  transition, in the metric of the border's ellipse, is less
+       *  than one. The distance is computed separably, like a
+       *  distance transform, so the cost doesn't depend on the radius.
+       */
+      data.dist = g_new (guint16, (gsize) roi->width * roi->height);
+      data.dest = src;
 
-  g_free (out);
-
-  for (i = 0; i < 3; i++)
-    g_free (buf[i]);
+      gimp_gegl_parallel_distribute_range (roi->width, 64,
+                                           gimp_operation_border_columns,
+                                           &data);
 
-  max -= self->radius_x;
-  g_free (max);
+      gimp_gegl_parallel_distribute_range (roi->height, 16,
+                                           gimp_operation_border_rows,
+                                           &data);
 
-  for (i = 0; i < self->radius_y + 1; i++)
-    {
-      transition[i] -= self->radius_x;
-      g_free (transition[i]);
-    }
-
-  g_free (transition);
+      gegl_buffer_set (output, roi, 0, format, data.dest,
+                       GEGL_AUTO_ROWSTRIDE);
 
-  for (i = 0; i < self->radius_x + 1 ; i++)
-    {
-      density[i] -= self->radius_y;
-      g_free (density[i]);
+      g_free (data.dist);
     }
 
-  density -= self->radius_x;
-  g_free (density);
+  g_free (data.transition);
+  g_free (data.outside);
+  g_free (src);
 
   return TRUE;
 }
@@ -79,6 +79,24 @@ gimp_operation_colorize_init (GimpOperationColorize *self)
 {
 }
 
+static inline gfloat
+hsl_value (gfloat hue)
+{
+  if (hue > 6.0)
+    hue -= 6.0;
+  else if (hue < 0.0)
+    hue += 6.0;
+
+  if (hue < 1.0)
+    return hue;
+  else if (hue < 3.0)
+    return 1.0;
+  else if (hue < 4.0)
+    return 4.0 - hue;
+  else
+    return 0.0;
+}
+
 static gboolean
 gimp_operation_colorize_process (GeglOperation       *operation,
                                  void                *in_buf,
@@ -91,46 +109,60 @@ gimp_operation_colorize_process (GeglOperation       *operation,
   GimpColorizeConfig       *config = GIMP_COLORIZE_CONFIG (point->config);
   gfloat                   *src    = in_buf;
   gfloat                   *dest   = out_buf;
-  GimpHSL                   hsl;
+  gfloat                    sat;
+  gfloat                    l_scale;
+  gfloat                    l_bias;
+  gfloat                    fr, fg, fb;
 
   if (! config)
     return FALSE;
 
-  hsl.h = config->hue;
-  hsl.s = config->saturation;
-  hsl.a = src[ALPHA];
+  /*  hue and saturation are constant, so gimp_hsl_to_rgb() reduces to
+   *  interpolating between m1 and m2 with per-channel weights which
+   *  only depend on the hue, and the lightness mapping is linear
+   */
+  sat = config->saturation;
 
-  while (samples--)
+  fr = hsl_value (config->hue * 6.0 + 2.0);
+  fg = hsl_value (config->hue * 6.0);
+  fb = hsl_value (config->hue * 6.0 - 2.0);
+
+  if (config->lightness > 0)
     {
-      GimpRGB rgb;
-      gfloat  lum = GIMP_RGB_LUMINANCE (src[RED],
-                                        src[GREEN],
-                                        src[BLUE]);
+      l_scale = 1.0 - config->lightness;
+      l_bias  = config->lightness;
+    }
+  else
+    {
+      l_scale = config->lightness + 1.0;
+      l_bias  = 0.0;
+    }
 
-      if (config->lightness > 0)
-        {
-          lum = lum * (1.0 - config->lightness);
+  while (samples--)
+    {
+      gfloat lum = GIMP_RGB_LUMINANCE (src[RED],
+                                       src[GREEN],
+                                       src[BLUE]);
+      gfloat m1, m2;
 
-          lum += 1.0 - (1.0 - config->lightness);
-        }
-      else if (config->lightness < 0)
-        {
-          lum = lum * (config->lightness + 1.0);
-        }
+      lum = lum * l_scale + l_bias;
 
-      hsl.l = lum;
+      if (lum <= 0.5)
+        m2 = lum * (1.0 + sat);
+      else
+        m2 = lum + sat - lum * sat;
 
-      gimp_hsl_to_rgb (&hsl, &rgb);
+      m1 = 2.0 * lum - m2;
 
       /*  the code in base/colorize.c would multiply r,b,g with lum,
        *  but this is a bug since it should multiply with 255. We
        *  don't repeat this bug here (this is the reason why the gegl
        *  colorize is brighter than the legacy one).
        */
-      dest[RED]   = rgb.r; /* * lum; */
-      dest[GREEN] = rgb.g; /* * lum; */
-      dest[BLUE]  = rgb.b; /* * lum */;
-      dest[ALPHA] = rgb.a;
+      dest[RED]   = m1 + (m2 - m1) * fr;
+      dest[GREEN] = m1 + (m2 - m1) * fg;
+      dest[BLUE]  = m1 + (m2 - m1) * fb;
+      dest[ALPHA] = src[ALPHA];
 
       src  += 4;
       dest += 4;
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimpmaskmorphology.h"
 #include "gimpoperationgrow.h"
 
 
@@ -64,6 +65,11 @@ static gboolean gimp_operation_grow_process           (GeglOperation       *oper
                                                        const GeglRectangle *roi,
                                                        gint                 level);
 
+static void     gimp_operation_grow_process_rows      (GimpOperationGrow   *self,
+                                                       GeglBuffer          *input,
+                                                       GeglBuffer          *output,
+                                                       const GeglRectangle *roi);
+
 
 G_DEFINE_TYPE (GimpOperationGrow, gimp_operation_grow,
                GEGL_TYPE_OPERATION_FILTER)
@@ -185,29 +191,6 @@ gimp_operation_grow_get_cached_region (GeglOperation       *self,
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
-static void
-compute_border (gint16  *circ,
-                guint16  xradius,
-                guint16  yradius)
-{
-  gint32  i;
-  gint32  diameter = xradius * 2 + 1;
-  gdouble tmp;
-
-  for (i = 0; i < diameter; i++)
-    {
-      if (i > xradius)
-        tmp = (i - xradius) - 0.5;
-      else if (i < xradius)
-        tmp = (xradius - i) - 0.5;
-      else
-        tmp = 0.0;
-
-      circ[i] = RINT (yradius /
-                      (gdouble) xradius * sqrt (SQR (xradius) - SQR (tmp)));
-    }
-}
-
 static inline void
 rotate_pointers (gfloat  **p,
                  guint32   n)
@@ -223,17 +206,15 @@ rotate_pointers (gfloat  **p,
   p[i] = tmp;
 }
 
-static gboolean
-gimp_operation_grow_process (GeglOperation       *operation,
-                             GeglBuffer          *input,
-                             GeglBuffer          *output,
-                             const GeglRectangle *roi,
-                             gint                 level)
+static void
+gimp_operation_grow_process_rows (GimpOperationGrow   *self,
+                                  GeglBuffer          *input,
+                                  GeglBuffer          *output,
+                                  const GeglRectangle *roi)
 {
   /* Any bugs in this fuction are probably also in thin_region.
    * Blame all bugs in this function on jaycox@gimp.org
    */
-  GimpOperationGrow *self          = GIMP_OPERATION_GROW (operation);
   const Babl        *input_format  = babl_format ("Y float");
   const Babl        *output_format = babl_format ("Y float");
   gint32             i, j, x, y;
@@ -275,7 +256,7 @@ gimp_operation_grow_process (GeglOperation       *operation,
   out =  g_new (gfloat, roi->width);
 
   circ = g_new (gint16, 2 * self->radius_x + 1);
-  compute_border (circ, self->radius_x, self->radius_y);
+  gimp_mask_morphology_ellipse (self->radius_x, self->radius_y, circ);
 
   /* offset the circ pointer by self->radius_x so the range of the
    * array is [-self->radius_x] to [self->radius_x]
@@ -384,6 +365,48 @@ gimp_operation_grow_process (GeglOperation       *operation,
 
   g_free (buf);
   g_free (out);
+}
+
+static gboolean
+gimp_operation_grow_process (GeglOperation       *operation,
+                             GeglBuffer          *input,
+                             GeglBuffer          *output,
+                             const GeglRectangle *roi,
+                             gint                 level)
+{
+  GimpOperationGrow *self   = GIMP_OPERATION_GROW (operation);
+  const Babl        *format = babl_format ("Y float");
+  gfloat            *src;
+  gfloat            *dest;
+
+  src  = g_new (gfloat, (gsize) roi->width * roi->height);
+  dest = g_new (gfloat, (gsize) roi->width * roi->height);
+
+  gegl_buffer_get (input, roi, 1.0, format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  /*  the separable version handles everything but masks with
+   *  lots of partially selected pixels, like feathered selections
+   */
+  if (gimp_mask_morphology_dilate (src, dest, roi->width, roi->height,
+                                   self->radius_x, self->radius_y, FALSE))
+    {
+      gegl_buffer_set (output, roi, 0, format, dest,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+  else
+    {
+      /*  the row based code reads the input itself  */
+      g_free (src);
+      g_free (dest);
+
+      gimp_operation_grow_process_rows (self, input, output, roi);
+
+      return TRUE;
+    }
+
+  g_free (src);
+  g_free (dest);
 
   return TRUE;
 }
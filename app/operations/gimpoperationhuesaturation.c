@@ -80,12 +80,67 @@ gimp_operation_hue_saturation_init (GimpOperationHueSaturation *self)
 {
 }
 
-static inline gdouble
-map_hue (GimpHueSaturationConfig *config,
-         GimpHueRange             range,
-         gdouble                  value)
+/*  the per-range adjustments, precomputed once per process() call so
+ *  the pixel loop doesn't have to go back to the config object and
+ *  redo the same arithmetic for every pixel
+ */
+typedef struct
+{
+  gfloat hue;          /*  hue offset                            */
+  gfloat saturation;   /*  saturation factor                     */
+  gfloat l_scale;      /*  lightness mapping is l * scale + bias  */
+  gfloat l_bias;
+} HueRangeTable;
+
+static void
+hue_range_table_init_range (GimpHueSaturationConfig *config,
+                            GimpHueRange             range,
+                            HueRangeTable           *table)
+{
+  gdouble v;
+
+  table->hue = (config->hue[GIMP_ALL_HUES] + config->hue[range]) / 2.0;
+
+  /* This change affects the way saturation is computed. With the
+   * old code (different code for value < 0), increasing the
+   * saturation affected muted colors very much, and bright colors
+   * less. With the new code, it affects muted colors and bright
+   * colors more or less evenly. For enhancing the color in
+   * photos, the new behavior is exactly what you want. It's hard
+   * for me to imagine a case in which the old behavior is better.
+   */
+  table->saturation = (config->saturation[GIMP_ALL_HUES] +
+                       config->saturation[range] + 1.0);
+
+  v = (config->lightness[GIMP_ALL_HUES] + config->lightness[range]) / 2.0;
+
+  if (v < 0)
+    {
+      table->l_scale = v + 1.0;
+      table->l_bias  = 0.0;
+    }
+  else
+    {
+      table->l_scale = 1.0 - v;
+      table->l_bias  = v;
+    }
+}
+
+static void
+hue_range_table_init (GimpHueSaturationConfig *config,
+                      HueRangeTable           *table)
+{
+  gint range;
+
+  for (range = GIMP_ALL_HUES; range <= GIMP_MAGENTA_HUES; range++)
+    hue_range_table_init_range (config, range, &table[range]);
+}
+
+static inline gfloat
+map_hue (const HueRangeTable *table,
+         gfloat               value)
 {
-  value += (config->hue[GIMP_ALL_HUES] + config->hue[range]) / 2.0;
+  value += table->hue;
 
   if (value < 0)
     return value + 1.0;
@@ -95,37 +150,40 @@ map_hue (GimpHueSaturationConfig *config,
     return value;
 }
 
-static inline gdouble
-map_saturation (GimpHueSaturationConfig *config,
-                GimpHueRange             range,
-                gdouble                  value)
+static inline gfloat
+map_saturation (const HueRangeTable *table,
+                gfloat               value)
 {
-  gdouble v = config->saturation[GIMP_ALL_HUES] + config->saturation[range];
-
-  /* This change affects the way saturation is computed. With the old
-   * code (different code for value < 0), increasing the saturation
-   * affected muted colors very much, and bright colors less. With the
-   * new code, it affects muted colors and bright colors more or less
-   * evenly. For enhancing the color in photos, the new behavior is
-   * exactly what you want. It's hard for me to imagine a case in
-   * which the old behavior is better.
-  */
-  value *= (v + 1.0);
+  value *= table->saturation;
 
   return CLAMP (value, 0.0, 1.0);
 }
 
-static inline gdouble
-map_lightness (GimpHueSaturationConfig *config,
-               GimpHueRange             range,
-               gdouble                  value)
+static inline gfloat
+map_lightness (const HueRangeTable *table,
+               gfloat               value)
 {
-  gdouble v = (config->lightness[GIMP_ALL_HUES] + config->lightness[range]) / 2.0;
+  return value * table->l_scale + table->l_bias;
+}
 
-  if (v < 0)
-    return value * (v + 1.0);
+static inline gfloat
+hsl_value (gfloat n1,
+           gfloat n2,
+           gfloat hue)
+{
+  if (hue > 6.0)
+    hue -= 6.0;
+  else if (hue < 0.0)
+    hue += 6.0;
+
+  if (hue < 1.0)
+    return n1 + (n2 - n1) * hue;
+  else if (hue < 3.0)
+    return n2;
+  else if (hue < 4.0)
+    return n1 + (n2 - n1) * (4.0 - hue);
   else
-    return value + (v * (1.0 - value));
+    return n1;
 }
 
 static gboolean
@@ -140,61 +198,84 @@ gimp_operation_hue_saturation_process (GeglOperation       *operation,
   GimpHueSaturationConfig  *config = GIMP_HUE_SATURATION_CONFIG (point->config);
   gfloat                   *src    = in_buf;
   gfloat                   *dest   = out_buf;
+  HueRangeTable             table[GIMP_MAGENTA_HUES + 1];
   gfloat                    overlap;
 
   if (! config)
     return FALSE;
 
+  hue_range_table_init (config, table);
+
   overlap = config->overlap / 2.0;
 
   while (samples--)
     {
-      GimpRGB  rgb;
-      GimpHSL  hsl;
-      gdouble  h;
-      gint     hue_counter;
-      gint     hue                 = 0;
+      gfloat   r = src[RED];
+      gfloat   g = src[GREEN];
+      gfloat   b = src[BLUE];
+      gfloat   max, min, delta;
+      gfloat   h, s, l;
+      gint     hue;
       gint     secondary_hue       = 0;
       gboolean use_secondary_hue   = FALSE;
       gfloat   primary_intensity   = 0.0;
       gfloat   secondary_intensity = 0.0;
 
-      rgb.r = src[RED];
-      rgb.g = src[GREEN];
-      rgb.b = src[BLUE];
-      rgb.a = src[ALPHA];
-
-      gimp_rgb_to_hsl (&rgb, &hsl);
+      /*  RGB -> HSL, see gimp_rgb_to_hsl()  */
+      max = MAX (r, MAX (g, b));
+      min = MIN (r, MIN (g, b));
 
-      h = hsl.h * 6.0;
+      l     = (max + min) / 2.0;
+      delta = max - min;
 
-      for (hue_counter = 0; hue_counter < 7; hue_counter++)
+      if (delta == 0.0)
         {
-          gdouble hue_threshold = (gdouble) hue_counter + 0.5;
+          s = 0.0;
+          h = GIMP_HSL_UNDEFINED;
+        }
+      else
+        {
+          if (l <= 0.5)
+            s = delta / (max + min);
+          else
+            s = delta / (2.0 - max - min);
+
+          if (r == max)
+            h = (g - b) / delta;
+          else if (g == max)
+            h = 2.0 + (b - r) / delta;
+          else
+            h = 4.0 + (r - g) / delta;
+
+          h /= 6.0;
+
+          if (h < 0.0)
+            h += 1.0;
+        }
 
-          if (h < ((gdouble) hue_threshold + overlap))
-            {
-              hue = hue_counter;
+      /*  find the hue sector directly instead of searching it: the
+       *  first sector whose upper threshold (sector + 0.5 + overlap)
+       *  lies above h * 6
+       */
+      {
+        gfloat h6        = h * 6.0;
+        gfloat threshold;
 
-              if (overlap > 0.0 && h > ((gdouble) hue_threshold - overlap))
-                {
-                  use_secondary_hue = TRUE;
+        hue = (gint) floor (h6 - 0.5 - overlap) + 1;
+        hue = MAX (hue, 0);
 
-                  secondary_hue = hue_counter + 1;
+        threshold = (gfloat) hue + 0.5;
 
-                  secondary_intensity =
-                    (h - (gdouble) hue_threshold + overlap) / (2.0 * overlap);
+        if (overlap > 0.0 && h6 > threshold - overlap)
+          {
+            use_secondary_hue = TRUE;
 
-                  primary_intensity = 1.0 - secondary_intensity;
-                }
-              else
-                {
-                  use_secondary_hue = FALSE;
-                }
+            secondary_hue = hue + 1;
 
-              break;
-            }
-        }
+            secondary_intensity = (h6 - threshold + overlap) / (2.0 * overlap);
+            primary_intensity   = 1.0 - secondary_intensity;
+          }
+      }
 
       if (hue >= 6)
         {
@@ -213,12 +294,14 @@ gimp_operation_hue_saturation_process (GeglOperation       *operation,
 
       if (use_secondary_hue)
         {
-          gdouble mapped_primary_hue;
-          gdouble mapped_secondary_hue;
-          gdouble diff;
+          const HueRangeTable *primary   = &table[hue];
+          const HueRangeTable *secondary = &table[secondary_hue];
+          gfloat               mapped_primary_hue;
+          gfloat               mapped_secondary_hue;
+          gfloat               diff;
 
-          mapped_primary_hue   = map_hue (config, hue,           hsl.h);
-          mapped_secondary_hue = map_hue (config, secondary_hue, hsl.h);
+          mapped_primary_hue   = map_hue (primary,   h);
+          mapped_secondary_hue = map_hue (secondary, h);
 
           /* Find nearest hue on the circle between primary and
            * secondary hue
@@ -233,28 +316,48 @@ gimp_operation_hue_saturation_process (GeglOperation       *operation,
               mapped_secondary_hue += 1.0;
             }
 
-          hsl.h = (mapped_primary_hue   * primary_intensity +
-                   mapped_secondary_hue * secondary_intensity);
+          h = (mapped_primary_hue   * primary_intensity +
+               mapped_secondary_hue * secondary_intensity);
 
-          hsl.s = (map_saturation (config, hue,           hsl.s) * primary_intensity +
-                   map_saturation (config, secondary_hue, hsl.s) * secondary_intensity);
+          s = (map_saturation (primary,   s) * primary_intensity +
+               map_saturation (secondary, s) * secondary_intensity);
 
-          hsl.l = (map_lightness (config, hue,           hsl.l) * primary_intensity +
-                   map_lightness (config, secondary_hue, hsl.l) * secondary_intensity);
+          l = (map_lightness (primary,   l) * primary_intensity +
+               map_lightness (secondary, l) * secondary_intensity);
         }
       else
         {
-          hsl.h = map_hue        (config, hue, hsl.h);
-          hsl.s = map_saturation (config, hue, hsl.s);
-          hsl.l = map_lightness  (config, hue, hsl.l);
+          h = map_hue        (&table[hue], h);
+          s = map_saturation (&table[hue], s);
+          l = map_lightness  (&table[hue], l);
+        }
+
+      /*  HSL -> RGB, see gimp_hsl_to_rgb()  */
+      if (s == 0.0)
+        {
+          dest[RED]   = l;
+          dest[GREEN] = l;
+          dest[BLUE]  = l;
         }
+      else
+        {
+          gfloat m1, m2;
 
-      gimp_hsl_to_rgb (&hsl, &rgb);
+          if (l <= 0.5)
+            m2 = l * (1.0 + s);
+          else
+            m2 = l + s - l * s;
 
-      dest[RED]   = rgb.r;
-      dest[GREEN] = rgb.g;
-      dest[BLUE]  = rgb.b;
-      dest[ALPHA] = rgb.a;
+          m1 = 2.0 * l - m2;
+
+          h *= 6.0;
+
+          dest[RED]   = hsl_value (m1, m2, h + 2.0);
+          dest[GREEN] = hsl_value (m1, m2, h);
+          dest[BLUE]  = hsl_value (m1, m2, h - 2.0);
+        }
+
+      dest[ALPHA] = src[ALPHA];
 
       src  += 4;
       dest += 4;
@@ -272,17 +375,20 @@ gimp_operation_hue_saturation_map (GimpHueSaturationConfig *config,
                                    GimpHueRange             range,
                                    GimpRGB                 *result)
 {
-  GimpHSL hsl;
+  HueRangeTable table;
+  GimpHSL       hsl;
 
   g_return_if_fail (GIMP_IS_HUE_SATURATION_CONFIG (config));
   g_return_if_fail (color != NULL);
   g_return_if_fail (result != NULL);
 
+  hue_range_table_init_range (config, range, &table);
+
   gimp_rgb_to_hsl (color, &hsl);
 
-  hsl.h = map_hue        (config, range, hsl.h);
-  hsl.s = map_saturation (config, range, hsl.s);
-  hsl.l = map_lightness  (config, range, hsl.l);
+  hsl.h = map_hue        (&table, hsl.h);
+  hsl.s = map_saturation (&table, hsl.s);
+  hsl.l = map_lightness  (&table, hsl.l);
 
   gimp_hsl_to_rgb (&hsl, result);
 }
@@ -29,6 +29,8 @@
 
 #include "operations-types.h"
 
+#include "gegl/gimp-gegl-parallel.h"
+
 #include "gimpoperationshapeburst.h"
 
 
@@ -40,6 +42,27 @@ enum
 };
 
 
+/*  The distance map is an exact euclidean distance transform of the
+ *  mask, where everything outside the input counts as unselected,
+ *  computed separably (Felzenszwalb & Huttenlocher, "Distance
+ *  Transforms of Sampled Functions"): a vertical pass computing each
+ *  pixel's distance to the closest unselected pixel in its column,
+ *  followed by a horizontal pass taking the lower envelope of the
+ *  parabolas rooted at these distances. Both passes are linear in
+ *  the number of pixels, and are split over threads by columns and
+ *  rows respectively.
+ */
+typedef struct
+{
+  const guchar *src;
+  gfloat       *dist;
+  gint          width;
+  gint          height;
+  gfloat        max;
+  GMutex        mutex;
+} ShapeburstData;
+
+
 static void     gimp_operation_shapeburst_get_property (GObject      *object,
                                                         guint         property_id,
                                                         GValue       *value,
@@ -63,6 +86,13 @@ static gboolean gimp_operation_shapeburst_process (GeglOperation       *operatio
                                                    const GeglRectangle *roi,
                                                    gint                 level);
 
+static void     gimp_operation_shapeburst_columns (gint                 offset,
+                                                   gint                 size,
+                                                   gpointer             user_data);
+static void     gimp_operation_shapeburst_rows    (gint                 offset,
+                                                   gint                 size,
+                                                   gpointer             user_data);
+
 
 G_DEFINE_TYPE (GimpOperationShapeburst, gimp_operation_shapeburst,
                GEGL_TYPE_OPERATION_FILTER)
@@ -182,138 +212,197 @@ gimp_operation_shapeburst_get_cached_region (GeglOperation       *self,
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
-static gboolean
-gimp_operation_shapeburst_process (GeglOperation       *operation,
-                                   GeglBuffer          *input,
-                                   GeglBuffer          *output,
-                                   const GeglRectangle *roi,
-                                   gint                 level)
+static void
+gimp_operation_shapeburst_columns (gint     offset,
+                                   gint     size,
+                                   gpointer user_data)
 {
-  const Babl *input_format   = babl_format ("Y u8");
-  const Babl *output_format  = babl_format ("Y float");
-  gfloat      max_iterations = 0.0;
-  gfloat     *distp_cur;
-  gfloat     *distp_prev;
-  gfloat     *memory;
-  gint        length;
-  gint        i;
-
-  length = roi->width + 1;
-  memory = g_new (gfloat, length * 2);
-
-  distp_prev = memory;
-  for (i = 0; i < length; i++)
-    distp_prev[i] = 0.0;
-
-  distp_prev += 1;
-  distp_cur = distp_prev + length;
-
-  for (i = 0; i < roi->height; i++)
+  ShapeburstData *data   = user_data;
+  gint            width  = data->width;
+  gint            height = data->height;
+  gint            x0     = offset;
+  gint            x1     = offset + size;
+  gint            x, y;
+
+  /*  top to bottom, the row above the input is unselected  */
+  for (x = x0; x < x1; x++)
+    data->dist[x] = data->src[x] ? 1.0 : 0.0;
+
+  for (y = 1; y < height; y++)
+    {
+      const guchar *src  = data->src  + y * width;
+      gfloat       *dist = data->dist + y * width;
+
+      for (x = x0; x < x1; x++)
+        dist[x] = src[x] ? dist[x - width] + 1.0 : 0.0;
+    }
+
+  /*  bottom to top, and so is the row below the input  */
+  for (x = x0; x < x1; x++)
+    {
+      gfloat *dist = data->dist + (height - 1) * width;
+
+      dist[x] = MIN (dist[x], 1.0);
+    }
+
+  for (y = height - 2; y >= 0; y--)
     {
-      gfloat *tmp;
-      gint    src = 0;
-      gint    j;
+      gfloat *dist = data->dist + y * width;
 
-      /*  set the current dist row to 0's  */
-      memset (distp_cur - 1, 0, sizeof (gfloat) * (length - 1));
+      for (x = x0; x < x1; x++)
+        dist[x] = MIN (dist[x], dist[x + width] + 1.0);
+    }
+}
 
-      for (j = 0; j < roi->width; j++)
+static void
+gimp_operation_shapeburst_rows (gint     offset,
+                                gint     size,
+                                gpointer user_data)
+{
+  ShapeburstData *data  = user_data;
+  gint            width = data->width;
+  gint            n     = width + 2;
+  gdouble        *f     = g_new (gdouble, n);
+  gdouble        *z     = g_new (gdouble, n + 1);
+  gint           *v     = g_new (gint, n);
+  gfloat          max   = 0.0;
+  gint            y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      const guchar *src  = data->src  + y * width;
+      gfloat       *dist = data->dist + y * width;
+      gint          k    = 0;
+      gint          q;
+
+      /*  the parabolas' heights; index q is column q - 1, with
+       *  unselected columns on both sides of the input
+       */
+      f[0]     = 0.0;
+      f[n - 1] = 0.0;
+
+      for (q = 1; q < n - 1; q++)
+        f[q] = (gdouble) dist[q - 1] * dist[q - 1];
+
+      /*  compute the lower envelope  */
+      v[0] = 0;
+      z[0] = -G_MAXDOUBLE;
+      z[1] =  G_MAXDOUBLE;
+
+      for (q = 1; q < n; q++)
         {
-          gfloat float_tmp;
-          gfloat min_prev = MIN (distp_cur[j-1], distp_prev[j]);
-          gint   min_left = MIN ((roi->width - j - 1), (roi->height - i - 1));
-          gint   min      = (gint) MIN (min_left, min_prev);
-          gint   fraction = 255;
-          gint   k;
+          gdouble s;
 
-          /*  This might need to be changed to 0
-              instead of k = (min) ? (min - 1) : 0  */
+          s = ((f[q] + (gdouble) q * q) - (f[v[k]] + (gdouble) v[k] * v[k])) /
+              (2.0 * (q - v[k]));
 
-          for (k = (min) ? (min - 1) : 0; k <= min; k++)
+          while (s <= z[k])
             {
-              gint x   = j;
-              gint y   = i + k;
-              gint end = y - k;
-
-              while (y >= end)
-                {
-                  guchar src_uchar;
-
-#if 1
-                  /* FIXME: this should be much faster, it converts
-                   * to 32 bit rgba intermediately, bah...
-                   */
-                  gegl_buffer_sample (input, x, y, NULL, &src_uchar,
-                                      input_format,
-                                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-#else
-                  gegl_buffer_get (input, GEGL_RECTANGLE (x, y, 1, 1), 1.0,
-                                   input_format, &src_uchar,
-                                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-#endif
-
-                  src = src_uchar;
-
-                  if (src == 0)
-                    {
-                      min = k;
-                      y = -1;
-                      break;
-                    }
-
-                  if (src < fraction)
-                    fraction = src;
-
-                  x++;
-                  y--;
-                }
+              k--;
+
+              s = ((f[q] + (gdouble) q * q) - (f[v[k]] + (gdouble) v[k] * v[k])) /
+                  (2.0 * (q - v[k]));
             }
 
-          if (src != 0)
-            {
-              /*  If min_left != min_prev use the previous fraction
-               *   if it is less than the one found
-               */
-              if (min_left != min)
-                {
-                  gint prev_frac = (int) (255 * (min_prev - min));
+          k++;
+          v[k]     = q;
+          z[k]     = s;
+          z[k + 1] = G_MAXDOUBLE;
+        }
 
-                  if (prev_frac == 255)
-                    prev_frac = 0;
+      /*  sample it  */
+      for (k = 0, q = 1; q < n - 1; q++)
+        {
+          gint   p;
+          gfloat d;
+
+          while (z[k + 1] < q)
+            k++;
 
-                  fraction = MIN (fraction, prev_frac);
-                }
+          p = v[k];
 
-              min++;
+          if (src[q - 1])
+            {
+              /*  pixels partially selected are moved towards the edge
+               *  by their amount of unselectedness, this keeps the
+               *  map smooth along antialiased mask edges
+               */
+              d = sqrt ((gdouble) (q - p) * (q - p) + f[p]) -
+                  1.0 + src[q - 1] / 255.0;
+            }
+          else
+            {
+              d = 0.0;
             }
 
-          float_tmp = distp_cur[j] = min + fraction / 256.0;
+          dist[q - 1] = d;
 
-          if (float_tmp > max_iterations)
-            max_iterations = float_tmp;
+          if (d > max)
+            max = d;
         }
-
-      /*  set the dist row  */
-      gegl_buffer_set (output,
-                       GEGL_RECTANGLE (roi->x, roi->y + i,
-                                       roi->width, 1),
-                       1.0, output_format, distp_cur,
-                       GEGL_AUTO_ROWSTRIDE);
-
-      /*  swap pointers around  */
-      tmp = distp_prev;
-      distp_prev = distp_cur;
-      distp_cur = tmp;
-
-      g_object_set (operation,
-                    "progress", (gdouble) i / roi->height,
-                    NULL);
     }
 
-  g_free (memory);
+  g_mutex_lock (&data->mutex);
+  data->max = MAX (data->max, max);
+  g_mutex_unlock (&data->mutex);
+
+  g_free (f);
+  g_free (z);
+  g_free (v);
+}
+
+static gboolean
+gimp_operation_shapeburst_process (GeglOperation       *operation,
+                                   GeglBuffer          *input,
+                                   GeglBuffer          *output,
+                                   const GeglRectangle *roi,
+                                   gint                 level)
+{
+  const Babl     *input_format  = babl_format ("Y u8");
+  const Babl     *output_format = babl_format ("Y float");
+  ShapeburstData  data;
+  guchar         *src;
+  gfloat         *dist;
+
+  if (roi->width < 1 || roi->height < 1)
+    return TRUE;
+
+  src  = g_new (guchar, (gsize) roi->width * roi->height);
+  dist = g_new (gfloat, (gsize) roi->width * roi->height);
+
+  gegl_buffer_get (input, roi, 1.0, input_format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  data.src    = src;
+  data.dist   = dist;
+  data.width  = roi->width;
+  data.height = roi->height;
+  data.max    = 0.0;
+  g_mutex_init (&data.mutex);
+
+  gimp_gegl_parallel_distribute_range (roi->width, 64,
+                                       gimp_operation_shapeburst_columns,
+                                       &data);
+
+  g_object_set (operation,
+                "progress", 0.5,
+                NULL);
+
+  gimp_gegl_parallel_distribute_range (roi->height, 64,
+                                       gimp_operation_shapeburst_rows,
+                                       &data);
+
+  g_mutex_clear (&data.mutex);
+
+  gegl_buffer_set (output, roi, 0, output_format, dist,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_free (src);
+  g_free (dist);
 
   g_object_set (operation,
-                "max-iterations", (gdouble) max_iterations,
+                "progress",       1.0,
+                "max-iterations", (gdouble) data.max,
                 NULL);
 
   return TRUE;
@@ -29,6 +29,7 @@
 
 #include "operations-types.h"
 
+#include "gimpmaskmorphology.h"
 #include "gimpoperationshrink.h"
 
 
@@ -65,6 +66,11 @@ static gboolean      gimp_operation_shrink_process (GeglOperation       *operati
                                                     const GeglRectangle *roi,
                                                     gint                 level);
 
+static void     gimp_operation_shrink_process_rows (GimpOperationShrink *self,
+                                                    GeglBuffer          *input,
+                                                    GeglBuffer          *output,
+                                                    const GeglRectangle *roi);
+
 
 G_DEFINE_TYPE (GimpOperationShrink, gimp_operation_shrink,
                GEGL_TYPE_OPERATION_FILTER)
@@ -202,29 +208,6 @@ gimp_operation_shrink_get_cached_region (GeglOperation       *self,
   return *gegl_operation_source_get_bounding_box (self, "input");
 }
 
-static void
-compute_border (gint16  *circ,
-                guint16  xradius,
-                guint16  yradius)
-{
-  gint32  i;
-  gint32  diameter = xradius * 2 + 1;
-  gdouble tmp;
-
-  for (i = 0; i < diameter; i++)
-    {
-      if (i > xradius)
-        tmp = (i - xradius) - 0.5;
-      else if (i < xradius)
-        tmp = (xradius - i) - 0.5;
-      else
-        tmp = 0.0;
-
-      circ[i] = RINT (yradius /
-                      (gdouble) xradius * sqrt (SQR (xradius) - SQR (tmp)));
-    }
-}
-
 static inline void
 rotate_pointers (gfloat  **p,
                  guint32   n)
@@ -240,12 +223,11 @@ rotate_pointers (gfloat  **p,
   p[i] = tmp;
 }
 
-static gboolean
-gimp_operation_shrink_process (GeglOperation       *operation,
-                               GeglBuffer          *input,
-                               GeglBuffer          *output,
-                               const GeglRectangle *roi,
-                               gint                 level)
+static void
+gimp_operation_shrink_process_rows (GimpOperationShrink *self,
+                                    GeglBuffer          *input,
+                                    GeglBuffer          *output,
+                                    const GeglRectangle *roi)
 {
   /* Pretty much the same as fatten_region only different.
    * Blame all bugs in this function on jaycox@gimp.org
@@ -254,7 +236,6 @@ gimp_operation_shrink_process (GeglOperation       *operation,
    * are passed are identical to the edge pixels.  If edge_lock is
    * false, we assume that pixels outside the region are 0
    */
-  GimpOperationShrink *self          = GIMP_OPERATION_SHRINK (operation);
   const Babl          *input_format  = babl_format ("Y float");
   const Babl          *output_format = babl_format ("Y float");
   gint32               i, j, x, y;
@@ -320,7 +301,7 @@ gimp_operation_shrink_process (GeglOperation       *operation,
   out = g_new (gfloat, roi->width);
 
   circ = g_new (gint16, 2 * self->radius_x + 1);
-  compute_border (circ, self->radius_x, self->radius_y);
+  gimp_mask_morphology_ellipse (self->radius_x, self->radius_y, circ);
 
  /* offset the circ pointer by self->radius_x so the range of the
   * array is [-self->radius_x] to [self->radius_x]
@@ -436,6 +417,77 @@ gimp_operation_shrink_process (GeglOperation       *operation,
 
   g_free (buf);
   g_free (out);
+}
+
+static gboolean
+gimp_operation_shrink_process (GeglOperation       *operation,
+                               GeglBuffer          *input,
+                               GeglBuffer          *output,
+                               const GeglRectangle *roi,
+                               gint                 level)
+{
+  GimpOperationShrink *self   = GIMP_OPERATION_SHRINK (operation);
+  const Babl          *format = babl_format ("Y float");
+  gfloat              *src;
+  gfloat              *dest;
+
+  src  = g_new (gfloat, (gsize) roi->width * roi->height);
+  dest = g_new (gfloat, (gsize) roi->width * roi->height);
+
+  gegl_buffer_get (input, roi, 1.0, format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  /*  the separable version handles everything but masks with
+   *  lots of partially selected pixels, like feathered selections;
+   *  shrinking is growing the inverted mask
+   */
+  if (gimp_mask_morphology_dilate (src, dest, roi->width, roi->height,
+                                   self->radius_x, self->radius_y, TRUE))
+    {
+      /*  with edge lock, the area outside the input is like its edge
+       *  pixels and doesn't change anything; without, it counts as
+       *  unselected, which unselects everything within the radius of
+       *  the input's edges
+       */
+      if (! self->edge_lock)
+        {
+          gint x, y;
+
+          for (y = 0; y < roi->height; y++)
+            {
+              gfloat *row = dest + (gsize) y * roi->width;
+
+              if (y < self->radius_y || y >= roi->height - self->radius_y)
+                {
+                  memset (row, 0, roi->width * sizeof (gfloat));
+                }
+              else
+                {
+                  for (x = 0; x < MIN (self->radius_x, roi->width); x++)
+                    row[x] = 0.0;
+
+                  for (x = MAX (roi->width - self->radius_x, 0); x < roi->width; x++)
+                    row[x] = 0.0;
+                }
+            }
+        }
+
+      gegl_buffer_set (output, roi, 0, format, dest,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+  else
+    {
+      /*  the row based code reads the input itself  */
+      g_free (src);
+      g_free (dest);
+
+      gimp_operation_shrink_process_rows (self, input, output, roi);
+
+      return TRUE;
+    }
+
+  g_free (src);
+  g_free (dest);
 
   return TRUE;
 }
@@ -27,6 +27,7 @@
 #include "paint-types.h"
 
 #include "gegl/gimp-babl.h"
+#include "gegl/gimp-gegl-parallel.h"
 
 #include "core/gimpbrush.h"
 #include "core/gimpdrawable.h"
@@ -47,6 +48,9 @@
 
 #define EPSILON  0.00001
 
+/*  masks smaller than this are not worth splitting across threads  */
+#define MIN_PARALLEL_PIXELS (256 * 256)
+
 enum
 {
   SET_BRUSH,
@@ -55,6 +59,34 @@ enum
 };
 
 
+typedef struct
+{
+  const guchar *src;
+  gint          src_width;
+  gint          src_height;
+  guchar       *dest;
+  gint          dest_width;
+  gint          dest_offset_x;
+  gint          dest_offset_y;
+  const gint   *kernel;
+} SubsampleData;
+
+typedef struct
+{
+  const guchar *src;
+  guchar       *dest;
+  const guchar *map;
+} PressurizeData;
+
+typedef struct
+{
+  const guchar *src;
+  gint          src_width;
+  gfloat       *dest;
+  gint          dest_width;
+} SolidifyData;
+
+
 /*  local function prototypes  */
 
 static void      gimp_brush_core_finalize           (GObject          *object);
@@ -117,6 +149,16 @@ static const GimpTempBuf *
 static void      gimp_brush_core_invalidate_cache   (GimpBrush         *brush,
                                                      GimpBrushCore     *core);
 
+static void      gimp_brush_core_subsample_rows     (gint               offset,
+                                                     gint               size,
+                                                     SubsampleData     *data);
+static void      gimp_brush_core_pressurize_pixels  (gint               offset,
+                                                     gint               size,
+                                                     PressurizeData    *data);
+static void      gimp_brush_core_solidify_rows      (gint               offset,
+                                                     gint               size,
+                                                     SolidifyData      *data);
+
 /*  brush pipe utility functions  */
 static void  gimp_brush_core_paint_line_pixmap_mask (GimpDrawable      *drawable,
                                                      const GimpTempBuf *pixmap_mask,
@@ -257,6 +299,18 @@ gimp_brush_core_finalize (GObject *object)
       core->rand = NULL;
     }
 
+  if (core->transform_brush)
+    {
+      gimp_temp_buf_unref (core->transform_brush);
+      core->transform_brush = NULL;
+    }
+
+  if (core->transform_pixmap)
+    {
+      gimp_temp_buf_unref (core->transform_pixmap);
+      core->transform_pixmap = NULL;
+    }
+
   for (i = 0; i < KERNEL_SUBSAMPLE + 1; i++)
     for (j = 0; j < KERNEL_SUBSAMPLE + 1; j++)
       if (core->subsample_brushes[i][j])
@@ -1030,19 +1084,97 @@ gimp_brush_core_invalidate_cache (GimpBrush     *brush,
  *             LOCAL FUNCTION DEFINITIONS                   *
  ************************************************************/
 
-static inline void
-rotate_pointers (gulong  **p,
-                 guint32   n)
+static void
+gimp_brush_core_subsample_rows (gint           offset,
+                                gint           size,
+                                SubsampleData *data)
+{
+  guint16 *accum = g_new (guint16, data->dest_width);
+  gint     y;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      guchar *d = data->dest + y * data->dest_width;
+      guint16 bias;
+      gint    r, c, j;
+
+      memset (accum, 0, sizeof (guint16) * data->dest_width);
+
+      /*  gather the contributions of the (at most) KERNEL_HEIGHT
+       *  source rows, one kernel tap at a time, so the inner loop is a
+       *  plain multiply-add over a row the compiler can vectorize.
+       *  KERNEL_SUM * 255 fits in 16 bits.
+       */
+      for (r = 0; r < KERNEL_HEIGHT; r++)
+        {
+          gint          src_y = y - data->dest_offset_y - r;
+          const guchar *m;
+
+          if (src_y < 0 || src_y >= data->src_height)
+            continue;
+
+          m = data->src + src_y * data->src_width;
+
+          for (c = 0; c < KERNEL_WIDTH; c++)
+            {
+              const guint16  weight = data->kernel[r * KERNEL_WIDTH + c];
+              guint16       *a      = accum + data->dest_offset_x + c;
+              gint           n;
+
+              if (! weight)
+                continue;
+
+              n = MIN (data->src_width,
+                       data->dest_width - data->dest_offset_x - c);
+
+              for (j = 0; j < n; j++)
+                a[j] += m[j] * weight;
+            }
+        }
+
+      /*  rows past the end of the source mask have always been
+       *  rounded differently, keep it that way
+       */
+      if (y - data->dest_offset_y < data->src_height)
+        bias = KERNEL_SUM / 2 - 1;
+      else
+        bias = KERNEL_SUM / 2;
+
+      for (j = 0; j < data->dest_width; j++)
+        d[j] = (accum[j] + bias) / KERNEL_SUM;
+    }
+
+  g_free (accum);
+}
+
+static void
+gimp_brush_core_pressurize_pixels (gint            offset,
+                                   gint            size,
+                                   PressurizeData *data)
 {
-  guint32  i;
-  gulong  *tmp;
+  const guchar *source = data->src  + offset;
+  guchar       *dest   = data->dest + offset;
+
+  while (size--)
+    *dest++ = data->map[*source++];
+}
 
-  tmp = p[0];
+static void
+gimp_brush_core_solidify_rows (gint          offset,
+                               gint          size,
+                               SolidifyData *data)
+{
+  gint y;
 
-  for (i = 0; i < n-1; i++)
-    p[i] = p[i+1];
+  for (y = offset; y < offset + size; y++)
+    {
+      const guchar *m = data->src  + y * data->src_width;
+      gfloat       *d = data->dest + y * data->dest_width;
+      gint          j;
 
-  p[i] = tmp;
+      for (j = 0; j < data->src_width; j++)
+        d[j] = m[j] ? 1.0 : 0.0;
+    }
 }
 
 static const GimpTempBuf *
@@ -1051,24 +1183,17 @@ gimp_brush_core_subsample_mask (GimpBrushCore     *core,
                                 gdouble            x,
                                 gdouble            y)
 {
-  GimpTempBuf  *dest;
-  gdouble       left;
-  const guchar *m;
-  guchar       *d;
-  const gint   *k;
-  gint          index1;
-  gint          index2;
-  gint          dest_offset_x = 0;
-  gint          dest_offset_y = 0;
-  const gint   *kernel;
-  gint          i, j;
-  gint          r, s;
-  gulong       *accum[KERNEL_HEIGHT];
-  gint          offs;
-  gint          mask_width  = gimp_temp_buf_get_width  (mask);
-  gint          mask_height = gimp_temp_buf_get_height (mask);
-  gint          dest_width;
-  gint          dest_height;
+  SubsampleData  data;
+  GimpTempBuf   *dest;
+  gdouble        left;
+  gint           index1;
+  gint           index2;
+  gint           dest_offset_x = 0;
+  gint           dest_offset_y = 0;
+  const gint    *kernel;
+  gint           i, j;
+  gint           mask_width  = gimp_temp_buf_get_width  (mask);
+  gint           mask_height = gimp_temp_buf_get_height (mask);
 
   while (x < 0)
     x += mask_width;
@@ -1131,56 +1256,24 @@ gimp_brush_core_subsample_mask (GimpBrushCore     *core,
   dest = gimp_temp_buf_new (mask_width  + 2,
                             mask_height + 2,
                             gimp_temp_buf_get_format (mask));
-  gimp_temp_buf_data_clear (dest);
-
-  dest_width  = gimp_temp_buf_get_width  (dest);
-  dest_height = gimp_temp_buf_get_height (dest);
-
-  /* Allocate and initialize the accum buffer */
-  for (i = 0; i < KERNEL_HEIGHT ; i++)
-    accum[i] = g_new0 (gulong, dest_width + 1);
 
   core->subsample_brushes[index2][index1] = dest;
 
-  m = gimp_temp_buf_get_data (mask);
-  for (i = 0; i < mask_height; i++)
-    {
-      for (j = 0; j < mask_width; j++)
-        {
-          k = kernel;
-          for (r = 0; r < KERNEL_HEIGHT; r++)
-            {
-              offs = j + dest_offset_x;
-              s = KERNEL_WIDTH;
-              while (s--)
-                accum[r][offs++] += *m * *k++;
-            }
-          m++;
-        }
-
-      /* store the accum buffer into the destination mask */
-      d = gimp_temp_buf_get_data (dest) + (i + dest_offset_y) * dest_width;
-      for (j = 0; j < dest_width; j++)
-        *d++ = (accum[0][j] + 127) / KERNEL_SUM;
-
-      rotate_pointers (accum, KERNEL_HEIGHT);
-
-      memset (accum[KERNEL_HEIGHT - 1], 0, sizeof (gulong) * dest_width);
-    }
-
-  /* store the rest of the accum buffer into the dest mask */
-  while (i + dest_offset_y < dest_height)
-    {
-      d = gimp_temp_buf_get_data (dest) + (i + dest_offset_y) * dest_width;
-      for (j = 0; j < dest_width; j++)
-        *d++ = (accum[0][j] + (KERNEL_SUM / 2)) / KERNEL_SUM;
-
-      rotate_pointers (accum, KERNEL_HEIGHT);
-      i++;
-    }
-
-  for (i = 0; i < KERNEL_HEIGHT ; i++)
-    g_free (accum[i]);
+  data.src           = gimp_temp_buf_get_data (mask);
+  data.src_width     = mask_width;
+  data.src_height    = mask_height;
+  data.dest          = gimp_temp_buf_get_data (dest);
+  data.dest_width    = gimp_temp_buf_get_width (dest);
+  data.dest_offset_x = dest_offset_x;
+  data.dest_offset_y = dest_offset_y;
+  data.kernel        = kernel;
+
+  gimp_gegl_parallel_distribute_range (gimp_temp_buf_get_height (dest),
+                                       MAX (MIN_PARALLEL_PIXELS /
+                                            data.dest_width, 1),
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_brush_core_subsample_rows,
+                                       &data);
 
   return dest;
 }
@@ -1194,9 +1287,8 @@ gimp_brush_core_pressurize_mask (GimpBrushCore     *core,
                                  gdouble            y,
                                  gdouble            pressure)
 {
-  static guchar      mapi[256];
-  const guchar      *source;
-  guchar            *dest;
+  guchar             mapi[256];
+  PressurizeData     data;
   const GimpTempBuf *subsample_mask;
   gint               i;
 
@@ -1216,7 +1308,6 @@ gimp_brush_core_pressurize_mask (GimpBrushCore     *core,
     gimp_temp_buf_new (gimp_temp_buf_get_width  (brush_mask) + 2,
                        gimp_temp_buf_get_height (brush_mask) + 2,
                        gimp_temp_buf_get_format (brush_mask));
-  gimp_temp_buf_data_clear (core->pressure_brush);
 
 #ifdef FANCY_PRESSURE
 
@@ -1293,14 +1384,16 @@ gimp_brush_core_pressurize_mask (GimpBrushCore     *core,
 
   /* Now convert the brush */
 
-  source = gimp_temp_buf_get_data (subsample_mask);
-  dest   = gimp_temp_buf_get_data (core->pressure_brush);
-
-  i = gimp_temp_buf_get_width  (subsample_mask) *
-      gimp_temp_buf_get_height (subsample_mask);
+  data.src  = gimp_temp_buf_get_data (subsample_mask);
+  data.dest = gimp_temp_buf_get_data (core->pressure_brush);
+  data.map  = mapi;
 
-  while (i--)
-    *dest++ = mapi[(*source++)];
+  gimp_gegl_parallel_distribute_range (gimp_temp_buf_get_width  (subsample_mask) *
+                                       gimp_temp_buf_get_height (subsample_mask),
+                                       MIN_PARALLEL_PIXELS,
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_brush_core_pressurize_pixels,
+                                       &data);
 
   return core->pressure_brush;
 }
@@ -1311,9 +1404,8 @@ gimp_brush_core_solidify_mask (GimpBrushCore     *core,
                                gdouble            x,
                                gdouble            y)
 {
+  SolidifyData  data;
   GimpTempBuf  *dest;
-  const guchar *m;
-  gfloat       *d;
   gint          dest_offset_x     = 0;
   gint          dest_offset_y     = 0;
   gint          brush_mask_width  = gimp_temp_buf_get_width  (brush_mask);
@@ -1365,18 +1457,19 @@ gimp_brush_core_solidify_mask (GimpBrushCore     *core,
 
   core->solid_brushes[dest_offset_y][dest_offset_x] = dest;
 
-  m = gimp_temp_buf_get_data (brush_mask);
-  d = ((gfloat *) gimp_temp_buf_get_data (dest) +
-       ((dest_offset_y + 1) * gimp_temp_buf_get_width (dest) +
-        (dest_offset_x + 1)));
+  data.src        = gimp_temp_buf_get_data (brush_mask);
+  data.src_width  = brush_mask_width;
+  data.dest       = ((gfloat *) gimp_temp_buf_get_data (dest) +
+                     ((dest_offset_y + 1) * gimp_temp_buf_get_width (dest) +
+                      (dest_offset_x + 1)));
+  data.dest_width = gimp_temp_buf_get_width (dest);
 
-  for (i = 0; i < brush_mask_height; i++)
-    {
-      for (j = 0; j < brush_mask_width; j++)
-        *d++ = (*m++) ? 1.0 : 0.0;
-
-      d += 2;
-    }
+  gimp_gegl_parallel_distribute_range (brush_mask_height,
+                                       MAX (MIN_PARALLEL_PIXELS /
+                                            brush_mask_width, 1),
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_brush_core_solidify_rows,
+                                       &data);
 
   return dest;
 }
@@ -1385,7 +1478,7 @@ static const GimpTempBuf *
 gimp_brush_core_transform_mask (GimpBrushCore *core,
                                 GimpBrush     *brush)
 {
-  const GimpTempBuf *mask;
+  GimpTempBuf *mask;
 
   if (core->scale <= 0.0)
     return NULL;
@@ -1396,8 +1489,18 @@ gimp_brush_core_transform_mask (GimpBrushCore *core,
                                     core->angle,
                                     core->hardness);
 
+  /*  keep our reference, so the mask stays alive while it's in use,
+   *  even when the brush's cache drops it
+   */
   if (mask == core->transform_brush)
-    return mask;
+    {
+      gimp_temp_buf_unref (mask);
+
+      return core->transform_brush;
+    }
+
+  if (core->transform_brush)
+    gimp_temp_buf_unref (core->transform_brush);
 
   core->transform_brush         = mask;
   core->subsample_cache_invalid = TRUE;
@@ -1410,7 +1513,7 @@ static const GimpTempBuf *
 gimp_brush_core_transform_pixmap (GimpBrushCore *core,
                                   GimpBrush     *brush)
 {
-  const GimpTempBuf *pixmap;
+  GimpTempBuf *pixmap;
 
   if (core->scale <= 0.0)
     return NULL;
@@ -1422,7 +1525,14 @@ gimp_brush_core_transform_pixmap (GimpBrushCore *core,
                                         core->hardness);
 
   if (pixmap == core->transform_pixmap)
-    return pixmap;
+    {
+      gimp_temp_buf_unref (pixmap);
+
+      return core->transform_pixmap;
+    }
+
+  if (core->transform_pixmap)
+    gimp_temp_buf_unref (core->transform_pixmap);
 
   core->transform_pixmap        = pixmap;
   core->subsample_cache_invalid = TRUE;
@@ -132,8 +132,6 @@ gimp_convolve_motion (GimpPaintCore    *paint_core,
   GeglBuffer          *paint_buffer;
   gint                 paint_buffer_x;
   gint                 paint_buffer_y;
-  GimpTempBuf         *temp_buf;
-  GeglBuffer          *convolve_buffer;
   gdouble              fade_point;
   gdouble              opacity;
   gdouble              rate;
@@ -168,25 +166,11 @@ gimp_convolve_motion (GimpPaintCore    *paint_core,
                                   gimp_temp_buf_get_height (brush_core->brush->mask) / 2,
                                   rate);
 
-  /*  need a linear buffer for gimp_gegl_convolve()  */
-  temp_buf = gimp_temp_buf_new (gegl_buffer_get_width  (paint_buffer),
-                                gegl_buffer_get_height (paint_buffer),
-                                gegl_buffer_get_format (paint_buffer));
-  convolve_buffer = gimp_temp_buf_create_buffer (temp_buf);
-  gimp_temp_buf_unref (temp_buf);
-
-  gegl_buffer_copy (gimp_drawable_get_buffer (drawable),
-                    GEGL_RECTANGLE (paint_buffer_x,
-                                    paint_buffer_y,
-                                    gegl_buffer_get_width  (paint_buffer),
-                                    gegl_buffer_get_height (paint_buffer)),
-                    convolve_buffer,
-                    GEGL_RECTANGLE (0, 0, 0, 0));
-
-  gimp_gegl_convolve (convolve_buffer,
-                      GEGL_RECTANGLE (0, 0,
-                                      gegl_buffer_get_width  (convolve_buffer),
-                                      gegl_buffer_get_height (convolve_buffer)),
+  gimp_gegl_convolve (gimp_drawable_get_buffer (drawable),
+                      GEGL_RECTANGLE (paint_buffer_x,
+                                      paint_buffer_y,
+                                      gegl_buffer_get_width  (paint_buffer),
+                                      gegl_buffer_get_height (paint_buffer)),
                       paint_buffer,
                       GEGL_RECTANGLE (0, 0,
                                       gegl_buffer_get_width  (paint_buffer),
@@ -194,8 +178,6 @@ gimp_convolve_motion (GimpPaintCore    *paint_core,
                       convolve->matrix, 3, convolve->matrix_divisor,
                       GIMP_NORMAL_CONVOL, TRUE);
 
-  g_object_unref (convolve_buffer);
-
   gimp_brush_core_replace_canvas (brush_core, drawable,
                                   coords,
                                   MIN (opacity, GIMP_OPACITY_OPAQUE),
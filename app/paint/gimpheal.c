@@ -40,12 +40,57 @@
 #include "core/gimppickable.h"
 #include "core/gimptempbuf.h"
 
+#include "gegl/gimp-gegl-parallel.h"
+
 #include "gimpheal.h"
 #include "gimpsourceoptions.h"
 
 #include "gimp-intl.h"
 
 
+/* don't create coarser levels smaller than this */
+#define MIN_LEVEL_SIZE    16
+
+/* Gauss-Seidel iterations before and after each coarse correction */
+#define N_SMOOTH          2
+
+/* give up after this many V-cycles, about ten are needed */
+#define MAX_CYCLES        50
+
+/* don't split iterations over fewer unknowns than this across threads */
+#define MIN_PARALLEL_SIZE (64 * 64)
+
+
+typedef struct _HealLevel HealLevel;
+
+struct _HealLevel
+{
+  gint       width;
+  gint       height;
+  gint       depth;
+  guchar    *mask;
+  gfloat    *pixels;
+  gfloat    *pixels_alloc;
+  gfloat    *rhs;
+
+  gfloat    *Adiag;
+  gint      *Aidx;
+  gint       nmask;
+  gint       nred;
+  gfloat     w;
+
+  HealLevel *coarse;
+};
+
+typedef struct
+{
+  HealLevel *level;
+  gint       offset;
+  gfloat     err;
+  GMutex     mutex;
+} LaplaceData;
+
+
 
 /* NOTES
  *
@@ -55,8 +100,12 @@
  * corrected, I1 is the reference pattern. Then we solve DeltaI=0
  * (Laplace) with I2 Dirichlet conditions at the borders of the
  * mask. The solver is a red/black checker Gauss-Seidel with over-relaxation.
- * It could benefit from a multi-grid evaluation of an initial solution
- * before the main iteration loop.
+ * It only removes the high frequency error quickly, so it is used as the
+ * smoother of multigrid V-cycles: the residual is restricted to a level
+ * at half the resolution, where the correction is solved for the same
+ * way, down to a small level that is solved with over-relaxation, and
+ * the interpolated correction is smoothed again. This converges in a
+ * number of cycles that doesn't depend on the size of the mask.
  *
  * I reduced the convergence criteria to 0.1% (0.001) as we are
  * dealing here with RGB integer components, more is overkill.
@@ -309,26 +358,126 @@ gimp_heal_laplace_iteration (gfloat *pixels,
   return err;
 }
 
-/* Solve the laplace equation for pixels and store the result in-place.
+/* Perform one iteration of Gauss-Seidel for A x = rhs, as used on the
+ * coarser levels, and return the sum squared residual.
+ */
+static float
+gimp_heal_laplace_iteration_rhs (gfloat       *pixels,
+                                 const gfloat *rhs,
+                                 gfloat       *Adiag,
+                                 gint         *Aidx,
+                                 gfloat        w,
+                                 gint          nmask,
+                                 gint          depth)
+{
+  gint   i, k;
+  gfloat err = 0;
+
+  for (i = 0; i < nmask; i++)
+    {
+      gint   j0 = Aidx[i * 5 + 0];
+      gint   j1 = Aidx[i * 5 + 1];
+      gint   j2 = Aidx[i * 5 + 2];
+      gint   j3 = Aidx[i * 5 + 3];
+      gint   j4 = Aidx[i * 5 + 4];
+      gfloat a  = Adiag[i];
+
+      for (k = 0; k < depth; k++)
+        {
+          gfloat diff = (a * pixels[j0 + k] -
+                         w * (pixels[j1 + k] +
+                              pixels[j2 + k] +
+                              pixels[j3 + k] +
+                              pixels[j4 + k] +
+                              rhs[j0 + k]));
+
+          pixels[j0 + k] -= diff;
+          err += diff * diff;
+        }
+    }
+
+  return err;
+}
+
+/* Perform one iteration of Gauss-Seidel over a part of the cells of one
+ * color. Cells of the same color don't depend on each other, so the parts
+ * can be processed in parallel.
  */
 static void
-gimp_heal_laplace_loop (gfloat *pixels,
-                        gint    height,
-                        gint    depth,
-                        gint    width,
-                        guchar *mask)
+gimp_heal_laplace_iteration_range (gint         offset,
+                                   gint         size,
+                                   LaplaceData *data)
 {
-  /* Tolerate a total deviation-from-smoothness of 0.1 LSBs at 8bit depth. */
-#define EPSILON  (0.1/255)
-#define MAX_ITER 500
+  HealLevel *level = data->level;
+  gint       start = data->offset + offset;
+  gfloat     err;
+
+  if (level->rhs)
+    {
+      err = gimp_heal_laplace_iteration_rhs (level->pixels, level->rhs,
+                                             level->Adiag + start,
+                                             level->Aidx  + start * 5,
+                                             level->w, size, level->depth);
+    }
+  else
+    {
+      err = gimp_heal_laplace_iteration (level->pixels,
+                                         level->Adiag + start,
+                                         level->Aidx  + start * 5,
+                                         level->w, size, level->depth);
+    }
+
+  g_mutex_lock (&data->mutex);
+  data->err += err;
+  g_mutex_unlock (&data->mutex);
+}
+
+/* Perform one iteration of Gauss-Seidel over the whole level, red cells
+ * first, and return the sum squared residual.
+ */
+static gfloat
+gimp_heal_laplace_sweep (HealLevel *level)
+{
+  LaplaceData data;
+
+  data.level = level;
+  data.err   = 0.0;
+
+  g_mutex_init (&data.mutex);
+
+  data.offset = 0;
+  gimp_gegl_parallel_distribute_range (level->nred, MIN_PARALLEL_SIZE,
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_heal_laplace_iteration_range,
+                                       &data);
+
+  data.offset = level->nred;
+  gimp_gegl_parallel_distribute_range (level->nmask - level->nred,
+                                       MIN_PARALLEL_SIZE,
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_heal_laplace_iteration_range,
+                                       &data);
+
+  g_mutex_clear (&data.mutex);
+
+  return data.err;
+}
 
-  gint    i, j, iter, parity, nmask, zero;
-  gfloat *Adiag;
-  gint   *Aidx;
-  gfloat  w;
+/* Construct the system of equations of a level, for the over-relaxation
+ * factor w.
+ */
+static void
+gimp_heal_laplace_level_init (HealLevel *level,
+                              gfloat     w)
+{
+  gint    width  = level->width;
+  gint    height = level->height;
+  gint    depth  = level->depth;
+  guchar *mask   = level->mask;
+  gint    i, j, parity, nmask, zero;
 
-  Adiag = g_new (gfloat, width * height);
-  Aidx  = g_new (gint, 5 * width * height);
+  level->Adiag = g_new (gfloat, width * height);
+  level->Aidx  = g_new (gint, 5 * width * height);
 
   /* All off-diagonal elements of A are either -1 or 0. We could store it as a
    * general-purpose sparse matrix, but that adds some unnecessary overhead to
@@ -337,56 +486,326 @@ gimp_heal_laplace_loop (gfloat *pixels,
    * coefs can put them in a dummy column to be multiplied by an empty pixel.
    */
   zero = depth * width * height;
-  memset (pixels + zero, 0, depth * sizeof (gfloat));
+  memset (level->pixels + zero, 0, depth * sizeof (gfloat));
 
-  /* Construct the system of equations.
-   * Arrange Aidx in checkerboard order, so that a single linear pass over that
-   * array results updating all of the red cells and then all of the black cells.
+  /* Arrange Aidx in checkerboard order, so that a single linear pass over
+   * that array results updating all of the red cells and then all of the
+   * black cells.
    */
   nmask = 0;
   for (parity = 0; parity < 2; parity++)
-    for (i = 0; i < height; i++)
-      for (j = (i&1)^parity; j < width; j+=2)
-        if (mask[j + i * width])
-          {
+    {
+      for (i = 0; i < height; i++)
+        for (j = (i&1)^parity; j < width; j+=2)
+          if (mask[j + i * width])
+            {
+              gint *Aidx = level->Aidx;
+
 #define A_NEIGHBOR(o,di,dj) \
-            if ((dj<0 && j==0) || (dj>0 && j==width-1) || (di<0 && i==0) || (di>0 && i==height-1)) \
-              Aidx[o + nmask * 5] = zero; \
-            else                                               \
-              Aidx[o + nmask * 5] = ((i + di) * width + (j + dj)) * depth;
-
-            /* Omit Dirichlet conditions for any neighbors off the
-             * edge of the canvas.
-             */
-            Adiag[nmask] = 4 - (i==0) - (j==0) - (i==height-1) - (j==width-1);
-            A_NEIGHBOR (0,  0,  0);
-            A_NEIGHBOR (1,  0,  1);
-            A_NEIGHBOR (2,  1,  0);
-            A_NEIGHBOR (3,  0, -1);
-            A_NEIGHBOR (4, -1,  0);
-            nmask++;
-          }
-
-  /* Empirically optimal over-relaxation factor. (Benchmarked on
-   * round brushes, at least. I don't know whether aspect ratio
-   * affects it.)
-   */
-  w = 2.0 - 1.0 / (0.1575 * sqrt (nmask) + 0.8);
+              if ((dj<0 && j==0) || (dj>0 && j==width-1) || (di<0 && i==0) || (di>0 && i==height-1)) \
+                Aidx[o + nmask * 5] = zero; \
+              else                                               \
+                Aidx[o + nmask * 5] = ((i + di) * width + (j + dj)) * depth;
+
+              /* Omit Dirichlet conditions for any neighbors off the
+               * edge of the canvas.
+               */
+              level->Adiag[nmask] = 4 - (i==0) - (j==0) - (i==height-1) - (j==width-1);
+              A_NEIGHBOR (0,  0,  0);
+              A_NEIGHBOR (1,  0,  1);
+              A_NEIGHBOR (2,  1,  0);
+              A_NEIGHBOR (3,  0, -1);
+              A_NEIGHBOR (4, -1,  0);
+              nmask++;
+
+#undef A_NEIGHBOR
+            }
+
+      if (parity == 0)
+        level->nred = nmask;
+    }
+
+  level->nmask = nmask;
+
   w *= 0.25;
   for (i = 0; i < nmask; i++)
-    Adiag[i] *= w;
+    level->Adiag[i] *= w;
+
+  level->w = w;
+}
+
+/* Empirically optimal over-relaxation factor for solving a level on its
+ * own. (Benchmarked on round brushes, at least. I don't know whether
+ * aspect ratio affects it.)
+ */
+static gfloat
+gimp_heal_laplace_sor_factor (HealLevel *level)
+{
+  gint nmask = 0;
+  gint i;
+
+  for (i = 0; i < level->width * level->height; i++)
+    nmask += (level->mask[i] != 0);
+
+  return 2.0 - 1.0 / (0.1575 * sqrt (nmask) + 0.8);
+}
+
+/* Create the next coarser level, at half the resolution. A coarse pixel
+ * holds the correction of its pixels, and is only unknown if all of them
+ * are; letting the correction leak into the known pixels makes the cycles
+ * diverge once there are more than two levels.
+ */
+static HealLevel *
+gimp_heal_laplace_level_new_coarse (HealLevel *fine)
+{
+  HealLevel *level = g_slice_new0 (HealLevel);
+  gint       size;
+  gint       i, j;
 
-  /* Gauss-Seidel with successive over-relaxation */
-  for (iter = 0; iter < MAX_ITER; iter++)
+  level->width  = (fine->width  + 1) / 2;
+  level->height = (fine->height + 1) / 2;
+  level->depth  = fine->depth;
+
+  size = (level->width * level->height + 1) * level->depth;
+
+  level->pixels_alloc = g_new0 (gfloat, 4 + size);
+  level->pixels       = (gfloat *) (((uintptr_t) level->pixels_alloc + 15) & ~15);
+  level->rhs          = g_new0 (gfloat, size);
+  level->mask         = g_new (guchar, level->width * level->height);
+
+  memset (level->mask, 255, level->width * level->height);
+
+  for (i = 0; i < fine->height; i++)
+    for (j = 0; j < fine->width; j++)
+      if (! fine->mask[i * fine->width + j])
+        level->mask[(i / 2) * level->width + j / 2] = 0;
+
+  if (level->width  >= 2 * MIN_LEVEL_SIZE &&
+      level->height >= 2 * MIN_LEVEL_SIZE)
+    {
+      gimp_heal_laplace_level_init (level, 1.0);
+
+      level->coarse = gimp_heal_laplace_level_new_coarse (level);
+    }
+  else
     {
-      gfloat err = gimp_heal_laplace_iteration (pixels, Adiag, Aidx,
-                                                w, nmask, depth);
-      if (err < EPSILON * EPSILON * w * w)
-        break;
+      gimp_heal_laplace_level_init (level,
+                                    gimp_heal_laplace_sor_factor (level));
+    }
+
+  return level;
+}
+
+static void
+gimp_heal_laplace_level_free (HealLevel *level)
+{
+  if (level->coarse)
+    gimp_heal_laplace_level_free (level->coarse);
+
+  g_free (level->Adiag);
+  g_free (level->Aidx);
+
+  if (level->pixels_alloc)
+    {
+      g_free (level->pixels_alloc);
+      g_free (level->rhs);
+      g_free (level->mask);
+    }
+
+  g_slice_free (HealLevel, level);
+}
+
+/* Restrict the residual of a level to the right hand side of the next
+ * coarser one, and clear the coarse correction, for a range of coarse rows.
+ */
+static void
+gimp_heal_laplace_restrict_rows (gint       offset,
+                                 gint       size,
+                                 HealLevel *level)
+{
+  HealLevel *coarse   = level->coarse;
+  gint       width    = level->width;
+  gint       height   = level->height;
+  gint       depth    = level->depth;
+  gint       row_size = coarse->width * depth;
+  gint       y, x, k;
+
+  memset (coarse->pixels + offset * row_size, 0,
+          size * row_size * sizeof (gfloat));
+  memset (coarse->rhs + offset * row_size, 0,
+          size * row_size * sizeof (gfloat));
+
+  for (y = 2 * offset; y < MIN (2 * (offset + size), height); y++)
+    {
+      const guchar *m = level->mask   + y * width;
+      const gfloat *p = level->pixels + y * width * depth;
+      const gfloat *b = level->rhs ? level->rhs + y * width * depth : NULL;
+      gfloat       *r = coarse->rhs   + (y / 2) * row_size;
+
+      for (x = 0; x < width; x++, p += depth)
+        {
+          if (! m[x])
+            continue;
+
+          /* the coarse operator is 4 times the fine one, so the sum of
+           * the residuals is the right hand side for the average
+           * correction
+           */
+          for (k = 0; k < depth; k++)
+            {
+              gfloat residual = b ? b[x * depth + k] : 0.0f;
+
+              if (x > 0)
+                residual += p[k - depth]         - p[k];
+              if (x < width - 1)
+                residual += p[k + depth]         - p[k];
+              if (y > 0)
+                residual += p[k - width * depth] - p[k];
+              if (y < height - 1)
+                residual += p[k + width * depth] - p[k];
+
+              r[(x / 2) * depth + k] += residual;
+            }
+        }
+    }
+}
+
+/* Add the bilinearly interpolated correction of the next coarser level to
+ * the unknown pixels of a range of rows.
+ */
+static void
+gimp_heal_laplace_prolongate_rows (gint       offset,
+                                   gint       size,
+                                   HealLevel *level)
+{
+  HealLevel *coarse = level->coarse;
+  gint       width  = level->width;
+  gint       depth  = level->depth;
+  gint       cw     = coarse->width;
+  gint       ch     = coarse->height;
+  gint       y, x, k;
+
+  for (y = offset; y < offset + size; y++)
+    {
+      const guchar *m  = level->mask   + y * width;
+      gfloat       *p  = level->pixels + y * width * depth;
+      /* the nearest coarse pixel gets 3/4 of the weight, and the one next
+       * to it on the side of the fine pixel 1/4, along each axis
+       */
+      const gfloat *c0 = coarse->pixels + (y / 2) * cw * depth;
+      const gfloat *c1 = coarse->pixels +
+                         CLAMP (y / 2 + ((y & 1) ? 1 : -1), 0, ch - 1) *
+                         cw * depth;
+
+      for (x = 0; x < width; x++, p += depth)
+        {
+          gint j0, j1;
+
+          if (! m[x])
+            continue;
+
+          j0 = (x / 2) * depth;
+          j1 = CLAMP (x / 2 + ((x & 1) ? 1 : -1), 0, cw - 1) * depth;
+
+          for (k = 0; k < depth; k++)
+            p[k] += (9.0f * c0[j0 + k] + 3.0f * c0[j1 + k] +
+                     3.0f * c1[j0 + k] + 1.0f * c1[j1 + k]) / 16.0f;
+        }
+    }
+}
+
+/* Perform one V-cycle on a level, and return the sum squared residual of
+ * its last iteration. The coarsest level is solved with over-relaxation.
+ */
+static gfloat
+gimp_heal_laplace_vcycle (HealLevel *level)
+{
+  /* Tolerate a total deviation-from-smoothness of 0.1 LSBs at 8bit depth. */
+#define EPSILON  (0.1/255)
+#define MAX_ITER 500
+
+  gfloat err = 0.0;
+  gint   iter;
+
+  if (! level->coarse)
+    {
+      for (iter = 0; iter < MAX_ITER; iter++)
+        {
+          err = gimp_heal_laplace_sweep (level);
+
+          if (err < EPSILON * EPSILON * level->w * level->w)
+            break;
+        }
+
+      return err;
+    }
+
+  for (iter = 0; iter < N_SMOOTH; iter++)
+    gimp_heal_laplace_sweep (level);
+
+  gimp_gegl_parallel_distribute_range (level->coarse->height,
+                                       MAX (MIN_PARALLEL_SIZE /
+                                            level->coarse->width, 1),
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_heal_laplace_restrict_rows,
+                                       level);
+
+  gimp_heal_laplace_vcycle (level->coarse);
+
+  gimp_gegl_parallel_distribute_range (level->height,
+                                       MAX (MIN_PARALLEL_SIZE /
+                                            level->width, 1),
+                                       (GimpGeglParallelRangeFunc)
+                                       gimp_heal_laplace_prolongate_rows,
+                                       level);
+
+  for (iter = 0; iter < N_SMOOTH; iter++)
+    err = gimp_heal_laplace_sweep (level);
+
+  return err;
+}
+
+/* Solve the laplace equation for pixels and store the result in-place.
+ */
+static void
+gimp_heal_laplace_loop (gfloat *pixels,
+                        gint    height,
+                        gint    depth,
+                        gint    width,
+                        guchar *mask)
+{
+  HealLevel *level = g_slice_new0 (HealLevel);
+  gint       cycle;
+
+  level->width  = width;
+  level->height = height;
+  level->depth  = depth;
+  level->mask   = mask;
+  level->pixels = pixels;
+
+  if (width >= 2 * MIN_LEVEL_SIZE && height >= 2 * MIN_LEVEL_SIZE)
+    {
+      gimp_heal_laplace_level_init (level, 1.0);
+
+      level->coarse = gimp_heal_laplace_level_new_coarse (level);
+
+      for (cycle = 0; cycle < MAX_CYCLES; cycle++)
+        {
+          gfloat err = gimp_heal_laplace_vcycle (level);
+
+          if (err < EPSILON * EPSILON * level->w * level->w)
+            break;
+        }
+    }
+  else
+    {
+      gimp_heal_laplace_level_init (level,
+                                    gimp_heal_laplace_sor_factor (level));
+
+      gimp_heal_laplace_vcycle (level);
     }
 
-  g_free (Adiag);
-  g_free (Aidx);
+  gimp_heal_laplace_level_free (level);
 }
 
 /* Original Algorithm Design:
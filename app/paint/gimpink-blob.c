@@ -20,6 +20,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib-object.h>
 
 #include "libgimpmath/gimpmath.h"
@@ -29,6 +31,12 @@
 #include "gimpink-blob.h"
 
 
+/*  freed blobs are kept for reuse, so painting doesn't allocate the
+ *  spans of a new blob for each dab
+ */
+#define BLOB_POOL_SIZE 16
+
+
 typedef enum
 {
   EDGE_NONE  = 0,
@@ -58,6 +66,12 @@ static void       gimp_blob_line           (GimpBlob *b,
 #endif
 
 
+G_LOCK_DEFINE_STATIC (blob_pool);
+
+static GimpBlob *blob_pool[BLOB_POOL_SIZE];
+static gint      blob_pool_size = 0;
+
+
 /*  public functions  */
 
 /* Return blob for the given (convex) polygon
@@ -461,9 +475,34 @@ gimp_blob_convex_union (GimpBlob *b1,
 GimpBlob *
 gimp_blob_duplicate (GimpBlob *b)
 {
+  GimpBlob *result;
+
   g_return_val_if_fail (b != NULL, NULL);
 
-  return g_memdup (b, sizeof (GimpBlob) +  sizeof (GimpBlobSpan) * (b->height - 1));
+  result = gimp_blob_new (b->y, b->height);
+
+  memcpy (result->data, b->data, sizeof (GimpBlobSpan) * b->height);
+
+  return result;
+}
+
+void
+gimp_blob_free (GimpBlob *b)
+{
+  if (! b)
+    return;
+
+  G_LOCK (blob_pool);
+
+  if (blob_pool_size < BLOB_POOL_SIZE)
+    {
+      blob_pool[blob_pool_size++] = b;
+      b = NULL;
+    }
+
+  G_UNLOCK (blob_pool);
+
+  g_free (b);
 }
 
 #if 0
@@ -492,9 +531,33 @@ static GimpBlob *
 gimp_blob_new (gint y,
                gint height)
 {
-  GimpBlob *result;
+  GimpBlob *result = NULL;
+  gint      i;
+
+  G_LOCK (blob_pool);
+
+  for (i = 0; i < blob_pool_size; i++)
+    {
+      if (blob_pool[i]->n_allocated >= height)
+        {
+          result = blob_pool[i];
+
+          blob_pool[i] = blob_pool[--blob_pool_size];
+          break;
+        }
+    }
+
+  G_UNLOCK (blob_pool);
 
-  result = g_malloc (sizeof (GimpBlob) +  sizeof (GimpBlobSpan) * (height - 1));
+  if (! result)
+    {
+      gint n_allocated = MAX (height, 1);
+
+      result = g_malloc (sizeof (GimpBlob) +
+                         sizeof (GimpBlobSpan) * (n_allocated - 1));
+
+      result->n_allocated = n_allocated;
+    }
 
   result->y      = y;
   result->height = height;
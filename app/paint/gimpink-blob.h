@@ -50,6 +50,7 @@ struct _GimpBlob
 {
   gint         y;
   gint         height;
+  gint         n_allocated;  /* number of spans allocated in data */
   GimpBlobSpan data[1];
 };
 
@@ -82,6 +83,7 @@ void       gimp_blob_bounds       (GimpBlob      *b,
 GimpBlob * gimp_blob_convex_union (GimpBlob      *b1,
                                    GimpBlob      *b2);
 GimpBlob * gimp_blob_duplicate    (GimpBlob      *b);
+void       gimp_blob_free         (GimpBlob      *b);
 
 
 #endif /* __GIMP_INK_BLOB_H__ */
@@ -125,13 +125,13 @@ gimp_ink_finalize (GObject *object)
 
   if (ink->start_blob)
     {
-      g_free (ink->start_blob);
+      gimp_blob_free (ink->start_blob);
       ink->start_blob = NULL;
     }
 
   if (ink->last_blob)
     {
-      g_free (ink->last_blob);
+      gimp_blob_free (ink->last_blob);
       ink->last_blob = NULL;
     }
 
@@ -163,13 +163,13 @@ gimp_ink_paint (GimpPaintCore    *paint_core,
 
           if (ink->start_blob)
             {
-              g_free (ink->start_blob);
+              gimp_blob_free (ink->start_blob);
               ink->start_blob = NULL;
             }
 
           if (ink->last_blob)
             {
-              g_free (ink->last_blob);
+              gimp_blob_free (ink->last_blob);
               ink->last_blob = NULL;
             }
         }
@@ -178,7 +178,7 @@ gimp_ink_paint (GimpPaintCore    *paint_core,
           /*  save the start blob of the line for undo otherwise  */
 
           if (ink->start_blob)
-            g_free (ink->start_blob);
+            gimp_blob_free (ink->start_blob);
 
           ink->start_blob = gimp_blob_duplicate (ink->last_blob);
         }
@@ -288,7 +288,7 @@ gimp_ink_motion (GimpPaintCore    *paint_core,
                                         100);
 
       if (ink->start_blob)
-        g_free (ink->start_blob);
+        gimp_blob_free (ink->start_blob);
 
       ink->start_blob = gimp_blob_duplicate (ink->last_blob);
 
@@ -306,7 +306,7 @@ gimp_ink_motion (GimpPaintCore    *paint_core,
 
       blob_union = gimp_blob_convex_union (ink->last_blob, blob);
 
-      g_free (ink->last_blob);
+      gimp_blob_free (ink->last_blob);
       ink->last_blob = blob;
 
       blob_to_render = blob_union;
@@ -349,7 +349,7 @@ gimp_ink_motion (GimpPaintCore    *paint_core,
                          GIMP_PAINT_CONSTANT);
 
   if (blob_union)
-    g_free (blob_union);
+    gimp_blob_free (blob_union);
 }
 
 static GimpBlob *
@@ -484,170 +484,59 @@ ink_pen_ellipse (GimpInkOptions *options,
  * do things. But it wouldn't be hard to implement at all.
  */
 
-enum
-{
-  ROW_START,
-  ROW_STOP
-};
-
-/* The insertion sort here, for SUBSAMPLE = 8, tends to beat out
- * qsort() by 4x with CFLAGS=-O2, 2x with CFLAGS=-g
+/* Each of the SUBSAMPLE rows of the blob that fall into a row of
+ * pixels covers the pixels from its left to its right edge, and
+ * partially covers the pixels in which the edges lie. Instead of
+ * sorting the edges, every edge adds a step to the "cover" deltas,
+ * split between the two pixels around it, and a running sum of the
+ * deltas then gives the exact coverage of each pixel.
  */
-static void
-insert_sort (gint *data,
-             gint  n)
-{
-  gint i, j, k;
-
-  for (i = 2; i < 2 * n; i += 2)
-    {
-      gint tmp1 = data[i];
-      gint tmp2 = data[i + 1];
-
-      j = 0;
-
-      while (data[j] < tmp1)
-        j += 2;
-
-      for (k = i; k > j; k -= 2)
-        {
-          data[k]     = data[k - 2];
-          data[k + 1] = data[k - 1];
-        }
-
-      data[j]     = tmp1;
-      data[j + 1] = tmp2;
-    }
-}
-
-static void
-fill_run (gfloat *dest,
-          gfloat  alpha,
-          gint    w)
-{
-  if (alpha == 1.0)
-    {
-      while (w--)
-        {
-          *dest = 1.0;
-          dest++;
-        }
-    }
-  else
-    {
-      while (w--)
-        {
-          *dest = MAX (*dest, alpha);
-          dest++;
-        }
-    }
-}
-
 static void
 render_blob_line (GimpBlob *blob,
                   gfloat   *dest,
                   gint      x,
                   gint      y,
-                  gint      width)
+                  gint      width,
+                  gint     *cover)
 {
-  gint  buf[4 * SUBSAMPLE];
-  gint *data    = buf;
-  gint  n       = 0;
-  gint  i, j;
-  gint  current = 0;  /* number of filled rows at this point
-                       * in the scan line
-                       */
-  gint last_x;
+  gint x1 = x * SUBSAMPLE;
+  gint x2 = (x + width) * SUBSAMPLE;
+  gint sum;
+  gint i, j;
 
-  /* Sort start and ends for all lines */
+  memset (cover, 0, (width + 2) * sizeof (gint));
 
   j = y * SUBSAMPLE - blob->y;
-  for (i = 0; i < SUBSAMPLE; i++)
-    {
-      if (j >= blob->height)
-        break;
 
-      if ((j > 0) && (blob->data[j].left <= blob->data[j].right))
-        {
-          data[2 * n]                     = blob->data[j].left;
-          data[2 * n + 1]                 = ROW_START;
-          data[2 * SUBSAMPLE + 2 * n]     = blob->data[j].right;
-          data[2 * SUBSAMPLE + 2 * n + 1] = ROW_STOP;
-          n++;
-        }
-      j++;
-    }
-
-  /*   If we have less than SUBSAMPLE rows, compress */
-  if (n < SUBSAMPLE)
+  for (i = 0; i < SUBSAMPLE && j < blob->height; i++, j++)
     {
-      for (i = 0; i < 2 * n; i++)
-        data[2 * n + i] = data[2 * SUBSAMPLE + i];
-    }
+      gint left;
+      gint right;
 
-  /*   Now count start and end separately */
-  n *= 2;
+      if (j <= 0)
+        continue;
 
-  insert_sort (data, n);
+      left  = CLAMP (blob->data[j].left,  x1, x2) - x1;
+      right = CLAMP (blob->data[j].right, x1, x2) - x1;
 
-  /* Discard portions outside of tile */
+      if (left >= right)
+        continue;
 
-  while ((n > 0) && (data[0] < SUBSAMPLE*x))
-    {
-      if (data[1] == ROW_START)
-        current++;
-      else
-        current--;
-      data += 2;
-      n--;
+      cover[left  / SUBSAMPLE]     += SUBSAMPLE - left % SUBSAMPLE;
+      cover[left  / SUBSAMPLE + 1] += left % SUBSAMPLE;
+      cover[right / SUBSAMPLE]     -= SUBSAMPLE - right % SUBSAMPLE;
+      cover[right / SUBSAMPLE + 1] -= right % SUBSAMPLE;
     }
 
-  while ((n > 0) && (data[2*(n-1)] >= SUBSAMPLE*(x+width)))
-    n--;
-
-  /* Render the row */
+  sum = 0;
 
-  last_x = 0;
-  for (i = 0; i < n;)
+  for (i = 0; i < width; i++)
     {
-      gint cur_x = data[2 * i] / SUBSAMPLE - x;
-      gint pixel;
-
-      /* Fill in portion leading up to this pixel */
-      if (current && cur_x != last_x)
-        fill_run (dest + last_x, (gfloat) current / SUBSAMPLE, cur_x - last_x);
-
-      /* Compute the value for this pixel */
-      pixel = current * SUBSAMPLE;
-
-      while (i<n)
-        {
-          gint tmp_x = data[2 * i] / SUBSAMPLE;
-
-          if (tmp_x - x != cur_x)
-            break;
-
-          if (data[2 * i + 1] == ROW_START)
-            {
-              current++;
-              pixel += ((tmp_x + 1) * SUBSAMPLE) - data[2 * i];
-            }
-          else
-            {
-              current--;
-              pixel -= ((tmp_x + 1) * SUBSAMPLE) - data[2 * i];
-            }
+      sum += cover[i];
 
-          i++;
-        }
-
-      dest[cur_x] = MAX (dest[cur_x], (gfloat) pixel / (SUBSAMPLE * SUBSAMPLE));
-
-      last_x = cur_x + 1;
+      if (sum)
+        dest[i] = MAX (dest[i], (gfloat) sum / (SUBSAMPLE * SUBSAMPLE));
     }
-
-  if (current != 0)
-    fill_run (dest + last_x, (gfloat) current / SUBSAMPLE, width - last_x);
 }
 
 static void
@@ -657,6 +546,10 @@ render_blob (GeglBuffer    *buffer,
 {
   GeglBufferIterator *iter;
   GeglRectangle      *roi;
+  gint               *cover;
+
+  /*  the cover deltas of a row, reused for all rows  */
+  cover = g_new (gint, rect->width + 2);
 
   iter = gegl_buffer_iterator_new (buffer, rect, 0, babl_format ("Y float"),
                                    GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
@@ -670,7 +563,9 @@ render_blob (GeglBuffer    *buffer,
 
       for (y = 0; y < h; y++, d += roi->width * 1)
         {
-          render_blob_line (blob, d, roi->x, roi->y + y, roi->width);
+          render_blob_line (blob, d, roi->x, roi->y + y, roi->width, cover);
         }
     }
+
+  g_free (cover);
 }
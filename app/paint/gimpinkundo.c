@@ -105,7 +105,7 @@ gimp_ink_undo_free (GimpUndo     *undo,
 
   if (ink_undo->last_blob)
     {
-      g_free (ink_undo->last_blob);
+      gimp_blob_free (ink_undo->last_blob);
       ink_undo->last_blob = NULL;
     }
 
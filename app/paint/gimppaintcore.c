@@ -54,6 +54,18 @@
 
 #define STROKE_BUFFER_INIT_SIZE 2000
 
+/*  pending updates are merged as long as the merged rectangle is at
+ *  most this many times the area actually painted
+ */
+#define UPDATE_MAX_WASTE 2
+
+
+typedef struct
+{
+  GeglRectangle rect;
+  gint64        n_pixels;
+} PendingUpdate;
+
 enum
 {
   PROP_0,
@@ -109,6 +121,31 @@ static GimpUndo* gimp_paint_core_real_push_undo      (GimpPaintCore    *core,
                                                       GimpImage        *image,
                                                       const gchar      *undo_desc);
 
+static void      gimp_paint_core_defer_blit          (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable,
+                                                      gdouble           image_opacity,
+                                                      GimpLayerModeEffects paint_mode);
+static void      gimp_paint_core_flush_blits         (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable);
+static void      gimp_paint_core_end_blits           (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable);
+static void      gimp_paint_core_free_blits          (GimpPaintCore    *core);
+static void      gimp_paint_core_queue_update        (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable,
+                                                      gint              x,
+                                                      gint              y,
+                                                      gint              width,
+                                                      gint              height);
+static void      gimp_paint_core_merge_rect          (GArray           *rects,
+                                                      const GeglRectangle *rect);
+static void      gimp_paint_core_add_undo_tiles      (GimpPaintCore    *core,
+                                                      gint              x,
+                                                      gint              y,
+                                                      gint              width,
+                                                      gint              height);
+static GArray  * gimp_paint_core_get_undo_rects      (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable);
+
 
 G_DEFINE_TYPE (GimpPaintCore, gimp_paint_core, GIMP_TYPE_OBJECT)
 
@@ -145,6 +182,8 @@ static void
 gimp_paint_core_init (GimpPaintCore *core)
 {
   core->ID = global_core_ID++;
+
+  g_mutex_init (&core->updates_mutex);
 }
 
 static void
@@ -163,6 +202,14 @@ gimp_paint_core_finalize (GObject *object)
       core->stroke_buffer = NULL;
     }
 
+  if (core->pending_updates)
+    {
+      g_array_free (core->pending_updates, TRUE);
+      core->pending_updates = NULL;
+    }
+
+  g_mutex_clear (&core->updates_mutex);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -300,6 +347,9 @@ gimp_paint_core_paint (GimpPaintCore    *core,
 
   core_class = GIMP_PAINT_CORE_GET_CLASS (core);
 
+  core->blit_level++;
+  core->update_level++;
+
   if (core_class->pre_paint (core, drawable,
                              paint_options,
                              paint_state, time))
@@ -321,6 +371,12 @@ gimp_paint_core_paint (GimpPaintCore    *core,
                               paint_options,
                               paint_state, time);
     }
+
+  if (--core->blit_level == 0)
+    gimp_paint_core_flush_blits (core, drawable);
+
+  if (--core->update_level == 0)
+    gimp_paint_core_flush_updates (core, drawable);
 }
 
 gboolean
@@ -372,6 +428,25 @@ gimp_paint_core_start (GimpPaintCore     *core,
 
   core->undo_buffer = gegl_buffer_dup (gimp_drawable_get_buffer (drawable));
 
+  /*  Keep track of the undo_buffer tiles that get painted, only
+   *  those are pushed to the undo stack
+   */
+  g_object_get (core->undo_buffer,
+                "tile-width",  &core->undo_tile_width,
+                "tile-height", &core->undo_tile_height,
+                NULL);
+
+  core->undo_tiles_stride = ((gimp_item_get_width (item) +
+                              core->undo_tile_width - 1) /
+                             core->undo_tile_width);
+
+  g_free (core->undo_tiles);
+  core->undo_tiles = g_new0 (guchar,
+                             core->undo_tiles_stride *
+                             ((gimp_item_get_height (item) +
+                               core->undo_tile_height - 1) /
+                              core->undo_tile_height));
+
   /*  Allocate the saved proj structure  */
   if (core->saved_proj_buffer)
     {
@@ -444,6 +519,13 @@ gimp_paint_core_start (GimpPaintCore     *core,
                                   gimp_drawable_get_active_mask (drawable));
       gimp_applicator_set_dest_buffer (core->applicator,
                                        gimp_drawable_get_buffer (drawable));
+
+      /*  see gimp_paint_core_paste()  */
+      gimp_paint_core_free_blits (core);
+
+      if (! GIMP_PAINT_CORE_GET_CLASS (core)->blits_each_dab)
+        core->pending_blits = g_array_new (FALSE, FALSE,
+                                           sizeof (PendingUpdate));
     }
   else
     {
@@ -488,6 +570,11 @@ gimp_paint_core_finish (GimpPaintCore *core,
   g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
   g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
 
+  if (core->pending_blits)
+    gimp_paint_core_end_blits (core, drawable);
+
+  gimp_paint_core_flush_updates (core, drawable);
+
   if (core->applicator)
     {
       g_object_unref (core->applicator);
@@ -525,40 +612,48 @@ gimp_paint_core_finish (GimpPaintCore *core,
 
   if (push_undo)
     {
-      GeglBuffer *buffer;
-      gint        x, y, width, height;
-
-      gimp_rectangle_intersect (core->x1, core->y1,
-                                core->x2 - core->x1, core->y2 - core->y1,
-                                0, 0,
-                                gimp_item_get_width  (GIMP_ITEM (drawable)),
-                                gimp_item_get_height (GIMP_ITEM (drawable)),
-                                &x, &y, &width, &height);
+      GArray *rects = gimp_paint_core_get_undo_rects (core, drawable);
+      gint    i;
 
       gimp_image_undo_group_start (image, GIMP_UNDO_GROUP_PAINT,
                                    core->undo_desc);
 
       GIMP_PAINT_CORE_GET_CLASS (core)->push_undo (core, image, NULL);
 
-      buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
-                                gimp_drawable_get_format (drawable));
+      /*  push only the painted tiles, instead of the stroke's whole
+       *  bounding box. The rects are tile-aligned, so the copies share
+       *  their tiles with the undo_buffer instead of duplicating them
+       */
+      for (i = 0; i < rects->len; i++)
+        {
+          const GeglRectangle *rect = &g_array_index (rects, GeglRectangle, i);
+          GeglBuffer          *buffer;
+
+          buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                                    rect->width, rect->height),
+                                    gimp_drawable_get_format (drawable));
 
-      gegl_buffer_copy (core->undo_buffer,
-                        GEGL_RECTANGLE (x, y, width, height),
-                        buffer,
-                        GEGL_RECTANGLE (0, 0, 0, 0));
+          gegl_buffer_copy (core->undo_buffer, rect,
+                            buffer, GEGL_RECTANGLE (0, 0, 0, 0));
 
-      gimp_drawable_push_undo (drawable, NULL,
-                               buffer, x, y, width, height);
+          gimp_drawable_push_undo (drawable, NULL, buffer,
+                                   rect->x, rect->y,
+                                   rect->width, rect->height);
 
-      g_object_unref (buffer);
+          g_object_unref (buffer);
+        }
 
       gimp_image_undo_group_end (image);
+
+      g_array_free (rects, TRUE);
     }
 
   g_object_unref (core->undo_buffer);
   core->undo_buffer = NULL;
 
+  g_free (core->undo_tiles);
+  core->undo_tiles = NULL;
+
   if (core->saved_proj_buffer)
     {
       g_object_unref (core->saved_proj_buffer);
@@ -579,6 +674,16 @@ gimp_paint_core_cancel (GimpPaintCore *core,
   g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
   g_return_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)));
 
+  /*  the whole painted area is restored and updated below  */
+  gimp_paint_core_free_blits (core);
+
+  g_mutex_lock (&core->updates_mutex);
+
+  if (core->pending_updates)
+    g_array_set_size (core->pending_updates, 0);
+
+  g_mutex_unlock (&core->updates_mutex);
+
   /*  Determine if any part of the image has been altered--
    *  if nothing has, then just return...
    */
@@ -593,15 +698,26 @@ gimp_paint_core_cancel (GimpPaintCore *core,
                                 gimp_item_get_height (GIMP_ITEM (drawable)),
                                 &x, &y, &width, &height))
     {
-      gegl_buffer_copy (core->undo_buffer,
-                        GEGL_RECTANGLE (x, y, width, height),
-                        gimp_drawable_get_buffer (drawable),
-                        GEGL_RECTANGLE (x, y, width, height));
+      GArray *rects = gimp_paint_core_get_undo_rects (core, drawable);
+      gint    i;
+
+      for (i = 0; i < rects->len; i++)
+        {
+          const GeglRectangle *rect = &g_array_index (rects, GeglRectangle, i);
+
+          gegl_buffer_copy (core->undo_buffer, rect,
+                            gimp_drawable_get_buffer (drawable), rect);
+        }
+
+      g_array_free (rects, TRUE);
     }
 
   g_object_unref (core->undo_buffer);
   core->undo_buffer = NULL;
 
+  g_free (core->undo_tiles);
+  core->undo_tiles = NULL;
+
   if (core->saved_proj_buffer)
     {
       g_object_unref (core->saved_proj_buffer);
@@ -624,6 +740,12 @@ gimp_paint_core_cleanup (GimpPaintCore *core)
       core->undo_buffer = NULL;
     }
 
+  if (core->undo_tiles)
+    {
+      g_free (core->undo_tiles);
+      core->undo_tiles = NULL;
+    }
+
   if (core->saved_proj_buffer)
     {
       g_object_unref (core->saved_proj_buffer);
@@ -641,6 +763,8 @@ gimp_paint_core_cleanup (GimpPaintCore *core)
       g_object_unref (core->paint_buffer);
       core->paint_buffer = NULL;
     }
+
+  gimp_paint_core_free_blits (core);
 }
 
 void
@@ -658,8 +782,85 @@ gimp_paint_core_interpolate (GimpPaintCore    *core,
 
   core->cur_coords = *coords;
 
+  /*  collect all dabs painted for this motion event, and composite
+   *  them and emit their updates together when done
+   */
+  core->blit_level++;
+  core->update_level++;
+
   GIMP_PAINT_CORE_GET_CLASS (core)->interpolate (core, drawable,
                                                  paint_options, time);
+
+  if (--core->blit_level == 0)
+    gimp_paint_core_flush_blits (core, drawable);
+
+  if (--core->update_level == 0)
+    gimp_paint_core_flush_updates (core, drawable);
+}
+
+/**
+ * gimp_paint_core_freeze_updates:
+ * @core: a #GimpPaintCore
+ *
+ * Makes @core queue the drawable updates of all painting until the
+ * matching gimp_paint_core_thaw_updates(), instead of emitting them
+ * when gimp_paint_core_paint() or gimp_paint_core_interpolate()
+ * return. In the meantime, gimp_paint_core_flush_updates() can be
+ * used to emit them, also while another thread paints.
+ **/
+void
+gimp_paint_core_freeze_updates (GimpPaintCore *core)
+{
+  g_return_if_fail (GIMP_IS_PAINT_CORE (core));
+
+  core->update_level++;
+}
+
+void
+gimp_paint_core_thaw_updates (GimpPaintCore *core,
+                              GimpDrawable  *drawable)
+{
+  g_return_if_fail (GIMP_IS_PAINT_CORE (core));
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (core->update_level > 0);
+
+  if (--core->update_level == 0)
+    gimp_paint_core_flush_updates (core, drawable);
+}
+
+void
+gimp_paint_core_flush_updates (GimpPaintCore *core,
+                               GimpDrawable  *drawable)
+{
+  GArray *updates;
+  gint    i;
+
+  g_return_if_fail (GIMP_IS_PAINT_CORE (core));
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+
+  g_mutex_lock (&core->updates_mutex);
+
+  updates = core->pending_updates;
+  core->pending_updates = NULL;
+
+  g_mutex_unlock (&core->updates_mutex);
+
+  if (! updates)
+    return;
+
+  for (i = 0; i < updates->len; i++)
+    {
+      const PendingUpdate *update = &g_array_index (updates,
+                                                    PendingUpdate, i);
+
+      gimp_drawable_update (drawable,
+                            update->rect.x,
+                            update->rect.y,
+                            update->rect.width,
+                            update->rect.height);
+    }
+
+  g_array_free (updates, TRUE);
 }
 
 void
@@ -801,8 +1002,9 @@ gimp_paint_core_paste (GimpPaintCore            *core,
                        GimpLayerModeEffects      paint_mode,
                        GimpPaintApplicationMode  mode)
 {
-  gint width  = gegl_buffer_get_width  (core->paint_buffer);
-  gint height = gegl_buffer_get_height (core->paint_buffer);
+  gint     width    = gegl_buffer_get_width  (core->paint_buffer);
+  gint     height   = gegl_buffer_get_height (core->paint_buffer);
+  gboolean deferred = FALSE;
 
   if (core->applicator)
     {
@@ -841,8 +1043,23 @@ gimp_paint_core_paste (GimpPaintCore            *core,
                                 GEGL_RECTANGLE (0, 0, width, height),
                                 1.0);
 
-          gimp_applicator_set_src_buffer (core->applicator,
-                                          core->undo_buffer);
+          /*  each dab is composited onto the original image, so only
+           *  the last dab painting a pixel matters for its result.
+           *  Within gimp_paint_core_paint() and
+           *  gimp_paint_core_interpolate(), collect the dabs' paint and
+           *  composite it together when the outermost call returns
+           */
+          if (core->pending_blits && core->blit_level > 0)
+            {
+              gimp_paint_core_defer_blit (core, drawable,
+                                          image_opacity, paint_mode);
+              deferred = TRUE;
+            }
+          else
+            {
+              gimp_applicator_set_src_buffer (core->applicator,
+                                              core->undo_buffer);
+            }
         }
       /*  Otherwise:
        *   combine the canvas buf and the paint mask to the canvas buf
@@ -866,20 +1083,29 @@ gimp_paint_core_paste (GimpPaintCore            *core,
                                           gimp_drawable_get_buffer (drawable));
         }
 
-      gimp_applicator_set_apply_buffer (core->applicator,
-                                        core->paint_buffer);
-      gimp_applicator_set_apply_offset (core->applicator,
-                                        core->paint_buffer_x,
-                                        core->paint_buffer_y);
+      if (! deferred)
+        {
+          /*  this dab is composited onto what the dabs before it
+           *  painted, so they can't be deferred any longer
+           */
+          if (core->pending_blits)
+            gimp_paint_core_end_blits (core, drawable);
+
+          gimp_applicator_set_apply_buffer (core->applicator,
+                                            core->paint_buffer);
+          gimp_applicator_set_apply_offset (core->applicator,
+                                            core->paint_buffer_x,
+                                            core->paint_buffer_y);
 
-      gimp_applicator_set_mode (core->applicator,
-                                image_opacity, paint_mode);
+          gimp_applicator_set_mode (core->applicator,
+                                    image_opacity, paint_mode);
 
-      /*  apply the paint area to the image  */
-      gimp_applicator_blit (core->applicator,
-                            GEGL_RECTANGLE (core->paint_buffer_x,
-                                            core->paint_buffer_y,
-                                            width, height));
+          /*  apply the paint area to the image  */
+          gimp_applicator_blit (core->applicator,
+                                GEGL_RECTANGLE (core->paint_buffer_x,
+                                                core->paint_buffer_y,
+                                                width, height));
+        }
     }
   else
     {
@@ -969,11 +1195,17 @@ gimp_paint_core_paste (GimpPaintCore            *core,
   core->x2 = MAX (core->x2, core->paint_buffer_x + width);
   core->y2 = MAX (core->y2, core->paint_buffer_y + height);
 
-  /*  Update the drawable  */
-  gimp_drawable_update (drawable,
-                        core->paint_buffer_x,
-                        core->paint_buffer_y,
-                        width, height);
+  gimp_paint_core_add_undo_tiles (core,
+                                  core->paint_buffer_x,
+                                  core->paint_buffer_y,
+                                  width, height);
+
+  /*  Update the drawable, deferred dabs are updated when composited  */
+  if (! deferred)
+    gimp_paint_core_queue_update (core, drawable,
+                                  core->paint_buffer_x,
+                                  core->paint_buffer_y,
+                                  width, height);
 }
 
 /* This works similarly to gimp_paint_core_paste. However, instead of
@@ -1069,6 +1301,10 @@ gimp_paint_core_replace (GimpPaintCore            *core,
                                    width, height);
     }
 
+  /*  this reads the drawable, see gimp_paint_core_paste()  */
+  if (core->pending_blits)
+    gimp_paint_core_end_blits (core, drawable);
+
   /*  apply the paint area to the image  */
   gimp_drawable_replace_buffer (drawable, core->paint_buffer,
                                 GEGL_RECTANGLE (0, 0, width, height),
@@ -1086,11 +1322,16 @@ gimp_paint_core_replace (GimpPaintCore            *core,
   core->x2 = MAX (core->x2, core->paint_buffer_x + width);
   core->y2 = MAX (core->y2, core->paint_buffer_y + height);
 
+  gimp_paint_core_add_undo_tiles (core,
+                                  core->paint_buffer_x,
+                                  core->paint_buffer_y,
+                                  width, height);
+
   /*  Update the drawable  */
-  gimp_drawable_update (drawable,
-                        core->paint_buffer_x,
-                        core->paint_buffer_y,
-                        width, height);
+  gimp_paint_core_queue_update (core, drawable,
+                                core->paint_buffer_x,
+                                core->paint_buffer_y,
+                                width, height);
 }
 
 /**
@@ -1159,3 +1400,270 @@ gimp_paint_core_smooth_coords (GimpPaintCore    *core,
         }
     }
 }
+
+
+/*  private functions  */
+
+/*  adds the dab in the paint buffer to the dabs composited by
+ *  gimp_paint_core_flush_blits(). The blit buffer keeps the paint of
+ *  the last dab at every pixel, which is all that compositing it onto
+ *  the original image depends on
+ */
+static void
+gimp_paint_core_defer_blit (GimpPaintCore        *core,
+                            GimpDrawable         *drawable,
+                            gdouble               image_opacity,
+                            GimpLayerModeEffects  paint_mode)
+{
+  GeglRectangle rect;
+
+  rect.x      = core->paint_buffer_x;
+  rect.y      = core->paint_buffer_y;
+  rect.width  = gegl_buffer_get_width  (core->paint_buffer);
+  rect.height = gegl_buffer_get_height (core->paint_buffer);
+
+  if (core->pending_blits->len > 0 &&
+      (image_opacity != core->blit_opacity ||
+       paint_mode    != core->blit_mode))
+    {
+      gimp_paint_core_flush_blits (core, drawable);
+    }
+
+  if (! core->blit_buffer)
+    {
+      GimpItem *item = GIMP_ITEM (drawable);
+
+      core->blit_buffer =
+        gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                         gimp_item_get_width  (item),
+                                         gimp_item_get_height (item)),
+                         gegl_buffer_get_format (core->paint_buffer));
+    }
+
+  gegl_buffer_copy (core->paint_buffer,
+                    GEGL_RECTANGLE (0, 0, rect.width, rect.height),
+                    core->blit_buffer, &rect);
+
+  core->blit_opacity = image_opacity;
+  core->blit_mode    = paint_mode;
+
+  gimp_paint_core_merge_rect (core->pending_blits, &rect);
+}
+
+static void
+gimp_paint_core_flush_blits (GimpPaintCore *core,
+                             GimpDrawable  *drawable)
+{
+  gint i;
+
+  if (! core->pending_blits || core->pending_blits->len == 0)
+    return;
+
+  gimp_applicator_set_src_buffer (core->applicator,
+                                  core->undo_buffer);
+  gimp_applicator_set_apply_buffer (core->applicator,
+                                    core->blit_buffer);
+  gimp_applicator_set_apply_offset (core->applicator, 0, 0);
+
+  gimp_applicator_set_mode (core->applicator,
+                            core->blit_opacity, core->blit_mode);
+
+  for (i = 0; i < core->pending_blits->len; i++)
+    {
+      const PendingUpdate *blit = &g_array_index (core->pending_blits,
+                                                  PendingUpdate, i);
+
+      gimp_applicator_blit (core->applicator, &blit->rect);
+
+      gimp_paint_core_queue_update (core, drawable,
+                                    blit->rect.x,
+                                    blit->rect.y,
+                                    blit->rect.width,
+                                    blit->rect.height);
+    }
+
+  g_array_set_size (core->pending_blits, 0);
+}
+
+/*  composites the pending dabs, and stops deferring them for the rest
+ *  of the stroke
+ */
+static void
+gimp_paint_core_end_blits (GimpPaintCore *core,
+                           GimpDrawable  *drawable)
+{
+  gimp_paint_core_flush_blits (core, drawable);
+
+  gimp_paint_core_free_blits (core);
+}
+
+static void
+gimp_paint_core_free_blits (GimpPaintCore *core)
+{
+  if (core->pending_blits)
+    {
+      g_array_free (core->pending_blits, TRUE);
+      core->pending_blits = NULL;
+    }
+
+  if (core->blit_buffer)
+    {
+      g_object_unref (core->blit_buffer);
+      core->blit_buffer = NULL;
+    }
+}
+
+/*  defers the drawable update of a painted area until the outermost
+ *  gimp_paint_core_paint() or gimp_paint_core_interpolate() returns,
+ *  the pixels themselves have already been written
+ */
+static void
+gimp_paint_core_queue_update (GimpPaintCore *core,
+                              GimpDrawable  *drawable,
+                              gint           x,
+                              gint           y,
+                              gint           width,
+                              gint           height)
+{
+  GeglRectangle rect = { x, y, width, height };
+
+  if (core->update_level == 0)
+    {
+      gimp_drawable_update (drawable, x, y, width, height);
+      return;
+    }
+
+  g_mutex_lock (&core->updates_mutex);
+
+  if (! core->pending_updates)
+    core->pending_updates = g_array_new (FALSE, FALSE,
+                                         sizeof (PendingUpdate));
+
+  gimp_paint_core_merge_rect (core->pending_updates, &rect);
+
+  g_mutex_unlock (&core->updates_mutex);
+}
+
+/*  appends @rect to @rects, an array of PendingUpdate. Consecutive
+ *  dabs mostly overlap, so @rect is merged into the last rectangle
+ *  unless that would cover too much that wasn't painted
+ */
+static void
+gimp_paint_core_merge_rect (GArray              *rects,
+                            const GeglRectangle *rect)
+{
+  PendingUpdate *last;
+
+  if (rects->len > 0)
+    {
+      GeglRectangle bbox;
+      gint64        n_pixels;
+
+      last = &g_array_index (rects, PendingUpdate, rects->len - 1);
+
+      gegl_rectangle_bounding_box (&bbox, &last->rect, rect);
+
+      n_pixels = last->n_pixels + (gint64) rect->width * rect->height;
+
+      if ((gint64) bbox.width * bbox.height <= UPDATE_MAX_WASTE * n_pixels)
+        {
+          last->rect     = bbox;
+          last->n_pixels = n_pixels;
+
+          return;
+        }
+    }
+
+  g_array_set_size (rects, rects->len + 1);
+
+  last = &g_array_index (rects, PendingUpdate, rects->len - 1);
+
+  last->rect     = *rect;
+  last->n_pixels = (gint64) rect->width * rect->height;
+}
+
+static void
+gimp_paint_core_add_undo_tiles (GimpPaintCore *core,
+                                gint           x,
+                                gint           y,
+                                gint           width,
+                                gint           height)
+{
+  gint x1, y1, x2, y2;
+  gint row;
+
+  if (! core->undo_tiles || width <= 0 || height <= 0)
+    return;
+
+  x1 = MAX (x, 0) / core->undo_tile_width;
+  y1 = MAX (y, 0) / core->undo_tile_height;
+  x2 = (x + width  - 1) / core->undo_tile_width;
+  y2 = (y + height - 1) / core->undo_tile_height;
+
+  x2 = MIN (x2, core->undo_tiles_stride - 1);
+  y2 = MIN (y2, (gegl_buffer_get_height (core->undo_buffer) - 1) /
+                core->undo_tile_height);
+
+  if (x1 > x2)
+    return;
+
+  for (row = y1; row <= y2; row++)
+    {
+      guchar *tiles = core->undo_tiles + row * core->undo_tiles_stride;
+
+      memset (tiles + x1, 1, x2 - x1 + 1);
+    }
+}
+
+/*  returns the painted tiles, clipped to the drawable, merged into one
+ *  rectangle per run of painted tiles in each row of tiles
+ */
+static GArray *
+gimp_paint_core_get_undo_rects (GimpPaintCore *core,
+                                GimpDrawable  *drawable)
+{
+  GArray *rects;
+  gint    width  = gimp_item_get_width  (GIMP_ITEM (drawable));
+  gint    height = gimp_item_get_height (GIMP_ITEM (drawable));
+  gint    n_rows;
+  gint    row;
+
+  rects = g_array_new (FALSE, FALSE, sizeof (GeglRectangle));
+
+  if (! core->undo_tiles)
+    return rects;
+
+  n_rows = (height + core->undo_tile_height - 1) / core->undo_tile_height;
+
+  for (row = 0; row < n_rows; row++)
+    {
+      const guchar *tiles = core->undo_tiles + row * core->undo_tiles_stride;
+      gint          col   = 0;
+
+      while (col < core->undo_tiles_stride)
+        {
+          GeglRectangle rect;
+          gint          start;
+
+          if (! tiles[col])
+            {
+              col++;
+              continue;
+            }
+
+          start = col;
+
+          while (col < core->undo_tiles_stride && tiles[col])
+            col++;
+
+          rect.x      = start * core->undo_tile_width;
+          rect.y      = row   * core->undo_tile_height;
+          rect.width  = MIN (col * core->undo_tile_width, width) - rect.x;
+          rect.height = MIN (rect.y + core->undo_tile_height, height) - rect.y;
+
+          g_array_append_val (rects, rect);
+        }
+    }
+
+  return rects;
+}
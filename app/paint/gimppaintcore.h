@@ -56,6 +56,10 @@ struct _GimpPaintCore
   gboolean     use_saved_proj;    /*  keep the unmodified proj around     */
 
   GeglBuffer  *undo_buffer;       /*  pixels which have been modified     */
+  guchar      *undo_tiles;        /*  undo_buffer tiles which were painted */
+  gint         undo_tile_width;
+  gint         undo_tile_height;
+  gint         undo_tiles_stride; /*  number of tile columns              */
   GeglBuffer  *saved_proj_buffer; /*  proj tiles which have been modified */
   GeglBuffer  *canvas_buffer;     /*  the buffer to paint the mask to     */
   GeglBuffer  *comp_buffer;       /*  scratch buffer used when masking components */
@@ -70,14 +74,28 @@ struct _GimpPaintCore
   gint         mask_y_offset;
 
   GimpApplicator *applicator;
+  GArray      *pending_blits;     /*  dabs not yet composited             */
+  GeglBuffer  *blit_buffer;       /*  the paint of the pending dabs       */
+  gdouble      blit_opacity;      /*  the pending dabs' image opacity     */
+  GimpLayerModeEffects blit_mode; /*  the pending dabs' paint mode        */
 
   GArray      *stroke_buffer;
+
+  gint         blit_level;        /*  nesting of paint/interpolate calls  */
+  gint         update_level;      /*  the same, and of frozen updates     */
+  GArray      *pending_updates;   /*  drawable updates not yet emitted    */
+  GMutex       updates_mutex;     /*  protects pending_updates            */
 };
 
 struct _GimpPaintCoreClass
 {
   GimpObjectClass  parent_class;
 
+  /*  Set for cores whose dabs read back what the dabs before them
+   *  painted, each dab is then composited right away
+   */
+  gboolean     blits_each_dab;
+
   /*  virtual functions  */
   gboolean     (* start)            (GimpPaintCore    *core,
                                      GimpDrawable     *drawable,
@@ -146,6 +164,12 @@ void      gimp_paint_core_interpolate               (GimpPaintCore    *core,
                                                      const GimpCoords *coords,
                                                      guint32           time);
 
+void      gimp_paint_core_freeze_updates            (GimpPaintCore    *core);
+void      gimp_paint_core_thaw_updates              (GimpPaintCore    *core,
+                                                     GimpDrawable     *drawable);
+void      gimp_paint_core_flush_updates             (GimpPaintCore    *core,
+                                                     GimpDrawable     *drawable);
+
 void      gimp_paint_core_set_current_coords        (GimpPaintCore    *core,
                                                      const GimpCoords *coords);
 void      gimp_paint_core_get_current_coords        (GimpPaintCore    *core,
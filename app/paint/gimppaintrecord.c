@@ -0,0 +1,308 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimppaintrecord.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gegl.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "paint-types.h"
+
+#include "gimppaintrecord.h"
+
+#include "gimp-intl.h"
+
+
+/*  The file format is plain text. Each stroke starts with a line
+ *  reading "stroke", followed by one line per event:
+ *
+ *    time x y pressure xtilt ytilt wheel velocity direction
+ *
+ *  Lines starting with '#' are ignored.
+ */
+
+#define N_EVENT_FIELDS 9
+
+
+struct _GimpPaintRecord
+{
+  GPtrArray *strokes;  /*  GArrays of GimpPaintRecordEvent  */
+};
+
+
+/*  public functions  */
+
+GimpPaintRecord *
+gimp_paint_record_new (void)
+{
+  GimpPaintRecord *record = g_slice_new (GimpPaintRecord);
+
+  record->strokes = g_ptr_array_new_with_free_func ((GDestroyNotify)
+                                                    g_array_unref);
+
+  return record;
+}
+
+void
+gimp_paint_record_free (GimpPaintRecord *record)
+{
+  g_return_if_fail (record != NULL);
+
+  g_ptr_array_unref (record->strokes);
+
+  g_slice_free (GimpPaintRecord, record);
+}
+
+void
+gimp_paint_record_begin_stroke (GimpPaintRecord *record)
+{
+  g_return_if_fail (record != NULL);
+
+  g_ptr_array_add (record->strokes,
+                   g_array_new (FALSE, FALSE, sizeof (GimpPaintRecordEvent)));
+}
+
+void
+gimp_paint_record_add_event (GimpPaintRecord  *record,
+                             const GimpCoords *coords,
+                             guint32           time)
+{
+  GimpPaintRecordEvent event;
+
+  g_return_if_fail (record != NULL);
+  g_return_if_fail (coords != NULL);
+
+  if (record->strokes->len == 0)
+    gimp_paint_record_begin_stroke (record);
+
+  event.coords = *coords;
+  event.time   = time;
+
+  g_array_append_val (g_ptr_array_index (record->strokes,
+                                         record->strokes->len - 1),
+                      event);
+}
+
+gint
+gimp_paint_record_get_n_strokes (GimpPaintRecord *record)
+{
+  g_return_val_if_fail (record != NULL, 0);
+
+  return record->strokes->len;
+}
+
+const GimpPaintRecordEvent *
+gimp_paint_record_get_stroke (GimpPaintRecord *record,
+                              gint             stroke,
+                              gint            *n_events)
+{
+  GArray *events;
+
+  g_return_val_if_fail (record != NULL, NULL);
+  g_return_val_if_fail (stroke >= 0 && stroke < record->strokes->len, NULL);
+  g_return_val_if_fail (n_events != NULL, NULL);
+
+  events = g_ptr_array_index (record->strokes, stroke);
+
+  *n_events = events->len;
+
+  return (const GimpPaintRecordEvent *) events->data;
+}
+
+/**
+ * gimp_paint_record_save:
+ * @record:   a #GimpPaintRecord
+ * @filename: the name of the file to write
+ * @append:   whether to add the strokes to the end of an existing file
+ * @error:    return location for errors
+ *
+ * Writes the strokes of @record to @filename.
+ *
+ * Return value: %TRUE on success,
+ *               %FALSE if there was an error writing the file
+ **/
+gboolean
+gimp_paint_record_save (GimpPaintRecord  *record,
+                        const gchar      *filename,
+                        gboolean          append,
+                        GError          **error)
+{
+  FILE *file;
+  gint  i, j;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  file = g_fopen (filename, append ? "a" : "w");
+  if (! file)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   _("Could not open '%s' for writing: %s"),
+                   gimp_filename_to_utf8 (filename), g_strerror (errno));
+      return FALSE;
+    }
+
+  for (i = 0; i < record->strokes->len; i++)
+    {
+      GArray *events = g_ptr_array_index (record->strokes, i);
+
+      fprintf (file, "stroke\n");
+
+      for (j = 0; j < events->len; j++)
+        {
+          const GimpPaintRecordEvent *event;
+          gdouble                     values[N_EVENT_FIELDS - 1];
+          gint                        k;
+
+          event = &g_array_index (events, GimpPaintRecordEvent, j);
+
+          values[0] = event->coords.x;
+          values[1] = event->coords.y;
+          values[2] = event->coords.pressure;
+          values[3] = event->coords.xtilt;
+          values[4] = event->coords.ytilt;
+          values[5] = event->coords.wheel;
+          values[6] = event->coords.velocity;
+          values[7] = event->coords.direction;
+
+          fprintf (file, "%u", event->time);
+
+          for (k = 0; k < N_EVENT_FIELDS - 1; k++)
+            {
+              gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+              fprintf (file, " %s",
+                       g_ascii_dtostr (buf, sizeof (buf), values[k]));
+            }
+
+          fprintf (file, "\n");
+        }
+    }
+
+  if (fclose (file))
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   _("Error while writing '%s': %s"),
+                   gimp_filename_to_utf8 (filename), g_strerror (errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gimp_paint_record_load:
+ * @filename: the name of the file to read
+ * @error:    return location for errors
+ *
+ * Reads the strokes written by gimp_paint_record_save().
+ *
+ * Return value: a new #GimpPaintRecord, or %NULL if there was an error
+ **/
+GimpPaintRecord *
+gimp_paint_record_load (const gchar  *filename,
+                        GError      **error)
+{
+  GimpPaintRecord  *record;
+  gchar            *contents;
+  gchar           **lines;
+  gint              i;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (! g_file_get_contents (filename, &contents, NULL, error))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  record = gimp_paint_record_new ();
+
+  for (i = 0; lines[i]; i++)
+    {
+      gchar  *line = g_strstrip (lines[i]);
+      gchar **fields;
+      gdouble values[N_EVENT_FIELDS];
+      gint    n_fields;
+
+      if (! *line || *line == '#')
+        continue;
+
+      if (! strcmp (line, "stroke"))
+        {
+          gimp_paint_record_begin_stroke (record);
+          continue;
+        }
+
+      fields   = g_strsplit_set (line, " \t", -1);
+      n_fields = 0;
+
+      for (; fields[n_fields] && n_fields < N_EVENT_FIELDS; n_fields++)
+        {
+          gchar *end;
+
+          values[n_fields] = g_ascii_strtod (fields[n_fields], &end);
+
+          if (end == fields[n_fields] || *end)
+            break;
+        }
+
+      g_strfreev (fields);
+
+      if (n_fields == N_EVENT_FIELDS)
+        {
+          GimpCoords coords;
+
+          coords.x         = values[1];
+          coords.y         = values[2];
+          coords.pressure  = values[3];
+          coords.xtilt     = values[4];
+          coords.ytilt     = values[5];
+          coords.wheel     = values[6];
+          coords.velocity  = values[7];
+          coords.direction = values[8];
+
+          gimp_paint_record_add_event (record, &coords, (guint32) values[0]);
+        }
+      else
+        {
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                       _("Error while reading '%s': "
+                         "malformed event on line %d"),
+                       gimp_filename_to_utf8 (filename), i + 1);
+
+          gimp_paint_record_free (record);
+          g_strfreev (lines);
+
+          return NULL;
+        }
+    }
+
+  g_strfreev (lines);
+
+  return record;
+}
@@ -115,6 +115,7 @@ gimp_source_core_class_init (GimpSourceCoreClass *klass)
 
   paint_core_class->start                  = gimp_source_core_start;
   paint_core_class->paint                  = gimp_source_core_paint;
+  paint_core_class->blits_each_dab         = TRUE;
 
   brush_core_class->handles_changing_brush = TRUE;
 
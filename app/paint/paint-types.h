@@ -64,6 +64,11 @@ typedef struct _GimpPaintCoreUndo GimpPaintCoreUndo;
 typedef struct _GimpInkUndo       GimpInkUndo;
 
 
+/*  non-object types  */
+
+typedef struct _GimpPaintRecord   GimpPaintRecord;
+
+
 /*  functions  */
 
 typedef void (* GimpPaintRegisterCallback) (Gimp        *gimp,
@@ -0,0 +1,503 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * paint-benchmark.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  Replays recorded paint strokes through the paint cores, without a
+ *  display, and reports how many dabs per second each of them paints.
+ *
+ *  Strokes are recorded by running GIMP with GIMP_PAINT_RECORD set to
+ *  a file name; without --record a synthetic stroke is used.
+ *
+ *    paint-benchmark --record=strokes.txt --size=1024x1024 \
+ *                    --size=4096x4096 --tool=gimp-paintbrush
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "paint/paint-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpbrushgenerated.h"
+#include "core/gimpcontainer.h"
+#include "core/gimpcontext.h"
+#include "core/gimpimage.h"
+#include "core/gimplayer.h"
+#include "core/gimppaintinfo.h"
+
+#include "paint/gimppaintcore.h"
+#include "paint/gimppaintoptions.h"
+#include "paint/gimppaintrecord.h"
+#include "paint/gimpperspectiveclone.h"
+#include "paint/gimpsourcecore.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+typedef struct
+{
+  gint    n_dabs;
+  gdouble start;
+  gdouble paint;
+  gdouble paint_buffer;
+  gdouble finish;
+  gdouble total;
+} Timings;
+
+
+static const gchar *default_tools[] =
+{
+  "gimp-paintbrush",
+  "gimp-airbrush",
+  "gimp-smudge",
+  "gimp-clone",
+  "gimp-heal",
+  "gimp-ink",
+  "gimp-perspective-clone"
+};
+
+static gchar   *record_file = NULL;
+static gchar  **sizes       = NULL;
+static gchar  **tools       = NULL;
+static gdouble  brush_size  = 51.0;
+static gint     repeat      = 3;
+
+static const GOptionEntry entries[] =
+{
+  { "record", 'r', 0, G_OPTION_ARG_FILENAME, &record_file,
+    "Replay the strokes recorded in FILE", "FILE" },
+  { "size", 's', 0, G_OPTION_ARG_STRING_ARRAY, &sizes,
+    "Paint on a WIDTHxHEIGHT canvas (may be repeated)", "WxH" },
+  { "tool", 't', 0, G_OPTION_ARG_STRING_ARRAY, &tools,
+    "Benchmark the paint core of TOOL (may be repeated)", "TOOL" },
+  { "brush-size", 'b', 0, G_OPTION_ARG_DOUBLE, &brush_size,
+    "The brush size", "SIZE" },
+  { "repeat", 'n', 0, G_OPTION_ARG_INT, &repeat,
+    "Replay the strokes N times", "N" },
+  { NULL }
+};
+
+
+/*  the paint core vfuncs are wrapped to count the dabs and to time
+ *  the stages of a stroke
+ */
+
+static Timings *timings = NULL;
+
+static void         (* orig_paint)            (GimpPaintCore    *core,
+                                               GimpDrawable     *drawable,
+                                               GimpPaintOptions *paint_options,
+                                               const GimpCoords *coords,
+                                               GimpPaintState    paint_state,
+                                               guint32           time);
+static GeglBuffer * (* orig_get_paint_buffer) (GimpPaintCore    *core,
+                                               GimpDrawable     *drawable,
+                                               GimpPaintOptions *paint_options,
+                                               const GimpCoords *coords,
+                                               gint             *paint_buffer_x,
+                                               gint             *paint_buffer_y);
+
+static void
+benchmark_paint (GimpPaintCore    *core,
+                 GimpDrawable     *drawable,
+                 GimpPaintOptions *paint_options,
+                 const GimpCoords *coords,
+                 GimpPaintState    paint_state,
+                 guint32           time)
+{
+  gint64 start = g_get_monotonic_time ();
+
+  orig_paint (core, drawable, paint_options, coords, paint_state, time);
+
+  timings->paint += (g_get_monotonic_time () - start) / 1000000.0;
+
+  if (paint_state == GIMP_PAINT_STATE_MOTION)
+    timings->n_dabs++;
+}
+
+static GeglBuffer *
+benchmark_get_paint_buffer (GimpPaintCore    *core,
+                            GimpDrawable     *drawable,
+                            GimpPaintOptions *paint_options,
+                            const GimpCoords *coords,
+                            gint             *paint_buffer_x,
+                            gint             *paint_buffer_y)
+{
+  gint64      start = g_get_monotonic_time ();
+  GeglBuffer *buffer;
+
+  buffer = orig_get_paint_buffer (core, drawable, paint_options, coords,
+                                  paint_buffer_x, paint_buffer_y);
+
+  timings->paint_buffer += (g_get_monotonic_time () - start) / 1000000.0;
+
+  return buffer;
+}
+
+/*  a spiral across the canvas, with varying pressure and tilt, for
+ *  when there is no recording
+ */
+static GimpPaintRecord *
+benchmark_synthetic_record (void)
+{
+  GimpPaintRecord *record = gimp_paint_record_new ();
+  GimpCoords       coords = GIMP_COORDS_DEFAULT_VALUES;
+  gint             i;
+
+  gimp_paint_record_begin_stroke (record);
+
+  for (i = 0; i < 2000; i++)
+    {
+      gdouble t = i / 2000.0;
+      gdouble a = t * 8.0 * G_PI;
+
+      coords.x        = 512.0 + 480.0 * t * cos (a);
+      coords.y        = 512.0 + 480.0 * t * sin (a);
+      coords.pressure = 0.5 + 0.5 * sin (a * 3.0);
+      coords.xtilt    = 0.2 * cos (a);
+      coords.ytilt    = 0.2 * sin (a);
+
+      gimp_paint_record_add_event (record, &coords, i * 8);
+    }
+
+  return record;
+}
+
+static void
+benchmark_replay (GimpPaintCore    *core,
+                  GimpDrawable     *drawable,
+                  GimpPaintOptions *options,
+                  GimpPaintRecord  *record,
+                  gdouble           scale_x,
+                  gdouble           scale_y)
+{
+  gint stroke;
+
+  for (stroke = 0; stroke < gimp_paint_record_get_n_strokes (record); stroke++)
+    {
+      const GimpPaintRecordEvent *events;
+      GimpCoords                  coords;
+      GError                     *error = NULL;
+      gint64                      start;
+      gint                        n_events;
+      gint                        i;
+
+      events = gimp_paint_record_get_stroke (record, stroke, &n_events);
+
+      if (n_events == 0)
+        continue;
+
+      coords    = events[0].coords;
+      coords.x *= scale_x;
+      coords.y *= scale_y;
+
+      start = g_get_monotonic_time ();
+
+      if (! gimp_paint_core_start (core, drawable, options, &coords, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          g_clear_error (&error);
+          continue;
+        }
+
+      core->start_coords = coords;
+      core->last_coords  = coords;
+
+      timings->start += (g_get_monotonic_time () - start) / 1000000.0;
+
+      gimp_paint_core_paint (core, drawable, options,
+                             GIMP_PAINT_STATE_INIT, events[0].time);
+      gimp_paint_core_paint (core, drawable, options,
+                             GIMP_PAINT_STATE_MOTION, events[0].time);
+
+      for (i = 1; i < n_events; i++)
+        {
+          coords    = events[i].coords;
+          coords.x *= scale_x;
+          coords.y *= scale_y;
+
+          gimp_paint_core_interpolate (core, drawable, options,
+                                       &coords, events[i].time);
+        }
+
+      gimp_paint_core_paint (core, drawable, options,
+                             GIMP_PAINT_STATE_FINISH,
+                             events[n_events - 1].time);
+
+      start = g_get_monotonic_time ();
+
+      gimp_paint_core_finish (core, drawable, TRUE);
+      gimp_paint_core_cleanup (core);
+
+      timings->finish += (g_get_monotonic_time () - start) / 1000000.0;
+    }
+}
+
+static void
+benchmark_tool (Gimp            *gimp,
+                GimpContext     *context,
+                GimpPaintInfo   *info,
+                GimpPaintRecord *record,
+                gint             width,
+                gint             height,
+                gdouble          scale_x,
+                gdouble          scale_y)
+{
+  GimpPaintCoreClass *klass;
+  GimpPaintOptions   *options;
+  GimpPaintCore      *core;
+  GimpImage          *image;
+  GimpLayer          *layer;
+  Timings             result = { 0, };
+  gint64              start;
+  gint                i;
+
+  image = gimp_image_new (gimp, width, height,
+                          GIMP_RGB, GIMP_PRECISION_U8_GAMMA);
+
+  layer = gimp_layer_new (image, width, height,
+                          babl_format ("R'G'B'A u8"),
+                          "Benchmark", 1.0, GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  gimp_drawable_fill_by_type (GIMP_DRAWABLE (layer), context,
+                              GIMP_FOREGROUND_FILL);
+
+  options = gimp_paint_options_new (info);
+
+  g_object_set (options,
+                "brush-size", brush_size,
+                NULL);
+
+  if (g_type_is_a (info->paint_type, GIMP_TYPE_PERSPECTIVE_CLONE))
+    g_object_set (options,
+                  "clone-mode", GIMP_PERSPECTIVE_CLONE_MODE_PAINT,
+                  NULL);
+
+  gimp_context_define_properties (GIMP_CONTEXT (options),
+                                  GIMP_CONTEXT_PAINT_PROPS_MASK,
+                                  FALSE);
+  gimp_context_set_parent (GIMP_CONTEXT (options), context);
+
+  if (g_type_is_a (info->paint_type, GIMP_TYPE_SOURCE_CORE))
+    core = g_object_new (info->paint_type,
+                         "undo-desc",    info->blurb,
+                         "src-drawable", layer,
+                         "src-x",        width  / 2.0,
+                         "src-y",        height / 2.0,
+                         NULL);
+  else
+    core = g_object_new (info->paint_type,
+                         "undo-desc", info->blurb,
+                         NULL);
+
+  if (GIMP_IS_PERSPECTIVE_CLONE (core))
+    {
+      GimpMatrix3 transform;
+
+      gimp_matrix3_identity (&transform);
+      transform.coeff[2][0] = 0.2 / width;
+
+      gimp_perspective_clone_set_transform (GIMP_PERSPECTIVE_CLONE (core),
+                                            &transform);
+    }
+
+  klass = GIMP_PAINT_CORE_GET_CLASS (core);
+
+  orig_paint            = klass->paint;
+  orig_get_paint_buffer = klass->get_paint_buffer;
+
+  klass->paint            = benchmark_paint;
+  klass->get_paint_buffer = benchmark_get_paint_buffer;
+
+  timings = &result;
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < repeat; i++)
+    benchmark_replay (core, GIMP_DRAWABLE (layer), options, record,
+                      scale_x, scale_y);
+
+  result.total = (g_get_monotonic_time () - start) / 1000000.0;
+
+  timings = NULL;
+
+  klass->paint            = orig_paint;
+  klass->get_paint_buffer = orig_get_paint_buffer;
+
+  g_print ("%-24s %5dx%-5d %8d dabs %10.1f dabs/s   "
+           "start %7.3fs  paint %7.3fs (buffer %7.3fs)  "
+           "finish %7.3fs  total %7.3fs\n",
+           gimp_object_get_name (info),
+           width, height,
+           result.n_dabs,
+           result.total > 0.0 ? result.n_dabs / result.total : 0.0,
+           result.start,
+           result.paint,
+           result.paint_buffer,
+           result.finish,
+           result.total);
+
+  g_object_unref (core);
+  g_object_unref (options);
+  g_object_unref (image);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  GOptionContext  *option_context;
+  Gimp            *gimp;
+  GimpContext     *context;
+  GimpData        *brush;
+  GimpPaintRecord *record;
+  GError          *error = NULL;
+  gint             record_width;
+  gint             record_height;
+  gint             n_tools;
+  gint             s;
+  gint             t;
+
+  option_context = g_option_context_new (NULL);
+
+  g_option_context_set_summary (option_context,
+                                "Replays paint strokes through the paint "
+                                "cores and reports their throughput.");
+  g_option_context_add_main_entries (option_context, entries, NULL);
+
+  if (! g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+
+      return EXIT_FAILURE;
+    }
+
+  g_option_context_free (option_context);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  if (record_file)
+    {
+      record = gimp_paint_record_load (record_file, &error);
+
+      if (! record)
+        {
+          g_printerr ("%s\n", error->message);
+          g_clear_error (&error);
+
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    {
+      record = benchmark_synthetic_record ();
+    }
+
+  /*  the strokes are scaled from the bounds of the recording to each
+   *  canvas size
+   */
+  record_width  = 1;
+  record_height = 1;
+
+  for (s = 0; s < gimp_paint_record_get_n_strokes (record); s++)
+    {
+      const GimpPaintRecordEvent *events;
+      gint                        n_events;
+      gint                        i;
+
+      events = gimp_paint_record_get_stroke (record, s, &n_events);
+
+      for (i = 0; i < n_events; i++)
+        {
+          record_width  = MAX (record_width,  ceil (events[i].coords.x) + 1);
+          record_height = MAX (record_height, ceil (events[i].coords.y) + 1);
+        }
+    }
+
+  context = gimp_context_new (gimp, "Benchmark", NULL);
+
+  brush = gimp_brush_generated_new ("Benchmark",
+                                    GIMP_BRUSH_GENERATED_CIRCLE,
+                                    brush_size / 2.0, 2, 0.5, 1.0, 0.0);
+  gimp_context_set_brush (context, GIMP_BRUSH (brush));
+
+  n_tools = tools ? g_strv_length (tools) : G_N_ELEMENTS (default_tools);
+
+  for (t = 0; t < n_tools; t++)
+    {
+      const gchar   *name = tools ? tools[t] : default_tools[t];
+      GimpPaintInfo *info;
+
+      info = (GimpPaintInfo *)
+        gimp_container_get_child_by_name (gimp->paint_info_list, name);
+
+      if (! info)
+        {
+          g_printerr ("No paint tool named '%s'\n", name);
+          continue;
+        }
+
+      if (! sizes)
+        {
+          benchmark_tool (gimp, context, info, record,
+                          record_width, record_height, 1.0, 1.0);
+          continue;
+        }
+
+      for (s = 0; sizes[s]; s++)
+        {
+          gint width;
+          gint height;
+
+          if (sscanf (sizes[s], "%dx%d", &width, &height) != 2 ||
+              width < 1 || height < 1)
+            {
+              g_printerr ("Invalid canvas size '%s'\n", sizes[s]);
+              continue;
+            }
+
+          benchmark_tool (gimp, context, info, record, width, height,
+                          (gdouble) width  / record_width,
+                          (gdouble) height / record_height);
+        }
+    }
+
+  g_object_unref (brush);
+  g_object_unref (context);
+
+  gimp_paint_record_free (record);
+
+  g_object_unref (gimp);
+
+  return EXIT_SUCCESS;
+}
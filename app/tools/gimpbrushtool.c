@@ -43,40 +43,57 @@
 #include "display/gimpdisplayshell.h"
 
 #include "gimpbrushtool.h"
+#include "gimppainttool-paint.h"
 #include "gimptoolcontrol.h"
 
 
-static void   gimp_brush_tool_constructed     (GObject           *object);
-
-static void   gimp_brush_tool_motion          (GimpTool          *tool,
-                                               const GimpCoords  *coords,
-                                               guint32            time,
-                                               GdkModifierType    state,
-                                               GimpDisplay       *display);
-static void   gimp_brush_tool_oper_update     (GimpTool          *tool,
-                                               const GimpCoords  *coords,
-                                               GdkModifierType    state,
-                                               gboolean           proximity,
-                                               GimpDisplay       *display);
-static void   gimp_brush_tool_cursor_update   (GimpTool          *tool,
-                                               const GimpCoords  *coords,
-                                               GdkModifierType    state,
-                                               GimpDisplay       *display);
-static void   gimp_brush_tool_options_notify  (GimpTool          *tool,
-                                               GimpToolOptions   *options,
-                                               const GParamSpec  *pspec);
-
-static void   gimp_brush_tool_draw            (GimpDrawTool      *draw_tool);
-
-static void   gimp_brush_tool_brush_changed   (GimpContext       *context,
-                                               GimpBrush         *brush,
-                                               GimpBrushTool     *brush_tool);
-static void   gimp_brush_tool_set_brush       (GimpBrushCore     *brush_core,
-                                               GimpBrush         *brush,
-                                               GimpBrushTool     *brush_tool);
-static void   gimp_brush_tool_notify_brush    (GimpDisplayConfig *config,
-                                               GParamSpec        *pspec,
-                                               GimpBrushTool     *brush_tool);
+static void     gimp_brush_tool_constructed    (GObject               *object);
+static void     gimp_brush_tool_finalize       (GObject               *object);
+
+static void     gimp_brush_tool_button_press   (GimpTool              *tool,
+                                                const GimpCoords      *coords,
+                                                guint32                time,
+                                                GdkModifierType        state,
+                                                GimpButtonPressType    press_type,
+                                                GimpDisplay           *display);
+static void     gimp_brush_tool_button_release (GimpTool              *tool,
+                                                const GimpCoords      *coords,
+                                                guint32                time,
+                                                GdkModifierType        state,
+                                                GimpButtonReleaseType  release_type,
+                                                GimpDisplay           *display);
+static void     gimp_brush_tool_motion         (GimpTool              *tool,
+                                                const GimpCoords      *coords,
+                                                guint32                time,
+                                                GdkModifierType        state,
+                                                GimpDisplay           *display);
+static void     gimp_brush_tool_oper_update    (GimpTool              *tool,
+                                                const GimpCoords      *coords,
+                                                GdkModifierType        state,
+                                                gboolean               proximity,
+                                                GimpDisplay           *display);
+static void     gimp_brush_tool_cursor_update  (GimpTool              *tool,
+                                                const GimpCoords      *coords,
+                                                GdkModifierType        state,
+                                                GimpDisplay           *display);
+static void     gimp_brush_tool_options_notify (GimpTool              *tool,
+                                                GimpToolOptions       *options,
+                                                const GParamSpec      *pspec);
+
+static void     gimp_brush_tool_draw           (GimpDrawTool          *draw_tool);
+
+static void     gimp_brush_tool_brush_changed  (GimpContext           *context,
+                                                GimpBrush             *brush,
+                                                GimpBrushTool         *brush_tool);
+static void     gimp_brush_tool_set_brush      (GimpBrushCore         *brush_core,
+                                                GimpBrush             *brush,
+                                                GimpBrushTool         *brush_tool);
+static gboolean gimp_brush_tool_set_brush_idle (GimpBrushTool         *brush_tool);
+static void     gimp_brush_tool_notify_brush   (GimpDisplayConfig     *config,
+                                                GParamSpec            *pspec,
+                                                GimpBrushTool         *brush_tool);
+
+static void     gimp_brush_tool_update_brush   (GimpBrushTool         *brush_tool);
 
 
 G_DEFINE_TYPE (GimpBrushTool, gimp_brush_tool, GIMP_TYPE_PAINT_TOOL)
@@ -92,7 +109,10 @@ gimp_brush_tool_class_init (GimpBrushToolClass *klass)
   GimpDrawToolClass *draw_tool_class = GIMP_DRAW_TOOL_CLASS (klass);
 
   object_class->constructed  = gimp_brush_tool_constructed;
+  object_class->finalize     = gimp_brush_tool_finalize;
 
+  tool_class->button_press   = gimp_brush_tool_button_press;
+  tool_class->button_release = gimp_brush_tool_button_release;
   tool_class->motion         = gimp_brush_tool_motion;
   tool_class->oper_update    = gimp_brush_tool_oper_update;
   tool_class->cursor_update  = gimp_brush_tool_cursor_update;
@@ -154,6 +174,72 @@ gimp_brush_tool_constructed (GObject *object)
                            brush_tool, 0);
 }
 
+static void
+gimp_brush_tool_finalize (GObject *object)
+{
+  GimpBrushTool *brush_tool = GIMP_BRUSH_TOOL (object);
+
+  g_clear_pointer (&brush_tool->boundary, gimp_bezier_desc_free);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gimp_brush_tool_button_press (GimpTool            *tool,
+                              const GimpCoords    *coords,
+                              guint32              time,
+                              GdkModifierType      state,
+                              GimpButtonPressType  press_type,
+                              GimpDisplay         *display)
+{
+  GimpBrushTool *brush_tool = GIMP_BRUSH_TOOL (tool);
+  GimpBrushCore *brush_core = GIMP_BRUSH_CORE (GIMP_PAINT_TOOL (tool)->core);
+
+  /*  the stroke may be painted on the paint thread, which owns the
+   *  core's brush transform and uses the brush's mask cache, so keep
+   *  the current outline for drawing while it paints
+   */
+  g_clear_pointer (&brush_tool->boundary, gimp_bezier_desc_free);
+
+  if (brush_core->main_brush && brush_core->scale > 0.0)
+    {
+      brush_tool->boundary =
+        gimp_brush_transform_boundary (brush_core->main_brush,
+                                       brush_core->scale,
+                                       brush_core->aspect_ratio,
+                                       brush_core->angle,
+                                       brush_core->hardness,
+                                       &brush_tool->boundary_width,
+                                       &brush_tool->boundary_height);
+    }
+
+  GIMP_TOOL_CLASS (parent_class)->button_press (tool, coords, time, state,
+                                                press_type, display);
+}
+
+static void
+gimp_brush_tool_button_release (GimpTool              *tool,
+                                const GimpCoords      *coords,
+                                guint32                time,
+                                GdkModifierType        state,
+                                GimpButtonReleaseType  release_type,
+                                GimpDisplay           *display)
+{
+  GimpBrushTool *brush_tool = GIMP_BRUSH_TOOL (tool);
+
+  GIMP_TOOL_CLASS (parent_class)->button_release (tool, coords, time, state,
+                                                  release_type, display);
+
+  g_clear_pointer (&brush_tool->boundary, gimp_bezier_desc_free);
+
+  /*  the stroke is painted, apply the brush changes made meanwhile  */
+  if (g_atomic_int_compare_and_exchange (&brush_tool->brush_pending,
+                                         TRUE, FALSE))
+    {
+      gimp_brush_tool_update_brush (brush_tool);
+    }
+}
+
 static void
 gimp_brush_tool_motion (GimpTool         *tool,
                         const GimpCoords *coords,
@@ -309,9 +395,11 @@ gimp_brush_tool_create_outline (GimpBrushTool *brush_tool,
   GimpBrushCore        *brush_core;
   GimpPaintOptions     *options;
   GimpDisplayShell     *shell;
-  const GimpBezierDesc *boundary = NULL;
-  gint                  width    = 0;
-  gint                  height   = 0;
+  const GimpBezierDesc *boundary    = NULL;
+  GimpBezierDesc       *transformed = NULL;
+  GimpCanvasItem       *item        = NULL;
+  gint                  width       = 0;
+  gint                  height      = 0;
 
   g_return_val_if_fail (GIMP_IS_BRUSH_TOOL (brush_tool), NULL);
   g_return_val_if_fail (GIMP_IS_DISPLAY (display), NULL);
@@ -323,17 +411,31 @@ gimp_brush_tool_create_outline (GimpBrushTool *brush_tool,
   options    = GIMP_PAINT_TOOL_GET_OPTIONS (brush_tool);
   shell      = gimp_display_get_shell (display);
 
-  if (! brush_core->main_brush || ! brush_core->dynamics)
-    return NULL;
-
-  if (brush_core->scale > 0.0)
-    boundary = gimp_brush_transform_boundary (brush_core->main_brush,
-                                              brush_core->scale,
-                                              brush_core->aspect_ratio,
-                                              brush_core->angle,
-                                              brush_core->hardness,
-                                              &width,
-                                              &height);
+  if (gimp_paint_tool_paint_is_active (GIMP_PAINT_TOOL (brush_tool)))
+    {
+      /*  don't touch the core while the paint thread paints, use the
+       *  outline from before the stroke
+       */
+      boundary = brush_tool->boundary;
+      width    = brush_tool->boundary_width;
+      height   = brush_tool->boundary_height;
+    }
+  else
+    {
+      if (! brush_core->main_brush || ! brush_core->dynamics)
+        return NULL;
+
+      if (brush_core->scale > 0.0)
+        transformed = gimp_brush_transform_boundary (brush_core->main_brush,
+                                                     brush_core->scale,
+                                                     brush_core->aspect_ratio,
+                                                     brush_core->angle,
+                                                     brush_core->hardness,
+                                                     &width,
+                                                     &height);
+
+      boundary = transformed;
+    }
 
   /*  don't draw the boundary if it becomes too small  */
   if (boundary                   &&
@@ -355,12 +457,12 @@ gimp_brush_tool_create_outline (GimpBrushTool *brush_tool,
 #undef EPSILON
         }
 
-      return gimp_canvas_path_new (shell, boundary, x, y, FALSE,
+      item = gimp_canvas_path_new (shell, boundary, x, y, FALSE,
                                    GIMP_PATH_STYLE_OUTLINE);
     }
   else if (draw_fallback)
     {
-      return gimp_canvas_handle_new (shell,
+      item = gimp_canvas_handle_new (shell,
                                      GIMP_HANDLE_CROSS,
                                      GIMP_HANDLE_ANCHOR_CENTER,
                                      x, y,
@@ -368,7 +470,10 @@ gimp_brush_tool_create_outline (GimpBrushTool *brush_tool,
                                      GIMP_TOOL_HANDLE_SIZE_SMALL);
     }
 
-  return NULL;
+  if (transformed)
+    gimp_bezier_desc_free (transformed);
+
+  return item;
 }
 
 static void
@@ -379,8 +484,16 @@ gimp_brush_tool_brush_changed (GimpContext   *context,
   GimpPaintTool *paint_tool = GIMP_PAINT_TOOL (brush_tool);
   GimpBrushCore *brush_core = GIMP_BRUSH_CORE (paint_tool->core);
 
-  gimp_brush_core_set_brush (brush_core, brush);
+  /*  the paint thread paints with the core's brush, switch it once
+   *  the stroke is finished
+   */
+  if (gimp_paint_tool_paint_is_active (paint_tool))
+    {
+      g_atomic_int_set (&brush_tool->brush_pending, TRUE);
+      return;
+    }
 
+  gimp_brush_core_set_brush (brush_core, brush);
 }
 
 static void
@@ -388,6 +501,26 @@ gimp_brush_tool_set_brush (GimpBrushCore *brush_core,
                            GimpBrush     *brush,
                            GimpBrushTool *brush_tool)
 {
+  /*  this is also emitted while the paint thread paints, possibly from
+   *  the paint thread itself; the core is the paint thread's then, so
+   *  update the outline from the main thread once the stroke is
+   *  finished, see gimp_brush_tool_button_release()
+   */
+  if (gimp_paint_tool_paint_is_active (GIMP_PAINT_TOOL (brush_tool)) ||
+      ! g_main_context_is_owner (NULL))
+    {
+      if (g_atomic_int_compare_and_exchange (&brush_tool->brush_pending,
+                                             FALSE, TRUE))
+        {
+          g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                           (GSourceFunc) gimp_brush_tool_set_brush_idle,
+                           g_object_ref (brush_tool),
+                           (GDestroyNotify) g_object_unref);
+        }
+
+      return;
+    }
+
   gimp_draw_tool_pause (GIMP_DRAW_TOOL (brush_tool));
 
   if (GIMP_BRUSH_CORE_GET_CLASS (brush_core)->handles_transforming_brush)
@@ -403,6 +536,22 @@ gimp_brush_tool_set_brush (GimpBrushCore *brush_core,
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (brush_tool));
 }
 
+static gboolean
+gimp_brush_tool_set_brush_idle (GimpBrushTool *brush_tool)
+{
+  /*  if the stroke is still being painted, the brush stays pending
+   *  until gimp_brush_tool_button_release()
+   */
+  if (! gimp_paint_tool_paint_is_active (GIMP_PAINT_TOOL (brush_tool)) &&
+      g_atomic_int_compare_and_exchange (&brush_tool->brush_pending,
+                                         TRUE, FALSE))
+    {
+      gimp_brush_tool_update_brush (brush_tool);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 gimp_brush_tool_notify_brush (GimpDisplayConfig *config,
                               GParamSpec        *pspec,
@@ -415,3 +564,16 @@ gimp_brush_tool_notify_brush (GimpDisplayConfig *config,
 
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (brush_tool));
 }
+
+static void
+gimp_brush_tool_update_brush (GimpBrushTool *brush_tool)
+{
+  GimpPaintTool *paint_tool = GIMP_PAINT_TOOL (brush_tool);
+  GimpBrushCore *brush_core = GIMP_BRUSH_CORE (paint_tool->core);
+  GimpContext   *context    = GIMP_CONTEXT (GIMP_PAINT_TOOL_GET_OPTIONS (brush_tool));
+
+  gimp_brush_core_set_brush (brush_core, gimp_context_get_brush (context));
+
+  g_signal_emit_by_name (brush_core, "set-brush",
+                         brush_core->main_brush);
+}
@@ -34,12 +34,17 @@ typedef struct _GimpBrushToolClass GimpBrushToolClass;
 
 struct _GimpBrushTool
 {
-  GimpPaintTool  parent_instance;
+  GimpPaintTool   parent_instance;
 
-  gboolean       show_cursor;
-  gboolean       draw_brush;
-  gdouble        brush_x;
-  gdouble        brush_y;
+  gboolean        show_cursor;
+  gboolean        draw_brush;
+  gdouble         brush_x;
+  gdouble         brush_y;
+
+  GimpBezierDesc *boundary;        /*  the outline while painting      */
+  gint            boundary_width;
+  gint            boundary_height;
+  gint            brush_pending;   /*  brush changed while painting    */
 };
 
 struct _GimpBrushToolClass
@@ -33,6 +33,7 @@
 #include "tools-types.h"
 
 #include "gegl/gimp-gegl-mask.h"
+#include "gegl/gimp-gegl-parallel.h"
 
 #include "core/gimp.h"
 #include "core/gimpdrawable-foreground-extract.h"
@@ -55,6 +56,14 @@
 #include "gimp-intl.h"
 
 
+/*  known pixels around the unknown area that are fed to the matting
+ *  engine along with it
+ */
+#define MATTING_MARGIN      32
+
+#define MIN_PARALLEL_PIXELS (64 * 64)
+
+
 typedef struct
 {
   gint         width;
@@ -63,6 +72,13 @@ typedef struct
   GimpVector2 *points;
 } FgSelectStroke;
 
+typedef struct
+{
+  GeglBuffer    *trimap;
+  GeglRectangle  area;
+  GMutex         mutex;
+} UnknownAreaData;
+
 
 static void   gimp_foreground_select_tool_constructed    (GObject          *object);
 static void   gimp_foreground_select_tool_finalize       (GObject          *object);
@@ -117,6 +133,13 @@ static void   gimp_foreground_select_tool_set_preview    (GimpForegroundSelectTo
 static void   gimp_foreground_select_tool_drop_masks     (GimpForegroundSelectTool *fg_select,
                                                           GimpDisplay              *display);
 
+static void   gimp_foreground_select_tool_unknown_area_func
+                                                         (const GeglRectangle      *area,
+                                                          UnknownAreaData          *data);
+static void   gimp_foreground_select_tool_get_unknown_area
+                                                         (GimpForegroundSelectTool *fg_select,
+                                                          GeglRectangle            *area);
+
 static void   gimp_foreground_select_tool_apply          (GimpForegroundSelectTool *fg_select,
                                                           GimpDisplay              *display);
 static void   gimp_foreground_select_tool_preview        (GimpForegroundSelectTool *fg_select,
@@ -199,10 +222,11 @@ gimp_foreground_select_tool_init (GimpForegroundSelectTool *fg_select)
   gimp_tool_control_set_action_value_2 (tool->control,
                                         "tools/tools-foreground-select-brush-size-set");
 
-  fg_select->stroke  = NULL;
-  fg_select->mask    = NULL;
-  fg_select->trimap  = NULL;
-  fg_select->state   = MATTING_STATE_FREE_SELECT;
+  fg_select->stroke             = NULL;
+  fg_select->mask               = NULL;
+  fg_select->trimap             = NULL;
+  fg_select->unknown_area_valid = FALSE;
+  fg_select->state              = MATTING_STATE_FREE_SELECT;
 }
 
 static void
@@ -627,6 +651,8 @@ gimp_foreground_select_tool_select (GimpFreeSelectTool *free_sel,
                                       0, 0, 1.0);
       gimp_scan_convert_free (scan_convert);
 
+      fg_select->unknown_area_valid = FALSE;
+
       gimp_foreground_select_tool_set_trimap (fg_select, display);
     }
 }
@@ -697,6 +723,8 @@ gimp_foreground_select_tool_drop_masks (GimpForegroundSelectTool *fg_select,
       fg_select->trimap = NULL;
     }
 
+  fg_select->unknown_area_valid = FALSE;
+
   if (fg_select->mask)
     {
       g_object_unref (fg_select->mask);
@@ -718,6 +746,90 @@ gimp_foreground_select_tool_drop_masks (GimpForegroundSelectTool *fg_select,
   fg_select->state = MATTING_STATE_FREE_SELECT;
 }
 
+static void
+gimp_foreground_select_tool_unknown_area_func (const GeglRectangle *area,
+                                               UnknownAreaData     *data)
+{
+  GeglBufferIterator *iter;
+  gint                x1 = G_MAXINT;
+  gint                y1 = G_MAXINT;
+  gint                x2 = G_MININT;
+  gint                y2 = G_MININT;
+
+  iter = gegl_buffer_iterator_new (data->trimap, area, 0,
+                                   babl_format ("Y float"),
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data_ptr = iter->data[0];
+      GeglRectangle roi      = iter->roi[0];
+      gint          x, y;
+
+      for (y = roi.y; y < roi.y + roi.height; y++)
+        {
+          for (x = roi.x; x < roi.x + roi.width; x++, data_ptr++)
+            {
+              /*  everything that is neither foreground nor background  */
+              if (*data_ptr > 0.0f && *data_ptr < 1.0f)
+                {
+                  x1 = MIN (x1, x);
+                  x2 = MAX (x2, x + 1);
+                  y1 = MIN (y1, y);
+                  y2 = MAX (y2, y + 1);
+                }
+            }
+        }
+    }
+
+  if (x1 < x2)
+    {
+      GeglRectangle found = { x1, y1, x2 - x1, y2 - y1 };
+
+      g_mutex_lock (&data->mutex);
+
+      if (data->area.width == 0)
+        data->area = found;
+      else
+        gegl_rectangle_bounding_box (&data->area, &data->area, &found);
+
+      g_mutex_unlock (&data->mutex);
+    }
+}
+
+/*  Returns the bounding box of the trimap's unknown pixels.  The area
+ *  is scanned once per trimap and then only grown by the bounds of
+ *  each painted stroke, so refining the trimap doesn't require another
+ *  pass over the whole image.
+ */
+static void
+gimp_foreground_select_tool_get_unknown_area (GimpForegroundSelectTool *fg_select,
+                                              GeglRectangle            *area)
+{
+  if (! fg_select->unknown_area_valid)
+    {
+      UnknownAreaData data;
+
+      data.trimap = fg_select->trimap;
+      gegl_rectangle_set (&data.area, 0, 0, 0, 0);
+
+      g_mutex_init (&data.mutex);
+
+      gimp_gegl_parallel_distribute_area (gegl_buffer_get_extent (data.trimap),
+                                          MIN_PARALLEL_PIXELS,
+                                          (GimpGeglParallelAreaFunc)
+                                          gimp_foreground_select_tool_unknown_area_func,
+                                          &data);
+
+      g_mutex_clear (&data.mutex);
+
+      fg_select->unknown_area       = data.area;
+      fg_select->unknown_area_valid = TRUE;
+    }
+
+  *area = fg_select->unknown_area;
+}
+
 static void
 gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
                                      GimpDisplay              *display)
@@ -728,15 +840,8 @@ gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
   GimpDrawable                *drawable = gimp_image_get_active_drawable (image);
   GeglBuffer                  *trimap_buffer;
   GeglBuffer                  *drawable_buffer;
-  GeglNode                    *gegl;
-  GeglNode                    *matting_node;
-  GeglNode                    *input_image;
-  GeglNode                    *input_trimap;
-  GeglNode                    *output_mask;
-  GeglBuffer                  *buffer;
-  GimpProgress                *progress;
-  GeglProcessor               *processor;
-  gdouble                     value;
+  GeglRectangle                extent;
+  GeglRectangle                area;
 
   if (fg_select->mask)
     {
@@ -744,70 +849,117 @@ gimp_foreground_select_tool_preview (GimpForegroundSelectTool *fg_select,
       fg_select->mask = NULL;
     }
 
-  progress = gimp_progress_start (GIMP_PROGRESS (fg_select),
-                                  _("Computing alpha of unknown pixels"),
-                                  FALSE);
-
   trimap_buffer   = fg_select->trimap;
   drawable_buffer = gimp_drawable_get_buffer (drawable);
 
-  gegl = gegl_node_new ();
-
-  input_trimap = gegl_node_new_child (gegl,
-                                      "operation", "gegl:buffer-source",
-                                      "buffer",    trimap_buffer,
-                                      NULL);
-  input_image = gegl_node_new_child (gegl,
-                                     "operation", "gegl:buffer-source",
-                                     "buffer",    drawable_buffer,
-                                     NULL);
-  output_mask = gegl_node_new_child (gegl,
-                                     "operation", "gegl:buffer-sink",
-                                     "buffer",    &buffer,
-                                     "format",    NULL,
-                                     NULL);
-
-  if (options->engine == GIMP_MATTING_ENGINE_GLOBAL)
-    {
-      matting_node = gegl_node_new_child (gegl,
-                                          "operation",  "gegl:matting-global",
-                                          "iterations", options->iterations,
-                                          NULL);
+  extent = *gegl_buffer_get_extent (drawable_buffer);
+
+  /*  the matting engines pass known pixels through unchanged, so start
+   *  from the trimap and only compute the alpha around the unknown
+   *  pixels
+   */
+  fg_select->mask = gegl_buffer_new (&extent, babl_format ("Y float"));
+
+  gegl_buffer_copy (trimap_buffer, &extent, fg_select->mask, &extent);
+
+  gimp_foreground_select_tool_get_unknown_area (fg_select, &area);
+
+  if (area.width > 0)
+    {
+      area.x      -= MATTING_MARGIN;
+      area.y      -= MATTING_MARGIN;
+      area.width  += 2 * MATTING_MARGIN;
+      area.height += 2 * MATTING_MARGIN;
     }
-  else
+
+  if (gegl_rectangle_intersect (&area, &area, &extent))
     {
-      matting_node = gegl_node_new_child (gegl,
-                                          "operation",     "gegl:matting-levin",
-                                          "levels",        options->levels,
-                                          "active_levels", options->active_levels,
+      GeglNode      *gegl;
+      GeglNode      *matting_node;
+      GeglNode      *input_image;
+      GeglNode      *input_trimap;
+      GeglNode      *crop_image;
+      GeglNode      *crop_trimap;
+      GeglNode      *output_mask;
+      GimpProgress  *progress;
+      GeglProcessor *processor;
+      gdouble        value;
+
+      progress = gimp_progress_start (GIMP_PROGRESS (fg_select),
+                                      _("Computing alpha of unknown pixels"),
+                                      FALSE);
+
+      gegl = gegl_node_new ();
+
+      input_trimap = gegl_node_new_child (gegl,
+                                          "operation", "gegl:buffer-source",
+                                          "buffer",    trimap_buffer,
                                           NULL);
-    }
+      input_image = gegl_node_new_child (gegl,
+                                         "operation", "gegl:buffer-source",
+                                         "buffer",    drawable_buffer,
+                                         NULL);
+      crop_trimap = gegl_node_new_child (gegl,
+                                         "operation", "gegl:crop",
+                                         "x",         (gdouble) area.x,
+                                         "y",         (gdouble) area.y,
+                                         "width",     (gdouble) area.width,
+                                         "height",    (gdouble) area.height,
+                                         NULL);
+      crop_image = gegl_node_new_child (gegl,
+                                        "operation", "gegl:crop",
+                                        "x",         (gdouble) area.x,
+                                        "y",         (gdouble) area.y,
+                                        "width",     (gdouble) area.width,
+                                        "height",    (gdouble) area.height,
+                                        NULL);
+      output_mask = gegl_node_new_child (gegl,
+                                         "operation", "gegl:write-buffer",
+                                         "buffer",    fg_select->mask,
+                                         NULL);
+
+      if (options->engine == GIMP_MATTING_ENGINE_GLOBAL)
+        {
+          matting_node = gegl_node_new_child (gegl,
+                                              "operation",  "gegl:matting-global",
+                                              "iterations", options->iterations,
+                                              NULL);
+        }
+      else
+        {
+          matting_node = gegl_node_new_child (gegl,
+                                              "operation",     "gegl:matting-levin",
+                                              "levels",        options->levels,
+                                              "active_levels", options->active_levels,
+                                              NULL);
+        }
 
-  gegl_node_connect_to (input_image,  "output",
-                        matting_node, "input");
-  gegl_node_connect_to (input_trimap, "output",
-                        matting_node, "aux");
-  gegl_node_connect_to (matting_node, "output",
-                        output_mask,  "input");
+      gegl_node_link_many (input_image, crop_image, NULL);
+      gegl_node_link_many (input_trimap, crop_trimap, NULL);
 
-  processor = gegl_node_new_processor (output_mask, NULL);
+      gegl_node_connect_to (crop_image,   "output",
+                            matting_node, "input");
+      gegl_node_connect_to (crop_trimap,  "output",
+                            matting_node, "aux");
+      gegl_node_connect_to (matting_node, "output",
+                            output_mask,  "input");
 
-  while (gegl_processor_work (processor, &value))
-    {
-      if (progress)
-        gimp_progress_set_value (progress, value);
-    }
+      processor = gegl_node_new_processor (output_mask, &area);
 
-  if (progress)
-    gimp_progress_end (progress);
+      while (gegl_processor_work (processor, &value))
+        {
+          if (progress)
+            gimp_progress_set_value (progress, value);
+        }
 
-  g_object_unref (processor);
+      if (progress)
+        gimp_progress_end (progress);
 
-  fg_select->mask = buffer;
+      g_object_unref (processor);
+      g_object_unref (gegl);
+    }
 
   gimp_foreground_select_tool_set_preview (fg_select, display);
-
-  g_object_unref (gegl);
 }
 
 static void
@@ -865,6 +1017,43 @@ gimp_foreground_select_tool_stroke_paint (GimpForegroundSelectTool    *fg_select
 
   width = ROUND ((gdouble) options->stroke_width);
 
+  /*  the stroke's antialiased pixels are unknown whatever the draw
+   *  mode, so grow the cached unknown area by the stroke's bounds
+   */
+  if (fg_select->unknown_area_valid)
+    {
+      const GimpVector2 *points = (const GimpVector2 *) fg_select->stroke->data;
+      gdouble            x1     = points[0].x;
+      gdouble            y1     = points[0].y;
+      gdouble            x2     = points[0].x;
+      gdouble            y2     = points[0].y;
+      GeglRectangle      rect;
+      gint               i;
+
+      for (i = 1; i < fg_select->stroke->len; i++)
+        {
+          x1 = MIN (x1, points[i].x);
+          y1 = MIN (y1, points[i].y);
+          x2 = MAX (x2, points[i].x);
+          y2 = MAX (y2, points[i].y);
+        }
+
+      rect.x      = floor (x1 - width / 2.0) - 1;
+      rect.y      = floor (y1 - width / 2.0) - 1;
+      rect.width  = ceil (x2 + width / 2.0) + 1 - rect.x;
+      rect.height = ceil (y2 + width / 2.0) + 1 - rect.y;
+
+      if (gegl_rectangle_intersect (&rect, &rect,
+                                    gegl_buffer_get_extent (fg_select->trimap)))
+        {
+          if (fg_select->unknown_area.width == 0)
+            fg_select->unknown_area = rect;
+          else
+            gegl_rectangle_bounding_box (&fg_select->unknown_area,
+                                         &fg_select->unknown_area, &rect);
+        }
+    }
+
   gimp_scan_convert_stroke (scan_convert,
                             width,
                             GIMP_JOIN_ROUND, GIMP_CAP_ROUND, 10.0,
@@ -50,6 +50,8 @@ struct _GimpForegroundSelectTool
   GimpCoords          last_coords;
   GArray             *stroke;
   GeglBuffer         *trimap;
+  GeglRectangle       unknown_area;
+  gboolean            unknown_area_valid;
   GeglBuffer         *mask;
   MattingState        state;
 };
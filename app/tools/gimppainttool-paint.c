@@ -0,0 +1,382 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpconfig/gimpconfig.h"
+
+#include "tools-types.h"
+
+#include "core/gimpbrush.h"
+#include "core/gimpdrawable.h"
+#include "core/gimpdynamics.h"
+#include "core/gimpimage.h"
+#include "core/gimpprojection.h"
+
+#include "paint/gimpairbrush.h"
+#include "paint/gimpbrushcore.h"
+#include "paint/gimppaintcore.h"
+#include "paint/gimppaintoptions.h"
+#include "paint/gimpsourcecore.h"
+#include "paint/gimpsourceoptions.h"
+
+#include "display/gimpdisplay.h"
+
+#include "gimppainttool.h"
+#include "gimppainttool-paint.h"
+
+
+/*  how often the display is updated while the paint thread paints  */
+#define DISPLAY_UPDATE_INTERVAL (1000 / 60)
+
+
+typedef struct
+{
+  GimpCoords coords;
+  guint32    time;
+  gboolean   paint;  /*  FALSE to only move the current coords  */
+} PaintItem;
+
+
+static gboolean   gimp_paint_tool_paint_use_thread   (GimpPaintTool *tool);
+static gboolean   gimp_paint_tool_paint_can_snapshot (GimpData      *data);
+static GimpData * gimp_paint_tool_paint_snapshot     (GimpData      *data);
+static gpointer   gimp_paint_tool_paint_thread       (GimpPaintTool *tool);
+static gboolean   gimp_paint_tool_paint_timeout      (GimpPaintTool *tool);
+
+
+/*  pushed to the queue to make the paint thread return  */
+static PaintItem  paint_thread_stop;
+
+
+/*  public functions  */
+
+/**
+ * gimp_paint_tool_paint_start:
+ * @tool:     a #GimpPaintTool
+ * @display:  the display the stroke is painted on
+ * @drawable: the drawable the stroke is painted on
+ *
+ * Starts painting the motion events of the current stroke, which are
+ * passed with gimp_paint_tool_paint_push(), on a separate thread, so
+ * that slow paint cores don't delay event processing. Meanwhile, the
+ * painted areas are updated on the display at regular intervals.
+ *
+ * Paint cores which interact with the user interface while painting,
+ * and strokes sampling the image's projection, are painted on the
+ * main thread as before; gimp_paint_tool_paint_is_active() returns
+ * %FALSE for them.
+ *
+ * While the paint thread runs, it owns the paint core's stroke state
+ * (coordinates, distances, the transformed brush). The main thread
+ * must not access it until gimp_paint_tool_paint_end(), and passes
+ * coordinates only through the queue. The thread holds the
+ * drawable's paint lock, see gimp_drawable_paint_lock(), while it
+ * paints to it.
+ *
+ * The paint thread paints with a copy of the paint options, and, for
+ * brush cores, with copies of the brush and the dynamics, so that
+ * editing them on the main thread, which dirties the brush and clears
+ * its caches, doesn't affect the stroke. The core's brush and
+ * dynamics are set back to the options' ones by
+ * gimp_paint_tool_paint_end().
+ **/
+void
+gimp_paint_tool_paint_start (GimpPaintTool *tool,
+                             GimpDisplay   *display,
+                             GimpDrawable  *drawable)
+{
+  GimpPaintOptions *options;
+
+  g_return_if_fail (GIMP_IS_PAINT_TOOL (tool));
+  g_return_if_fail (GIMP_IS_DISPLAY (display));
+  g_return_if_fail (GIMP_IS_DRAWABLE (drawable));
+  g_return_if_fail (tool->paint_thread == NULL);
+
+  if (! gimp_paint_tool_paint_use_thread (tool))
+    return;
+
+  options = GIMP_PAINT_TOOL_GET_OPTIONS (tool);
+
+  if (GIMP_IS_BRUSH_CORE (tool->core))
+    {
+      GimpBrushCore *brush_core = GIMP_BRUSH_CORE (tool->core);
+      GimpData      *brush;
+
+      brush = gimp_paint_tool_paint_snapshot (GIMP_DATA (brush_core->main_brush));
+      gimp_brush_core_set_brush (brush_core, GIMP_BRUSH (brush));
+      g_object_unref (brush);
+
+      if (brush_core->dynamics)
+        {
+          GimpData *dynamics;
+
+          dynamics = gimp_paint_tool_paint_snapshot (GIMP_DATA (brush_core->dynamics));
+          gimp_brush_core_set_dynamics (brush_core, GIMP_DYNAMICS (dynamics));
+          g_object_unref (dynamics);
+        }
+    }
+
+  tool->paint_options  = gimp_config_duplicate (GIMP_CONFIG (options));
+  tool->paint_display  = display;
+  tool->paint_drawable = drawable;
+  tool->paint_queue    = g_async_queue_new ();
+  tool->paint_cancel   = FALSE;
+
+  /*  the updates are emitted from the timeout, on this thread  */
+  gimp_paint_core_freeze_updates (tool->core);
+
+  tool->paint_thread = g_thread_new ("paint",
+                                     (GThreadFunc) gimp_paint_tool_paint_thread,
+                                     tool);
+
+  tool->paint_timeout_id =
+    g_timeout_add_full (G_PRIORITY_HIGH_IDLE,
+                        DISPLAY_UPDATE_INTERVAL,
+                        (GSourceFunc) gimp_paint_tool_paint_timeout,
+                        tool, NULL);
+}
+
+/**
+ * gimp_paint_tool_paint_end:
+ * @tool:   a #GimpPaintTool
+ * @cancel: whether the stroke is being canceled
+ *
+ * Waits until all pushed motion events are painted, or, if @cancel is
+ * %TRUE, skips the ones that aren't painted yet, and stops the paint
+ * thread. Does nothing if gimp_paint_tool_paint_is_active() is
+ * %FALSE.
+ **/
+void
+gimp_paint_tool_paint_end (GimpPaintTool *tool,
+                           gboolean       cancel)
+{
+  g_return_if_fail (GIMP_IS_PAINT_TOOL (tool));
+
+  if (! tool->paint_thread)
+    return;
+
+  g_atomic_int_set (&tool->paint_cancel, cancel);
+
+  g_async_queue_push (tool->paint_queue, &paint_thread_stop);
+
+  g_thread_join (tool->paint_thread);
+  tool->paint_thread = NULL;
+
+  g_async_queue_unref (tool->paint_queue);
+  tool->paint_queue = NULL;
+
+  g_source_remove (tool->paint_timeout_id);
+  tool->paint_timeout_id = 0;
+
+  gimp_paint_core_thaw_updates (tool->core, tool->paint_drawable);
+
+  g_clear_object (&tool->paint_options);
+  tool->paint_display  = NULL;
+  tool->paint_drawable = NULL;
+
+  if (GIMP_IS_BRUSH_CORE (tool->core))
+    {
+      GimpBrushCore *brush_core = GIMP_BRUSH_CORE (tool->core);
+      GimpContext   *context;
+
+      context = GIMP_CONTEXT (GIMP_PAINT_TOOL_GET_OPTIONS (tool));
+
+      gimp_brush_core_set_brush (brush_core,
+                                 gimp_context_get_brush (context));
+      gimp_brush_core_set_dynamics (brush_core,
+                                    gimp_context_get_dynamics (context));
+    }
+}
+
+gboolean
+gimp_paint_tool_paint_is_active (GimpPaintTool *tool)
+{
+  g_return_val_if_fail (GIMP_IS_PAINT_TOOL (tool), FALSE);
+
+  return tool->paint_thread != NULL;
+}
+
+void
+gimp_paint_tool_paint_push (GimpPaintTool    *tool,
+                            const GimpCoords *coords,
+                            guint32           time)
+{
+  PaintItem *item;
+
+  g_return_if_fail (GIMP_IS_PAINT_TOOL (tool));
+  g_return_if_fail (coords != NULL);
+  g_return_if_fail (tool->paint_thread != NULL);
+
+  item = g_slice_new (PaintItem);
+
+  item->coords = *coords;
+  item->time   = time;
+  item->paint  = TRUE;
+
+  g_async_queue_push (tool->paint_queue, item);
+}
+
+/**
+ * gimp_paint_tool_paint_set_current_coords:
+ * @tool:   a #GimpPaintTool
+ * @coords: the new current coords
+ *
+ * Like gimp_paint_core_set_current_coords(), but has the paint thread
+ * set @coords in its turn, after painting the motion events pushed
+ * before.
+ **/
+void
+gimp_paint_tool_paint_set_current_coords (GimpPaintTool    *tool,
+                                          const GimpCoords *coords)
+{
+  PaintItem *item;
+
+  g_return_if_fail (GIMP_IS_PAINT_TOOL (tool));
+  g_return_if_fail (coords != NULL);
+  g_return_if_fail (tool->paint_thread != NULL);
+
+  item = g_slice_new (PaintItem);
+
+  item->coords = *coords;
+  item->time   = 0;
+  item->paint  = FALSE;
+
+  g_async_queue_push (tool->paint_queue, item);
+}
+
+
+/*  private functions  */
+
+static gboolean
+gimp_paint_tool_paint_use_thread (GimpPaintTool *tool)
+{
+  static gint use_thread = -1;
+
+  if (use_thread < 0)
+    use_thread = g_getenv ("GIMP_NO_PAINT_THREAD") == NULL;
+
+  if (! use_thread)
+    return FALSE;
+
+  /*  the airbrush paints from a timeout on the main thread  */
+  if (GIMP_IS_AIRBRUSH (tool->core))
+    return FALSE;
+
+  /*  flushing the projection to sample it must happen on the main
+   *  thread
+   */
+  if (GIMP_IS_SOURCE_CORE (tool->core))
+    {
+      GimpSourceOptions *options;
+
+      options = GIMP_SOURCE_OPTIONS (GIMP_PAINT_TOOL_GET_OPTIONS (tool));
+
+      if (options->sample_merged)
+        return FALSE;
+    }
+
+  /*  the paint thread paints with snapshots of the brush and the
+   *  dynamics, see gimp_paint_tool_paint_start()
+   */
+  if (GIMP_IS_BRUSH_CORE (tool->core))
+    {
+      GimpBrushCore *brush_core = GIMP_BRUSH_CORE (tool->core);
+
+      if (! gimp_paint_tool_paint_can_snapshot (GIMP_DATA (brush_core->main_brush)))
+        return FALSE;
+
+      if (brush_core->dynamics &&
+          ! gimp_paint_tool_paint_can_snapshot (GIMP_DATA (brush_core->dynamics)))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gimp_paint_tool_paint_can_snapshot (GimpData *data)
+{
+  /*  data which can't be duplicated can't be edited either, unless it
+   *  is internal data, like the clipboard brush, which changes with
+   *  the clipboard
+   */
+  return (GIMP_DATA_GET_CLASS (data)->duplicate ||
+          ! gimp_data_is_internal (data));
+}
+
+static GimpData *
+gimp_paint_tool_paint_snapshot (GimpData *data)
+{
+  if (GIMP_DATA_GET_CLASS (data)->duplicate)
+    return gimp_data_duplicate (data);
+
+  return g_object_ref (data);
+}
+
+static gpointer
+gimp_paint_tool_paint_thread (GimpPaintTool *tool)
+{
+  PaintItem *item;
+
+  while ((item = g_async_queue_pop (tool->paint_queue)) != &paint_thread_stop)
+    {
+      if (! item->paint)
+        {
+          gimp_paint_core_set_current_coords (tool->core, &item->coords);
+        }
+      else if (! g_atomic_int_get (&tool->paint_cancel))
+        {
+          gimp_drawable_paint_lock (tool->paint_drawable);
+
+          gimp_paint_core_interpolate (tool->core,
+                                       tool->paint_drawable,
+                                       tool->paint_options,
+                                       &item->coords, item->time);
+
+          gimp_drawable_paint_unlock (tool->paint_drawable);
+        }
+
+      g_slice_free (PaintItem, item);
+    }
+
+  return NULL;
+}
+
+static gboolean
+gimp_paint_tool_paint_timeout (GimpPaintTool *tool)
+{
+  GimpImage *image = gimp_item_get_image (GIMP_ITEM (tool->paint_drawable));
+
+  /*  the painted areas are only invalidated here, and rendered right
+   *  away, so the projection reads them while the paint thread waits
+   */
+  gimp_drawable_paint_lock (tool->paint_drawable);
+
+  gimp_paint_core_flush_updates (tool->core, tool->paint_drawable);
+
+  gimp_projection_flush_now (gimp_image_get_projection (image));
+  gimp_display_flush_now (tool->paint_display);
+
+  gimp_drawable_paint_unlock (tool->paint_drawable);
+
+  return TRUE;
+}
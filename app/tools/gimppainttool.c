@@ -36,6 +36,7 @@
 
 #include "paint/gimppaintcore.h"
 #include "paint/gimppaintoptions.h"
+#include "paint/gimppaintrecord.h"
 
 #include "widgets/gimpdevices.h"
 #include "widgets/gimpwidgets-utils.h"
@@ -46,6 +47,7 @@
 
 #include "gimpcoloroptions.h"
 #include "gimppainttool.h"
+#include "gimppainttool-paint.h"
 #include "gimptoolcontrol.h"
 
 #include "gimp-intl.h"
@@ -219,7 +221,10 @@ gimp_paint_tool_control (GimpTool       *tool,
       break;
 
     case GIMP_TOOL_ACTION_HALT:
+      gimp_paint_tool_paint_end (paint_tool, TRUE);
       gimp_paint_core_cleanup (paint_tool->core);
+
+      g_clear_pointer (&paint_tool->record, gimp_paint_record_free);
       break;
     }
 
@@ -304,6 +309,17 @@ gimp_paint_tool_button_press (GimpTool            *tool,
       return;
     }
 
+  /*  record the stroke, for replaying it in the paint benchmark  */
+  if (g_getenv ("GIMP_PAINT_RECORD"))
+    {
+      g_clear_pointer (&paint_tool->record, gimp_paint_record_free);
+
+      paint_tool->record = gimp_paint_record_new ();
+
+      gimp_paint_record_begin_stroke (paint_tool->record);
+      gimp_paint_record_add_event (paint_tool->record, &curr_coords, time);
+    }
+
   if ((display != tool->display) || ! paint_tool->draw_line)
     {
       /* if this is a new display, resest the "last stroke's endpoint"
@@ -353,6 +369,9 @@ gimp_paint_tool_button_press (GimpTool            *tool,
   gimp_projection_flush_now (gimp_image_get_projection (image));
   gimp_display_flush_now (display);
 
+  /*  paint the rest of the stroke on the paint thread, if possible  */
+  gimp_paint_tool_paint_start (paint_tool, display, drawable);
+
   gimp_draw_tool_start (draw_tool, display);
 }
 
@@ -381,6 +400,10 @@ gimp_paint_tool_button_release (GimpTool              *tool,
 
   gimp_draw_tool_pause (GIMP_DRAW_TOOL (tool));
 
+  /*  wait for the paint thread to catch up  */
+  gimp_paint_tool_paint_end (paint_tool,
+                             release_type == GIMP_BUTTON_RELEASE_CANCEL);
+
   /*  Let the specific painting function finish up  */
   gimp_paint_core_paint (core, drawable, paint_options,
                          GIMP_PAINT_STATE_FINISH, time);
@@ -397,6 +420,22 @@ gimp_paint_tool_button_release (GimpTool              *tool,
   else
     gimp_paint_core_finish (core, drawable, TRUE);
 
+  if (paint_tool->record)
+    {
+      GError *error = NULL;
+
+      if (release_type != GIMP_BUTTON_RELEASE_CANCEL &&
+          ! gimp_paint_record_save (paint_tool->record,
+                                    g_getenv ("GIMP_PAINT_RECORD"), TRUE,
+                                    &error))
+        {
+          gimp_tool_message_literal (tool, display, error->message);
+          g_clear_error (&error);
+        }
+
+      g_clear_pointer (&paint_tool->record, gimp_paint_record_free);
+    }
+
   gimp_image_flush (image);
 
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
@@ -434,17 +473,34 @@ gimp_paint_tool_motion (GimpTool         *tool,
   /*  don't paint while the Shift key is pressed for line drawing  */
   if (paint_tool->draw_line)
     {
-      gimp_paint_core_set_current_coords (core, &curr_coords);
+      if (gimp_paint_tool_paint_is_active (paint_tool))
+        gimp_paint_tool_paint_set_current_coords (paint_tool, &curr_coords);
+      else
+        gimp_paint_core_set_current_coords (core, &curr_coords);
+
       return;
     }
 
+  if (paint_tool->record)
+    gimp_paint_record_add_event (paint_tool->record, &curr_coords, time);
+
   gimp_draw_tool_pause (GIMP_DRAW_TOOL (tool));
 
-  gimp_paint_core_interpolate (core, drawable, paint_options,
-                               &curr_coords, time);
+  if (gimp_paint_tool_paint_is_active (paint_tool))
+    {
+      /*  the paint thread paints it, and the display is updated
+       *  periodically while it does
+       */
+      gimp_paint_tool_paint_push (paint_tool, &curr_coords, time);
+    }
+  else
+    {
+      gimp_paint_core_interpolate (core, drawable, paint_options,
+                                   &curr_coords, time);
 
-  gimp_projection_flush_now (gimp_image_get_projection (image));
-  gimp_display_flush_now (display);
+      gimp_projection_flush_now (gimp_image_get_projection (image));
+      gimp_display_flush_now (display);
+    }
 
   gimp_draw_tool_resume (GIMP_DRAW_TOOL (tool));
 }
@@ -622,8 +678,11 @@ gimp_paint_tool_oper_update (GimpTool         *tool,
           gimp_paint_core_round_line (core, paint_options,
                                       (state & constrain_mask) != 0);
 
-          dx = core->cur_coords.x - core->last_coords.x;
-          dy = core->cur_coords.y - core->last_coords.y;
+          paint_tool->line_start = core->last_coords;
+          paint_tool->line_end   = core->cur_coords;
+
+          dx = paint_tool->line_end.x - paint_tool->line_start.x;
+          dy = paint_tool->line_end.y - paint_tool->line_start.y;
 
           status_help = gimp_suggest_modifiers (paint_tool->status_line,
                                                 constrain_mask & ~state,
@@ -716,7 +775,6 @@ gimp_paint_tool_draw (GimpDrawTool *draw_tool)
       if (paint_tool->draw_line &&
           ! gimp_tool_control_is_active (GIMP_TOOL (draw_tool)->control))
         {
-          GimpPaintCore *core       = paint_tool->core;
           GimpImage     *image      = gimp_display_get_image (draw_tool->display);
           GimpDrawable  *drawable   = gimp_image_get_active_drawable (image);
           gint           off_x, off_y;
@@ -725,16 +783,16 @@ gimp_paint_tool_draw (GimpDrawTool *draw_tool)
 
           /*  Draw the line between the start and end coords  */
           gimp_draw_tool_add_line (draw_tool,
-                                   core->last_coords.x + off_x,
-                                   core->last_coords.y + off_y,
-                                   core->cur_coords.x + off_x,
-                                   core->cur_coords.y + off_y);
+                                   paint_tool->line_start.x + off_x,
+                                   paint_tool->line_start.y + off_y,
+                                   paint_tool->line_end.x + off_x,
+                                   paint_tool->line_end.y + off_y);
 
           /*  Draw start target  */
           gimp_draw_tool_add_handle (draw_tool,
                                      GIMP_HANDLE_CROSS,
-                                     core->last_coords.x + off_x,
-                                     core->last_coords.y + off_y,
+                                     paint_tool->line_start.x + off_x,
+                                     paint_tool->line_start.y + off_y,
                                      GIMP_TOOL_HANDLE_SIZE_CROSS,
                                      GIMP_TOOL_HANDLE_SIZE_CROSS,
                                      GIMP_HANDLE_ANCHOR_CENTER);
@@ -742,8 +800,8 @@ gimp_paint_tool_draw (GimpDrawTool *draw_tool)
           /*  Draw end target  */
           gimp_draw_tool_add_handle (draw_tool,
                                      GIMP_HANDLE_CROSS,
-                                     core->cur_coords.x + off_x,
-                                     core->cur_coords.y + off_y,
+                                     paint_tool->line_end.x + off_x,
+                                     paint_tool->line_end.y + off_y,
                                      GIMP_TOOL_HANDLE_SIZE_CROSS,
                                      GIMP_TOOL_HANDLE_SIZE_CROSS,
                                      GIMP_HANDLE_ANCHOR_CENTER);
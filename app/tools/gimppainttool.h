@@ -40,12 +40,28 @@ struct _GimpPaintTool
 
   gboolean       pick_colors;  /*  pick color if ctrl is pressed   */
   gboolean       draw_line;
+  GimpCoords     line_start;   /*  the line to draw, copied from   */
+  GimpCoords     line_end;     /*  the core in oper_update()       */
 
   const gchar   *status;       /* status message */
   const gchar   *status_line;  /* status message when drawing a line */
   const gchar   *status_ctrl;  /* additional message for the ctrl modifier */
 
   GimpPaintCore *core;
+
+  /*  while paint_thread runs, it owns the core's stroke state, see
+   *  gimp_paint_tool_paint_start()
+   */
+  GThread       *paint_thread;     /*  paints the current stroke      */
+  GAsyncQueue   *paint_queue;      /*  motion events to paint         */
+  gint           paint_cancel;     /*  skip the queued motion events  */
+  guint          paint_timeout_id; /*  updates the display            */
+  GimpDisplay   *paint_display;
+  GimpDrawable  *paint_drawable;
+
+  GimpPaintOptions *paint_options; /*  the options the thread uses    */
+
+  GimpPaintRecord *record;         /*  the stroke, if it is recorded  */
 };
 
 struct _GimpPaintToolClass
@@ -382,7 +382,7 @@ gimp_blob_editor_draw_blob (GimpBlobEditor *editor,
 
   cairo_close_path (cr);
 
-  g_free (blob);
+  gimp_blob_free (blob);
 
   gdk_cairo_set_source_color (cr, &style->fg[gtk_widget_get_state (widget)]);
   cairo_fill (cr);
@@ -108,6 +108,7 @@ gimp_histogram_editor_init (GimpHistogramEditor *editor)
   editor->bg_histogram = NULL;
   editor->valid        = FALSE;
   editor->idle_id      = 0;
+  editor->exact        = FALSE;
   editor->box          = gimp_histogram_box_new ();
 
   gimp_editor_set_show_name (GIMP_EDITOR (editor), TRUE);
@@ -373,9 +374,29 @@ gimp_histogram_editor_validate (GimpHistogramEditor *editor)
   if (! editor->valid && editor->histogram)
     {
       if (editor->drawable)
-        gimp_drawable_calculate_histogram (editor->drawable, editor->histogram);
+        {
+          /*  while painting, a sampled histogram is good enough for
+           *  drawing the curve, otherwise compute the exact numbers
+           *  the info labels show
+           */
+          if (gimp_viewable_preview_is_frozen (GIMP_VIEWABLE (editor->drawable)))
+            {
+              editor->exact =
+                gimp_drawable_calculate_histogram_approximate (editor->drawable,
+                                                               editor->histogram);
+            }
+          else
+            {
+              gimp_drawable_calculate_histogram (editor->drawable,
+                                                 editor->histogram);
+              editor->exact = TRUE;
+            }
+        }
       else
-        gimp_histogram_clear_values (editor->histogram);
+        {
+          gimp_histogram_clear_values (editor->histogram);
+          editor->exact = TRUE;
+        }
 
       gimp_histogram_editor_info_update (editor);
 
@@ -408,12 +429,19 @@ gimp_histogram_editor_frozen_update (GimpHistogramEditor *editor,
           gimp_histogram_view_set_background (view, editor->bg_histogram);
         }
     }
-  else if (editor->bg_histogram)
+  else
     {
-      g_object_unref (editor->bg_histogram);
-      editor->bg_histogram = NULL;
+      if (editor->bg_histogram)
+        {
+          g_object_unref (editor->bg_histogram);
+          editor->bg_histogram = NULL;
+
+          gimp_histogram_view_set_background (view, NULL);
+        }
 
-      gimp_histogram_view_set_background (view, NULL);
+      /*  replace the sampled histogram from painting  */
+      if (! editor->exact)
+        gimp_histogram_editor_update (editor);
     }
 }
 
@@ -514,7 +542,8 @@ gimp_histogram_editor_info_update (GimpHistogramEditor *editor)
   GimpHistogramView *view = GIMP_HISTOGRAM_BOX (editor->box)->view;
   GimpHistogram     *hist = editor->histogram;
 
-  if (hist)
+  /*  don't show numbers computed from a sampled histogram  */
+  if (hist && editor->exact)
     {
       gint    n_bins;
       gdouble pixels;
@@ -42,6 +42,7 @@ struct _GimpHistogramEditor
 
   guint                 idle_id;
   gboolean              valid;
+  gboolean              exact;
 
   GtkWidget            *menu;
   GtkWidget            *box;
@@ -1118,6 +1118,8 @@ xcf_load_channel_props (XcfInfo      *info,
             *channel = mask;
             (*channel)->boundary_known = FALSE;
             (*channel)->bounds_known   = FALSE;
+
+            gimp_drawable_invalidate_boundary (GIMP_DRAWABLE (*channel));
           }
           break;
 
@@ -174,8 +174,12 @@ do_zcrop (GimpDrawable *drawable,
 {
   GimpPixelRgn  srcPR, destPR;
   gint          width, height, x, y;
+  gint          tile_width, tile_height;
+  gint          tx, ty;
   gint          bytes;
   guchar       *buffer;
+  guchar       *rowref;
+  guchar       *colref;
   gint8        *killrows;
   gint8        *killcols;
   gint32        livingrows, livingcols, destrow, destcol;
@@ -186,7 +190,10 @@ do_zcrop (GimpDrawable *drawable,
   height = drawable->height;
   bytes  = drawable->bpp;
 
-  total_area = width * height * 4;
+  tile_width  = gimp_tile_width ();
+  tile_height = gimp_tile_height ();
+
+  total_area = width * height * 3;
   area = 0;
 
   killrows = g_new (gint8, height);
@@ -194,57 +201,88 @@ do_zcrop (GimpDrawable *drawable,
 
   buffer = g_malloc ((width > height ? width : height) * bytes);
 
+  /*  the first pixel of each row and column is its reference color  */
+  rowref = g_malloc (height * bytes);
+  colref = g_malloc (width * bytes);
+
   /*  initialize the pixel regions  */
   gimp_pixel_rgn_init (&srcPR, drawable, 0, 0, width, height, FALSE, FALSE);
   gimp_pixel_rgn_init (&destPR, drawable, 0, 0, width, height, TRUE, TRUE);
 
   has_alpha = gimp_drawable_has_alpha (drawable->drawable_id);
 
-  livingrows = 0;
+  gimp_pixel_rgn_get_col (&srcPR, rowref, 0, 0, height);
+  gimp_pixel_rgn_get_row (&srcPR, colref, 0, 0, width);
+
   for (y = 0; y < height; y++)
-    {
-      gimp_pixel_rgn_get_row (&srcPR, buffer, 0, y, width);
+    killrows[y] = TRUE;
+
+  for (x = 0; x < width; x++)
+    killcols[x] = TRUE;
 
-      killrows[y] = TRUE;
+  /*  Find the uniform rows and columns in a single pass over the
+   *  tiles.  A tile whose rows and columns are all known to be living
+   *  already can't tell anything new, so it isn't even fetched.
+   */
+  for (ty = 0; ty < height; ty += tile_height)
+    {
+      gint tile_rows = MIN (tile_height, height - ty);
 
-      for (x = 0; x < width * bytes; x += bytes)
+      for (tx = 0; tx < width; tx += tile_width)
         {
-          if (! colors_equal (buffer, &buffer[x], bytes, has_alpha))
-            {
-              livingrows++;
-              killrows[y] = FALSE;
-              break;
-            }
-        }
+          gint      tile_cols = MIN (tile_width, width - tx);
+          gboolean  needed    = FALSE;
+          GimpTile *tile;
 
-      area += width;
-      if (y % 20 == 0)
-        gimp_progress_update ((double) area / (double) total_area);
-    }
+          for (y = ty; y < ty + tile_rows && ! needed; y++)
+            needed = killrows[y];
 
+          for (x = tx; x < tx + tile_cols && ! needed; x++)
+            needed = killcols[x];
 
-  livingcols = 0;
-  for (x = 0; x < width; x++)
-    {
-      gimp_pixel_rgn_get_col (&srcPR, buffer, x, 0, height);
+          if (! needed)
+            continue;
 
-      killcols[x] = TRUE;
+          tile = gimp_drawable_get_tile2 (drawable, FALSE, tx, ty);
+          gimp_tile_ref (tile);
 
-      for (y = 0; y < height * bytes; y += bytes)
-        {
-          if (! colors_equal (buffer, &buffer[y], bytes, has_alpha))
+          for (y = 0; y < tile->eheight; y++)
             {
-              livingcols++;
-              killcols[x] = FALSE;
-              break;
+              const guchar *src  = tile->data + y * tile->ewidth * bytes;
+              gint8        *kill = &killrows[ty + y];
+              const guchar *ref  = rowref + (ty + y) * bytes;
+
+              for (x = 0; x < tile->ewidth; x++, src += bytes)
+                {
+                  if (*kill && ! colors_equal (ref, src, bytes, has_alpha))
+                    *kill = FALSE;
+
+                  if (killcols[tx + x] &&
+                      ! colors_equal (colref + (tx + x) * bytes, src,
+                                      bytes, has_alpha))
+                    killcols[tx + x] = FALSE;
+                }
             }
+
+          gimp_tile_unref (tile, FALSE);
         }
 
-      area += height;
-      if (x % 20 == 0)
-        gimp_progress_update ((double) area / (double) total_area);
+      area += width * tile_rows;
+      gimp_progress_update ((double) area / (double) total_area);
     }
 
+  g_free (rowref);
+  g_free (colref);
+
+  livingrows = 0;
+  for (y = 0; y < height; y++)
+    if (! killrows[y])
+      livingrows++;
+
+  livingcols = 0;
+  for (x = 0; x < width; x++)
+    if (! killcols[x])
+      livingcols++;
 
   if ((livingcols == 0 || livingrows==0) ||
       (livingcols == width && livingrows == height))